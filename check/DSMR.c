@@ -0,0 +1,201 @@
+#define _GNU_SOURCE /* posix_openpt */
+/**************************************************************
+This file checks the DSMR driver with telegrams written to a
+pseudo-terminal: the CRC check, telegrams without CRC and opening the
+port again after it has gone away like an unplugged USB adapter. The
+device is given as a symlink to the pseudo-terminal, like the
+/dev/serial/by-id links of real adapters, and pointed at a new one to
+plug the adapter in again.
+
+SPDX-License-Identifier: BSD-2-Clause
+
+Copyright (c) 2026, Henrik Carlqvist
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **************************************************************/
+#include "../plugin_src/DSMR.c"
+#include <errno.h>
+#include <sys/wait.h>
+#include "check.h"
+
+#define WAIT_MS 10000 /* longest wait for the reader thread */
+
+/* Opens a new pseudo-terminal and points link at its slave side */
+static int open_pty(const char *link)
+{
+   int m = posix_openpt(O_RDWR | O_NOCTTY);
+
+   if((m < 0) || grantpt(m) || unlockpt(m))
+      return -1;
+   unlink(link);
+   if(symlink(ptsname(m), link))
+   {
+      close(m);
+      return -1;
+   }
+   return m;
+} /* open_pty */
+
+/* Writes a telegram with power kw, with a correct CRC, a wrong one or
+   none at all */
+enum crc_kind { CRC_RIGHT, CRC_WRONG, CRC_NONE };
+static void write_telegram(int m, double kw, enum crc_kind kind)
+{
+   char buf[256];
+   unsigned short crc = 0;
+   int len, i;
+
+   len = snprintf(buf, sizeof(buf),
+		  "/ISK5\\2M550T-1012\r\n\r\n1-0:1.7.0(%06.3f*kW)\r\n!", kw);
+   for(i=0; i<len; i++)
+      crc = crc16_update(crc, buf[i]);
+   if(kind == CRC_WRONG)
+      crc ^= 0x1234;
+   if(kind == CRC_NONE)
+      len += snprintf(buf+len, sizeof(buf)-len, "\r\n");
+   else
+      len += snprintf(buf+len, sizeof(buf)-len, "%04X\r\n", crc);
+   if(write(m, buf, len) != len)
+      fprintf(stderr, "DSMR: writing telegram: %s\n", strerror(errno));
+} /* write_telegram */
+
+/* Waits at most timeout ms until the reader has seen telegrams good and
+   errors bad ones, returns non zero on timeout */
+static int wait_for(struct instance *inst, unsigned long good,
+		    unsigned long errors, int timeout)
+{
+   int ms, done;
+
+   for(ms=0; ms<timeout; ms+=10)
+   {
+      pthread_mutex_lock(&(inst->mutex));
+      done = (inst->telegrams >= good) && (inst->crc_errors >= errors);
+      pthread_mutex_unlock(&(inst->mutex));
+      if(done)
+	 return 0;
+      usleep(10000);
+   }
+   return -1;
+} /* wait_for */
+
+/* Returns the latest power presented, in W */
+static long latest_power(struct instance *inst,
+			 struct MeterTable_entry *entry)
+{
+   update_driver_data(inst, entry);
+   return entry->ObisEntries[0].latest_value;
+} /* latest_power */
+
+/* Checks the CRC of DSMR 4 and that a lost port is opened again, in
+   the process going on after the fork */
+static void check_crc(struct instance *inst, struct MeterTable_entry *entry,
+		      int m, const char *link)
+{
+   int ms;
+
+   update_driver_data(inst, entry);
+   CHECK(inst->started);
+   write_telegram(m, 1.234, CRC_RIGHT);
+   CHECK(!wait_for(inst, 1, 0, WAIT_MS));
+   CHECK(latest_power(inst, entry) == 1234);
+   write_telegram(m, 2.345, CRC_WRONG);
+   CHECK(!wait_for(inst, 1, 1, WAIT_MS));
+   write_telegram(m, 3.456, CRC_NONE);
+   CHECK(!wait_for(inst, 1, 2, WAIT_MS));
+   CHECK(latest_power(inst, entry) == 1234);
+   CHECK(inst->telegrams == 1);
+
+   /* unplugged, and plugged in again as another pseudo-terminal */
+   close(m);
+   usleep(100000);
+   m = open_pty(link);
+   CHECK(m >= 0);
+   /* telegrams written before the port is open again may be lost */
+   for(ms=0; (ms<WAIT_MS) && (m >= 0) && wait_for(inst, 2, 0, 500); ms+=500)
+      write_telegram(m, 4.567, CRC_RIGHT);
+   CHECK(latest_power(inst, entry) == 4567);
+   remove_driver(inst, entry);
+   close(m);
+} /* check_crc */
+
+int main(void)
+{
+   struct MeterTable_entry entry, old;
+   struct instance *inst;
+   char dir[] = "/tmp/dsmr_checkXXXXXX";
+   char link[64], parameters[128];
+   int m, status;
+   pid_t pid;
+
+   if((!mkdtemp(dir)) ||
+      (snprintf(link, sizeof(link), "%s/ttyUSB", dir) >= sizeof(link)))
+      return 1;
+   m = open_pty(link);
+   if(m < 0)
+   {
+      fprintf(stderr, "DSMR: no pseudo-terminal: %s\n", strerror(errno));
+      return 1;
+   }
+
+   /* DSMR 4 and later, every telegram must have a right CRC */
+   memset(&entry, 0, sizeof(entry));
+   snprintf(parameters, sizeof(parameters), "device=%s", link);
+   inst = init_driver(&entry, parameters);
+   CHECK(inst != NULL);
+   if(!inst)
+      return check_done("DSMR");
+   /* no thread until the agent has gone to the background */
+   CHECK(!inst->started);
+   fflush(stderr);
+   pid = fork();
+   if(!pid)
+   {
+      check_crc(inst, &entry, m, link);
+      exit(check_done("DSMR after fork"));
+   }
+   close(m);
+   CHECK(pid > 0);
+   CHECK((waitpid(pid, &status, 0) == pid) && WIFEXITED(status) &&
+	 !WEXITSTATUS(status));
+   remove_driver(inst, &entry);
+
+   /* DSMR 2.2 sends no CRC */
+   m = open_pty(link);
+   memset(&old, 0, sizeof(old));
+   snprintf(parameters, sizeof(parameters), "device=%s,version=2", link);
+   inst = init_driver(&old, parameters);
+   CHECK(inst != NULL);
+   if(inst)
+   {
+      update_driver_data(inst, &old);
+      write_telegram(m, 0.5, CRC_NONE);
+      CHECK(!wait_for(inst, 1, 0, WAIT_MS));
+      write_telegram(m, 0.6, CRC_WRONG);
+      CHECK(!wait_for(inst, 1, 1, WAIT_MS));
+      CHECK(latest_power(inst, &old) == 500);
+      remove_driver(inst, &old);
+   }
+   close(m);
+   unlink(link);
+   rmdir(dir);
+   return check_done("DSMR");
+} /* main */
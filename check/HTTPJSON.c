@@ -0,0 +1,117 @@
+/**************************************************************
+This file checks that the HTTPJSON driver handles a poll without any
+heap allocation once the first replies have been handled, as replies
+are scanned in a buffer kept in the instance without building any JSON
+objects. Made up replies, like microbench/payloads/HTTPJSON.json with
+an energy growing between them, are replayed from a capture file
+through update_driver_data.
+
+SPDX-License-Identifier: BSD-2-Clause
+
+Copyright (c) 2026, Henrik Carlqvist
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **************************************************************/
+
+#include "../plugin_src/HTTPJSON.c"
+#include <unistd.h>
+#include "check.h"
+#include "../microbench/allocs.h"
+
+#define POLLS 200
+#define WARMUP 10 /* polls allowed to grow buffers */
+
+/* fields of the replies */
+#define FIELDS "\"type\": \"info.meter\", \"mac\": \"info.mac\", " \
+   "\"rssi\": \"info.rssi\", \"fields\": [" \
+   "{\"path\": \"d.1_7_0.v\", \"obis\": \"1-0:1.7.0\"}, " \
+   "{\"path\": \"d.1_8_0.v\", \"obis\": \"1-0:1.8.0\"}, " \
+   "{\"path\": \"d.32_7_0.v\", \"obis\": \"1-0:32.7.0\"}, " \
+   "{\"path\": \"d.phases.1.i\", \"obis\": \"1-0:51.7.0\"}]"
+
+/* the energy in Wh of reply n */
+static long energy(int n)
+{
+   return 6678394 + 13*n;
+} /* energy */
+
+static int reply(char *buf, size_t size, int n)
+{
+   return snprintf(buf, size, "{\"info\":{\"meter\":\"Generic bridge\","
+		   "\"mac\":\"24:0A:C4:AB:CD:EF\",\"rssi\":-58},\"d\":{"
+		   "\"1_7_0\":{\"v\":%d.254,\"u\":\"kW\"},"
+		   "\"1_8_0\":{\"v\":%ld.%03ld,\"u\":\"kWh\"},"
+		   "\"32_7_0\":{\"v\":\"230.1\",\"u\":\"V\"},"
+		   "\"phases\":[{\"i\":1.21},{\"i\":0.%02d},{\"i\":2.07}],"
+		   "\"relay\":true}}", n%3, energy(n)/1000, energy(n)%1000,
+		   10 + n%90);
+} /* reply */
+
+int main(void)
+{
+   static char buf[4096];
+   struct MeterTable_entry entry;
+   struct instance *inst;
+   struct capture *c;
+   char path[] = "/tmp/httpjson_checkXXXXXX";
+   char parameters[1024];
+   unsigned long allocs = 0, before;
+   int fd, len, n;
+
+   /* the first reply is replayed by init_driver */
+   fd = mkstemp(path);
+   if(fd < 0)
+      return 1;
+   close(fd);
+   c = capture_open_record(path);
+   if(!c)
+      return 1;
+   for(n=0; n<POLLS; n++)
+   {
+      len = reply(buf, sizeof(buf), n);
+      capture_write(c, buf, len);
+      capture_end(c);
+   }
+   capture_close(c);
+   memset(&entry, 0, sizeof(entry));
+   snprintf(parameters, sizeof(parameters),
+	    "{\"url\": \"http://check\", \"replay\": \"%s\", "
+	    "\"replayspeed\": \"max\", %s}", path, FIELDS);
+   inst = init_driver(&entry, parameters);
+   unlink(path);
+   CHECK(inst != NULL);
+   if(!inst)
+      return check_done("HTTPJSON");
+   CHECK(!strcmp(entry.ObisEntries[1].obis_string, "1-0:1.8.0"));
+   for(n=1; n<POLLS; n++)
+   {
+      before = mb_allocs_made();
+      update_driver_data(inst, &entry);
+      if(n > WARMUP)
+	 allocs += mb_allocs_made() - before;
+      /* kWh multiplied by 1000 and truncated, allow for rounding */
+      CHECK(labs(entry.ObisEntries[1].latest_value - energy(n)) <= 1);
+   }
+   CHECK(allocs == 0);
+   remove_driver(inst, &entry);
+   return check_done("HTTPJSON");
+} /* main */
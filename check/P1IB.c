@@ -0,0 +1,196 @@
+/**************************************************************
+This file checks the 6 minute filter of the P1IB driver. Made up
+replies, each with the latest 10 samples of a row as the P1IB sends them,
+are passed through the unmodified driver while the sample counter moves
+on at different paces, jumps ahead and starts over. Once a full 6
+minutes has been collected since the counter last jumped, mean, max and
+min must be those of the 36 samples of the last 6 whole minutes. Once
+the first replies have been handled, a reply must be handled without
+any heap allocation.
+
+SPDX-License-Identifier: BSD-2-Clause
+
+Copyright (c) 2026, Henrik Carlqvist
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **************************************************************/
+
+#include "../plugin_src/P1IB.c"
+#include <unistd.h>
+#include "check.h"
+#include "../microbench/allocs.h"
+
+/* sample number s of power, in kW */
+static double power(long s)
+{
+   return 0.5 + ((s * 37) % 101) / 10.0;
+} /* power */
+
+/* Writes the reply of the P1IB when its sample counter is count */
+static int reply(char *buf, size_t size, long count)
+{
+   int len, k;
+
+   len = snprintf(buf, size, "{\"info\":{\"meter\":\"CHECK\",\"resetCnt\":%ld},"
+		  "\"d\":{\"1-0:1.7.0\":[", count);
+   for(k=0; k<10; k++)
+      len += snprintf(buf+len, size-len, "%s%.3f", k ? "," : "",
+		      power(count - 9 + k));
+   len += snprintf(buf+len, size-len, "],\"1-0:1.8.0\":[");
+   for(k=0; k<10; k++)
+      len += snprintf(buf+len, size-len, "%s%ld.5", k ? "," : "",
+		      count - 9 + k);
+   len += snprintf(buf+len, size-len, "]}}");
+   return len;
+} /* reply */
+
+static int find_row(const struct MeterTable_entry *entry, const char *obis)
+{
+   unsigned int r;
+
+   for(r=0; r<entry->numObisEntries; r++)
+      if(!strcmp(entry->ObisEntries[r].obis_string, obis))
+	 return r;
+   return -1;
+} /* find_row */
+
+/* Values are multiplied by 1000 and truncated, allow for rounding */
+static int close_to(long value, double expected)
+{
+   long e = 1000*expected;
+
+   return (value >= e-1) && (value <= e+1);
+} /* close_to */
+
+/* the 6 minutes ending with sample last */
+static void check_filter(const struct obis_data *o, long last)
+{
+   double sum = 0, max = power(last), min = power(last);
+   long s;
+
+   for(s=last-35; s<=last; s++)
+   {
+      sum += power(s);
+      if(power(s) > max)
+	 max = power(s);
+      if(power(s) < min)
+	 min = power(s);
+   }
+   CHECK(close_to(o->mean6m_value, sum/36));
+   CHECK(close_to(o->max6m_value, max));
+   CHECK(close_to(o->min6m_value, min));
+} /* check_filter */
+
+int main(void)
+{
+   static const long steps[] = {1, 2, 3, 4, 5, 6, 25, 3, -400, 1, 4, 30, 2};
+   static char buf[4096];
+   struct MeterTable_entry entry;
+   struct instance *inst;
+   struct capture *c;
+   char path[] = "/tmp/p1ib_checkXXXXXX";
+   char parameters[64];
+   long count = 500, last, minutes, latest;
+   unsigned long allocs = 0, before;
+   int fd, power_row, energy_row, len, checked = 0;
+   unsigned int i, n;
+
+   /* the first reply is replayed by init_driver to find the rows */
+   fd = mkstemp(path);
+   if(fd < 0)
+      return 1;
+   close(fd);
+   c = capture_open_record(path);
+   if(!c)
+      return 1;
+   len = reply(buf, sizeof(buf), count);
+   capture_write(c, buf, len);
+   capture_end(c);
+   capture_close(c);
+   memset(&entry, 0, sizeof(entry));
+   snprintf(parameters, sizeof(parameters), "replay=%s,replayspeed=max", path);
+   inst = init_driver(&entry, parameters);
+   unlink(path);
+   CHECK(inst != NULL);
+   if(!inst)
+      return check_done("P1IB");
+   power_row = find_row(&entry, "1-0:1.7.0");
+   energy_row = find_row(&entry, "1-0:1.8.0");
+   CHECK((power_row >= 0) && (energy_row >= 0));
+   if((power_row < 0) || (energy_row < 0))
+      return check_done("P1IB");
+   CHECK(entry.ObisEntries[power_row].mean6m_is_valid);
+   CHECK(!entry.ObisEntries[energy_row].mean6m_is_valid);
+
+   /* the whole minutes taken so far end with sample last, the first
+      reply gives one and fills the rest of the filter with single samples */
+   last = count;
+   minutes = 0;
+   latest = count;
+   for(i=0; i<sizeof(steps)/sizeof(steps[0]); i++)
+      for(n=0; n<60; n++)
+      {
+	 /* a negative step starts the counter over, then it counts on */
+	 count += ((steps[i] < 0) && n) ? 3 : steps[i];
+	 len = reply(buf, sizeof(buf), count);
+	 inst->reply_len = 0;
+	 before = mb_allocs_made();
+	 my_curl_callback(buf, 1, len, inst);
+	 /* the buffers of the instance are grown by the first replies */
+	 if(i)
+	    allocs += mb_allocs_made() - before;
+	 /* the minutes are taken up again from the sample counter after it
+	    has started over or jumped ahead of the 10 samples of a reply */
+	 if(count < last)
+	 {
+	    last = count - 3;
+	    minutes = 0;
+	 }
+	 else if(count - last > 10)
+	 {
+	    last = count - 10;
+	    minutes = 0;
+	 }
+	 /* the rows are updated once a whole minute has been taken */
+	 if(count - last >= 6)
+	 {
+	    last += 6;
+	    minutes++;
+	    latest = count;
+	 }
+	 CHECK(close_to(entry.ObisEntries[power_row].latest_value,
+			power(latest)));
+	 CHECK(entry.ObisEntries[energy_row].latest_value ==
+	       1000*latest + 500);
+	 if(minutes >= 6)
+	 {
+	    check_filter(&entry.ObisEntries[power_row], last);
+	    checked++;
+	 }
+      }
+   /* a pace slower than the filter must not stop it */
+   CHECK(checked > 500);
+   /* not even when the counter starts over or jumps ahead */
+   CHECK(allocs == 0);
+   remove_driver(inst, &entry);
+   return check_done("P1IB");
+} /* main */
@@ -0,0 +1,125 @@
+/**************************************************************
+This file checks that init_driver of TEMPerX232 gives every value of a
+reply a row of its own, also for probe names too long for the rows and
+for probes of the same name, and that update_driver_data then finds the
+rows of the values again. The replies are replayed from a capture file.
+
+SPDX-License-Identifier: BSD-2-Clause
+
+Copyright (c) 2026, Henrik Carlqvist
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **************************************************************/
+#include "../plugin_src/TEMPerX232.c"
+#include "check.h"
+
+/* names cut to the same row name, and two probes of the same name */
+#define LONG_NAME "Probe-with-a-name-far-too-long-for-the-obis-string-"
+static const char *names[] = {
+   "Inner", LONG_NAME "first", LONG_NAME "second", "Same", "Same"
+};
+#define NUM_NAMES (sizeof(names)/sizeof(names[0]))
+
+/* Writes a ReadTemp reply, the probes have temperatures base+2*n and
+   humidities base+2*n+1 */
+static int reply(char *buf, size_t size, int base)
+{
+   unsigned int n;
+   int len = 0;
+
+   for(n=0; n<NUM_NAMES; n++)
+      len += snprintf(buf+len, size-len, "%sTemp-%s:%d.00 [C],%d.00 [%%RH]",
+		      n ? ";" : "", names[n], base+2*n, base+2*n+1);
+   len += snprintf(buf+len, size-len, "\r\n");
+   return len;
+} /* reply */
+
+/* Records a reply in chunks like those read from the device */
+static void record(struct capture *c, const char *buf, int len)
+{
+   int k;
+
+   for(k=0; k<len; k+=SERIAL_CHUNK)
+      capture_write(c, buf+k, (len-k < SERIAL_CHUNK) ? len-k : SERIAL_CHUNK);
+   capture_end(c);
+} /* record */
+
+/* Checks that each of the values of a reply is in a row of its own */
+static void check_rows(const struct MeterTable_entry *entry, int base)
+{
+   int seen[2*NUM_NAMES];
+   unsigned int r;
+   long v;
+
+   memset(seen, 0, sizeof(seen));
+   CHECK(entry->numObisEntries == 2*NUM_NAMES);
+   for(r=0; r<entry->numObisEntries; r++)
+   {
+      v = entry->ObisEntries[r].latest_value/entry->MeterMultiplier - base;
+      CHECK((v >= 0) && (v < 2*NUM_NAMES));
+      if((v < 0) || (v >= 2*NUM_NAMES))
+	 continue;
+      seen[v]++;
+      CHECK(entry->ObisEntries[r].unit &&
+	    !strcmp(entry->ObisEntries[r].unit, (v % 2) ? "%RH" : "C"));
+   }
+   for(r=0; r<2*NUM_NAMES; r++)
+      CHECK(seen[r] == 1);
+} /* check_rows */
+
+int main(void)
+{
+   static char buf[REPLY_SIZE];
+   struct MeterTable_entry entry;
+   struct instance *inst;
+   struct capture *c;
+   char path[] = "/tmp/temperx232_checkXXXXXX";
+   char parameters[64];
+   int fd, len;
+
+   /* Version and the first ReadTemp are replayed by init_driver */
+   fd = mkstemp(path);
+   if(fd < 0)
+      return 1;
+   close(fd);
+   c = capture_open_record(path);
+   if(!c)
+      return 1;
+   record(c, "TEMPerX232 CHECK\r\n", 18);
+   len = reply(buf, sizeof(buf), 10);
+   record(c, buf, len);
+   len = reply(buf, sizeof(buf), 20);
+   record(c, buf, len);
+   capture_close(c);
+   memset(&entry, 0, sizeof(entry));
+   snprintf(parameters, sizeof(parameters), "replay=%s,replayspeed=max", path);
+   inst = init_driver(&entry, parameters);
+   unlink(path);
+   CHECK(inst != NULL);
+   if(!inst)
+      return check_done("TEMPerX232");
+   check_rows(&entry, 10);
+   update_driver_data(inst, &entry);
+   check_rows(&entry, 20);
+   remove_driver(inst, &entry);
+   return check_done("TEMPerX232");
+} /* main */
@@ -0,0 +1,109 @@
+/**************************************************************
+This file checks that the WiMBIB driver handles a poll without any heap
+allocation once the first replies have been handled, as the reply and
+its index are kept in the instance between polls. Made up replies, like
+microbench/payloads/WiMBIB.json with a volume growing between them, are
+replayed from a capture file through update_driver_data.
+
+SPDX-License-Identifier: BSD-2-Clause
+
+Copyright (c) 2026, Henrik Carlqvist
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **************************************************************/
+
+#include "../plugin_src/WiMBIB.c"
+#include <unistd.h>
+#include "check.h"
+#include "../microbench/allocs.h"
+
+#define POLLS 200
+#define WARMUP 10 /* polls allowed to grow buffers */
+
+/* the volume in L of reply n */
+static long volume(int n)
+{
+   return 123456 + 7*n;
+} /* volume */
+
+/* Writes reply n, taken 6 samples after the one before */
+static int reply(char *buf, size_t size, int n)
+{
+   return snprintf(buf, size, "{\"info\":{\"meter_model\":\"Kamstrup flowIQ "
+		   "2200\",\"meter_id\":67012345,\"mac\":\"24:0A:C4:65:43:21\","
+		   "\"rssi\":-72,\"crc_ok_cnt\":%d},\"meter\":{"
+		   "\"total_volume\":%ld,\"target_volume\":120500,"
+		   "\"flow_temperature\":12.5,\"ambient_temperature\":20.25,"
+		   "\"time_weighted_meter_temp_day\":%d.3,"
+		   "\"min_water_temp_day\":9.8,\"leak-alarm\":false,"
+		   "\"burst-alarm\":%s,\"dry-alarm\":false,"
+		   "\"reverse-alarm\":false,\"min_flow\":0,\"max_flow\":1450}}",
+		   4711 + 6*n, volume(n), 10 + n%5, (n%7) ? "false" : "true");
+} /* reply */
+
+int main(void)
+{
+   static char buf[4096];
+   struct MeterTable_entry entry;
+   struct instance *inst;
+   struct capture *c;
+   char path[] = "/tmp/wimbib_checkXXXXXX";
+   char parameters[64];
+   unsigned long allocs = 0, before;
+   int fd, len, n;
+
+   /* the first reply is replayed by init_driver */
+   fd = mkstemp(path);
+   if(fd < 0)
+      return 1;
+   close(fd);
+   c = capture_open_record(path);
+   if(!c)
+      return 1;
+   for(n=0; n<POLLS; n++)
+   {
+      len = reply(buf, sizeof(buf), n);
+      capture_write(c, buf, len);
+      capture_end(c);
+   }
+   capture_close(c);
+   memset(&entry, 0, sizeof(entry));
+   snprintf(parameters, sizeof(parameters),
+	    "replay=%s,replayspeed=max,showextra=1", path);
+   inst = init_driver(&entry, parameters);
+   unlink(path);
+   CHECK(inst != NULL);
+   if(!inst)
+      return check_done("WiMBIB");
+   CHECK(!strcmp(entry.ObisEntries[0].obis_string, "total_volume"));
+   for(n=1; n<POLLS; n++)
+   {
+      before = mb_allocs_made();
+      update_driver_data(inst, &entry);
+      if(n > WARMUP)
+	 allocs += mb_allocs_made() - before;
+      CHECK(entry.ObisEntries[0].latest_value == 1000*volume(n));
+   }
+   CHECK(allocs == 0);
+   remove_driver(inst, &entry);
+   return check_done("WiMBIB");
+} /* main */
@@ -0,0 +1,99 @@
+/**************************************************************
+This file checks the realtime replay of captures. A capture is written
+with a transfer recorded before the first one, as when the clock was set
+back while recording, and one far into the future. The earlier
+transfers must be due at once and only the newest due one replayed.
+
+SPDX-License-Identifier: BSD-2-Clause
+
+Copyright (c) 2026, Henrik Carlqvist
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **************************************************************/
+
+#include <unistd.h>
+#include "../inc/capture.h"
+#include "check.h"
+
+#define FIRST_US 1700000000000000ULL
+
+static void write_transfer(FILE *f, uint64_t time_us, const char *data)
+{
+   struct capture_record r;
+
+   r.time_us = time_us;
+   r.length = strlen(data);
+   r.flags = 0;
+   fwrite(&r, sizeof(r), 1, f);
+   fwrite(data, 1, r.length, f);
+   r.length = 0;
+   r.flags = CAPTURE_END_OF_TRANSFER;
+   fwrite(&r, sizeof(r), 1, f);
+} /* write_transfer */
+
+int main(void)
+{
+   char path[] = "/tmp/capture_checkXXXXXX";
+   char buf[16];
+   struct capture *c;
+   FILE *f;
+   long len;
+   int fd;
+
+   fd = mkstemp(path);
+   if(fd < 0)
+      return 1;
+   f = fdopen(fd, "wb");
+   if(!f)
+      return 1;
+   fwrite(CAPTURE_MAGIC, 1, 8, f);
+   write_transfer(f, FIRST_US, "A");
+   write_transfer(f, FIRST_US - 5000000, "B");
+   write_transfer(f, FIRST_US - 1000000, "C");
+   write_transfer(f, FIRST_US + 100000000, "D");
+   fclose(f);
+
+   c = capture_open_replay(path, 1);
+   unlink(path);
+   CHECK(c != NULL);
+   if(!c)
+      return check_done("capture");
+   /* A, B and C are all due, C is the newest of them */
+   CHECK(capture_next_transfer(c));
+   len = capture_read(c, buf, sizeof(buf));
+   CHECK((len == 1) && (buf[0] == 'C'));
+   CHECK(capture_read(c, buf, sizeof(buf)) == 0);
+   /* D was recorded 100 s after A */
+   CHECK(!capture_next_transfer(c));
+   capture_close(c);
+
+   /* a value ends at the next parameter and is cut to fit */
+   CHECK(capture_parameter("device=x,replay=/a/b,baud=9600", "replay=",
+			   buf, sizeof(buf)) && !strcmp(buf, "/a/b"));
+   CHECK(capture_parameter("replay=/a/b", "replay=", buf, sizeof(buf)) &&
+	 !strcmp(buf, "/a/b"));
+   CHECK(capture_parameter("record=/0123456789abcdefghij,x=1", "record=",
+			   buf, sizeof(buf)) &&
+	 !strcmp(buf, "/0123456789abcd"));
+   CHECK(!capture_parameter("device=x", "replay=", buf, sizeof(buf)));
+   return check_done("capture");
+} /* main */
@@ -0,0 +1,209 @@
+/**************************************************************
+This file checks the accessors of inc/meterjson.h against json-c, which
+the drivers used before. The payloads of the microbenchmarks are replayed
+together with made up documents with escapes at every position around
+the 64 byte blocks, numbers with exponents, true, false and null in
+arrays and nesting to just below and above METERJSON_MAX_DEPTH. Every
+value found by json-c must be found and read the same way.
+
+SPDX-License-Identifier: BSD-2-Clause
+
+Copyright (c) 2026, Henrik Carlqvist
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **************************************************************/
+
+#include "../inc/meterjson.h"
+#include <json.h>
+#include "check.h"
+
+#define MAX_DOC 65536
+
+static const char *payloads[] = {
+   "microbench/payloads/P1IB.json",
+   "microbench/payloads/WiMBIB.json",
+   "microbench/payloads/HTTPJSON.json"
+};
+
+static const char *docs[] = {
+   "{\"a\\\"b\":\"x\\\\y\\\"z\",\"k\\\\\":\"\\n\\t\\/\\b\\f\\r\","
+   "\"end\":\"\\\\\\\\\"}",
+   "{\"n\":[1e3,-2.5E-3,1E+2,6.02e23,1e-7,0.1,-0,123456789012345678,"
+   "12345678901234567890,1.7976931348623157e308,4.9e-324,-12,0.5e1]}",
+   "{\"a\":[true,null,false,1,\"2\",\"x\",\"\",[],{}],\"t\":true,"
+   "\"f\":false,\"z\":null,\"s\":\"12.5\",\"i\":\"-7\"}",
+   "{ \"a\" : [ 1 , true , null ] ,\n\t\"b\" : { \"c\" : \"d\" } }",
+   "{\"d\":{\"1-0:1.7.0\":[],\"e\":{},\"f\":[[1,2],[3,[4,5]],{\"g\":6}]}}"
+};
+
+/* Compares value v of j with jo found by json-c */
+static void compare(const struct meterjson *j, long v, struct json_object *jo,
+		    const char *doc)
+{
+   char s[256];
+   size_t n;
+
+   CHECK(v >= 0);
+   if(v < 0)
+      return;
+   switch(json_object_get_type(jo))
+   {
+      case json_type_object:
+      {
+	 size_t member = 0, key_len;
+	 const char *key;
+	 long mv;
+
+	 CHECK(meterjson_is_object(j, v));
+	 json_object_object_foreach(jo, name, value)
+	 {
+	    mv = meterjson_next_member(j, v, &member, &key, &key_len);
+	    CHECK(mv >= 0);
+	    if(mv < 0)
+	       return;
+	    /* the key is the string value just before the colon */
+	    meterjson_string(j, mv - 3, s, sizeof(s));
+	    CHECK(!strcmp(s, name));
+	    compare(j, mv, value, doc);
+	 }
+	 CHECK(meterjson_next_member(j, v, &member, &key, &key_len) < 0);
+	 break;
+      }
+      case json_type_array:
+      {
+	 size_t len = json_object_array_length(jo), i, t = v + 1;
+	 double d[16];
+	 int num;
+
+	 CHECK(meterjson_is_array(j, v));
+	 num = meterjson_doubles(j, v, d, 16);
+	 CHECK((size_t)num == len);
+	 for(i=0; i<len; i++)
+	 {
+	    struct json_object *e = json_object_array_get_idx(jo, i);
+
+	    if(i < 16)
+	       CHECK(d[i] == json_object_get_double(e));
+	    compare(j, t, e, doc);
+	    t = meterjson_after(j, t) + 1;
+	 }
+	 break;
+      }
+      default:
+	 CHECK(!meterjson_is_object(j, v) && !meterjson_is_array(j, v));
+	 break;
+   }
+   CHECK(meterjson_double(j, v) == json_object_get_double(jo));
+   CHECK(meterjson_int64(j, v) == json_object_get_int64(jo));
+   CHECK(meterjson_boolean(j, v) == json_object_get_boolean(jo));
+   if(json_object_is_type(jo, json_type_string) &&
+      !strstr(json_object_get_string(jo), "\\u"))
+   {
+      /* \u escapes are kept as they are, other strings are unescaped */
+      n = meterjson_string(j, v, s, sizeof(s));
+      CHECK((n == strlen(s)) && !strcmp(s, json_object_get_string(jo)));
+   }
+   if(check_failures)
+   {
+      fprintf(stderr, "in %s\n", doc);
+      exit(check_done("meterjson"));
+   }
+} /* compare */
+
+/* Parses doc with both, returns 0 if meterjson accepted it */
+static int replay(struct meterjson *j, const char *doc)
+{
+   struct json_tokener *tok = json_tokener_new_ex(4*METERJSON_MAX_DEPTH);
+   struct json_object *jo;
+   size_t len = strlen(doc);
+   int ret;
+
+   jo = json_tokener_parse_ex(tok, doc, len + 1);
+   json_tokener_free(tok);
+   CHECK(jo != NULL);
+   ret = meterjson_parse(j, doc, len);
+   if(jo && !ret)
+      compare(j, 0, jo, doc);
+   json_object_put(jo);
+   return ret;
+} /* replay */
+
+/* doc nested depth deep with the innermost array holding 42 */
+static void nest(char *doc, int depth)
+{
+   int d, n = 0;
+
+   n += sprintf(doc + n, "{\"x\":");
+   for(d=1; d<depth; d++)
+      n += sprintf(doc + n, (d % 2) ? "[" : "{\"y\":");
+   n += sprintf(doc + n, "42");
+   for(d=depth-1; d>=1; d--)
+      n += sprintf(doc + n, (d % 2) ? "]" : "}");
+   sprintf(doc + n, "}");
+} /* nest */
+
+int main(void)
+{
+   static char doc[MAX_DOC];
+   struct meterjson j;
+   unsigned int i;
+   int pad, depth;
+   FILE *f;
+   size_t len;
+
+   memset(&j, 0, sizeof(j));
+   for(i=0; i<sizeof(payloads)/sizeof(payloads[0]); i++)
+   {
+      f = fopen(payloads[i], "rb");
+      CHECK(f != NULL);
+      if(!f)
+	 continue;
+      len = fread(doc, 1, sizeof(doc)-1, f);
+      fclose(f);
+      while(len && ((doc[len-1] == '\n') || (doc[len-1] == '\r')))
+	 len--;
+      doc[len] = 0;
+      CHECK(!replay(&j, doc));
+   }
+   for(i=0; i<sizeof(docs)/sizeof(docs[0]); i++)
+      CHECK(!replay(&j, docs[i]));
+   /* escaped quotes and backslashes at every position of a block and
+      across the end of it */
+   for(pad=0; pad<140; pad++)
+   {
+      snprintf(doc, sizeof(doc),
+	       "{\"p\":\"%.*s\",\"a\\\\\":\"\\\"\\\\\\\\\\\"q\\\\\","
+	       "\"b\":[\"\\\\\",1.5e2,\"]\\\"}\"],\"c\":true}",
+	       pad, "................................................"
+	       "................................................"
+	       "................................................");
+      CHECK(!replay(&j, doc));
+   }
+   /* as deep as meterjson goes, and deeper */
+   for(depth=METERJSON_MAX_DEPTH-4; depth<=METERJSON_MAX_DEPTH+4; depth++)
+   {
+      nest(doc, depth);
+      CHECK(!replay(&j, doc) == (depth <= METERJSON_MAX_DEPTH));
+   }
+   meterjson_free(&j);
+   return check_done("meterjson");
+} /* main */
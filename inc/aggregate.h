@@ -0,0 +1,100 @@
+/**************************************************************
+This file defines virtual meters aggregating rows of other meters.
+An aggregate meter has one row for each OBIS code it is configured
+with, giving the sum, mean or max of the rows with that code among
+its member meters.
+
+SPDX-License-Identifier: BSD-2-Clause
+
+Copyright (c) 2026, Henrik Carlqvist
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **************************************************************/
+
+#ifndef AGGREGATE_H
+#define AGGREGATE_H
+
+#include <time.h>
+#include <json.h>
+#include "driver.h"
+#include "filtered.h"
+
+enum aggregate_op
+{
+   AGGREGATE_SUM,
+   AGGREGATE_MEAN,
+   AGGREGATE_MAX
+};
+
+/* a row of a member meter */
+struct aggregate_source
+{
+   unsigned int row;              /* row of the aggregate it goes to */
+   const struct obis_data *data;  /* row of the member */
+   double scale;                  /* to multiplier of the aggregate */
+   double last;                   /* scaled value when last seen */
+   int seen;
+};
+
+struct aggregate_row
+{
+   double sum;
+   double max;
+   unsigned int count;            /* number of sources seen */
+   unsigned int first_source;     /* sources are sorted by row */
+   unsigned int num_sources;
+   int rescan;                    /* max has to be found again */
+   struct filtered filter;
+};
+
+struct aggregate
+{
+   struct MeterTable_entry *entry;
+   enum aggregate_op op;
+   struct aggregate_row *rows;
+   struct aggregate_source *sources;
+   unsigned int num_sources;
+   unsigned int max_sources;
+   unsigned int *members;         /* meter slots, counting from 0 */
+   unsigned int num_members;
+   unsigned long generation;      /* of the meters when sources were found */
+   time_t minute;
+};
+
+/* Sets up entry as an aggregate meter from its config entry. Returns 0 on
+   success. */
+int aggregate_init(struct aggregate *a, struct MeterTable_entry *entry,
+		   struct json_object *conf);
+
+/* Forgets all sources, to be followed by aggregate_add_source for each row
+   of each valid member and then aggregate_sources_done */
+void aggregate_clear_sources(struct aggregate *a);
+void aggregate_add_source(struct aggregate *a, const struct obis_data *data,
+			  long multiplier);
+void aggregate_sources_done(struct aggregate *a);
+
+/* Takes in the values of member rows changed since the last update */
+void aggregate_update(struct aggregate *a);
+
+void aggregate_free(struct aggregate *a);
+
+#endif
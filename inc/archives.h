@@ -0,0 +1,107 @@
+/**************************************************************
+This file defines how the agent consolidates the values of all rows
+into round robin archives of fixed resolution, like RRDtool and mrtg do,
+so that graphing tools can fetch a whole day or more of mean, max and
+min values from the agent at once.
+
+SPDX-License-Identifier: BSD-2-Clause
+
+Copyright (c) 2026, Henrik Carlqvist
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **************************************************************/
+
+#ifndef ARCHIVES_H
+#define ARCHIVES_H
+
+#include <time.h>
+#include "driver.h"
+
+#define ARCHIVE_LEVELS 4
+
+/* one consolidated time slot */
+struct archive_slot
+{
+   time_t start;
+   long mean;
+   long max;
+   long min;
+};
+
+/* the slot of a level being consolidated */
+struct archive_pending
+{
+   time_t start;
+   double sum;
+   unsigned long count; /* number of samples */
+   long max;
+   long min;
+};
+
+struct archive_row
+{
+   oid code[5];
+   struct archive_slot *slots; /* rings of all levels after each other */
+   unsigned int next[ARCHIVE_LEVELS];
+   unsigned int count[ARCHIVE_LEVELS];
+   struct archive_pending pending[ARCHIVE_LEVELS];
+   time_t last_time; /* time of last sample added */
+};
+
+struct archive_meter
+{
+   unsigned int num_rows;
+   struct archive_row *rows;
+};
+
+struct archives
+{
+   unsigned int num_meters;
+   struct archive_meter *meters;
+};
+
+/* Returns the seconds per slot of level, or 0 if there is no such level */
+int archive_step(unsigned int level);
+
+/* Returns 0 on success */
+int archive_init(struct archives *a, unsigned int num_meters);
+
+/* Adds the latest value of row o of meter, or the raw samples of the row
+   not yet added if the driver keeps them */
+void archive_add(struct archives *a, unsigned int meter, unsigned int row,
+		 const struct obis_data *o, time_t now);
+
+/* Returns the number of finished slots of level for row o of meter */
+unsigned int archive_count(const struct archives *a, unsigned int meter,
+			   unsigned int row, const struct obis_data *o,
+			   unsigned int level);
+
+/* Returns slot n of level, 0 being the newest, or NULL if there is no
+   such slot */
+const struct archive_slot *archive_get(const struct archives *a,
+				       unsigned int meter, unsigned int row,
+				       const struct obis_data *o,
+				       unsigned int level, unsigned int n);
+
+void archive_free(struct archives *a);
+
+#endif
@@ -0,0 +1,260 @@
+/**************************************************************
+This file contains helpers for drivers to record the raw data
+they receive from meters into a capture file, and to later replay
+such a capture file instead of talking to a real meter.
+
+A capture file starts with the 8 bytes CAPTURE_MAGIC followed by
+records. Each record is a struct capture_record in host byte order
+followed by length bytes of data as received by the driver. A
+record with the flag CAPTURE_END_OF_TRANSFER and no data ends the
+reply to one request.
+
+SPDX-License-Identifier: BSD-2-Clause
+
+Copyright (c) 2026, Henrik Carlqvist
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **************************************************************/
+
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <sys/time.h>
+
+#define CAPTURE_MAGIC "OBISCAP1"
+#define CAPTURE_END_OF_TRANSFER 1
+
+struct capture_record {
+   uint64_t time_us; /* wall clock time when data was received */
+   uint32_t length;  /* number of data bytes following this header */
+   uint32_t flags;
+};
+
+struct capture {
+   FILE *f;
+   int realtime;     /* replay with the timing of the recording */
+   int have_next;    /* next holds a header not yet consumed */
+   struct capture_record next;
+   uint64_t first_us; /* time of first replayed transfer */
+   uint64_t start_us; /* when replay started, by capture_elapsed_clock */
+};
+
+static inline uint64_t capture_now(void)
+{
+   struct timeval tv;
+
+   gettimeofday(&tv, NULL);
+   return (uint64_t)tv.tv_sec*1000000 + tv.tv_usec;
+} /* capture_now */
+
+/* Replay is timed by a clock not set back or forward with the time */
+static inline uint64_t capture_elapsed_clock(void)
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return (uint64_t)ts.tv_sec*1000000 + ts.tv_nsec/1000;
+} /* capture_elapsed_clock */
+
+/* Gets the value of parameter name (like "record=") into out, returns
+   non zero if the parameter was given */
+static inline int capture_parameter(const char *parameters, const char *name,
+				    char *out, size_t maxlen)
+{
+   const char *pc = strstr(parameters, name);
+   size_t len;
+
+   if(!pc)
+      return 0;
+   pc += strlen(name);
+   /* the value ends at the next parameter, cut to fit in out */
+   len = strcspn(pc, ",");
+   if(len >= maxlen)
+      len = maxlen - 1;
+   memcpy(out, pc, len);
+   out[len] = 0;
+   return 1;
+} /* capture_parameter */
+
+/* Opens a capture file for recording, new data is appended to any
+   previous recording. Returns NULL at failure. */
+static inline struct capture *capture_open_record(const char *path)
+{
+   struct capture *c = calloc(1, sizeof(struct capture));
+
+   if(!c)
+      return NULL;
+   c->f = fopen(path, "ab");
+   if(!c->f)
+   {
+      free(c);
+      return NULL;
+   }
+   if(!ftell(c->f))
+      fwrite(CAPTURE_MAGIC, 1, 8, c->f);
+   return c;
+} /* capture_open_record */
+
+/* Opens a capture file for replay, with realtime set transfers are
+   replayed no faster than they were recorded. Returns NULL at failure. */
+static inline struct capture *capture_open_replay(const char *path,
+						  int realtime)
+{
+   char magic[8];
+   struct capture *c = calloc(1, sizeof(struct capture));
+
+   if(!c)
+      return NULL;
+   c->f = fopen(path, "rb");
+   if((!c->f) || (fread(magic, 1, 8, c->f) != 8) ||
+      memcmp(magic, CAPTURE_MAGIC, 8))
+   {
+      if(c->f)
+	 fclose(c->f);
+      free(c);
+      return NULL;
+   }
+   c->realtime = realtime;
+   return c;
+} /* capture_open_replay */
+
+static inline void capture_close(struct capture *c)
+{
+   if(!c)
+      return;
+   fclose(c->f);
+   free(c);
+} /* capture_close */
+
+/* Records data received from a meter */
+static inline void capture_write(struct capture *c, const void *buf,
+				 size_t len)
+{
+   struct capture_record r;
+
+   r.time_us = capture_now();
+   r.length = len;
+   r.flags = 0;
+   fwrite(&r, sizeof(r), 1, c->f);
+   fwrite(buf, 1, len, c->f);
+} /* capture_write */
+
+/* Records that the reply to a request is complete */
+static inline void capture_end(struct capture *c)
+{
+   struct capture_record r;
+
+   r.time_us = capture_now();
+   r.length = 0;
+   r.flags = CAPTURE_END_OF_TRANSFER;
+   fwrite(&r, sizeof(r), 1, c->f);
+   fflush(c->f);
+} /* capture_end */
+
+/* makes sure that next holds the next record header, returns 0 at end of
+   file */
+static inline int capture_peek(struct capture *c)
+{
+   if(!c->have_next)
+      c->have_next = (fread(&(c->next), sizeof(c->next), 1, c->f) == 1);
+   return c->have_next;
+} /* capture_peek */
+
+/* Reads next chunk of data of the current transfer into buf. Returns number
+   of bytes read, 0 at end of transfer or -1 at end of file. Any part of a
+   chunk not fitting in buf is thrown away. */
+static inline long capture_read(struct capture *c, void *buf, size_t maxlen)
+{
+   size_t len;
+
+   if(!capture_peek(c))
+      return -1;
+   c->have_next = 0;
+   if(c->next.flags & CAPTURE_END_OF_TRANSFER)
+      return 0;
+   len = (c->next.length < maxlen) ? c->next.length : maxlen;
+   if(fread(buf, 1, len, c->f) != len)
+      return -1;
+   if(len < c->next.length)
+      fseek(c->f, c->next.length - len, SEEK_CUR);
+   return len;
+} /* capture_read */
+
+/* skips the rest of the current transfer */
+static inline void capture_skip_transfer(struct capture *c)
+{
+   while(capture_peek(c))
+   {
+      c->have_next = 0;
+      if(c->next.flags & CAPTURE_END_OF_TRANSFER)
+	 return;
+      fseek(c->f, c->next.length, SEEK_CUR);
+   }
+} /* capture_skip_transfer */
+
+/* A transfer recorded before the first one, as when the clock was set
+   back while recording, is due at once */
+static inline int capture_due(struct capture *c)
+{
+   int64_t recorded = (int64_t)(c->next.time_us - c->first_us);
+
+   return recorded <= (int64_t)(capture_elapsed_clock() - c->start_us);
+} /* capture_due */
+
+/* Returns non zero when there is a transfer to replay with capture_read.
+   In realtime mode a transfer is only available once as much time has passed
+   since the start of the replay as had passed in the recording, and if the
+   caller is late only the newest due transfer is replayed. */
+static inline int capture_next_transfer(struct capture *c)
+{
+   if(!capture_peek(c))
+      return 0;
+   if(!c->start_us)
+   {
+      c->start_us = capture_elapsed_clock();
+      c->first_us = c->next.time_us;
+   }
+   if(!c->realtime)
+      return 1;
+   if(!capture_due(c))
+      return 0;
+   for(;;)
+   {
+      long pos = ftell(c->f);
+      struct capture_record current = c->next;
+
+      capture_skip_transfer(c);
+      if(capture_peek(c) && capture_due(c))
+	 continue;
+      fseek(c->f, pos, SEEK_SET);
+      c->next = current;
+      c->have_next = 1;
+      return 1;
+   }
+} /* capture_next_transfer */
+
+#endif
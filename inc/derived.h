@@ -0,0 +1,75 @@
+/**************************************************************
+This file defines how the agent computes derived values like
+apparent power and power factor from the values of a meter after each
+update by its driver. Derived rows are presented like the rows of the
+driver, with OBIS indexes following those of the driver.
+
+SPDX-License-Identifier: BSD-2-Clause
+
+Copyright (c) 2026, Henrik Carlqvist
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **************************************************************/
+
+#ifndef DERIVED_H
+#define DERIVED_H
+
+#include <time.h>
+#include "driver.h"
+#include "filtered.h"
+
+#define DERIVED_MAX_INPUTS 8
+
+/* one derived row and how to compute it */
+struct derived_step
+{
+   int op;
+   int num_inputs;
+   /* index in gathered values of each input, -1 if the meter lacks it */
+   int inputs[DERIVED_MAX_INPUTS];
+};
+
+struct derived_rows
+{
+   unsigned int num_rows;
+   struct obis_data *rows;
+   struct derived_step *steps;
+   struct filtered *filters;
+   unsigned int num_sources;
+   unsigned int *sources; /* driver rows read by any step */
+   double *gathered; /* latest value of each source row */
+   time_t minute;
+};
+
+/* Sets up the derived rows asked for by spec, like "apparent,pf" or "all",
+   for which the meter has all values needed. Returns the number of rows. */
+unsigned int derived_init(struct derived_rows *d,
+			  const struct MeterTable_entry *entry,
+			  const char *spec);
+
+/* Computes derived rows from the latest values of the meter */
+void derived_update(struct derived_rows *d,
+		    const struct MeterTable_entry *entry);
+
+void derived_free(struct derived_rows *d);
+
+#endif
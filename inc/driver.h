@@ -29,17 +29,34 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  **************************************************************/
 
 #ifndef DRIVER_H
-#define DRIVER_
+#define DRIVER_H
 
 #include <net-snmp/net-snmp-config.h>
 #include <net-snmp/net-snmp-includes.h>
+#include <time.h>
+
+/* one raw sample of a value as read from the meter */
+struct obis_sample {
+   time_t time;           /* when the meter took the sample */
+   long value;            /* obis float*MeterMultiplier */
+};
+
+/* the latest raw samples of a value, oldest overwritten when full */
+struct sample_ring {
+   unsigned int size;     /* number of samples allocated */
+   unsigned int count;    /* number of samples kept, at most size */
+   unsigned int next;     /* where the next sample goes */
+   struct obis_sample *samples;
+};
 
 struct obis_data {
    oid obis_oid[5];       /* mandatory {A,B,C,D} A-B:C.D.E */
    char obis_string[50];  /* optional for drivers internal use */
-   char description[255]; /* mandatory description of value */
+   const char *description; /* description of value, if NULL set by
+			       calling agent from OBIS catalogue */
    size_t description_len;/* will later be set by calling agent */
-   char unit[255];        /* mandatory unit of original obis float value */
+   const char *unit;      /* unit of original obis float value, if NULL set
+			     by calling agent from OBIS catalogue */
    size_t unit_len;       /* will later be set by calling agent */
    int latest_is_valid;   /* mandatory, 0 if not used latest */
    long latest_value;     /* obis float*MeterMultiplier if valid */
@@ -49,6 +66,12 @@ struct obis_data {
    long max6m_value;      /* max float*MeterMultiplier if valid */
    int min6m_is_valid;    /* mandatory, 0 if not used 5 minute min */
    long min6m_value;      /* min float*MeterMultiplier if valid */
+   int p95_is_valid;      /* optional, 0 if not used 6 minute 95 percentile */
+   long p95_value;        /* 95 percentile float*MeterMultiplier if valid */
+   int p99_is_valid;      /* optional, 0 if not used 6 minute 99 percentile */
+   long p99_value;        /* 99 percentile float*MeterMultiplier if valid */
+   struct sample_ring *samples; /* optional, raw samples allocated and
+				   updated by driver, NULL if not kept */
 };
 
 struct MeterTable_entry {
@@ -69,9 +92,22 @@ struct MeterTable_entry {
    int             valid; /* set to non zero by init_driver at success */
 };
 
+/* Filled in by discover_devices for each device found */
+struct driver_device {
+   char key[256];        /* stable name of device, like its /dev/serial/by-id
+			    path, used to give the device the same meter
+			    index every time */
+   char parameters[512]; /* parameters to give init_driver for the device */
+};
+
 extern void *init_driver(struct MeterTable_entry *out_data,
 			 const char *parameters);
 void update_driver_data(void *driver, struct MeterTable_entry *work_data);
 void remove_driver(void *driver, struct MeterTable_entry *work_data);
+/* optional, for drivers able to find their own devices, called with the
+   "discover" parameters of the config entry. Fills in at most max_devices
+   devices and returns the number of devices filled in */
+int discover_devices(const char *parameters, struct driver_device *devices,
+		     int max_devices);
 
 #endif
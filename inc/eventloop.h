@@ -0,0 +1,74 @@
+/**************************************************************
+This file defines the main loop of the agent. It waits with epoll for
+the file descriptors of net-snmp, including those registered with
+register_readfd, a timer giving the updates of all meters and a signalfd
+for the signals stopping the agent or asking it to update at once.
+
+SPDX-License-Identifier: BSD-2-Clause
+
+Copyright (c) 2026, Henrik Carlqvist
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **************************************************************/
+
+#ifndef EVENTLOOP_H
+#define EVENTLOOP_H
+
+#include <sys/select.h>
+#include <time.h>
+
+/* bits returned by eventloop_wait */
+#define EVENTLOOP_UPDATE 1 /* time to update all meters */
+#define EVENTLOOP_STOP   2 /* SIGTERM or SIGINT received */
+#define EVENTLOOP_DONE   4 /* worker threads have done jobs */
+
+struct eventloop
+{
+   int epfd;
+   int timerfd;
+   int sigfd;
+   int workfd;                   /* eventfd of worker threads or -1 */
+   time_t interval;              /* seconds between updates */
+   int num_fds;                  /* highest net-snmp fd watched + 1 */
+   unsigned int events[FD_SETSIZE]; /* epoll events of net-snmp fds */
+};
+
+/* Blocks the signals handled by the loop, to be called before any thread
+   is started so that no thread gets them */
+void eventloop_block_signals(void);
+
+/* Sets up the loop with updates every interval seconds, the first one at
+   once, returns 0 on success */
+int eventloop_init(struct eventloop *l, time_t interval);
+
+/* Makes eventloop_wait return EVENTLOOP_DONE when the eventfd fd of a
+   pool of worker threads is signalled, returns 0 on success */
+int eventloop_watch_workers(struct eventloop *l, int fd);
+
+/* Serves net-snmp until an update is due, jobs are done or the agent is
+   to stop and returns the EVENTLOOP_ bits of what happened. SIGHUP makes an update
+   due at once. */
+int eventloop_wait(struct eventloop *l);
+
+void eventloop_close(struct eventloop *l);
+
+#endif
@@ -0,0 +1,125 @@
+/**************************************************************
+This file defines how the agent pushes the values of all meters to a
+time series database in InfluxDB line protocol or Graphite plaintext,
+spooling them to disk while the receiver is unavailable.
+
+SPDX-License-Identifier: BSD-2-Clause
+
+Copyright (c) 2026, Henrik Carlqvist
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **************************************************************/
+
+#ifndef EXPORT_H
+#define EXPORT_H
+
+#include <stddef.h>
+#include <time.h>
+#include <pthread.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <json.h>
+#include "driver.h"
+
+enum export_format
+{
+   EXPORT_INFLUX,
+   EXPORT_GRAPHITE
+};
+
+/* the values last sent of a row */
+struct export_sent
+{
+   oid code[5];
+   int valid;       /* bits for latest, mean, max and min */
+   long latest;
+   long mean;
+   long max;
+   long min;
+   time_t time;     /* 0 if never sent */
+   time_t sample_time; /* of the newest raw sample sent */
+};
+
+struct export_meter
+{
+   unsigned int num_rows;
+   struct export_sent *rows;
+};
+
+struct exporter
+{
+   enum export_format format;
+   int type;        /* SOCK_STREAM or SOCK_DGRAM */
+   char host[256];  /* or path of UNIX socket */
+   char port[16];
+   char name[64];   /* measurement or prefix of paths */
+   char spool[256]; /* spool file, empty if none */
+   long spool_size; /* max bytes of spool file */
+   int resend;      /* seconds before unchanged values are sent again */
+   int fd;          /* -1 if not connected, non blocking */
+   int connecting;  /* waiting for fd to connect */
+   int writing;     /* waiting for fd to take more */
+   time_t last_attempt; /* of connecting */
+   int down;        /* the receiver is known to be unavailable */
+   pthread_t resolver; /* looking up host, which may take long */
+   int resolving;   /* the resolver has been started */
+   int wake;        /* eventfd written when the resolver is done */
+   struct addrinfo *addrs; /* of host, while connecting */
+   struct addrinfo *next_addr; /* to try if connecting fails */
+   char *out;       /* lines being sent, before those in the spool */
+   size_t out_size;
+   size_t out_len;
+   size_t out_sent;
+   long spool_len;  /* bytes of the spool file */
+   long spool_read; /* bytes of the spool file moved to out */
+   int spool_full;  /* the spool file has been full */
+   unsigned int num_meters;
+   struct export_meter *meters;
+   char *buffer;    /* lines of the batch being built */
+   size_t size;
+   size_t used;
+   time_t now;
+};
+
+/* Sets up the exporter from the "export" object of the config, returns 0
+   on success */
+int export_init(struct exporter *e, struct json_object *conf,
+		unsigned int num_meters);
+
+/* Starts a batch of the values of one update */
+void export_begin(struct exporter *e, time_t now);
+
+/* Adds row o of meter to the batch if it changed since last sent, and any
+   raw samples of it not yet sent */
+void export_row(struct exporter *e, unsigned int meter, unsigned int row,
+		const struct MeterTable_entry *entry,
+		const struct obis_data *o);
+
+/* Queues the batch after any lines not yet sent, or spools it while the
+   receiver is unavailable. The lines are sent from callbacks of the event
+   loop as the receiver takes them. */
+void export_end(struct exporter *e);
+
+/* Disconnects, whatever was not sent is kept in the spool file */
+void export_close(struct exporter *e);
+
+#endif
@@ -0,0 +1,114 @@
+/**************************************************************
+This file contains the 6 minute mean, max and min kept by the agent
+for rows it computes itself. A sample is added at each update, and
+each minute the samples of the minute are folded into one mean, max
+and min.
+
+SPDX-License-Identifier: BSD-2-Clause
+
+Copyright (c) 2026, Henrik Carlqvist
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **************************************************************/
+
+#ifndef FILTERED_H
+#define FILTERED_H
+
+#include <string.h>
+#include "driver.h"
+
+struct filtered
+{
+   /* values for each of the last 6 minutes */
+   double mean[6];
+   double max[6];
+   double min[6];
+   /* the minute being collected */
+   double sum;
+   double cur_max;
+   double cur_min;
+   unsigned int count;
+   int initialized;
+};
+
+static inline void filtered_add(double value, int new_minute,
+				struct filtered *f)
+{
+   int i;
+
+   if(!f->initialized)
+   {
+      for(i=0; i<6; i++)
+      {
+	 f->mean[i] = value;
+	 f->max[i] = value;
+	 f->min[i] = value;
+      }
+      f->initialized = 1;
+   }
+   if(new_minute && f->count)
+   {
+      memmove(&(f->mean[0]), &(f->mean[1]), 5*sizeof(double));
+      memmove(&(f->max[0]), &(f->max[1]), 5*sizeof(double));
+      memmove(&(f->min[0]), &(f->min[1]), 5*sizeof(double));
+      f->mean[5] = f->sum / f->count;
+      f->max[5] = f->cur_max;
+      f->min[5] = f->cur_min;
+      f->count = 0;
+   }
+   if(!f->count)
+   {
+      f->sum = 0.0;
+      f->cur_max = value;
+      f->cur_min = value;
+   }
+   f->sum += value;
+   f->count++;
+   if(value > f->cur_max)
+      f->cur_max = value;
+   if(value < f->cur_min)
+      f->cur_min = value;
+} /* filtered_add */
+
+/* Sets the 6 minute values of row o from f */
+static inline void filtered_fill(struct obis_data *o, const struct filtered *f,
+				 double multiplier)
+{
+   double mean=0.0, max, min;
+   int m;
+
+   max = f->max[0];
+   min = f->min[0];
+   for(m=0; m<6; m++)
+   {
+      mean += f->mean[m];
+      if(f->max[m] > max)
+	 max = f->max[m];
+      if(f->min[m] < min)
+	 min = f->min[m];
+   }
+   o->mean6m_value = multiplier * mean / 6;
+   o->max6m_value = multiplier * max;
+   o->min6m_value = multiplier * min;
+} /* filtered_fill */
+
+#endif
@@ -0,0 +1,586 @@
+/**************************************************************
+This file contains a JSON reader for drivers getting small documents of
+known shape, like the replies of P1IB and WiMBIB, where only a few
+numbers are wanted. Instead of building a tree of objects the document
+is indexed: the position of every structural character ({}[]:, and the
+quotes of strings) is found, and every bracket is paired with the one
+closing it. Values are then read in place when asked for.
+
+The structural characters are found 64 bytes at a time, with AVX2 when
+the CPU has it, else with SSE2 or plain C. Quotes inside strings are
+removed with the backslashes before them, then a prefix xor of the
+quotes gives what is inside strings, so only characters outside strings
+are kept.
+
+A value is referred to by the index of the structural character
+following the one before it: its own opening bracket or quote, or for
+numbers, true, false and null the comma or bracket ending it. The
+document itself, which must be an object, is value 0.
+
+SPDX-License-Identifier: BSD-2-Clause
+
+Copyright (c) 2026, Henrik Carlqvist
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **************************************************************/
+
+#ifndef METERJSON_H
+#define METERJSON_H
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <math.h>
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#define METERJSON_X86
+#endif
+
+#define METERJSON_MAX_DEPTH 64
+
+/* bit i set in each mask for character i of a 64 byte block */
+struct meterjson_masks
+{
+   uint64_t quote;
+   uint64_t backslash;
+   uint64_t structural; /* {}[]:, */
+};
+
+typedef void (*meterjson_masks_func)(const char *, struct meterjson_masks *);
+
+struct meterjson
+{
+   meterjson_masks_func masks; /* chosen for the CPU at first parse */
+   const char *text;  /* followed by a NUL, not copied */
+   size_t len;
+   uint32_t *pos;     /* offset in text of each structural character */
+   uint32_t *match;   /* for each bracket the index of its pair */
+   size_t num;        /* structural characters found */
+   size_t size;       /* allocated for pos and match */
+};
+
+static inline void meterjson_masks_c(const char *b, struct meterjson_masks *m)
+{
+   int i;
+
+   m->quote = m->backslash = m->structural = 0;
+   for(i=0; i<64; i++)
+   {
+      uint64_t bit = (uint64_t)1 << i;
+
+      switch(b[i])
+      {
+	 case '"':
+	    m->quote |= bit;
+	    break;
+	 case '\\':
+	    m->backslash |= bit;
+	    break;
+	 case '{': case '}': case '[': case ']': case ':': case ',':
+	    m->structural |= bit;
+	    break;
+      }
+   }
+} /* meterjson_masks_c */
+
+#ifdef METERJSON_X86
+static inline void meterjson_masks_sse2(const char *b,
+					struct meterjson_masks *m)
+{
+   int i;
+
+   m->quote = m->backslash = m->structural = 0;
+   for(i=0; i<64; i+=16)
+   {
+      __m128i v = _mm_loadu_si128((const __m128i *)(b+i));
+      /* { and [ differ only in bit 5, as do } and ] */
+      __m128i lower = _mm_or_si128(v, _mm_set1_epi8(0x20));
+      __m128i s =
+	 _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(lower, _mm_set1_epi8('{')),
+				   _mm_cmpeq_epi8(lower, _mm_set1_epi8('}'))),
+		      _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(':')),
+				   _mm_cmpeq_epi8(v, _mm_set1_epi8(','))));
+
+      m->quote |= (uint64_t)(uint16_t)
+	 _mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8('"'))) << i;
+      m->backslash |= (uint64_t)(uint16_t)
+	 _mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8('\\'))) << i;
+      m->structural |= (uint64_t)(uint16_t)_mm_movemask_epi8(s) << i;
+   }
+} /* meterjson_masks_sse2 */
+
+__attribute__((target("avx2")))
+static inline void meterjson_masks_avx2(const char *b,
+					struct meterjson_masks *m)
+{
+   int i;
+
+   m->quote = m->backslash = m->structural = 0;
+   for(i=0; i<64; i+=32)
+   {
+      __m256i v = _mm256_loadu_si256((const __m256i *)(b+i));
+      __m256i lower = _mm256_or_si256(v, _mm256_set1_epi8(0x20));
+      __m256i s =
+	 _mm256_or_si256(
+	    _mm256_or_si256(_mm256_cmpeq_epi8(lower, _mm256_set1_epi8('{')),
+			    _mm256_cmpeq_epi8(lower, _mm256_set1_epi8('}'))),
+	    _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(':')),
+			    _mm256_cmpeq_epi8(v, _mm256_set1_epi8(','))));
+
+      m->quote |= (uint64_t)(uint32_t)
+	 _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('"')))
+	 << i;
+      m->backslash |= (uint64_t)(uint32_t)
+	 _mm256_movemask_epi8(_mm256_cmpeq_epi8(v,
+						_mm256_set1_epi8('\\')))
+	 << i;
+      m->structural |= (uint64_t)(uint32_t)_mm256_movemask_epi8(s) << i;
+   }
+} /* meterjson_masks_avx2 */
+#endif
+
+/* The fastest way to find structural characters on this CPU */
+static inline meterjson_masks_func meterjson_masks_best(void)
+{
+#ifdef METERJSON_X86
+   __builtin_cpu_init();
+   if(__builtin_cpu_supports("avx2"))
+      return meterjson_masks_avx2;
+   return meterjson_masks_sse2;
+#else
+   return meterjson_masks_c;
+#endif
+} /* meterjson_masks_best */
+
+/* Bit i set if an odd number of quotes are at or before bit i */
+static inline uint64_t meterjson_prefix_xor(uint64_t x)
+{
+   x ^= x << 1;
+   x ^= x << 2;
+   x ^= x << 4;
+   x ^= x << 8;
+   x ^= x << 16;
+   x ^= x << 32;
+   return x;
+} /* meterjson_prefix_xor */
+
+/* Pairs brackets, returns 0 if they are balanced */
+static inline int meterjson_pair(struct meterjson *j)
+{
+   uint32_t stack[METERJSON_MAX_DEPTH];
+   unsigned int depth = 0;
+   size_t t;
+
+   for(t=0; t<j->num; t++)
+   {
+      char c = j->text[j->pos[t]];
+
+      if((c == '{') || (c == '['))
+      {
+	 if(depth == METERJSON_MAX_DEPTH)
+	    return -1;
+	 stack[depth++] = t;
+      }
+      else if((c == '}') || (c == ']'))
+      {
+	 /* the pair differs by 2 in ASCII */
+	 if((!depth) || (j->text[j->pos[stack[depth-1]]] != c - 2))
+	    return -1;
+	 depth--;
+	 j->match[stack[depth]] = t;
+	 j->match[t] = stack[depth];
+      }
+   }
+   return depth ? -1 : 0;
+} /* meterjson_pair */
+
+/* Makes room for indexing texts of size-1 bytes without allocating,
+   returns 0 on success */
+static inline int meterjson_reserve(struct meterjson *j, size_t size)
+{
+   uint32_t *p, *q;
+
+   if(size <= j->size)
+      return 0;
+   p = realloc(j->pos, size*sizeof(uint32_t));
+   if(!p)
+      return -1;
+   j->pos = p;
+   q = realloc(j->match, size*sizeof(uint32_t));
+   if(!q)
+      return -1;
+   j->match = q;
+   j->size = size;
+   return 0;
+} /* meterjson_reserve */
+
+/* Indexes len bytes of text, which must be followed by a NUL and be
+   kept until done with j. Returns 0 if text is an object with balanced
+   brackets and closed strings. */
+static inline int meterjson_parse(struct meterjson *j, const char *text,
+				  size_t len)
+{
+   struct meterjson_masks m;
+   char tail[64];
+   uint64_t in_string = 0; /* all ones while inside a string */
+   uint64_t escape_next = 0; /* the block ended with a lone backslash */
+   size_t base;
+
+   if(!j->masks)
+      j->masks = meterjson_masks_best();
+   j->text = text;
+   j->len = len;
+   j->num = 0;
+   /* with room to spare, replies a few bytes longer than the longest
+      seen so far should not allocate again */
+   if((len + 1 > j->size) && meterjson_reserve(j, len + 1 + len/4 + 64))
+      return -1;
+   for(base=0; base<len; base+=64)
+   {
+      uint64_t string, tokens;
+
+      if(len - base >= 64)
+	 j->masks(text + base, &m);
+      else
+      {
+	 memset(tail, ' ', sizeof(tail));
+	 memcpy(tail, text + base, len - base);
+	 j->masks(tail, &m);
+      }
+      if(m.backslash || escape_next)
+      {
+	 /* characters after a backslash not itself escaped are escaped */
+	 uint64_t escaped = escape_next;
+	 uint64_t b = m.backslash & ~escape_next;
+
+	 escape_next = 0;
+	 while(b)
+	 {
+	    int i = __builtin_ctzll(b);
+
+	    b &= b - 1;
+	    if(i == 63)
+	       escape_next = 1;
+	    else
+	    {
+	       escaped |= (uint64_t)1 << (i+1);
+	       b &= ~((uint64_t)1 << (i+1));
+	    }
+	 }
+	 m.quote &= ~escaped;
+      }
+      string = meterjson_prefix_xor(m.quote) ^ in_string;
+      in_string = (uint64_t)((int64_t)string >> 63);
+      tokens = (m.structural & ~string) | m.quote;
+      while(tokens)
+      {
+	 j->pos[j->num++] = base + __builtin_ctzll(tokens);
+	 tokens &= tokens - 1;
+      }
+   }
+   if(in_string || (!j->num) || (text[j->pos[0]] != '{'))
+      return -1;
+   return meterjson_pair(j);
+} /* meterjson_parse */
+
+static inline void meterjson_free(struct meterjson *j)
+{
+   free(j->pos);
+   free(j->match);
+   memset(j, 0, sizeof(struct meterjson));
+} /* meterjson_free */
+
+/* The first character of value v */
+static inline const char *meterjson_start(const struct meterjson *j,
+					  size_t v)
+{
+   const char *p;
+
+   if(!v)
+      p = j->text;
+   else
+      p = j->text + j->pos[v-1] + 1;
+   while((*p == ' ') || (*p == '\t') || (*p == '\r') || (*p == '\n'))
+      p++;
+   return p;
+} /* meterjson_start */
+
+/* The index of the structural character following value v */
+static inline size_t meterjson_after(const struct meterjson *j, size_t v)
+{
+   switch(j->text[j->pos[v]])
+   {
+      case '{':
+      case '[':
+	 return j->match[v] + 1;
+      case '"':
+	 return v + 2;
+      default:
+	 return v; /* number, true, false or null */
+   }
+} /* meterjson_after */
+
+static inline int meterjson_is_object(const struct meterjson *j, long v)
+{
+   return (v >= 0) && (*meterjson_start(j, v) == '{');
+} /* meterjson_is_object */
+
+static inline int meterjson_is_array(const struct meterjson *j, long v)
+{
+   return (v >= 0) && (*meterjson_start(j, v) == '[');
+} /* meterjson_is_array */
+
+/* Steps to the next member of object, begin with *member = 0. Returns the
+   value of the member and sets key to its name, which is not NUL
+   terminated and still escaped, or returns -1 after the last member. */
+static inline long meterjson_next_member(const struct meterjson *j,
+					 long object, size_t *member,
+					 const char **key, size_t *key_len)
+{
+   size_t k = *member ? *member : (size_t)object + 1;
+   size_t end, value, next;
+
+   if(!meterjson_is_object(j, object))
+      return -1;
+   end = j->match[object];
+   /* a key is two quotes and a colon */
+   if((k + 3 > end) || (j->text[j->pos[k]] != '"') ||
+      (j->text[j->pos[k+2]] != ':'))
+      return -1;
+   *key = j->text + j->pos[k] + 1;
+   *key_len = j->pos[k+1] - j->pos[k] - 1;
+   value = k + 3;
+   next = meterjson_after(j, value);
+   *member = ((next < end) && (j->text[j->pos[next]] == ',')) ? next + 1 :
+      end;
+   return value;
+} /* meterjson_next_member */
+
+/* The value of key in object, or -1 */
+static inline long meterjson_get(const struct meterjson *j, long object,
+				 const char *key)
+{
+   size_t member = 0, len = strlen(key), key_len;
+   const char *k;
+   long v;
+
+   while((v = meterjson_next_member(j, object, &member, &k, &key_len)) >= 0)
+      if((key_len == len) && !memcmp(k, key, len))
+	 return v;
+   return -1;
+} /* meterjson_get */
+
+/* Copies the text of v, unescaped if a string, to out of size bytes.
+   Returns the length copied. */
+static inline size_t meterjson_string(const struct meterjson *j, long v,
+				      char *out, size_t size)
+{
+   const char *p, *end;
+   size_t n = 0;
+
+   if((v < 0) || !size)
+      return 0;
+   p = meterjson_start(j, v);
+   if(*p == '"')
+   {
+      end = j->text + j->pos[v+1];
+      p++;
+   }
+   else if((*p == '{') || (*p == '['))
+      end = p; /* like json-c would need a printed document */
+   else
+   {
+      end = j->text + j->pos[v];
+      while((end > p) && ((end[-1] == ' ') || (end[-1] == '\t') ||
+			  (end[-1] == '\r') || (end[-1] == '\n')))
+	 end--;
+   }
+   for(; (p < end) && (n+1 < size); p++)
+   {
+      if((*p == '\\') && (p+1 < end))
+      {
+	 p++;
+	 switch(*p)
+	 {
+	    case 'b': out[n++] = '\b'; continue;
+	    case 'f': out[n++] = '\f'; continue;
+	    case 'n': out[n++] = '\n'; continue;
+	    case 'r': out[n++] = '\r'; continue;
+	    case 't': out[n++] = '\t'; continue;
+	    case 'u': /* kept as it is */
+	       if(n+2 < size)
+		  out[n++] = '\\';
+	       break;
+	 }
+      }
+      out[n++] = *p;
+   }
+   out[n] = 0;
+   return n;
+} /* meterjson_string */
+
+/* Reads a number at p, returns 0 if there is none */
+static inline int meterjson_number(const char *p, double *d)
+{
+   static const double exact[] = {
+      1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+      1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+   const char *q = p;
+   uint64_t mantissa = 0;
+   int digits = 0, exponent = 0, negative = 0;
+   char *end;
+
+   if(*q == '-')
+   {
+      negative = 1;
+      q++;
+   }
+   for(; (*q >= '0') && (*q <= '9'); q++, digits++)
+      mantissa = 10*mantissa + (*q - '0');
+   if(*q == '.')
+      for(q++; (*q >= '0') && (*q <= '9'); q++, digits++, exponent--)
+	 mantissa = 10*mantissa + (*q - '0');
+   if(!digits)
+      return 0;
+   /* both mantissa and power of ten are exact doubles, so is the result
+      of one multiplication or division */
+   if((*q != 'e') && (*q != 'E') && (digits <= 19) &&
+      (mantissa <= ((uint64_t)1 << 53)) && (exponent >= -22))
+   {
+      *d = exponent ? mantissa / exact[-exponent] : (double)mantissa;
+      if(negative)
+	 *d = -*d;
+      return 1;
+   }
+   *d = strtod(p, &end);
+   return end != p;
+} /* meterjson_number */
+
+/* Like json_object_get_double, 1 for true, a string is read if it is all
+   a number and 0 for anything else */
+static inline double meterjson_double(const struct meterjson *j, long v)
+{
+   const char *p;
+   char s[64], *end;
+   double d;
+
+   if(v < 0)
+      return 0.0;
+   p = meterjson_start(j, v);
+   if(*p == 't')
+      return 1.0;
+   if(*p == '"')
+   {
+      meterjson_string(j, v, s, sizeof(s));
+      errno = 0;
+      d = strtod(s, &end);
+      if((end == s) || *end || ((errno == ERANGE) && isinf(d)))
+	 return 0.0;
+      return d;
+   }
+   return meterjson_number(p, &d) ? d : 0.0;
+} /* meterjson_double */
+
+static inline int64_t meterjson_int64(const struct meterjson *j, long v)
+{
+   const char *p;
+   char *end;
+   int64_t i;
+
+   if(v < 0)
+      return 0;
+   p = meterjson_start(j, v);
+   if(*p == 't')
+      return 1;
+   if(*p == '"')
+   {
+      char s[64];
+
+      /* like json-c the number the string starts with */
+      meterjson_string(j, v, s, sizeof(s));
+      return strtoll(s, &end, 10);
+   }
+   i = strtoll(p, &end, 10);
+   if((*end == '.') || (*end == 'e') || (*end == 'E'))
+   {
+      double d = meterjson_double(j, v);
+
+      /* clamped like json-c */
+      if(d >= (double)INT64_MAX)
+	 return INT64_MAX;
+      if(d <= (double)INT64_MIN)
+	 return INT64_MIN;
+      return (int64_t)d;
+   }
+   return i;
+} /* meterjson_int64 */
+
+/* Like json_object_get_boolean */
+static inline int meterjson_boolean(const struct meterjson *j, long v)
+{
+   const char *p;
+
+   if(v < 0)
+      return 0;
+   p = meterjson_start(j, v);
+   switch(*p)
+   {
+      case 't':
+	 return 1;
+      case 'f':
+      case 'n':
+	 return 0;
+      case '"':
+	 return p[1] != '"';
+      default:
+	 return meterjson_double(j, v) != 0.0;
+   }
+} /* meterjson_boolean */
+
+/* Reads up to max numbers of array to d, the rest of d is set to 0 like
+   json-c gives for missing elements. Returns the number of elements. */
+static inline int meterjson_doubles(const struct meterjson *j, long array,
+				    double *d, int max)
+{
+   size_t t, end;
+   int n = 0;
+
+   memset(d, 0, max*sizeof(double));
+   if(!meterjson_is_array(j, array))
+      return 0;
+   end = j->match[array];
+   if(*meterjson_start(j, array + 1) == ']')
+      return 0;
+   for(t=array+1; ; n++)
+   {
+      if(n < max)
+	 d[n] = meterjson_double(j, t);
+      t = meterjson_after(j, t);
+      if((t >= end) || (j->text[j->pos[t]] != ','))
+	 break;
+      t++;
+   }
+   return n + 1;
+} /* meterjson_doubles */
+
+#endif
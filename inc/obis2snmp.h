@@ -50,8 +50,45 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define COLUMN_METEROBIS6MINMEAN       	10
 #define COLUMN_METEROBIS6MINMAX		11
 #define COLUMN_METEROBIS6MINMIN		12
+#define COLUMN_METEROBIS6MINP95		13
+#define COLUMN_METEROBIS6MINP99		14
 
 #define MeterTable_oid (const oid[]){ 1, 3, 6, 1, 4, 1, 62368, 1 }
 #define MeterTable_oid_len (size_t)OID_LENGTH(MeterTable_oid)
 
+/*
+ * column number definitions for table MeterSampleTable, indexed by
+ * meter index, OBIS code and sample number, 1 being the newest
+ */
+#define COLUMN_METERSAMPLETIME		1
+#define COLUMN_METERSAMPLEVALUE		2
+
+#define MeterSampleEntry_oid (const oid[]){ 1, 3, 6, 1, 4, 1, 62368, 2, 1 }
+#define MeterSampleEntry_oid_len (size_t)OID_LENGTH(MeterSampleEntry_oid)
+#define METERSAMPLE_INDEX_LEN 7
+
+/*
+ * column number definitions for table MeterHistoryTable, indexed by
+ * meter index, OBIS code, seconds per slot and slot number, 1 being the
+ * newest
+ */
+#define COLUMN_METERHISTORYTIME		1
+#define COLUMN_METERHISTORYMEAN		2
+#define COLUMN_METERHISTORYMAX		3
+#define COLUMN_METERHISTORYMIN		4
+
+#define MeterHistoryEntry_oid (const oid[]){ 1, 3, 6, 1, 4, 1, 62368, 3, 1 }
+#define MeterHistoryEntry_oid_len (size_t)OID_LENGTH(MeterHistoryEntry_oid)
+#define METERHISTORY_INDEX_LEN 8
+
+/*
+ * column number definitions for table MeterDiscoveryTable, indexed by
+ * chunk number, the chunks together make up the discovery document
+ */
+#define COLUMN_METERDISCOVERYCHUNK	1
+
+#define MeterDiscoveryEntry_oid (const oid[]){ 1, 3, 6, 1, 4, 1, 62368, 4, 1 }
+#define MeterDiscoveryEntry_oid_len (size_t)OID_LENGTH(MeterDiscoveryEntry_oid)
+#define METERDISCOVERY_CHUNK 1024 /* max bytes of each chunk */
+
 #endif
@@ -0,0 +1,124 @@
+/**************************************************************
+This file describes the POSIX shared memory segment in which
+obis2snmp_agentxd mirrors the latest values of all meters, and may be
+included by programs reading it.
+
+The segment starts with a struct o2s_shm_header followed by num_meters
+struct o2s_shm_meter, one for each meter index, and then rows_per_meter
+struct o2s_shm_row for each meter index. Each meter is protected by its
+own sequence number, which is odd while the agent writes the meter. A
+reader copies a meter and its rows with o2s_shm_read_meter, which tries
+again if the agent wrote the meter during the copy. All numbers are in
+the byte order of the host.
+
+SPDX-License-Identifier: BSD-2-Clause
+
+Copyright (c) 2026, Henrik Carlqvist
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **************************************************************/
+
+#ifndef OBIS2SNMP_SHM_H
+#define OBIS2SNMP_SHM_H
+
+#include <stdint.h>
+#include <string.h>
+
+#define O2S_SHM_MAGIC "O2SM"
+#define O2S_SHM_VERSION 1
+#define O2S_SHM_NAME "/obis2snmp" /* default name of the segment */
+
+/* bits of valid in struct o2s_shm_row */
+#define O2S_SHM_LATEST 1
+#define O2S_SHM_MEAN   2
+#define O2S_SHM_MAX    4
+#define O2S_SHM_MIN    8
+
+struct o2s_shm_header
+{
+   char magic[4];           /* O2S_SHM_MAGIC, not NUL terminated */
+   uint32_t version;        /* O2S_SHM_VERSION */
+   uint32_t num_meters;     /* number of meter indexes */
+   uint32_t rows_per_meter; /* rows allocated for each meter */
+};
+
+struct o2s_shm_meter
+{
+   uint32_t sequence;       /* odd while being written */
+   uint32_t num_rows;       /* 0 if there is no meter at this index */
+   int64_t multiplier;      /* MeterMultiplier */
+   int64_t updated;         /* seconds since 1970 of last update */
+   char type[64];           /* MeterType, NUL terminated */
+};
+
+struct o2s_shm_row
+{
+   uint32_t code[5];        /* OBIS code A-B:C.D.E */
+   uint32_t valid;          /* O2S_SHM_ bits of the values given */
+   int64_t latest;          /* values multiplied with the multiplier */
+   int64_t mean;
+   int64_t max;
+   int64_t min;
+};
+
+static inline struct o2s_shm_meter *o2s_shm_meters(struct o2s_shm_header *h)
+{
+   return (struct o2s_shm_meter *)(h + 1);
+} /* o2s_shm_meters */
+
+/* Returns the rows of meter i, 0 being MeterIndex 1 */
+static inline struct o2s_shm_row *o2s_shm_rows(struct o2s_shm_header *h,
+					       uint32_t i)
+{
+   return (struct o2s_shm_row *)(o2s_shm_meters(h) + h->num_meters) +
+      (size_t)i * h->rows_per_meter;
+} /* o2s_shm_rows */
+
+/* Copies meter i and its rows, which must have room for rows_per_meter
+   rows. Returns 0 on success and -1 if the meter kept being written. */
+static inline int o2s_shm_read_meter(struct o2s_shm_header *h, uint32_t i,
+				     struct o2s_shm_meter *meter,
+				     struct o2s_shm_row *rows)
+{
+   struct o2s_shm_meter *m = &(o2s_shm_meters(h)[i]);
+   uint32_t before, after;
+   int tries;
+
+   for(tries=0; tries<1000; tries++)
+   {
+      before = __atomic_load_n(&m->sequence, __ATOMIC_ACQUIRE);
+      if(before & 1)
+	 continue;
+      memcpy(meter, m, sizeof(struct o2s_shm_meter));
+      if(meter->num_rows > h->rows_per_meter)
+	 continue;
+      memcpy(rows, o2s_shm_rows(h, i),
+	     meter->num_rows * sizeof(struct o2s_shm_row));
+      __atomic_thread_fence(__ATOMIC_ACQUIRE);
+      after = __atomic_load_n(&m->sequence, __ATOMIC_RELAXED);
+      if(before == after)
+	 return 0;
+   }
+   return -1;
+} /* o2s_shm_read_meter */
+
+#endif
@@ -0,0 +1,111 @@
+/**************************************************************
+This file describes the snapshot of all meters which obis2snmp_agentxd
+serves on its UNIX domain socket to local readers, and may be included
+by such readers.
+
+A reader connects to the socket and writes the sequence number of the
+snapshot it already has as a uint64_t, 0 if it has none. As soon as the
+agent has a snapshot with a higher sequence number it answers with that
+snapshot, so a reader asking for the same number again waits until the
+next update. The reader may keep the connection for more requests.
+
+A snapshot is a struct o2s_snapshot_header followed by num_meters meters,
+each a struct o2s_snapshot_meter followed by its num_rows struct
+o2s_snapshot_row. The rest of the snapshot, up to size, holds the raw
+samples kept of rows, each row with samples as a struct
+o2s_snapshot_samples followed by its num_samples struct o2s_snapshot_sample
+oldest first. All numbers are in the byte order of the host and strings
+are NUL terminated.
+
+SPDX-License-Identifier: BSD-2-Clause
+
+Copyright (c) 2026, Henrik Carlqvist
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **************************************************************/
+
+#ifndef OBIS2SNMP_SNAPSHOT_H
+#define OBIS2SNMP_SNAPSHOT_H
+
+#include <stdint.h>
+
+#define O2S_SNAPSHOT_MAGIC "O2SS"
+#define O2S_SNAPSHOT_VERSION 2
+
+/* bits of valid in struct o2s_snapshot_row */
+#define O2S_LATEST 1
+#define O2S_MEAN   2
+#define O2S_MAX    4
+#define O2S_MIN    8
+#define O2S_P95    16
+#define O2S_P99    32
+
+struct o2s_snapshot_header
+{
+   char magic[4];         /* O2S_SNAPSHOT_MAGIC, not NUL terminated */
+   uint32_t version;      /* O2S_SNAPSHOT_VERSION */
+   uint64_t sequence;     /* increased at every update of the agent */
+   int64_t time;          /* of the update, seconds since 1970 */
+   uint32_t size;         /* bytes of the whole snapshot, header included */
+   uint32_t num_meters;
+};
+
+struct o2s_snapshot_meter
+{
+   uint32_t index;        /* MeterIndex */
+   uint32_t num_rows;     /* number of rows following the meter */
+   int64_t multiplier;    /* MeterMultiplier */
+   int64_t rssi;          /* 0 if not used */
+   char type[64];
+   char ip[48];
+   char mac[32];
+};
+
+struct o2s_snapshot_row
+{
+   uint32_t code[5];      /* OBIS code A-B:C.D.E */
+   uint32_t valid;        /* O2S_ bits of the values given */
+   int64_t latest;        /* values multiplied with the multiplier */
+   int64_t mean;
+   int64_t max;
+   int64_t min;
+   int64_t p95;
+   int64_t p99;
+   char unit[16];
+   char description[80];
+};
+
+struct o2s_snapshot_samples
+{
+   uint32_t index;        /* MeterIndex of the meter */
+   uint32_t row;          /* of the meter, 0 for the first */
+   uint32_t num_samples;  /* number of samples following */
+   uint32_t reserved;
+};
+
+struct o2s_snapshot_sample
+{
+   int64_t time;          /* when the meter took the sample */
+   int64_t value;         /* multiplied with the multiplier */
+};
+
+#endif
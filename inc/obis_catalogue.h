@@ -0,0 +1,117 @@
+/**************************************************************
+This file gives the agent and drivers access to the catalogue of
+known OBIS codes with their descriptions and units. The catalogue
+is made from obis_catalogue.txt by the Makefile, sorted by code so
+that it can be searched with binary search.
+
+SPDX-License-Identifier: BSD-2-Clause
+
+Copyright (c) 2026, Henrik Carlqvist
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **************************************************************/
+
+#ifndef OBIS_CATALOGUE_H
+#define OBIS_CATALOGUE_H
+
+#include "driver.h"
+
+enum obis_kind
+{
+   OBIS_COUNTER, /* cumulative value like energy, never averaged */
+   OBIS_GAUGE,   /* instantaneous value like power */
+   OBIS_STATE    /* status or indicator */
+};
+
+struct obis_catalogue_entry
+{
+   oid code[5];
+   const char *obis_string;
+   enum obis_kind kind;
+   int decimals; /* number of decimals usually given by meters */
+   const char *unit;
+   const char *description;
+};
+
+#include "obis_catalogue_data.h"
+
+#define OBIS_CATALOGUE_SIZE \
+   (sizeof(obis_catalogue)/sizeof(struct obis_catalogue_entry))
+
+static inline int obis_compare(const oid *a, const oid *b)
+{
+   int i;
+
+   for(i=0; i<5; i++)
+      if(a[i] != b[i])
+	 return (a[i] < b[i]) ? -1 : 1;
+   return 0;
+} /* obis_compare */
+
+static inline const struct obis_catalogue_entry *
+obis_search(const oid *code)
+{
+   int low = 0;
+   int high = OBIS_CATALOGUE_SIZE - 1;
+
+   while(low <= high)
+   {
+      int mid = (low + high) / 2;
+      int c = obis_compare(code, obis_catalogue[mid].code);
+
+      if(!c)
+	 return &(obis_catalogue[mid]);
+      if(c < 0)
+	 high = mid - 1;
+      else
+	 low = mid + 1;
+   }
+   return NULL;
+} /* obis_search */
+
+/* Returns the catalogue entry for code or NULL when the code is unknown.
+   A code with a channel (B) not in the catalogue gets the entry of
+   channel 0. */
+static inline const struct obis_catalogue_entry *obis_lookup(const oid *code)
+{
+   const struct obis_catalogue_entry *e = obis_search(code);
+   oid channel0[5];
+
+   if(e || !code[1])
+      return e;
+   memcpy(channel0, code, sizeof(channel0));
+   channel0[1] = 0;
+   return obis_search(channel0);
+} /* obis_lookup */
+
+/* Returns non zero for instantaneous values which should get mean, max and
+   min. Unknown codes are taken as cumulative when D is 8. */
+static inline int obis_is_gauge(const oid *code)
+{
+   const struct obis_catalogue_entry *e = obis_lookup(code);
+
+   if(e)
+      return e->kind == OBIS_GAUGE;
+   return code[3] != 8;
+} /* obis_is_gauge */
+
+#endif
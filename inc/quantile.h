@@ -0,0 +1,196 @@
+/**************************************************************
+This file contains helpers for drivers to estimate the 95 and 99
+percentiles of a row over the 6 minute window without saving all
+samples. Each minute has its own P-square estimator (Jain and
+Chlamtac, 1985) keeping 5 markers for each percentile. For the
+window the markers of all minutes are taken as estimates of the
+number of samples below a value, and the value with the wanted
+number of samples below it is searched for.
+
+SPDX-License-Identifier: BSD-2-Clause
+
+Copyright (c) 2026, Henrik Carlqvist
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **************************************************************/
+
+#ifndef QUANTILE_H
+#define QUANTILE_H
+
+#include <string.h>
+#include "driver.h"
+
+struct p2_quantile
+{
+   double q[5];  /* marker heights, the first samples sorted until 5 */
+   double n[5];  /* marker positions, counting from 1 */
+   double np[5]; /* desired marker positions */
+   unsigned long count;
+};
+
+struct quantiles
+{
+   /* the minute being collected is [5] */
+   struct p2_quantile p95[6];
+   struct p2_quantile p99[6];
+};
+
+static inline void p2_add(struct p2_quantile *e, double p, double x)
+{
+   const double dn[5] = {0.0, p/2, p, (1+p)/2, 1.0};
+   int i, k;
+
+   if(e->count < 5)
+   {
+      /* insertion sort of the first samples */
+      for(i=e->count; (i > 0) && (e->q[i-1] > x); i--)
+	 e->q[i] = e->q[i-1];
+      e->q[i] = x;
+      if(++e->count == 5)
+	 for(i=0; i<5; i++)
+	 {
+	    e->n[i] = i+1;
+	    e->np[i] = 1 + 4*dn[i];
+	 }
+      return;
+   }
+   if(x < e->q[0])
+   {
+      e->q[0] = x;
+      k = 0;
+   }
+   else if(x >= e->q[4])
+   {
+      e->q[4] = x;
+      k = 3;
+   }
+   else
+      for(k=0; x >= e->q[k+1]; k++);
+   for(i=k+1; i<5; i++)
+      e->n[i]++;
+   for(i=0; i<5; i++)
+      e->np[i] += dn[i];
+   e->count++;
+   /* move the middle markers towards their desired positions */
+   for(i=1; i<4; i++)
+   {
+      double d = e->np[i] - e->n[i];
+
+      if(((d >= 1.0) && (e->n[i+1] - e->n[i] > 1.0)) ||
+	 ((d <= -1.0) && (e->n[i-1] - e->n[i] < -1.0)))
+      {
+	 int s = (d > 0) ? 1 : -1;
+	 double q = e->q[i] + s / (e->n[i+1] - e->n[i-1]) *
+	    ((e->n[i] - e->n[i-1] + s) * (e->q[i+1] - e->q[i]) /
+	     (e->n[i+1] - e->n[i]) +
+	     (e->n[i+1] - e->n[i] - s) * (e->q[i] - e->q[i-1]) /
+	     (e->n[i] - e->n[i-1]));
+
+	 if((q <= e->q[i-1]) || (q >= e->q[i+1]))
+	    q = e->q[i] + s * (e->q[i+s] - e->q[i]) / (e->n[i+s] - e->n[i]);
+	 e->q[i] = q;
+	 e->n[i] += s;
+      }
+   }
+} /* p2_add */
+
+/* Estimated number of samples not above x */
+static inline double p2_rank(const struct p2_quantile *e, double x)
+{
+   unsigned int i;
+
+   if(e->count < 5)
+   {
+      for(i=0; (i < e->count) && (e->q[i] <= x); i++);
+      return i;
+   }
+   if(x < e->q[0])
+      return 0.0;
+   if(x >= e->q[4])
+      return e->count;
+   for(i=0; x >= e->q[i+1]; i++);
+   return e->n[i] + (e->n[i+1] - e->n[i]) * (x - e->q[i]) /
+      (e->q[i+1] - e->q[i]);
+} /* p2_rank */
+
+/* Estimates quantile p of all samples of the 6 minutes */
+static inline double p2_window(const struct p2_quantile *e, double p)
+{
+   double low=0.0, high=0.0, target, rank;
+   unsigned long total=0;
+   int m, i, first=1;
+
+   for(m=0; m<6; m++)
+   {
+      int last = (e[m].count < 5) ? e[m].count-1 : 4;
+
+      if(!e[m].count)
+	 continue;
+      if(first || (e[m].q[0] < low))
+	 low = e[m].q[0];
+      if(first || (e[m].q[last] > high))
+	 high = e[m].q[last];
+      first = 0;
+      total += e[m].count;
+   }
+   if(!total)
+      return 0.0;
+   target = p * total;
+   /* the lowest value with at least target samples not above it */
+   for(i=0; i<50; i++)
+   {
+      double mid = (low + high) / 2;
+
+      for(m=0, rank=0.0; m<6; m++)
+	 rank += p2_rank(&(e[m]), mid);
+      if(rank >= target)
+	 high = mid;
+      else
+	 low = mid;
+   }
+   return high;
+} /* p2_window */
+
+static inline void quantiles_add(struct quantiles *qs, double value,
+				 int new_minute)
+{
+   if(new_minute && qs->p95[5].count)
+   {
+      memmove(&(qs->p95[0]), &(qs->p95[1]), 5*sizeof(struct p2_quantile));
+      memmove(&(qs->p99[0]), &(qs->p99[1]), 5*sizeof(struct p2_quantile));
+      memset(&(qs->p95[5]), 0, sizeof(struct p2_quantile));
+      memset(&(qs->p99[5]), 0, sizeof(struct p2_quantile));
+   }
+   p2_add(&(qs->p95[5]), 0.95, value);
+   p2_add(&(qs->p99[5]), 0.99, value);
+} /* quantiles_add */
+
+/* Sets the percentile values of row o from qs */
+static inline void quantiles_fill(struct obis_data *o,
+				  const struct quantiles *qs,
+				  double multiplier)
+{
+   o->p95_value = multiplier * p2_window(qs->p95, 0.95);
+   o->p99_value = multiplier * p2_window(qs->p99, 0.99);
+} /* quantiles_fill */
+
+#endif
@@ -0,0 +1,78 @@
+/**************************************************************
+This file contains helpers for drivers keeping the latest raw samples
+of their rows in a struct sample_ring, and for the agent presenting
+them.
+
+SPDX-License-Identifier: BSD-2-Clause
+
+Copyright (c) 2026, Henrik Carlqvist
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **************************************************************/
+
+#ifndef SAMPLES_H
+#define SAMPLES_H
+
+#include <stdlib.h>
+#include "driver.h"
+
+/* Returns 0 on success */
+static inline int samples_alloc(struct sample_ring *r, unsigned int size)
+{
+   r->samples = calloc(size, sizeof(struct obis_sample));
+   r->size = r->samples ? size : 0;
+   r->count = 0;
+   r->next = 0;
+   return r->samples ? 0 : -1;
+} /* samples_alloc */
+
+static inline void samples_free(struct sample_ring *r)
+{
+   free(r->samples);
+   r->samples = NULL;
+   r->size = 0;
+   r->count = 0;
+   r->next = 0;
+} /* samples_free */
+
+static inline void samples_push(struct sample_ring *r, time_t time,
+				long value)
+{
+   if(!r->size)
+      return;
+   r->samples[r->next].time = time;
+   r->samples[r->next].value = value;
+   r->next = (r->next + 1) % r->size;
+   if(r->count < r->size)
+      r->count++;
+} /* samples_push */
+
+/* Returns sample n, 0 being the newest, or NULL if there is no such sample */
+static inline const struct obis_sample *
+samples_get(const struct sample_ring *r, unsigned int n)
+{
+   if(n >= r->count)
+      return NULL;
+   return &(r->samples[(r->next + r->size - 1 - n) % r->size]);
+} /* samples_get */
+
+#endif
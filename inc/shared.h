@@ -0,0 +1,67 @@
+/**************************************************************
+This file defines how the agent mirrors the latest values of all meters
+in a POSIX shared memory segment laid out as in obis2snmp_shm.h.
+
+SPDX-License-Identifier: BSD-2-Clause
+
+Copyright (c) 2026, Henrik Carlqvist
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **************************************************************/
+
+#ifndef SHARED_H
+#define SHARED_H
+
+#include <stddef.h>
+#include <time.h>
+#include <json.h>
+#include "driver.h"
+#include "obis2snmp_shm.h"
+
+#define SHARED_ROWS 64 /* default rows allocated for each meter */
+
+struct shared
+{
+   char name[256];
+   struct o2s_shm_header *header;
+   size_t size;
+   int warned;      /* a meter had more rows than allocated */
+};
+
+/* Creates the segment from the "shm" object of the config, returns 0 on
+   success */
+int shared_init(struct shared *s, struct json_object *conf,
+		unsigned int num_meters);
+
+/* Mirrors meter i, 0 being MeterIndex 1. The rows are written with
+   shared_set_row between shared_begin_meter and shared_end_meter. */
+void shared_begin_meter(struct shared *s, unsigned int i,
+			const struct MeterTable_entry *entry);
+void shared_set_row(struct shared *s, unsigned int i, unsigned int row,
+		    const struct obis_data *o);
+void shared_end_meter(struct shared *s, unsigned int i,
+		      unsigned int num_rows, time_t now);
+
+/* Unmaps and removes the segment */
+void shared_close(struct shared *s);
+
+#endif
@@ -0,0 +1,96 @@
+/**************************************************************
+This file defines how the agent serves snapshots of all meters on a UNIX
+domain socket, in the format of obis2snmp_snapshot.h. The socket and
+its clients are served from the main loop of net-snmp.
+
+SPDX-License-Identifier: BSD-2-Clause
+
+Copyright (c) 2026, Henrik Carlqvist
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **************************************************************/
+
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <time.h>
+#include <sys/un.h>
+#include "driver.h"
+#include "obis2snmp_snapshot.h"
+
+#define SNAPSHOT_MAX_CLIENTS 16
+
+struct snapshot_client
+{
+   int fd;          /* non blocking */
+   uint64_t have;   /* sequence number the client already has */
+   int waiting;     /* non zero until a newer snapshot has been sent */
+   uint8_t request[sizeof(uint64_t)]; /* sequence number being received */
+   unsigned int request_len;
+   uint8_t *backlog; /* rest of a snapshot the socket could not take yet */
+   size_t backlog_size; /* bytes allocated for backlog */
+   size_t backlog_len;  /* bytes of backlog, 0 if all sent */
+   size_t backlog_sent;
+};
+
+struct snapshot
+{
+   int fd;          /* listening socket */
+   char path[sizeof(((struct sockaddr_un *)0)->sun_path)];
+   unsigned int num_clients;
+   struct snapshot_client clients[SNAPSHOT_MAX_CLIENTS];
+   uint8_t *data;   /* the snapshot */
+   size_t size;     /* bytes allocated for data */
+   size_t used;     /* bytes of the snapshot */
+   size_t meter;    /* where the meter being added starts in data */
+   uint32_t num_meters;
+   uint64_t sequence; /* of the latest snapshot published */
+   int failed;      /* out of memory while building the snapshot */
+};
+
+/* Starts listening on the socket path, returns 0 on success */
+int snapshot_init(struct snapshot *s, const char *path);
+
+/* Starts building a new snapshot, which is not served until published */
+void snapshot_begin(struct snapshot *s);
+
+/* Adds a meter, its rows are added by snapshot_add_row */
+void snapshot_add_meter(struct snapshot *s, unsigned int index,
+			const struct MeterTable_entry *entry);
+
+void snapshot_add_row(struct snapshot *s, const struct obis_data *o);
+
+/* Adds the raw samples of a row, after all meters have been added */
+void snapshot_add_samples(struct snapshot *s, unsigned int index,
+			  unsigned int row, const struct sample_ring *r);
+
+/* Gives the new snapshot a sequence number and sends it to all clients
+   waiting for it. A client which has not yet taken all of the previous
+   snapshot is disconnected. */
+void snapshot_publish(struct snapshot *s, time_t now);
+
+/* Disconnects all clients and removes the socket */
+void snapshot_close(struct snapshot *s);
+
+#endif
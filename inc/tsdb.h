@@ -0,0 +1,115 @@
+/**************************************************************
+This file defines the history kept by the agent on disk. Every value
+of every meter is appended to segment files, one file per meter and
+day, in blocks compressed with delta-of-delta encoding of both times
+and values. Old days are rewritten into fewer blocks, downsampled and
+finally removed.
+
+SPDX-License-Identifier: BSD-2-Clause
+
+Copyright (c) 2026, Henrik Carlqvist
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **************************************************************/
+
+#ifndef TSDB_H
+#define TSDB_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+#include <pthread.h>
+#include <json.h>
+#include "driver.h"
+
+#define TSDB_MAGIC "O2STSDB1"
+
+/* header of each block in a segment file, in host byte order and followed
+   by (nbits+7)/8 bytes of encoded samples */
+struct tsdb_block
+{
+   uint32_t code[5];     /* OBIS code */
+   uint32_t count;       /* number of samples */
+   uint32_t resolution;  /* 0 for raw samples, else seconds per sample */
+   uint32_t nbits;
+   int64_t first_time;   /* seconds since 1970 */
+   int64_t first_value;  /* obis float*MeterMultiplier */
+};
+
+/* samples of one row being collected into a block */
+struct tsdb_series
+{
+   struct tsdb_block block;
+   uint8_t *data;
+   size_t size;          /* bytes allocated for data */
+   int64_t prev_time;
+   int64_t prev_time_delta;
+   int64_t prev_value;
+   int64_t prev_value_delta;
+   int64_t last_time;    /* time of last sample appended, also flushed */
+   time_t opened;        /* when the block got its first sample */
+};
+
+struct tsdb_meter
+{
+   unsigned int num_series;
+   struct tsdb_series *series;
+};
+
+struct tsdb
+{
+   char dir[256];
+   int flush;            /* seconds before a block is written */
+   int retention;        /* days to keep */
+   int downsample;       /* days before samples are downsampled */
+   int resolution;       /* seconds per downsampled sample */
+   unsigned int num_meters;
+   struct tsdb_meter *meters;
+   time_t last_maintenance;
+   pthread_t maintainer; /* rewrites old days, which may take long */
+   int maintaining;      /* the maintainer has been started */
+   int maintained;       /* set by the maintainer when done */
+   time_t maintenance_time; /* of the maintenance being done */
+};
+
+/* Sets up history from the "history" object of the config, returns 0 on
+   success */
+int tsdb_init(struct tsdb *t, struct json_object *conf,
+	      unsigned int num_meters);
+
+/* Appends the latest value of row o of meter, or the raw samples of the
+   row not yet stored if the driver keeps them */
+void tsdb_append(struct tsdb *t, unsigned int meter, unsigned int row,
+		 const struct obis_data *o, time_t now);
+
+/* Writes blocks which are full or old enough and once an hour starts a
+   thread rewriting old days and removing days no longer to be kept */
+void tsdb_sync(struct tsdb *t, time_t now);
+
+/* Writes all blocks and frees everything, after waiting for any
+   rewriting of old days to finish */
+void tsdb_close(struct tsdb *t);
+
+/* Prints all samples of a segment file to out, returns 0 on success */
+int tsdb_dump(const char *path, FILE *out);
+
+#endif
@@ -0,0 +1,76 @@
+/**************************************************************
+This file defines a pool of worker threads running numbered jobs, such
+as the update of each meter, in parallel. Jobs are queued without waiting
+for them, and an eventfd becomes readable when jobs are done, so the
+thread queuing them can go on serving requests meanwhile.
+
+SPDX-License-Identifier: BSD-2-Clause
+
+Copyright (c) 2026, Henrik Carlqvist
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **************************************************************/
+
+#ifndef WORKERS_H
+#define WORKERS_H
+
+#include <pthread.h>
+
+typedef void (*worker_job)(unsigned int job, void *arg);
+
+struct workers
+{
+   unsigned int num_threads;
+   pthread_t *threads;
+   pthread_mutex_t lock;
+   pthread_cond_t start;     /* jobs are waiting in the queue */
+   worker_job job;
+   void *arg;
+   unsigned int max_jobs;
+   unsigned int *queue;      /* jobs waiting, a ring of max_jobs */
+   unsigned int first;       /* the next job for an idle thread to take */
+   unsigned int num_queued;
+   unsigned int *done;       /* jobs done but not yet collected */
+   unsigned int num_done;
+   int fd;                   /* eventfd signalled when a job is done */
+   int stop;
+};
+
+/* Starts num_threads threads running job(number, arg), with 0 as many as
+   there are cores, but no more than needed to run max_jobs at once. If no
+   thread could be started queued jobs are run at once by workers_queue.
+   Returns the number of threads started or -1 on failure. */
+int workers_init(struct workers *w, unsigned int num_threads,
+		 unsigned int max_jobs, worker_job job, void *arg);
+
+/* Queues job, a number below max_jobs. A job must not be queued again
+   until it has been collected by workers_done. */
+void workers_queue(struct workers *w, unsigned int job);
+
+/* Fills in jobs with the jobs done since the last call, at most max_jobs,
+   and returns how many they are. Call when w->fd is readable. */
+unsigned int workers_done(struct workers *w, unsigned int *jobs);
+
+/* Waits for jobs being run to be done, jobs still queued are dropped */
+void workers_close(struct workers *w);
+
+#endif
@@ -0,0 +1,76 @@
+/**************************************************************
+This file measures the telegram parser of the DSMR driver, see
+microbench.h.
+
+SPDX-License-Identifier: BSD-2-Clause
+
+Copyright (c) 2026, Henrik Carlqvist
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **************************************************************/
+#include "../plugin_src/DSMR.c"
+#include "microbench.h"
+
+static struct MeterTable_entry entry;
+static struct instance *inst;
+
+/* received bytes parsed, and telegrams passing their CRC check
+   published */
+static size_t bench_parse_chunk(struct microbench *mb, unsigned long n)
+{
+   const struct mb_payload *p = mb_payload(mb, n);
+
+   parse_chunk(inst, p->data, p->len);
+   return p->len;
+} /* bench_parse_chunk */
+
+/* presenting what has been published, as done by the agent */
+static size_t bench_update(struct microbench *mb, unsigned long n)
+{
+   update_driver_data(inst, &entry);
+   return 0;
+} /* bench_update */
+
+int main(int argc, char **argv)
+{
+   struct microbench mb;
+   char parameters[512];
+
+   if(mb_init(&mb, "DSMR", argc, argv, "microbench/payloads/DSMR.txt"))
+      return 1;
+   snprintf(parameters, sizeof(parameters), "replay=%s,replayspeed=max,%s",
+	    mb.capture, mb.parameters);
+   inst = init_driver(&entry, parameters);
+   if(!inst)
+      return 1;
+   /* the reader thread would parse at the same time */
+   inst->running = 0;
+   pthread_join(inst->thread, NULL);
+   mb_run(&mb, "parse_chunk", bench_parse_chunk);
+   mb_run(&mb, "update_driver_data", bench_update);
+   /* a telegram failing its CRC check is parsed but never published */
+   if(inst->crc_errors)
+      fprintf(stderr, "DSMR: %lu of %lu telegrams failed their CRC check\n",
+	      inst->crc_errors, inst->crc_errors + inst->telegrams);
+   /* not removed as remove_driver would wait for the stopped reader */
+   return mb_done(&mb);
+} /* main */
@@ -0,0 +1,81 @@
+/**************************************************************
+This file measures the functions of the HTTPJSON driver which handle
+a reply, see microbench.h.
+
+SPDX-License-Identifier: BSD-2-Clause
+
+Copyright (c) 2026, Henrik Carlqvist
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **************************************************************/
+#include "../plugin_src/HTTPJSON.c"
+#include "microbench.h"
+
+/* fields of microbench/payloads/HTTPJSON.json */
+#define DEFAULT_FIELDS "\"type\": \"info.meter\", \"mac\": \"info.mac\", " \
+   "\"rssi\": \"info.rssi\", \"fields\": [" \
+   "{\"path\": \"d.1_7_0.v\", \"obis\": \"1-0:1.7.0\"}, " \
+   "{\"path\": \"d.1_8_0.v\", \"obis\": \"1-0:1.8.0\"}, " \
+   "{\"path\": \"d.2_7_0.v\", \"obis\": \"1-0:2.7.0\"}, " \
+   "{\"path\": \"d.32_7_0.v\", \"obis\": \"1-0:32.7.0\"}, " \
+   "{\"path\": \"d.52_7_0.v\", \"obis\": \"1-0:52.7.0\"}, " \
+   "{\"path\": \"d.72_7_0.v\", \"obis\": \"1-0:72.7.0\"}, " \
+   "{\"path\": \"d.phases.0.i\", \"obis\": \"1-0:31.7.0\"}, " \
+   "{\"path\": \"d.phases.1.i\", \"obis\": \"1-0:51.7.0\"}, " \
+   "{\"path\": \"d.phases.2.i\", \"obis\": \"1-0:71.7.0\"}]"
+
+static struct MeterTable_entry entry;
+static struct instance *inst;
+
+/* a whole reply as passed by curl, scanned and filtered */
+static size_t bench_perform(struct microbench *mb, unsigned long n)
+{
+   const struct mb_payload *p = mb_payload(mb, n);
+
+   inst->response_len = 0;
+   my_curl_callback(p->data, 1, p->len, inst);
+   fill_obis_data(inst);
+   return p->len;
+} /* bench_perform */
+
+int main(int argc, char **argv)
+{
+   struct microbench mb;
+   char parameters[2048];
+
+   if(mb_init(&mb, "HTTPJSON", argc, argv,
+	      "microbench/payloads/HTTPJSON.json"))
+      return 1;
+   /* parameters are given as the members of the object, without url */
+   snprintf(parameters, sizeof(parameters),
+	    "{\"url\": \"http://microbench\", \"replay\": \"%s\", "
+	    "\"replayspeed\": \"max\", %s}", mb.capture,
+	    *mb.parameters ? mb.parameters : DEFAULT_FIELDS);
+   inst = init_driver(&entry, parameters);
+   if(!inst)
+      return 1;
+   /* replies are handled in buffers kept between polls */
+   mb.no_allocs = 1;
+   mb_run(&mb, "fill_obis_data", bench_perform);
+   remove_driver(inst, &entry);
+   return mb_done(&mb);
+} /* main */
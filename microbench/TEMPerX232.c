@@ -0,0 +1,53 @@
+/**************************************************************
+This file measures the tokenizer of the TEMPerX232 driver, see
+microbench.h.
+
+SPDX-License-Identifier: BSD-2-Clause
+
+Copyright (c) 2026, Henrik Carlqvist
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **************************************************************/
+#include "../plugin_src/TEMPerX232.c"
+#include "microbench.h"
+
+static struct token tokens[MAX_TOKENS];
+
+/* one reply split into values */
+static size_t bench_tokenize(struct microbench *mb, unsigned long n)
+{
+   const struct mb_payload *p = mb_payload(mb, n);
+
+   tokenize(p->data, tokens, MAX_TOKENS);
+   return p->len;
+} /* bench_tokenize */
+
+int main(int argc, char **argv)
+{
+   struct microbench mb;
+
+   if(mb_init(&mb, "TEMPerX232", argc, argv,
+	      "microbench/payloads/TEMPerX232.txt"))
+      return 1;
+   mb_run(&mb, "tokenize", bench_tokenize);
+   return mb_done(&mb);
+} /* main */
@@ -0,0 +1,164 @@
+/**************************************************************
+This file measures the functions of the WiMBIB driver which handle a
+reply, see microbench.h.
+
+SPDX-License-Identifier: BSD-2-Clause
+
+Copyright (c) 2026, Henrik Carlqvist
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **************************************************************/
+#include "../plugin_src/WiMBIB.c"
+#include <json.h>
+#include "microbench.h"
+
+static struct MeterTable_entry entry;
+static struct instance *inst;
+static int64_t obis_count;
+static double values_sum; /* of values looked up, so that they are read */
+
+/* the members of "meter" read for the rows, the alarms are two rows of
+   two members each */
+static const char *row_key(const char *obis_string, int second)
+{
+   if(second > 1)
+      return NULL;
+   if(!strcmp(obis_string, "leak-alarm burst-alarm"))
+      return second ? "burst-alarm" : "leak-alarm";
+   if(!strcmp(obis_string, "dry-alarm reverse-alarm"))
+      return second ? "reverse-alarm" : "dry-alarm";
+   return second ? NULL : obis_string;
+} /* row_key */
+
+/* a whole reply as passed by curl, indexed, read and filtered */
+static size_t bench_callback(struct microbench *mb, unsigned long n)
+{
+   const struct mb_payload *p = mb_payload(mb, n);
+
+   inst->reply_len = 0;
+   my_curl_callback(p->data, 1, p->len, inst);
+   return p->len;
+} /* bench_callback */
+
+/* only the indexing of a reply */
+static size_t bench_parse(struct microbench *mb, unsigned long n)
+{
+   const struct mb_payload *p = mb_payload(mb, n);
+
+   meterjson_parse(&(inst->json), p->data, p->len);
+   return p->len;
+} /* bench_parse */
+
+/* the reply indexed and what the driver reads from it looked up, to
+   compare with json-c doing the same */
+static size_t bench_meterjson(struct microbench *mb, unsigned long n)
+{
+   const struct mb_payload *p = mb_payload(mb, n);
+   struct meterjson *json = &(inst->json);
+   const char *key;
+   long info, d;
+   char s[256];
+   int r, k;
+
+   if(meterjson_parse(json, p->data, p->len))
+      return p->len;
+   info = meterjson_get(json, 0, "info");
+   meterjson_string(json, meterjson_get(json, info, "meter_model"), s,
+		    sizeof(s));
+   meterjson_string(json, meterjson_get(json, info, "meter_id"), s,
+		    sizeof(s));
+   meterjson_string(json, meterjson_get(json, info, "mac"), s, sizeof(s));
+   meterjson_int64(json, meterjson_get(json, info, "rssi"));
+   meterjson_int64(json, meterjson_get(json, info, "crc_ok_cnt"));
+   d = meterjson_get(json, 0, "meter");
+   for(r=0; r<entry.numObisEntries; r++)
+      for(k=0; (key = row_key(entry.ObisEntries[r].obis_string, k)); k++)
+	 values_sum += meterjson_double(json, meterjson_get(json, d, key));
+   return p->len;
+} /* bench_meterjson */
+
+/* the same with json-c, as the driver did before it used meterjson */
+static size_t bench_json_c(struct microbench *mb, unsigned long n)
+{
+   const struct mb_payload *p = mb_payload(mb, n);
+   struct json_object *meter, *info, *d;
+   const char *key;
+   char s[256];
+   int r, k;
+
+   meter = json_tokener_parse(p->data);
+   if(!meter)
+      return p->len;
+   info = json_object_object_get(meter, "info");
+   snprintf(s, sizeof(s), "%s", json_object_get_string(
+	       json_object_object_get(info, "meter_model")));
+   snprintf(s, sizeof(s), "%s", json_object_get_string(
+	       json_object_object_get(info, "meter_id")));
+   snprintf(s, sizeof(s), "%s",
+	    json_object_get_string(json_object_object_get(info, "mac")));
+   json_object_get_int(json_object_object_get(info, "rssi"));
+   json_object_get_int64(json_object_object_get(info, "crc_ok_cnt"));
+   d = json_object_object_get(meter, "meter");
+   for(r=0; r<entry.numObisEntries; r++)
+      for(k=0; (key = row_key(entry.ObisEntries[r].obis_string, k)); k++)
+	 values_sum +=
+	    json_object_get_double(json_object_object_get(d, key));
+   json_object_put(meter);
+   return p->len;
+} /* bench_json_c */
+
+/* the values of the indexed reply read and filtered, every call as if
+   the meter had taken 6 new samples */
+static size_t bench_fill(struct microbench *mb, unsigned long n)
+{
+   obis_count += 6;
+   fill_obis_data(obis_count, inst);
+   return 0;
+} /* bench_fill */
+
+int main(int argc, char **argv)
+{
+   struct microbench mb;
+   char parameters[512];
+
+   if(mb_init(&mb, "WiMBIB", argc, argv, "microbench/payloads/WiMBIB.json"))
+      return 1;
+   /* all rows unless told otherwise */
+   snprintf(parameters, sizeof(parameters),
+	    "replay=%s,replayspeed=max,%s", mb.capture,
+	    *mb.parameters ? mb.parameters : "showextra=1");
+   inst = init_driver(&entry, parameters);
+   if(!inst)
+      return 1;
+   /* replies are handled in buffers kept between polls */
+   mb.no_allocs = 1;
+   mb_run(&mb, "my_curl_callback", bench_callback);
+   mb_run(&mb, "meterjson_parse", bench_parse);
+   obis_count = inst->last_obis_filter_update;
+   mb_run(&mb, "fill_obis_data", bench_fill);
+   mb_run(&mb, "meterjson lookup", bench_meterjson);
+   /* the baseline, json-c allocates every object of a reply */
+   mb.no_allocs = 0;
+   mb_run(&mb, "json-c lookup", bench_json_c);
+   remove_driver(inst, &entry);
+   return mb_done(&mb);
+} /* main */
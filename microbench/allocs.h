@@ -0,0 +1,142 @@
+/**************************************************************
+This file counts the heap allocations of a microbenchmark or a check by
+replacing malloc and the other allocation functions of the C library,
+so that the allocations made while a driver handles a reply can be
+compared before and after. It may only be included once in a program.
+
+SPDX-License-Identifier: BSD-2-Clause
+
+Copyright (c) 2026, Henrik Carlqvist
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **************************************************************/
+
+#ifndef ALLOCS_H
+#define ALLOCS_H
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <errno.h>
+
+/* counted by any thread, like a reader thread of a driver */
+static unsigned long mb_allocs;
+
+#ifdef __GLIBC__
+/* Every allocation of the process is counted, also those made by
+   libraries and by glibc itself, such as stdio buffers, since glibc
+   calls these functions when they are replaced. Since this header is
+   only included once by a program, these may replace the functions of the
+   C library. Not counted are allocations made by the dynamic loader
+   while loading libraries, memory mapped directly with mmap, like the
+   stacks of threads, and what libraries hand out of pools of their own
+   without growing them. */
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void *__libc_memalign(size_t alignment, size_t size);
+extern void *__libc_valloc(size_t size);
+extern void *__libc_pvalloc(size_t size);
+
+static inline void mb_count_alloc(void)
+{
+   __atomic_add_fetch(&mb_allocs, 1, __ATOMIC_RELAXED);
+} /* mb_count_alloc */
+
+void *malloc(size_t size)
+{
+   mb_count_alloc();
+   return __libc_malloc(size);
+} /* malloc */
+
+void *calloc(size_t nmemb, size_t size)
+{
+   mb_count_alloc();
+   return __libc_calloc(nmemb, size);
+} /* calloc */
+
+void *realloc(void *ptr, size_t size)
+{
+   mb_count_alloc();
+   return __libc_realloc(ptr, size);
+} /* realloc */
+
+void *reallocarray(void *ptr, size_t nmemb, size_t size)
+{
+   mb_count_alloc();
+   if(size && (nmemb > SIZE_MAX / size))
+   {
+      errno = ENOMEM;
+      return NULL;
+   }
+   return __libc_realloc(ptr, nmemb * size);
+} /* reallocarray */
+
+void *memalign(size_t alignment, size_t size)
+{
+   mb_count_alloc();
+   return __libc_memalign(alignment, size);
+} /* memalign */
+
+void *aligned_alloc(size_t alignment, size_t size)
+{
+   mb_count_alloc();
+   return __libc_memalign(alignment, size);
+} /* aligned_alloc */
+
+int posix_memalign(void **ptr, size_t alignment, size_t size)
+{
+   void *p;
+
+   if((alignment % sizeof(void *)) || (alignment & (alignment - 1)) ||
+      (!alignment))
+      return EINVAL;
+   mb_count_alloc();
+   p = __libc_memalign(alignment, size);
+   if(!p)
+      return ENOMEM;
+   *ptr = p;
+   return 0;
+} /* posix_memalign */
+
+void *valloc(size_t size)
+{
+   mb_count_alloc();
+   return __libc_valloc(size);
+} /* valloc */
+
+void *pvalloc(size_t size)
+{
+   mb_count_alloc();
+   return __libc_pvalloc(size);
+} /* pvalloc */
+#define MB_COUNTS_ALLOCS 1
+#else
+#define MB_COUNTS_ALLOCS 0
+#endif
+
+/* The allocations made so far by the whole process */
+static inline unsigned long mb_allocs_made(void)
+{
+   return __atomic_load_n(&mb_allocs, __ATOMIC_RELAXED);
+} /* mb_allocs_made */
+
+#endif
@@ -0,0 +1,317 @@
+/**************************************************************
+This file contains the harness shared by the microbenchmarks of the
+drivers. Each benchmark includes the source of a driver, so that its
+static functions can be called without a meter, and feeds payloads
+through them in a tight loop. The payloads are the transfers of a
+capture file recorded with the record parameter of a driver, or the
+contents of any other file as one single payload.
+
+Every function is run in a number of repetitions long enough to be
+timed accurately. The median time of a call is printed together with
+the median deviation of the repetitions, the heap allocations made
+per call and the payload bytes handled per second. A benchmark of
+functions which should not allocate anything once warmed up sets
+no_allocs, and then fails if they do.
+
+SPDX-License-Identifier: BSD-2-Clause
+
+Copyright (c) 2026, Henrik Carlqvist
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **************************************************************/
+
+#ifndef MICROBENCH_H
+#define MICROBENCH_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include "capture.h"
+#include "allocs.h"
+
+#define MB_REPS 15 /* repetitions of each function */
+#define MB_REP_NS 20000000 /* shortest time of a repetition */
+
+struct mb_payload
+{
+   char *data; /* followed by a NUL not counted in len */
+   size_t len;
+};
+
+struct microbench
+{
+   const char *driver;
+   unsigned int num_payloads;
+   struct mb_payload *payloads;
+   char capture[64]; /* the payloads as a capture for drivers to replay */
+   const char *parameters; /* extra driver parameters, never NULL */
+   int no_allocs; /* fail if a function allocates after warming up */
+   int failed;
+};
+
+/* Runs the function measured once for call number n, returns the number
+   of payload bytes handled */
+typedef size_t (*mb_func)(struct microbench *mb, unsigned long n);
+
+static inline uint64_t mb_now_ns(void)
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return (uint64_t)ts.tv_sec*1000000000 + ts.tv_nsec;
+} /* mb_now_ns */
+
+static int mb_add_payload(struct microbench *mb, const char *data, size_t len)
+{
+   struct mb_payload *p;
+
+   if(!(mb->num_payloads % 16))
+   {
+      p = realloc(mb->payloads,
+		  (mb->num_payloads + 16)*sizeof(struct mb_payload));
+      if(!p)
+	 return -1;
+      mb->payloads = p;
+   }
+   p = &(mb->payloads[mb->num_payloads]);
+   p->data = malloc(len + 1);
+   if(!p->data)
+      return -1;
+   memcpy(p->data, data, len);
+   p->data[len] = 0;
+   p->len = len;
+   mb->num_payloads++;
+   return 0;
+} /* mb_add_payload */
+
+/* Reads every transfer of a capture file as a payload, returns 0 on
+   success */
+static int mb_load_capture(struct microbench *mb, struct capture *c)
+{
+   char chunk[65536];
+   char *data = NULL;
+   char *p;
+   size_t len, size = 0;
+   long n = 0;
+
+   while((n >= 0) && capture_next_transfer(c))
+   {
+      len = 0;
+      while((n = capture_read(c, chunk, sizeof(chunk))) > 0)
+      {
+	 if(len + n > size)
+	 {
+	    size = 2*(len + n);
+	    p = realloc(data, size);
+	    if(!p)
+	    {
+	       free(data);
+	       return -1;
+	    }
+	    data = p;
+	 }
+	 memcpy(data + len, chunk, n);
+	 len += n;
+      }
+      if(len && mb_add_payload(mb, data, len))
+      {
+	 free(data);
+	 return -1;
+      }
+   }
+   free(data);
+   return 0;
+} /* mb_load_capture */
+
+/* Reads a whole file as one payload, returns 0 on success */
+static int mb_load_file(struct microbench *mb, const char *path)
+{
+   FILE *f = fopen(path, "rb");
+   char *data;
+   long len;
+   int r = -1;
+
+   if(!f)
+      return -1;
+   if((!fseek(f, 0, SEEK_END)) && ((len = ftell(f)) > 0) &&
+      (!fseek(f, 0, SEEK_SET)) && (data = malloc(len)))
+   {
+      if(fread(data, 1, len, f) == (size_t)len)
+	 r = mb_add_payload(mb, data, len);
+      free(data);
+   }
+   fclose(f);
+   return r;
+} /* mb_load_file */
+
+/* Writes the payloads to a temporary capture, so that a driver given
+   "replay=" can be set up without a meter. Returns 0 on success */
+static int mb_write_capture(struct microbench *mb)
+{
+   struct capture *c;
+   unsigned int i;
+   int fd;
+
+   strcpy(mb->capture, "/tmp/microbench-XXXXXX");
+   fd = mkstemp(mb->capture);
+   if(fd < 0)
+      return -1;
+   close(fd);
+   c = capture_open_record(mb->capture);
+   if(!c)
+      return -1;
+   for(i=0; i<mb->num_payloads; i++)
+   {
+      capture_write(c, mb->payloads[i].data, mb->payloads[i].len);
+      capture_end(c);
+   }
+   capture_close(c);
+   return 0;
+} /* mb_write_capture */
+
+/* Sets up mb from the command line "[payloads [parameters]]", where
+   payloads is a capture file or a file with one payload, by default
+   default_path. Returns 0 on success */
+static int mb_init(struct microbench *mb, const char *driver, int argc,
+		   char **argv, const char *default_path)
+{
+   const char *path = (argc > 1) ? argv[1] : default_path;
+   struct capture *c;
+   int r;
+
+   memset(mb, 0, sizeof(struct microbench));
+   mb->driver = driver;
+   mb->parameters = (argc > 2) ? argv[2] : "";
+   c = capture_open_replay(path, 0);
+   if(c)
+   {
+      r = mb_load_capture(mb, c);
+      capture_close(c);
+   }
+   else
+      r = mb_load_file(mb, path);
+   if(r || (!mb->num_payloads))
+   {
+      fprintf(stderr, "%s: no payloads in %s\n", driver, path);
+      return -1;
+   }
+   if(mb_write_capture(mb))
+   {
+      fprintf(stderr, "%s: failed writing a capture to replay\n", driver);
+      return -1;
+   }
+   return 0;
+} /* mb_init */
+
+/* The payload of call number n, every payload is used in turn */
+static inline const struct mb_payload *mb_payload(const struct microbench *mb,
+						  unsigned long n)
+{
+   return &(mb->payloads[n % mb->num_payloads]);
+} /* mb_payload */
+
+static int mb_compare(const void *a, const void *b)
+{
+   double x = *(const double *)a;
+   double y = *(const double *)b;
+
+   return (x > y) - (x < y);
+} /* mb_compare */
+
+/* Runs func until a repetition takes long enough, then MB_REPS
+   repetitions of the same number of calls, and prints the result */
+static void mb_run(struct microbench *mb, const char *name, mb_func func)
+{
+   double ns[MB_REPS];
+   double deviation[MB_REPS];
+   double median, bytes = 0;
+   uint64_t start, elapsed, total = 0;
+   unsigned long calls = 1;
+   unsigned long n = 0;
+   unsigned long i, allocs;
+   int r;
+
+   /* this also warms up caches and anything the driver sets up once */
+   for(;;)
+   {
+      start = mb_now_ns();
+      for(i=0; i<calls; i++)
+	 func(mb, n++);
+      elapsed = mb_now_ns() - start;
+      if(elapsed >= MB_REP_NS)
+	 break;
+      calls *= 2;
+   }
+   allocs = mb_allocs_made();
+   for(r=0; r<MB_REPS; r++)
+   {
+      start = mb_now_ns();
+      for(i=0; i<calls; i++)
+	 bytes += func(mb, n++);
+      elapsed = mb_now_ns() - start;
+      total += elapsed;
+      ns[r] = (double)elapsed / calls;
+   }
+   allocs = mb_allocs_made() - allocs;
+   qsort(ns, MB_REPS, sizeof(double), mb_compare);
+   median = ns[MB_REPS/2];
+   for(r=0; r<MB_REPS; r++)
+      deviation[r] = (ns[r] > median) ? ns[r] - median : median - ns[r];
+   qsort(deviation, MB_REPS, sizeof(double), mb_compare);
+   printf("%-10s %-20s %10.1f ns/op +-%4.1f%%", mb->driver, name, median,
+	  100*deviation[MB_REPS/2]/median);
+   if(MB_COUNTS_ALLOCS)
+      printf(" %8.2f allocs/op", (double)allocs/(MB_REPS*calls));
+   else
+      printf("        - allocs/op");
+   if(bytes)
+      printf(" %9.1f MB/s\n", bytes*1000/total);
+   else
+      printf("         - MB/s\n");
+   fflush(stdout);
+   if(mb->no_allocs && allocs)
+   {
+      fprintf(stderr, "%s: %s made %lu allocations in %lu calls, "
+	      "expected none\n", mb->driver, name, allocs, MB_REPS*calls);
+      mb->failed = 1;
+   }
+} /* mb_run */
+
+/* Returns what main should return */
+static int mb_done(struct microbench *mb)
+{
+   unsigned int i;
+
+   unlink(mb->capture);
+   for(i=0; i<mb->num_payloads; i++)
+      free(mb->payloads[i].data);
+   free(mb->payloads);
+   mb->payloads = NULL;
+   mb->num_payloads = 0;
+   return mb->failed;
+} /* mb_done */
+
+#endif
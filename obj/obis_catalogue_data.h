@@ -0,0 +1,97 @@
+/* made by Makefile from obis_catalogue.txt */
+static const struct obis_catalogue_entry obis_catalogue[] = {
+   {{0,0,17,0,0}, "0-0:17.0.0", OBIS_GAUGE, 3, "kW", "Actual threshold electricity"},
+   {{0,0,96,3,10}, "0-0:96.3.10", OBIS_STATE, 0, "", "Breaker state"},
+   {{0,0,96,7,9}, "0-0:96.7.9", OBIS_COUNTER, 0, "", "Number of long power failures in any phase"},
+   {{0,0,96,7,21}, "0-0:96.7.21", OBIS_COUNTER, 0, "", "Number of power failures in any phase"},
+   {{0,0,96,14,0}, "0-0:96.14.0", OBIS_STATE, 0, "", "Tariff indicator"},
+   {{0,1,24,2,1}, "0-1:24.2.1", OBIS_COUNTER, 3, "m3", "Gas delivered to client"},
+   {{0,2,24,2,1}, "0-2:24.2.1", OBIS_COUNTER, 3, "m3", "Gas or water delivered, M-Bus channel 2"},
+   {{0,3,24,2,1}, "0-3:24.2.1", OBIS_COUNTER, 3, "m3", "Gas or water delivered, M-Bus channel 3"},
+   {{0,4,24,2,1}, "0-4:24.2.1", OBIS_COUNTER, 3, "m3", "Gas or water delivered, M-Bus channel 4"},
+   {{1,0,1,7,0}, "1-0:1.7.0", OBIS_GAUGE, 3, "kW", "Instantaneous power (A+) consumed from grid"},
+   {{1,0,1,8,0}, "1-0:1.8.0", OBIS_COUNTER, 3, "kWh", "Total active energy consumed from grid"},
+   {{1,0,1,8,1}, "1-0:1.8.1", OBIS_COUNTER, 3, "kWh", "Active energy consumed from grid tariff 1"},
+   {{1,0,1,8,2}, "1-0:1.8.2", OBIS_COUNTER, 3, "kWh", "Active energy consumed from grid tariff 2"},
+   {{1,0,2,7,0}, "1-0:2.7.0", OBIS_GAUGE, 3, "kW", "Instantaneous power (A-) exported to grid"},
+   {{1,0,2,8,0}, "1-0:2.8.0", OBIS_COUNTER, 3, "kWh", "Total active energy exported to grid"},
+   {{1,0,2,8,1}, "1-0:2.8.1", OBIS_COUNTER, 3, "kWh", "Active energy exported to grid tariff 1"},
+   {{1,0,2,8,2}, "1-0:2.8.2", OBIS_COUNTER, 3, "kWh", "Active energy exported to grid tariff 2"},
+   {{1,0,3,7,0}, "1-0:3.7.0", OBIS_GAUGE, 3, "kvar", "Positive reactive instantaneous power (Q+)"},
+   {{1,0,3,8,0}, "1-0:3.8.0", OBIS_COUNTER, 3, "kvarh", "Positive reactive energy (Q+) total"},
+   {{1,0,4,7,0}, "1-0:4.7.0", OBIS_GAUGE, 3, "kvar", "Negative reactive instantaneous power (Q-)"},
+   {{1,0,4,8,0}, "1-0:4.8.0", OBIS_COUNTER, 3, "kvarh", "Negative reactive energy (Q-) total"},
+   {{1,0,9,7,0}, "1-0:9.7.0", OBIS_GAUGE, 3, "kVA", "Apparent instantaneous power (S+)"},
+   {{1,0,9,8,0}, "1-0:9.8.0", OBIS_COUNTER, 3, "kVAh", "Apparent energy (S+) total"},
+   {{1,0,10,7,0}, "1-0:10.7.0", OBIS_GAUGE, 3, "kVA", "Apparent instantaneous power (S-)"},
+   {{1,0,11,7,0}, "1-0:11.7.0", OBIS_GAUGE, 1, "A", "Instantaneous current (I) in any phase"},
+   {{1,0,12,7,0}, "1-0:12.7.0", OBIS_GAUGE, 1, "V", "Instantaneous voltage (U) in any phase"},
+   {{1,0,13,7,0}, "1-0:13.7.0", OBIS_GAUGE, 3, "", "Instantaneous power factor"},
+   {{1,0,14,7,0}, "1-0:14.7.0", OBIS_GAUGE, 2, "Hz", "Supply frequency"},
+   {{1,0,15,7,0}, "1-0:15.7.0", OBIS_GAUGE, 3, "kW", "Instantaneous absolute active power (|A+|+|A-|)"},
+   {{1,0,15,8,0}, "1-0:15.8.0", OBIS_COUNTER, 3, "kWh", "Total absolute active energy (|A+|+|A-|)"},
+   {{1,0,16,7,0}, "1-0:16.7.0", OBIS_GAUGE, 3, "kW", "Instantaneous net active power (A+ - A-)"},
+   {{1,0,16,8,0}, "1-0:16.8.0", OBIS_COUNTER, 3, "kWh", "Total net active energy (A+ - A-)"},
+   {{1,0,21,7,0}, "1-0:21.7.0", OBIS_GAUGE, 3, "kW", "Instantaneous power (A+) consumed from phase L1"},
+   {{1,0,21,8,0}, "1-0:21.8.0", OBIS_COUNTER, 3, "kWh", "Total active energy (A+) consumed phase L1"},
+   {{1,0,22,7,0}, "1-0:22.7.0", OBIS_GAUGE, 3, "kW", "Negative active instantaneous power (A-) phase L1"},
+   {{1,0,22,8,0}, "1-0:22.8.0", OBIS_COUNTER, 3, "kWh", "Total active energy (A-) exported phase L1"},
+   {{1,0,23,7,0}, "1-0:23.7.0", OBIS_GAUGE, 3, "kvar", "Positive reactive instantaneous power (Q+) phase L1"},
+   {{1,0,23,8,0}, "1-0:23.8.0", OBIS_COUNTER, 3, "kvarh", "Positive reactive energy (Q+) total phase L1"},
+   {{1,0,24,7,0}, "1-0:24.7.0", OBIS_GAUGE, 3, "kvar", "Negative reactive instantaneous power (Q-) phase L1"},
+   {{1,0,24,8,0}, "1-0:24.8.0", OBIS_COUNTER, 3, "kvarh", "Negative reactive energy (Q-) total phase L1"},
+   {{1,0,29,7,0}, "1-0:29.7.0", OBIS_GAUGE, 3, "kVA", "Apparent instantaneous power (S+) phase L1"},
+   {{1,0,29,8,0}, "1-0:29.8.0", OBIS_COUNTER, 3, "kVAh", "Apparent energy (S+) total phase L1"},
+   {{1,0,30,7,0}, "1-0:30.7.0", OBIS_GAUGE, 3, "kVA", "Apparent instantaneous power (S-) phase L1"},
+   {{1,0,31,7,0}, "1-0:31.7.0", OBIS_GAUGE, 1, "A", "Instantaneous current (I) in phase L1"},
+   {{1,0,32,7,0}, "1-0:32.7.0", OBIS_GAUGE, 1, "V", "Instantaneous voltage (U) in phase L1"},
+   {{1,0,32,32,0}, "1-0:32.32.0", OBIS_COUNTER, 0, "", "Number of voltage sags phase L1"},
+   {{1,0,32,36,0}, "1-0:32.36.0", OBIS_COUNTER, 0, "", "Number of voltage swells phase L1"},
+   {{1,0,33,7,0}, "1-0:33.7.0", OBIS_GAUGE, 3, "", "Instantaneous power factor phase L1"},
+   {{1,0,41,7,0}, "1-0:41.7.0", OBIS_GAUGE, 3, "kW", "Instantaneous power (A+) consumed from phase L2"},
+   {{1,0,41,8,0}, "1-0:41.8.0", OBIS_COUNTER, 3, "kWh", "Total active energy (A+) consumed phase L2"},
+   {{1,0,42,7,0}, "1-0:42.7.0", OBIS_GAUGE, 3, "kW", "Negative active instantaneous power (A-) phase L2"},
+   {{1,0,42,8,0}, "1-0:42.8.0", OBIS_COUNTER, 3, "kWh", "Total active energy (A-) exported phase L2"},
+   {{1,0,43,7,0}, "1-0:43.7.0", OBIS_GAUGE, 3, "kvar", "Positive reactive instantaneous power (Q+) phase L2"},
+   {{1,0,43,8,0}, "1-0:43.8.0", OBIS_COUNTER, 3, "kvarh", "Positive reactive energy (Q+) total phase L2"},
+   {{1,0,44,7,0}, "1-0:44.7.0", OBIS_GAUGE, 3, "kvar", "Negative reactive instantaneous power (Q-) phase L2"},
+   {{1,0,44,8,0}, "1-0:44.8.0", OBIS_COUNTER, 3, "kvarh", "Negative reactive energy (Q-) total phase L2"},
+   {{1,0,49,7,0}, "1-0:49.7.0", OBIS_GAUGE, 3, "kVA", "Apparent instantaneous power (S+) phase L2"},
+   {{1,0,49,8,0}, "1-0:49.8.0", OBIS_COUNTER, 3, "kVAh", "Apparent energy (S+) total phase L2"},
+   {{1,0,50,7,0}, "1-0:50.7.0", OBIS_GAUGE, 3, "kVA", "Apparent instantaneous power (S-) phase L2"},
+   {{1,0,51,7,0}, "1-0:51.7.0", OBIS_GAUGE, 1, "A", "Instantaneous current (I) in phase L2"},
+   {{1,0,52,7,0}, "1-0:52.7.0", OBIS_GAUGE, 1, "V", "Instantaneous voltage (U) in phase L2"},
+   {{1,0,52,32,0}, "1-0:52.32.0", OBIS_COUNTER, 0, "", "Number of voltage sags phase L2"},
+   {{1,0,52,36,0}, "1-0:52.36.0", OBIS_COUNTER, 0, "", "Number of voltage swells phase L2"},
+   {{1,0,53,7,0}, "1-0:53.7.0", OBIS_GAUGE, 3, "", "Instantaneous power factor phase L2"},
+   {{1,0,61,7,0}, "1-0:61.7.0", OBIS_GAUGE, 3, "kW", "Instantaneous power (A+) consumed from phase L3"},
+   {{1,0,61,8,0}, "1-0:61.8.0", OBIS_COUNTER, 3, "kWh", "Total active energy (A+) consumed phase L3"},
+   {{1,0,62,7,0}, "1-0:62.7.0", OBIS_GAUGE, 3, "kW", "Negative active instantaneous power (A-) phase L3"},
+   {{1,0,62,8,0}, "1-0:62.8.0", OBIS_COUNTER, 3, "kWh", "Total active energy (A-) exported phase L3"},
+   {{1,0,63,7,0}, "1-0:63.7.0", OBIS_GAUGE, 3, "kvar", "Positive reactive instantaneous power (Q+) phase L3"},
+   {{1,0,63,8,0}, "1-0:63.8.0", OBIS_COUNTER, 3, "kvarh", "Positive reactive energy (Q+) total phase L3"},
+   {{1,0,64,7,0}, "1-0:64.7.0", OBIS_GAUGE, 3, "kvar", "Negative reactive instantaneous power (Q-) phase L3"},
+   {{1,0,64,8,0}, "1-0:64.8.0", OBIS_COUNTER, 3, "kvarh", "Negative reactive energy (Q-) total phase L3"},
+   {{1,0,69,7,0}, "1-0:69.7.0", OBIS_GAUGE, 3, "kVA", "Apparent instantaneous power (S+) phase L3"},
+   {{1,0,69,8,0}, "1-0:69.8.0", OBIS_COUNTER, 3, "kVAh", "Apparent energy (S+) total phase L3"},
+   {{1,0,70,7,0}, "1-0:70.7.0", OBIS_GAUGE, 3, "kVA", "Apparent instantaneous power (S-) phase L3"},
+   {{1,0,71,7,0}, "1-0:71.7.0", OBIS_GAUGE, 1, "A", "Instantaneous current (I) in phase L3"},
+   {{1,0,72,7,0}, "1-0:72.7.0", OBIS_GAUGE, 1, "V", "Instantaneous voltage (U) in phase L3"},
+   {{1,0,72,32,0}, "1-0:72.32.0", OBIS_COUNTER, 0, "", "Number of voltage sags phase L3"},
+   {{1,0,72,36,0}, "1-0:72.36.0", OBIS_COUNTER, 0, "", "Number of voltage swells phase L3"},
+   {{1,0,73,7,0}, "1-0:73.7.0", OBIS_GAUGE, 3, "", "Instantaneous power factor phase L3"},
+   {{1,0,91,7,0}, "1-0:91.7.0", OBIS_GAUGE, 1, "A", "Instantaneous current (I) in neutral"},
+   {{1,0,128,7,0}, "1-0:128.7.0", OBIS_GAUGE, 1, "%", "Current imbalance between phases (manufacturer specific)"},
+   {{1,0,129,7,0}, "1-0:129.7.0", OBIS_GAUGE, 1, "%", "Voltage imbalance between phases (manufacturer specific)"},
+   {{6,0,1,0,0}, "6-0:1.0.0", OBIS_COUNTER, 3, "GJ", "Heat energy, total"},
+   {{6,0,2,0,0}, "6-0:2.0.0", OBIS_GAUGE, 3, "m3", "Heat volume, total"},
+   {{6,0,8,0,0}, "6-0:8.0.0", OBIS_GAUGE, 3, "kW", "Heat power"},
+   {{6,0,9,0,0}, "6-0:9.0.0", OBIS_GAUGE, 3, "m3/h", "Heat flow rate"},
+   {{6,0,10,0,0}, "6-0:10.0.0", OBIS_GAUGE, 1, "C", "Heat flow temperature"},
+   {{6,0,11,0,0}, "6-0:11.0.0", OBIS_GAUGE, 1, "C", "Heat return temperature"},
+   {{7,0,3,0,0}, "7-0:3.0.0", OBIS_COUNTER, 3, "m3", "Gas volume, total"},
+   {{7,0,43,0,0}, "7-0:43.0.0", OBIS_GAUGE, 3, "m3/h", "Gas flow rate"},
+   {{8,0,1,0,0}, "8-0:1.0.0", OBIS_COUNTER, 3, "m3", "Volume (V), accumulated, total, current value"},
+   {{8,0,1,2,0}, "8-0:1.2.0", OBIS_COUNTER, 3, "m3", "Volume (V), accumulated, total, set date value"},
+   {{8,0,2,0,0}, "8-0:2.0.0", OBIS_GAUGE, 3, "m3/h", "Flow rate, average (Va/t), current value"},
+};
@@ -0,0 +1,639 @@
+/**************************************************************
+This is the dynamic driver plugin for electricity meters with a P1 or
+HAN port sending DSMR / IEC 62056-21 telegrams, read directly from a
+serial port without any bridge. A telegram looks like
+
+/ISK5\2M550T-1012
+
+1-0:1.8.0(00006678.394*kWh)
+1-0:1.7.0(00.193*kW)
+...
+!EF2F
+
+where the last line holds a CRC16 of everything from '/' to '!'.
+
+SPDX-License-Identifier: BSD-2-Clause
+
+Copyright (c) 2026, Henrik Carlqvist
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **************************************************************/
+#include <stdio.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/file.h>
+#include <termios.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <string.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <poll.h>
+#include <time.h>
+#include "driver.h"
+#include "capture.h"
+#include "quantile.h"
+#include "filtered.h"
+
+#define SERIAL_CHUNK 1024 /* bytes asked for by each read */
+#define MAX_LINE 1024 /* longer lines are ignored */
+#define POLL_MS 1000 /* how often the reader checks if it should stop */
+
+enum telegram_state
+{
+   WAIT_START, /* waiting for '/' */
+   LINES, /* inside telegram */
+   CHECKSUM /* after '!', collecting CRC */
+};
+
+/* values of one telegram are staged here until its CRC has been checked */
+struct staged
+{
+   double value;
+   int valid;
+};
+
+struct instance
+{
+   struct MeterTable_entry *entry;
+   int fd;
+   char device[255]; /* opened again if it goes away */
+   int baud;
+   int crc_optional; /* telegrams without CRC accepted, DSMR before 4 */
+   struct capture *record; /* where to save what is received, if anywhere */
+   struct capture *replay; /* read from here instead of the meter if set */
+   pthread_t thread;
+   int started; /* the reader is started by the first update */
+   int running; /* read and cleared atomically */
+   pthread_mutex_t mutex;
+   /* parser state, only used by reader thread */
+   enum telegram_state state;
+   unsigned short crc;
+   char crc_text[5];
+   int crc_len;
+   char line[MAX_LINE]; /* only used for lines split between reads */
+   int line_len;
+   char identification[255];
+   struct staged *staged;
+   /* published by reader thread, protected by mutex */
+   time_t minute;
+   double *latest;
+   int *latest_valid;
+   struct filtered *filter_data;
+   struct quantiles *quantile_data; /* NULL unless percentiles=1 */
+   char meter_type[255];
+   unsigned long telegrams;
+   unsigned long crc_errors;
+};
+
+/* the same rows as P1IB, descriptions and units come from the catalogue */
+static const struct obis_data driver_obis[] = {
+   {{1,0,1,7,0}, "1-0:1.7.0", NULL, 0, NULL, 0,
+    1, 0, 1, 0, 1, 0, 1, 0},
+   {{1,0,1,8,0}, "1-0:1.8.0", NULL, 0, NULL, 0,
+    1, 0, 0, 0, 0, 0, 0, 0},
+   {{1,0,2,7,0}, "1-0:2.7.0", NULL, 0, NULL, 0,
+    1, 0, 1, 0, 1, 0, 1, 0},
+   {{1,0,2,8,0}, "1-0:2.8.0", NULL, 0, NULL, 0,
+    1, 0, 0, 0, 0, 0, 0, 0},
+   {{1,0,3,7,0}, "1-0:3.7.0", NULL, 0, NULL, 0,
+    1, 0, 1, 0, 1, 0, 1, 0},
+   {{1,0,3,8,0}, "1-0:3.8.0", NULL, 0, NULL, 0,
+    1, 0, 0, 0, 0, 0, 0, 0},
+   {{1,0,4,7,0}, "1-0:4.7.0", NULL, 0, NULL, 0,
+    1, 0, 1, 0, 1, 0, 1, 0},
+   {{1,0,4,8,0}, "1-0:4.8.0", NULL, 0, NULL, 0,
+    1, 0, 0, 0, 0, 0, 0, 0},
+   {{1,0,21,7,0}, "1-0:21.7.0", NULL, 0, NULL, 0,
+    1, 0, 1, 0, 1, 0, 1, 0},
+   {{1,0,22,7,0}, "1-0:22.7.0", NULL, 0, NULL, 0,
+    1, 0, 1, 0, 1, 0, 1, 0},
+   {{1,0,31,7,0}, "1-0:31.7.0", NULL, 0, NULL, 0,
+    1, 0, 1, 0, 1, 0, 1, 0},
+   {{1,0,32,7,0}, "1-0:32.7.0", NULL, 0, NULL, 0,
+    1, 0, 1, 0, 1, 0, 1, 0},
+   {{1,0,41,7,0}, "1-0:41.7.0", NULL, 0, NULL, 0,
+    1, 0, 1, 0, 1, 0, 1, 0},
+   {{1,0,42,7,0}, "1-0:42.7.0", NULL, 0, NULL, 0,
+    1, 0, 1, 0, 1, 0, 1, 0},
+   {{1,0,51,7,0}, "1-0:51.7.0", NULL, 0, NULL, 0,
+    1, 0, 1, 0, 1, 0, 1, 0},
+   {{1,0,52,7,0}, "1-0:52.7.0", NULL, 0, NULL, 0,
+    1, 0, 1, 0, 1, 0, 1, 0},
+   {{1,0,61,7,0}, "1-0:61.7.0", NULL, 0, NULL, 0,
+    1, 0, 1, 0, 1, 0, 1, 0},
+   {{1,0,62,7,0}, "1-0:62.7.0", NULL, 0, NULL, 0,
+    1, 0, 1, 0, 1, 0, 1, 0},
+   {{1,0,71,7,0}, "1-0:71.7.0", NULL, 0, NULL, 0,
+    1, 0, 1, 0, 1, 0, 1, 0},
+   {{1,0,72,7,0}, "1-0:72.7.0", NULL, 0, NULL, 0,
+    1, 0, 1, 0, 1, 0, 1, 0},
+};
+#define NUM_ROWS (sizeof(driver_obis)/sizeof(struct obis_data))
+
+/* CRC16 as used by DSMR, polynomial 0x8005 reflected, start value 0 */
+static unsigned short crc16_update(unsigned short crc, unsigned char c)
+{
+   int i;
+
+   crc ^= c;
+   for(i=0; i<8; i++)
+      crc = (crc & 1) ? ((crc >> 1) ^ 0xa001) : (crc >> 1);
+   return crc;
+} /* crc16_update */
+
+static speed_t baud_rate(int baud)
+{
+   switch(baud)
+   {
+      case 9600:
+	 return B9600;
+      case 19200:
+	 return B19200;
+      case 38400:
+	 return B38400;
+      case 57600:
+	 return B57600;
+      default:
+	 return B115200;
+   }
+} /* baud_rate */
+
+/* returns file descriptor or < 0 at failure */
+static int init_serial(const char *port, int baud)
+{
+   struct termios t;
+   int fd = open(port, O_RDWR | O_NOCTTY);
+
+   if(fd < 0)
+      return fd;
+   if(flock(fd, LOCK_EX | LOCK_NB))
+   {
+      close(fd);
+      return -1;
+   }
+   if(tcgetattr(fd, &t))
+   {
+      close(fd);
+      return -1;
+   }
+   cfmakeraw(&t);
+   cfsetispeed(&t, baud_rate(baud));
+   cfsetospeed(&t, baud_rate(baud));
+   t.c_cflag |= CLOCAL | CREAD;
+   /* never block in read, waiting is done by poll in reader */
+   t.c_cc[VTIME]=0;
+   t.c_cc[VMIN]=0;
+   tcsetattr(fd, TCSANOW, &t);
+
+   return fd;
+} /* init_serial */
+
+/* Parses one line "A-B:C.D.E(value*unit)" of len characters, the line is
+   not zero terminated and not copied. Values for known rows are staged. */
+static void parse_line(struct instance *inst, const char *line, int len)
+{
+   oid code[5];
+   const char *p = line;
+   const char *end = line + len;
+   const char *value = NULL;
+   char number[32];
+   int i, n;
+
+   if((len > 1) && (line[0] == '/'))
+   {
+      n = (len < 254) ? len-1 : 253;
+      memcpy(inst->identification, line+1, n);
+      inst->identification[n] = 0;
+      return;
+   }
+   /* A-B:C.D.E, each part a decimal number */
+   for(i=0; i<5; i++)
+   {
+      if((p >= end) || (*p < '0') || (*p > '9'))
+	 return;
+      for(code[i]=0; (p < end) && (*p >= '0') && (*p <= '9'); p++)
+	 code[i] = 10*code[i] + (*p - '0');
+      if(i<4)
+      {
+	 if((p >= end) || (*p != "-:..("[i]))
+	    return;
+	 p++;
+      }
+   }
+   /* the value is in the last pair of parentheses, like the gas reading
+      in 0-1:24.2.1(101209112500W)(12785.123*m3) */
+   for(; p < end; p++)
+      if(*p == '(')
+	 value = p+1;
+   if(!value)
+      return;
+   for(n=0; (n < 31) && (value+n < end) && (value[n] != '*') &&
+	  (value[n] != ')'); n++)
+      number[n] = value[n];
+   number[n] = 0;
+   for(i=0; i<NUM_ROWS; i++)
+      if(!memcmp(code, driver_obis[i].obis_oid, sizeof(code)))
+      {
+	 inst->staged[i].value = atof(number);
+	 inst->staged[i].valid = 1;
+	 break;
+      }
+} /* parse_line */
+
+/* Publishes the values of a telegram that has passed its CRC check */
+static void commit_telegram(struct instance *inst)
+{
+   time_t now = time(NULL);
+   int new_minute;
+   int i;
+
+   pthread_mutex_lock(&(inst->mutex));
+   new_minute = ((now/60) != inst->minute);
+   inst->minute = now/60;
+   for(i=0; i<NUM_ROWS; i++)
+      if(inst->staged[i].valid)
+      {
+	 inst->latest[i] = inst->staged[i].value;
+	 inst->latest_valid[i] = 1;
+	 filtered_add(inst->staged[i].value, new_minute,
+		      &(inst->filter_data[i]));
+	 if(inst->quantile_data && driver_obis[i].mean6m_is_valid)
+	    quantiles_add(&(inst->quantile_data[i]), inst->staged[i].value,
+			  new_minute);
+      }
+   strcpy(inst->meter_type, inst->identification);
+   inst->telegrams++;
+   pthread_mutex_unlock(&(inst->mutex));
+} /* commit_telegram */
+
+/* Takes care of a line ending at end, which started either at start in buf
+   or earlier and then is saved in inst->line */
+static void end_line(struct instance *inst, const char *start,
+		     const char *end)
+{
+   int len = end - start;
+
+   if(inst->line_len)
+   {
+      if(inst->line_len + len < MAX_LINE)
+      {
+	 memcpy(&(inst->line[inst->line_len]), start, len);
+	 parse_line(inst, inst->line, inst->line_len + len);
+      }
+      inst->line_len = 0;
+   }
+   else
+      parse_line(inst, start, len);
+} /* end_line */
+
+/* Feeds received bytes through the telegram parser, returns number of
+   telegrams completed. Lines are parsed where they are in buf, only a line
+   split between two reads is copied. */
+static int parse_chunk(struct instance *inst, const char *buf, int len)
+{
+   const char *p;
+   const char *start = buf; /* start of current line within buf */
+   const char *end = buf + len;
+   int completed = 0;
+   int i;
+
+   for(p=buf; p<end; p++)
+   {
+      switch(inst->state)
+      {
+	 case WAIT_START:
+	    if(*p != '/')
+	       break;
+	    inst->state = LINES;
+	    inst->crc = 0;
+	    inst->line_len = 0;
+	    start = p;
+	    for(i=0; i<NUM_ROWS; i++)
+	       inst->staged[i].valid = 0;
+	    inst->crc = crc16_update(inst->crc, *p);
+	    break;
+	 case LINES:
+	    inst->crc = crc16_update(inst->crc, *p);
+	    if((*p == '\r') || (*p == '\n'))
+	    {
+	       if((p > start) || inst->line_len)
+		  end_line(inst, start, p);
+	       start = p+1;
+	    }
+	    else if(*p == '!')
+	    {
+	       inst->state = CHECKSUM;
+	       inst->crc_len = 0;
+	    }
+	    break;
+	 case CHECKSUM:
+	    if((*p == '\r') || (*p == '\n'))
+	    {
+	       inst->crc_text[inst->crc_len] = 0;
+	       /* telegrams of DSMR before version 4 have no CRC */
+	       if(((!inst->crc_len) && inst->crc_optional) ||
+		  (inst->crc_len &&
+		   (strtoul(inst->crc_text, NULL, 16) == inst->crc)))
+		  commit_telegram(inst);
+	       else
+		  inst->crc_errors++;
+	       inst->state = WAIT_START;
+	       completed++;
+	    }
+	    else if(inst->crc_len < 4)
+	       inst->crc_text[inst->crc_len++] = *p;
+	    break;
+      }
+   }
+   /* save the start of a line continued in next read */
+   if((inst->state == LINES) && (start < end))
+   {
+      len = end - start;
+      if(inst->line_len + len < MAX_LINE)
+      {
+	 memcpy(&(inst->line[inst->line_len]), start, len);
+	 inst->line_len += len;
+      }
+      else
+	 inst->line_len = MAX_LINE; /* too long, will be ignored */
+   }
+   return completed;
+} /* parse_chunk */
+
+/* Closes the port after it has gone away, like an unplugged USB adapter,
+   and opens it again when it is back. Returns non zero if stopped first. */
+static int reopen_port(struct instance *inst)
+{
+   close(inst->fd);
+   inst->fd = -1;
+   inst->state = WAIT_START;
+   inst->line_len = 0;
+   fprintf(stderr, "Lost %s, waiting for it to come back\n", inst->device);
+   while(__atomic_load_n(&inst->running, __ATOMIC_ACQUIRE))
+   {
+      usleep(POLL_MS*1000);
+      inst->fd = init_serial(inst->device, inst->baud);
+      if(inst->fd >= 0)
+	 return 0;
+   }
+   return -1;
+} /* reopen_port */
+
+static void *reader(void *arg)
+{
+   struct instance *inst = arg;
+   char chunk[SERIAL_CHUNK];
+   struct pollfd pfd;
+   long n;
+
+   pfd.events = POLLIN;
+   while(__atomic_load_n(&inst->running, __ATOMIC_ACQUIRE))
+   {
+      if(inst->replay)
+      {
+	 if(!capture_next_transfer(inst->replay))
+	 {
+	    usleep(100000);
+	    continue;
+	 }
+	 while((n = capture_read(inst->replay, chunk, SERIAL_CHUNK)) > 0)
+	    parse_chunk(inst, chunk, n);
+	 continue;
+      }
+      pfd.fd = inst->fd;
+      if(poll(&pfd, 1, POLL_MS) <= 0)
+	 continue;
+      /* readable without anything to read when the port has gone away */
+      n = read(inst->fd, chunk, SERIAL_CHUNK);
+      if((n <= 0) && reopen_port(inst))
+	 break;
+      if(n <= 0)
+	 continue;
+      if(inst->record)
+	 capture_write(inst->record, chunk, n);
+      if(parse_chunk(inst, chunk, n) && inst->record)
+	 capture_end(inst->record);
+   }
+   return NULL;
+} /* reader */
+
+static void free_instance(struct instance *i)
+{
+   if(i->fd >= 0)
+      close(i->fd);
+   capture_close(i->record);
+   capture_close(i->replay);
+   free(i->staged);
+   free(i->latest);
+   free(i->latest_valid);
+   free(i->filter_data);
+   free(i->quantile_data);
+   free(i);
+} /* free_instance */
+
+void *init_driver(struct MeterTable_entry *entry,
+		  const char *parameters)
+{
+   char *pc;
+   char path[256];
+   int baud=115200;
+   int i;
+   struct instance *out = calloc(1, sizeof(struct instance));
+
+   if(!out)
+      return NULL;
+   out->entry=entry;
+   out->fd = -1;
+   entry->valid = 1;
+   pc = strstr(parameters, "device=");
+   if(pc)
+   {
+      pc += 7;
+      strncpy(entry->MeterIP, pc, 255);
+      entry->MeterIP[254]=0;
+      pc=strchr(entry->MeterIP, ',');
+      if(pc)
+	 *pc=0;
+   }
+   else
+      sprintf(entry->MeterIP, "/dev/ttyUSB0");
+   entry->MeterIP_len = strlen(entry->MeterIP);
+   pc = strstr(parameters, "baud=");
+   if(pc)
+      baud = atoi(pc+5);
+   strcpy(out->device, entry->MeterIP);
+   out->baud = baud;
+   pc = strstr(parameters, "version=");
+   out->crc_optional = pc && (atoi(pc+8) < 4);
+   pc = strstr(parameters, "multiplier=");
+   if(pc)
+   {
+      pc += 11;
+      entry->MeterMultiplier=atol(pc);
+      if(entry->MeterMultiplier < 1)
+	 entry->MeterMultiplier = 1;
+   }
+   else
+   {
+      entry->MeterMultiplier=1000;
+   }
+   out->staged = calloc(NUM_ROWS, sizeof(struct staged));
+   out->latest = calloc(NUM_ROWS, sizeof(double));
+   out->latest_valid = calloc(NUM_ROWS, sizeof(int));
+   out->filter_data = calloc(NUM_ROWS, sizeof(struct filtered));
+   entry->ObisEntries = malloc(sizeof(driver_obis));
+   if((!out->staged) || (!out->latest) || (!out->latest_valid) ||
+      (!out->filter_data) || (!entry->ObisEntries))
+   {
+      free(entry->ObisEntries);
+      entry->ObisEntries = NULL;
+      free_instance(out);
+      return NULL;
+   }
+   memcpy(entry->ObisEntries, driver_obis, sizeof(driver_obis));
+   entry->numObisEntries = NUM_ROWS;
+   pc = strstr(parameters, "percentiles=");
+   if(pc && atoi(pc+12))
+   {
+      out->quantile_data = calloc(NUM_ROWS, sizeof(struct quantiles));
+      for(i=0; out->quantile_data && (i<NUM_ROWS); i++)
+	 if(driver_obis[i].mean6m_is_valid)
+	 {
+	    entry->ObisEntries[i].p95_is_valid = 1;
+	    entry->ObisEntries[i].p99_is_valid = 1;
+	 }
+   }
+   /* nothing is known until the first telegram has arrived */
+   for(i=0; i<NUM_ROWS; i++)
+   {
+      entry->ObisEntries[i].latest_value = 0;
+      entry->ObisEntries[i].mean6m_value = 0;
+      entry->ObisEntries[i].max6m_value = 0;
+      entry->ObisEntries[i].min6m_value = 0;
+   }
+   entry->MeterMAC[0]=0;
+   entry->MeterMAC_len=0;
+   entry->MeterRSSI=0; /* not used */
+
+   if(capture_parameter(parameters, "replay=", path, 256))
+   {
+      char speed[10]="";
+
+      capture_parameter(parameters, "replayspeed=", speed, 10);
+      out->replay = capture_open_replay(path, strcmp(speed, "max"));
+      if(!out->replay)
+	 fprintf(stderr, "Failed opening capture %s\n", path);
+   }
+   else
+   {
+      out->fd = init_serial(entry->MeterIP, baud);
+      if(out->fd < 0)
+	 fprintf(stderr, "Failed opening %s\n", entry->MeterIP);
+      else if(capture_parameter(parameters, "record=", path, 256))
+      {
+	 out->record = capture_open_record(path);
+	 if(!out->record)
+	    fprintf(stderr, "Failed opening capture %s\n", path);
+      }
+   }
+   if(((out->fd < 0) && (!out->replay)) ||
+      pthread_mutex_init(&(out->mutex), NULL))
+   {
+      free(entry->ObisEntries);
+      entry->ObisEntries = NULL;
+      entry->numObisEntries = 0;
+      free_instance(out);
+      return NULL;
+   }
+   return out;
+} /* init_driver */
+
+/* Starts the reader thread. Not done by init_driver as static meters are
+   set up before the agent forks to the background, which only keeps the
+   thread forking. */
+static void start_reader(struct instance *i)
+{
+   __atomic_store_n(&i->running, 1, __ATOMIC_RELEASE);
+   if(pthread_create(&(i->thread), NULL, reader, i))
+   {
+      fprintf(stderr, "Failed starting DSMR reader thread\n");
+      __atomic_store_n(&i->running, 0, __ATOMIC_RELEASE);
+      return;
+   }
+   i->started = 1;
+} /* start_reader */
+
+void update_driver_data(void *driver, struct MeterTable_entry *entry)
+{
+   struct instance *i = driver;
+   long multiplier;
+   int r;
+
+   if(!i)
+      return;
+   if(!i->started)
+      start_reader(i);
+   multiplier = entry->MeterMultiplier;
+   pthread_mutex_lock(&(i->mutex));
+   if(!entry->MeterType_len && i->meter_type[0])
+   {
+      strcpy(entry->MeterType, i->meter_type);
+      entry->MeterType_len = strlen(entry->MeterType);
+   }
+   for(r=0; r<NUM_ROWS; r++)
+   {
+      struct obis_data *o = &(entry->ObisEntries[r]);
+
+      if(!i->latest_valid[r])
+	 continue;
+      o->latest_value = multiplier * i->latest[r];
+      filtered_fill(o, &(i->filter_data[r]), multiplier);
+      if(o->p95_is_valid)
+	 quantiles_fill(o, &(i->quantile_data[r]), multiplier);
+   }
+   pthread_mutex_unlock(&(i->mutex));
+} /* update_driver_data */
+
+void remove_driver(void *driver, struct MeterTable_entry *entry)
+{
+   struct instance *i = driver;
+
+   if(!i)
+      return;
+   if (!entry)
+      return;                 /* Nothing to remove */
+   entry->valid=0;
+   if(i->started)
+   {
+      __atomic_store_n(&i->running, 0, __ATOMIC_RELEASE);
+      pthread_join(i->thread, NULL);
+   }
+   pthread_mutex_destroy(&(i->mutex));
+   if(entry->numObisEntries)
+   {
+      free(entry->ObisEntries);
+      entry->ObisEntries = NULL;
+      entry->numObisEntries = 0;
+   }
+   free_instance(i);
+} /* remove_driver */
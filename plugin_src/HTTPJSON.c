@@ -0,0 +1,651 @@
+/**************************************************************
+This is a generic dynamic driver plugin for meters or bridges which
+present their values as JSON over HTTP. The URL and which JSON values
+to present as which OBIS codes are given in the configuration file, so
+no C code needs to be written for a new device.
+
+The paths of the configured values are compiled into a tree when the
+driver is initialized. Each reply is then scanned once, following the
+tree and skipping everything not configured, without building any JSON
+objects.
+
+SPDX-License-Identifier: BSD-2-Clause
+
+Copyright (c) 2026, Henrik Carlqvist
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **************************************************************/
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+#include <json.h>
+#include <curl/curl.h>
+#include "driver.h"
+#include "filtered.h"
+#include "obis_catalogue.h"
+#include "capture.h"
+
+#define MAX_RESPONSE (1024*1024)
+#define MAX_DEPTH 32 /* deeper JSON is not scanned */
+
+/* what a node of the tree gives a value to, rows are numbered from 0 */
+#define TARGET_NONE -1
+#define TARGET_TYPE -2
+#define TARGET_MAC -3
+#define TARGET_RSSI -4
+
+/* One step of a path. The children of a node are linked with
+   next_sibling, the tree is kept in one array. */
+struct node
+{
+   char *key;
+   int key_len;
+   int index; /* array index matched by a numeric key, or -1 */
+   int first_child;
+   int next_sibling;
+   int target;
+};
+
+struct field
+{
+   char *description; /* as configured or NULL */
+   char *unit;
+   double scale;
+   double value;
+   int seen; /* value found in latest reply */
+};
+
+struct instance
+{
+   struct MeterTable_entry *entry;
+   CURL *curl;
+   struct capture *record; /* where to save what is received, if anywhere */
+   struct capture *replay; /* read from here instead of the meter if set */
+   char *response;
+   size_t response_len;
+   size_t response_size;
+   int num_nodes;
+   int max_nodes;
+   struct node *nodes; /* nodes[0] is the root */
+   int num_fields;
+   struct field *fields;
+   struct filtered *filter_data;
+   time_t minute;
+};
+
+static int add_node(struct instance *inst, int parent, const char *key,
+		    int key_len)
+{
+   struct node *n;
+   int i;
+
+   /* paths with the same beginning share nodes */
+   for(i=inst->nodes[parent].first_child; i>=0; i=inst->nodes[i].next_sibling)
+      if((inst->nodes[i].key_len == key_len) &&
+	 !memcmp(inst->nodes[i].key, key, key_len))
+	 return i;
+   if(inst->num_nodes == inst->max_nodes)
+   {
+      n = realloc(inst->nodes, 2*inst->max_nodes*sizeof(struct node));
+      if(!n)
+	 return -1;
+      inst->nodes = n;
+      inst->max_nodes *= 2;
+   }
+   i = inst->num_nodes++;
+   n = &(inst->nodes[i]);
+   n->key = malloc(key_len+1);
+   if(!n->key)
+      return -1;
+   memcpy(n->key, key, key_len);
+   n->key[key_len] = 0;
+   n->key_len = key_len;
+   n->index = (strspn(n->key, "0123456789") == key_len) ? atoi(n->key) : -1;
+   n->first_child = -1;
+   n->target = TARGET_NONE;
+   /* keep children in the order they were configured */
+   n->next_sibling = -1;
+   if(inst->nodes[parent].first_child < 0)
+      inst->nodes[parent].first_child = i;
+   else
+   {
+      int last = inst->nodes[parent].first_child;
+
+      while(inst->nodes[last].next_sibling >= 0)
+	 last = inst->nodes[last].next_sibling;
+      inst->nodes[last].next_sibling = i;
+   }
+   return i;
+} /* add_node */
+
+/* Adds a path like "info.meter" or "phases.0.voltage" to the tree. A
+   backslash makes the next character part of the key, so "d.1-0:1\.7\.0"
+   is key "1-0:1.7.0" of "d". Returns non zero at failure. */
+static int compile_path(struct instance *inst, const char *path, int target)
+{
+   int node = 0;
+   int len;
+   char *key;
+
+   if(!path)
+      return -1;
+   key = malloc(strlen(path)+1);
+   if(!key)
+      return -1;
+   do
+   {
+      for(len=0; *path && (*path != '.'); path++)
+      {
+	 if((*path == '\\') && path[1])
+	    path++;
+	 key[len++] = *path;
+      }
+      node = add_node(inst, node, key, len);
+   } while((node >= 0) && *path++);
+   free(key);
+   if(node < 0)
+      return -1;
+   if(inst->nodes[node].target != TARGET_NONE)
+      fprintf(stderr, "Path configured twice\n");
+   inst->nodes[node].target = target;
+   return 0;
+} /* compile_path */
+
+static int find_key(const struct instance *inst, int node,
+		    const char *key, int key_len)
+{
+   int i;
+
+   if(node < 0)
+      return -1;
+   for(i=inst->nodes[node].first_child; i>=0; i=inst->nodes[i].next_sibling)
+      if((inst->nodes[i].key_len == key_len) &&
+	 !memcmp(inst->nodes[i].key, key, key_len))
+	 return i;
+   return -1;
+} /* find_key */
+
+static int find_index(const struct instance *inst, int node, int index)
+{
+   int i;
+
+   if(node < 0)
+      return -1;
+   for(i=inst->nodes[node].first_child; i>=0; i=inst->nodes[i].next_sibling)
+      if(inst->nodes[i].index == index)
+	 return i;
+   return -1;
+} /* find_index */
+
+static const char *skip_space(const char *p, const char *end)
+{
+   while((p < end) && ((*p == ' ') || (*p == '\t') || (*p == '\r') ||
+		       (*p == '\n')))
+      p++;
+   return p;
+} /* skip_space */
+
+/* returns pointer to the closing quote of the string starting at p */
+static const char *string_end(const char *p, const char *end)
+{
+   for(; p < end; p++)
+   {
+      if(*p == '\\')
+	 p++;
+      else if(*p == '"')
+	 return p;
+   }
+   return NULL;
+} /* string_end */
+
+/* Gives a scanned value of len characters at p to the target of node */
+static void set_target(struct instance *inst, int node, const char *p,
+		       int len)
+{
+   struct MeterTable_entry *entry = inst->entry;
+   int target = inst->nodes[node].target;
+   char text[64];
+
+   if(target == TARGET_NONE)
+      return;
+   if((target == TARGET_TYPE) || (target == TARGET_MAC))
+   {
+      char *dst = (target == TARGET_TYPE) ? entry->MeterType : entry->MeterMAC;
+      size_t *dst_len = (target == TARGET_TYPE) ? &(entry->MeterType_len) :
+	 &(entry->MeterMAC_len);
+
+      if(len > 254)
+	 len = 254;
+      memcpy(dst, p, len);
+      dst[len] = 0;
+      *dst_len = len;
+      return;
+   }
+   if(len > 63)
+      len = 63;
+   memcpy(text, p, len);
+   text[len] = 0;
+   if(target == TARGET_RSSI)
+      entry->MeterRSSI = atol(text);
+   else
+   {
+      inst->fields[target].value = strcmp(text, "true") ? atof(text) : 1.0;
+      inst->fields[target].seen = 1;
+   }
+} /* set_target */
+
+/* Scans one JSON value starting at p, node is where in the tree the value
+   is or -1 when it is not configured. Returns pointer after the value or
+   NULL when the JSON is not valid. */
+static const char *scan_value(struct instance *inst, const char *p,
+			      const char *end, int node, int depth)
+{
+   const char *start;
+   int index;
+
+   p = skip_space(p, end);
+   if(p >= end)
+      return NULL;
+   switch(*p)
+   {
+      case '{':
+	 if(depth >= MAX_DEPTH)
+	    return NULL;
+	 p = skip_space(p+1, end);
+	 if((p < end) && (*p == '}'))
+	    return p+1;
+	 while(p < end)
+	 {
+	    int child;
+
+	    if(*p != '"')
+	       return NULL;
+	    start = p+1;
+	    p = string_end(start, end);
+	    if(!p)
+	       return NULL;
+	    child = find_key(inst, node, start, p - start);
+	    p = skip_space(p+1, end);
+	    if((p >= end) || (*p != ':'))
+	       return NULL;
+	    p = scan_value(inst, p+1, end, child, depth+1);
+	    if(!p)
+	       return NULL;
+	    p = skip_space(p, end);
+	    if((p < end) && (*p == '}'))
+	       return p+1;
+	    if((p >= end) || (*p != ','))
+	       return NULL;
+	    p = skip_space(p+1, end);
+	 }
+	 return NULL;
+      case '[':
+	 if(depth >= MAX_DEPTH)
+	    return NULL;
+	 p = skip_space(p+1, end);
+	 if((p < end) && (*p == ']'))
+	    return p+1;
+	 for(index=0; p < end; index++)
+	 {
+	    p = scan_value(inst, p, end, find_index(inst, node, index),
+			   depth+1);
+	    if(!p)
+	       return NULL;
+	    p = skip_space(p, end);
+	    if((p < end) && (*p == ']'))
+	       return p+1;
+	    if((p >= end) || (*p != ','))
+	       return NULL;
+	    p++;
+	 }
+	 return NULL;
+      case '"':
+	 start = p+1;
+	 p = string_end(start, end);
+	 if(!p)
+	    return NULL;
+	 if(node >= 0)
+	    set_target(inst, node, start, p - start);
+	 return p+1;
+      default:
+	 /* number, true, false or null */
+	 start = p;
+	 while((p < end) && (*p != ',') && (*p != '}') && (*p != ']') &&
+	       (*p != ' ') && (*p != '\t') && (*p != '\r') && (*p != '\n'))
+	    p++;
+	 if(p == start)
+	    return NULL;
+	 if((node >= 0) && ((p - start != 4) || memcmp(start, "null", 4)))
+	    set_target(inst, node, start, p - start);
+	 return p;
+   }
+} /* scan_value */
+
+static void fill_obis_entry(double value, int new_minute, long multiplier,
+			    struct obis_data *o, struct filtered *f)
+{
+   o->latest_value = multiplier * value;
+   if(!o->mean6m_is_valid)
+      return;
+   filtered_add(value, new_minute, f);
+   filtered_fill(o, f, multiplier);
+} /* fill_obis_entry */
+
+/* Scans a complete reply and presents the values found */
+static void fill_obis_data(struct instance *inst)
+{
+   struct MeterTable_entry *entry = inst->entry;
+   time_t now = time(NULL);
+   int new_minute;
+   int r;
+
+   for(r=0; r<entry->numObisEntries; r++)
+      inst->fields[r].seen = 0;
+   if(!scan_value(inst, inst->response, inst->response + inst->response_len,
+		  0, 0))
+      fprintf(stderr, "Bad JSON from %s\n", entry->MeterIP);
+   new_minute = ((now/60) != inst->minute);
+   inst->minute = now/60;
+   for(r=0; r<entry->numObisEntries; r++)
+      if(inst->fields[r].seen)
+	 fill_obis_entry(inst->fields[r].scale * inst->fields[r].value,
+			 new_minute, entry->MeterMultiplier,
+			 &(entry->ObisEntries[r]), &(inst->filter_data[r]));
+} /* fill_obis_data */
+
+static size_t my_curl_callback(void *buffer, size_t size, size_t nmemb, void *userp)
+{
+   size_t out = size*nmemb;
+   struct instance *inst=userp;
+
+   if(!inst) /* sanity check */
+      return 0;
+   if(inst->record)
+      capture_write(inst->record, buffer, out);
+   if(inst->response_len + out > inst->response_size)
+   {
+      size_t new_size = 2*inst->response_size;
+      char *p;
+
+      while(new_size < inst->response_len + out)
+	 new_size *= 2;
+      if(new_size > MAX_RESPONSE)
+	 return 0;
+      p = realloc(inst->response, new_size);
+      if(!p)
+	 return 0;
+      inst->response = p;
+      inst->response_size = new_size;
+   }
+   memcpy(inst->response + inst->response_len, buffer, out);
+   inst->response_len += out;
+   return out;
+} /* my_curl_callback */
+
+/* Gets new data from the meter, or from the capture being replayed */
+static void perform(struct instance *inst)
+{
+   char buf[CURL_MAX_WRITE_SIZE];
+   long len;
+   int ok=0;
+
+   inst->response_len = 0;
+   if(inst->replay)
+   {
+      if(capture_next_transfer(inst->replay))
+      {
+	 while((len = capture_read(inst->replay, buf,
+				   CURL_MAX_WRITE_SIZE)) > 0)
+	    my_curl_callback(buf, 1, len, inst);
+	 ok = 1;
+      }
+   }
+   else if(inst->curl)
+   {
+      ok = (curl_easy_perform(inst->curl) == CURLE_OK);
+      if(inst->record)
+	 capture_end(inst->record);
+   }
+   if(ok && inst->response_len)
+      fill_obis_data(inst);
+} /* perform */
+
+/* Sets up row r from one element of the "fields" array */
+static int init_field(struct instance *inst, int r, struct json_object *f)
+{
+   struct obis_data *o = &(inst->entry->ObisEntries[r]);
+   struct json_object *tmp;
+
+   if((!json_object_object_get_ex(f, "path", &tmp)) ||
+      compile_path(inst, json_object_get_string(tmp), r))
+      return -1;
+   if((!json_object_object_get_ex(f, "obis", &tmp)) ||
+      (sscanf(json_object_get_string(tmp), "%lu-%lu:%lu.%lu.%lu",
+	      &(o->obis_oid[0]), &(o->obis_oid[1]), &(o->obis_oid[2]),
+	      &(o->obis_oid[3]), &(o->obis_oid[4])) != 5))
+      return -1;
+   snprintf(o->obis_string, 50, "%lu-%lu:%lu.%lu.%lu",
+	    o->obis_oid[0], o->obis_oid[1], o->obis_oid[2],
+	    o->obis_oid[3], o->obis_oid[4]);
+   /* without description or unit the agent takes them from the catalogue */
+   if(json_object_object_get_ex(f, "description", &tmp))
+   {
+      inst->fields[r].description = strdup(json_object_get_string(tmp));
+      if(!inst->fields[r].description)
+	 return -1;
+      o->description = inst->fields[r].description;
+   }
+   if(json_object_object_get_ex(f, "unit", &tmp))
+   {
+      inst->fields[r].unit = strdup(json_object_get_string(tmp));
+      if(!inst->fields[r].unit)
+	 return -1;
+      o->unit = inst->fields[r].unit;
+   }
+   inst->fields[r].scale = 1.0;
+   if(json_object_object_get_ex(f, "scale", &tmp))
+      inst->fields[r].scale = json_object_get_double(tmp);
+   o->latest_is_valid = 1;
+   if(obis_is_gauge(o->obis_oid))
+   {
+      o->mean6m_is_valid = 1;
+      o->max6m_is_valid = 1;
+      o->min6m_is_valid = 1;
+   }
+   return 0;
+} /* init_field */
+
+static void free_instance(struct instance *inst)
+{
+   int i;
+
+   if(inst->curl)
+      curl_easy_cleanup(inst->curl);
+   capture_close(inst->record);
+   capture_close(inst->replay);
+   for(i=0; i<inst->num_nodes; i++)
+      free(inst->nodes[i].key);
+   free(inst->nodes);
+   for(i=0; i<inst->num_fields; i++)
+   {
+      free(inst->fields[i].description);
+      free(inst->fields[i].unit);
+   }
+   free(inst->fields);
+   free(inst->filter_data);
+   free(inst->response);
+   free(inst);
+} /* free_instance */
+
+/* parameters is a JSON object like
+   {"url": "http://192.168.67.112/meterData", "type": "info.meter",
+    "fields": [{"path": "d.1_7_0", "obis": "1-0:1.7.0", "unit": "kW"}]} */
+void *init_driver(struct MeterTable_entry *entry,
+		  const char *parameters)
+{
+   struct json_object *conf, *fields, *tmp;
+   const char *url = NULL;
+   int r, num_fields;
+   struct instance *out = calloc(1, sizeof(struct instance));
+
+   if(!out)
+      return NULL;
+   out->entry=entry;
+   entry->valid = 1;
+   conf = json_tokener_parse(parameters);
+   if((!conf) || (!json_object_object_get_ex(conf, "fields", &fields)) ||
+      (!json_object_object_get_ex(conf, "url", &tmp)))
+   {
+      fprintf(stderr, "HTTPJSON needs parameters with url and fields\n");
+      if(conf)
+	 json_object_put(conf);
+      free(out);
+      return NULL;
+   }
+   url = json_object_get_string(tmp);
+   strncpy(entry->MeterIP, url, 254);
+   entry->MeterIP[254]=0;
+   entry->MeterIP_len = strlen(entry->MeterIP);
+   entry->MeterMultiplier=1000;
+   if(json_object_object_get_ex(conf, "multiplier", &tmp))
+      entry->MeterMultiplier = json_object_get_int(tmp);
+   if(entry->MeterMultiplier < 1)
+      entry->MeterMultiplier = 1;
+   entry->MeterType[0]=0;
+   entry->MeterType_len=0;
+   entry->MeterMAC[0]=0;
+   entry->MeterMAC_len=0;
+   entry->MeterRSSI=0;
+
+   num_fields = json_object_array_length(fields);
+   out->max_nodes = 4*num_fields + 4;
+   out->nodes = calloc(out->max_nodes, sizeof(struct node));
+   out->fields = calloc(num_fields, sizeof(struct field));
+   if(out->fields)
+      out->num_fields = num_fields;
+   out->filter_data = calloc(num_fields, sizeof(struct filtered));
+   out->response_size = CURL_MAX_WRITE_SIZE;
+   out->response = malloc(out->response_size);
+   entry->ObisEntries = calloc(num_fields, sizeof(struct obis_data));
+   if((!out->nodes) || (!out->fields) || (!out->filter_data) ||
+      (!out->response) || (!entry->ObisEntries))
+      r = -1;
+   else
+   {
+      out->num_nodes = 1; /* root */
+      out->nodes[0].first_child = -1;
+      out->nodes[0].next_sibling = -1;
+      out->nodes[0].index = -1;
+      out->nodes[0].target = TARGET_NONE;
+      for(r=0; r<num_fields; r++)
+	 if(init_field(out, r, json_object_array_get_idx(fields, r)))
+	 {
+	    fprintf(stderr, "Bad field %d for %s\n", r, url);
+	    r = -1;
+	    break;
+	 }
+   }
+   if((r >= 0) && json_object_object_get_ex(conf, "type", &tmp))
+      r = compile_path(out, json_object_get_string(tmp), TARGET_TYPE) ? -1:r;
+   if((r >= 0) && json_object_object_get_ex(conf, "mac", &tmp))
+      r = compile_path(out, json_object_get_string(tmp), TARGET_MAC) ? -1 : r;
+   if((r >= 0) && json_object_object_get_ex(conf, "rssi", &tmp))
+      r = compile_path(out, json_object_get_string(tmp), TARGET_RSSI) ? -1:r;
+   if(r < 0)
+   {
+      json_object_put(conf);
+      free(entry->ObisEntries);
+      entry->ObisEntries = NULL;
+      entry->numObisEntries = 0;
+      free_instance(out);
+      return NULL;
+   }
+   entry->numObisEntries = num_fields;
+   if(!json_object_object_get_ex(conf, "type", NULL))
+   {
+      sprintf(entry->MeterType, "HTTP JSON");
+      entry->MeterType_len = strlen(entry->MeterType);
+   }
+
+   if(json_object_object_get_ex(conf, "replay", &tmp))
+   {
+      struct json_object *speed;
+      int realtime = 1;
+
+      if(json_object_object_get_ex(conf, "replayspeed", &speed))
+	 realtime = strcmp(json_object_get_string(speed), "max");
+      out->replay = capture_open_replay(json_object_get_string(tmp),
+					realtime);
+      if(!out->replay)
+	 fprintf(stderr, "Failed opening capture %s\n",
+		 json_object_get_string(tmp));
+   }
+   else
+   {
+      out->curl = curl_easy_init();
+      curl_easy_setopt(out->curl, CURLOPT_URL, url);
+      curl_easy_setopt(out->curl, CURLOPT_WRITEFUNCTION, my_curl_callback);
+      curl_easy_setopt(out->curl, CURLOPT_WRITEDATA, (void *)out);
+      /* updated by worker threads, no signals for timeouts */
+      curl_easy_setopt(out->curl, CURLOPT_NOSIGNAL, 1L);
+      curl_easy_setopt(out->curl, CURLOPT_TIMEOUT, 5L);
+      if(json_object_object_get_ex(conf, "timeout", &tmp))
+	 curl_easy_setopt(out->curl, CURLOPT_TIMEOUT,
+			  (long)json_object_get_int(tmp));
+      if(json_object_object_get_ex(conf, "record", &tmp))
+      {
+	 out->record = capture_open_record(json_object_get_string(tmp));
+	 if(!out->record)
+	    fprintf(stderr, "Failed opening capture %s\n",
+		    json_object_get_string(tmp));
+      }
+   }
+   json_object_put(conf); /* free json stuff */
+   out->minute = time(NULL)/60;
+   perform(out);
+   return out;
+} /* init_driver */
+
+void update_driver_data(void *driver, struct MeterTable_entry *entry)
+{
+   struct instance *i = driver;
+
+   if(!i)
+      return;
+   perform(i);
+} /* update_driver_data */
+
+void remove_driver(void *driver, struct MeterTable_entry *entry)
+{
+   struct instance *i = driver;
+
+   if(!i)
+      return;
+   if (!entry)
+      return;                 /* Nothing to remove */
+   entry->valid=0;
+   free(entry->ObisEntries);
+   entry->ObisEntries = NULL;
+   entry->numObisEntries = 0;
+   free_instance(i);
+} /* remove_driver */
@@ -0,0 +1,644 @@
+/**************************************************************
+This is the dynamic driver plugin for meters read with Modbus TCP,
+either directly or through a gateway to Modbus RTU sub-meters. Which
+registers to read and what OBIS codes they get is configured with the
+map parameter. Adjacent registers are read with as few requests as
+possible and requests to different unit ids are sent without waiting for
+previous replies.
+
+SPDX-License-Identifier: BSD-2-Clause
+
+Copyright (c) 2026, Henrik Carlqvist
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **************************************************************/
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <stdint.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include "driver.h"
+#include "filtered.h"
+#include "obis_catalogue.h"
+
+#define FC_HOLDING 3
+#define FC_INPUT 4
+#define MAX_REGISTERS 125 /* most registers allowed in one read request */
+#define MBAP_SIZE 7 /* transaction, protocol, length and unit id */
+#define MAX_FRAME (MBAP_SIZE + 2 + 2*MAX_REGISTERS)
+#define RX_SIZE (4*MAX_FRAME)
+
+enum register_type
+{
+   U16, S16, U32, S32, F32
+};
+
+static const struct
+{
+   const char *name;
+   enum register_type type;
+   int words;
+   int swapped; /* low word first */
+} type_names[] = {
+   {"u16", U16, 1, 0},
+   {"s16", S16, 1, 0},
+   {"u32", U32, 2, 0},
+   {"s32", S32, 2, 0},
+   {"f32", F32, 2, 0},
+   {"u32r", U32, 2, 1},
+   {"s32r", S32, 2, 1},
+   {"f32r", F32, 2, 1},
+};
+#define NUM_TYPES (sizeof(type_names)/sizeof(type_names[0]))
+
+/* one configured value, giving one OBIS row */
+struct mapping
+{
+   unsigned char unit;
+   unsigned char fc;
+   unsigned short reg;
+   enum register_type type;
+   int words;
+   int swapped;
+   double scale;
+   int row;
+   char unit_text[32]; /* as configured or empty */
+   char description[160]; /* catalogue text followed by the register */
+};
+
+/* one read request covering one or more mappings */
+struct request
+{
+   unsigned char unit;
+   unsigned char fc;
+   unsigned short start;
+   unsigned short count;
+   unsigned int first; /* index in sorted mappings */
+   unsigned int num;
+   unsigned short tid;
+   int pending;
+};
+
+struct instance
+{
+   struct MeterTable_entry *entry;
+   struct sockaddr_in addr;
+   int fd;
+   int timeout_ms;
+   int window; /* most requests waiting for replies at the same time */
+   unsigned short tid;
+   unsigned int num_mappings;
+   struct mapping *mappings; /* sorted by unit, function and register */
+   unsigned int num_requests;
+   struct request *requests;
+   struct filtered *filter_data;
+   time_t minute;
+   unsigned char rx[RX_SIZE];
+   int rx_len;
+};
+
+/* 64 bits, an int would overflow after less than 25 days of uptime */
+static int64_t now_ms(void)
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return (int64_t)ts.tv_sec*1000 + ts.tv_nsec/1000000;
+} /* now_ms */
+
+static int compare_mapping(const void *a, const void *b)
+{
+   const struct mapping *ma = a;
+   const struct mapping *mb = b;
+
+   if(ma->unit != mb->unit)
+      return ma->unit - mb->unit;
+   if(ma->fc != mb->fc)
+      return ma->fc - mb->fc;
+   return ma->reg - mb->reg;
+} /* compare_mapping */
+
+/* Parses one item "unit/register/type/obis[/scale[/unit]]" of the map
+   parameter ending at end into mapping m and row o, returns 0 at success */
+static int parse_mapping(const char *item, const char *end,
+			 struct mapping *m, struct obis_data *o)
+{
+   char text[256];
+   char *field[6];
+   char *pc;
+   int num_fields=1;
+   int len = end - item;
+   int i;
+
+   if(len > 255)
+      return -1;
+   memcpy(text, item, len);
+   text[len]=0;
+   field[0]=text;
+   /* the unit is the last field and may itself contain '/' like m3/h */
+   for(pc=text; *pc && (num_fields < 6); pc++)
+      if(*pc == '/')
+      {
+	 *pc=0;
+	 field[num_fields++]=pc+1;
+      }
+   if(num_fields < 4)
+      return -1;
+   m->unit = atoi(field[0]);
+   m->fc = FC_HOLDING;
+   pc = field[1];
+   if((*pc == 'i') || (*pc == 'h'))
+   {
+      if(*pc == 'i')
+	 m->fc = FC_INPUT;
+      pc++;
+   }
+   m->reg = atoi(pc);
+   for(i=0; i<NUM_TYPES; i++)
+      if(!strcmp(field[2], type_names[i].name))
+	 break;
+   if(i == NUM_TYPES)
+      return -1;
+   m->type = type_names[i].type;
+   m->words = type_names[i].words;
+   m->swapped = type_names[i].swapped;
+   if(sscanf(field[3], "%lu-%lu:%lu.%lu.%lu", &(o->obis_oid[0]),
+	     &(o->obis_oid[1]), &(o->obis_oid[2]), &(o->obis_oid[3]),
+	     &(o->obis_oid[4])) != 5)
+      return -1;
+   m->scale = (num_fields > 4) ? atof(field[4]) : 1.0;
+   if(num_fields > 5)
+   {
+      strncpy(m->unit_text, field[5], 31);
+      m->unit_text[31]=0;
+   }
+   snprintf(o->obis_string, 50, "%lu-%lu:%lu.%lu.%lu",
+	    o->obis_oid[0], o->obis_oid[1], o->obis_oid[2],
+	    o->obis_oid[3], o->obis_oid[4]);
+   /* unit, if not given, comes from the catalogue */
+   o->latest_is_valid = 1;
+   if(obis_is_gauge(o->obis_oid))
+   {
+      o->mean6m_is_valid = 1;
+      o->max6m_is_valid = 1;
+      o->min6m_is_valid = 1;
+   }
+   return 0;
+} /* parse_mapping */
+
+/* Groups sorted mappings into as few requests as possible. Registers not
+   mapped are only read when they are at most gap registers between mapped
+   ones. */
+static int build_requests(struct instance *inst, int gap)
+{
+   unsigned int m;
+   struct request *r = NULL;
+
+   inst->requests = calloc(inst->num_mappings, sizeof(struct request));
+   if(!inst->requests)
+      return -1;
+   inst->num_requests = 0;
+   for(m=0; m<inst->num_mappings; m++)
+   {
+      struct mapping *map = &(inst->mappings[m]);
+      int end = map->reg + map->words;
+
+      if(r && (r->unit == map->unit) && (r->fc == map->fc) &&
+	 (map->reg <= r->start + r->count + gap) &&
+	 (end - r->start <= MAX_REGISTERS))
+      {
+	 if(end > r->start + r->count)
+	    r->count = end - r->start;
+	 r->num++;
+	 continue;
+      }
+      r = &(inst->requests[inst->num_requests++]);
+      r->unit = map->unit;
+      r->fc = map->fc;
+      r->start = map->reg;
+      r->count = map->words;
+      r->first = m;
+      r->num = 1;
+   }
+   return 0;
+} /* build_requests */
+
+static void disconnect(struct instance *inst)
+{
+   if(inst->fd >= 0)
+      close(inst->fd);
+   inst->fd = -1;
+   inst->rx_len = 0;
+} /* disconnect */
+
+/* returns 0 when connected */
+static int connect_meter(struct instance *inst)
+{
+   struct pollfd pfd;
+   int err=0;
+   socklen_t len = sizeof(err);
+   int one=1;
+
+   if(inst->fd >= 0)
+      return 0;
+   inst->fd = socket(AF_INET, SOCK_STREAM, 0);
+   if(inst->fd < 0)
+      return -1;
+   fcntl(inst->fd, F_SETFL, fcntl(inst->fd, F_GETFL) | O_NONBLOCK);
+   setsockopt(inst->fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+   if(connect(inst->fd, (struct sockaddr *)&(inst->addr),
+	      sizeof(inst->addr)) && (errno != EINPROGRESS))
+   {
+      disconnect(inst);
+      return -1;
+   }
+   pfd.fd = inst->fd;
+   pfd.events = POLLOUT;
+   if((poll(&pfd, 1, inst->timeout_ms) != 1) ||
+      getsockopt(inst->fd, SOL_SOCKET, SO_ERROR, &err, &len) || err)
+   {
+      disconnect(inst);
+      return -1;
+   }
+   return 0;
+} /* connect_meter */
+
+static int send_request(struct instance *inst, struct request *r)
+{
+   unsigned char frame[12];
+
+   r->tid = ++inst->tid;
+   frame[0] = r->tid >> 8;
+   frame[1] = r->tid & 0xff;
+   frame[2] = 0; /* protocol id */
+   frame[3] = 0;
+   frame[4] = 0; /* length of what follows */
+   frame[5] = 6;
+   frame[6] = r->unit;
+   frame[7] = r->fc;
+   frame[8] = r->start >> 8;
+   frame[9] = r->start & 0xff;
+   frame[10] = r->count >> 8;
+   frame[11] = r->count & 0xff;
+   if(send(inst->fd, frame, sizeof(frame), MSG_NOSIGNAL) != sizeof(frame))
+      return -1;
+   r->pending = 1;
+   return 0;
+} /* send_request */
+
+static void fill_obis_entry(double value, int new_minute, long multiplier,
+			    struct obis_data *o, struct filtered *f)
+{
+   o->latest_value = multiplier * value;
+   if(!o->mean6m_is_valid)
+      return;
+   filtered_add(value, new_minute, f);
+   filtered_fill(o, f, multiplier);
+} /* fill_obis_entry */
+
+static double decode(const struct mapping *m, const unsigned char *data)
+{
+   unsigned int hi = (data[0] << 8) | data[1];
+   unsigned int lo;
+   uint32_t u;
+   float f;
+
+   switch(m->type)
+   {
+      case U16:
+	 return hi;
+      case S16:
+	 return (int16_t)hi;
+      default:
+	 break;
+   }
+   lo = (data[2] << 8) | data[3];
+   u = m->swapped ? ((lo << 16) | hi) : ((hi << 16) | lo);
+   switch(m->type)
+   {
+      case S32:
+	 return (int32_t)u;
+      case F32:
+	 memcpy(&f, &u, sizeof(f));
+	 return f;
+      default:
+	 return u;
+   }
+} /* decode */
+
+/* Takes care of a complete reply frame of len bytes */
+static void handle_reply(struct instance *inst, const unsigned char *frame,
+			 int len, int new_minute)
+{
+   struct MeterTable_entry *entry = inst->entry;
+   unsigned short tid = (frame[0] << 8) | frame[1];
+   struct request *r = NULL;
+   unsigned int i;
+
+   for(i=0; i<inst->num_requests; i++)
+      if(inst->requests[i].pending && (inst->requests[i].tid == tid))
+      {
+	 r = &(inst->requests[i]);
+	 break;
+      }
+   if(!r)
+      return; /* late reply to an earlier update */
+   r->pending = 0;
+   if((frame[7] != r->fc) || (len < MBAP_SIZE + 2 + 2*r->count) ||
+      (frame[8] != 2*r->count))
+   {
+      if(frame[7] & 0x80)
+	 fprintf(stderr, "Modbus unit %d exception %d at register %d\n",
+		 r->unit, frame[8], r->start);
+      return;
+   }
+   for(i=r->first; i<r->first+r->num; i++)
+   {
+      struct mapping *m = &(inst->mappings[i]);
+
+      fill_obis_entry(m->scale * decode(m, &frame[9 + 2*(m->reg-r->start)]),
+		      new_minute, entry->MeterMultiplier,
+		      &(entry->ObisEntries[m->row]),
+		      &(inst->filter_data[m->row]));
+   }
+} /* handle_reply */
+
+/* Sends all requests keeping at most window of them waiting for replies,
+   returns number of requests not answered in time. The timeout is counted
+   from the latest reply, so a slow gateway answering one request at a time
+   still gets all its requests answered. */
+static int poll_meter(struct instance *inst)
+{
+   struct pollfd pfd;
+   unsigned int sent=0;
+   int waiting=0;
+   int64_t deadline = now_ms() + inst->timeout_ms;
+   int new_minute;
+   time_t now = time(NULL);
+   unsigned int i;
+   long n;
+
+   new_minute = ((now/60) != inst->minute);
+   inst->minute = now/60;
+   for(i=0; i<inst->num_requests; i++)
+      inst->requests[i].pending = 0;
+   if(connect_meter(inst))
+      return inst->num_requests;
+   pfd.fd = inst->fd;
+   pfd.events = POLLIN;
+   while((sent < inst->num_requests) || waiting)
+   {
+      int64_t left = deadline - now_ms();
+      int pos=0;
+
+      while((sent < inst->num_requests) && (waiting < inst->window))
+      {
+	 if(send_request(inst, &(inst->requests[sent])))
+	 {
+	    disconnect(inst);
+	    return inst->num_requests - sent + waiting;
+	 }
+	 sent++;
+	 waiting++;
+      }
+      /* never more than timeout_ms, so it fits in an int */
+      if((left <= 0) || (poll(&pfd, 1, (int)left) != 1))
+	 break;
+      n = recv(inst->fd, inst->rx + inst->rx_len, RX_SIZE - inst->rx_len, 0);
+      if(n <= 0)
+      {
+	 disconnect(inst);
+	 break;
+      }
+      inst->rx_len += n;
+      /* replies may arrive in pieces or several at once */
+      while(inst->rx_len - pos >= MBAP_SIZE)
+      {
+	 unsigned char *frame = inst->rx + pos;
+	 int len = 6 + ((frame[4] << 8) | frame[5]);
+
+	 if((len > MAX_FRAME) || (len < MBAP_SIZE + 2))
+	 {
+	    /* out of sync, start over with a new connection */
+	    disconnect(inst);
+	    return inst->num_requests - sent + waiting;
+	 }
+	 if(inst->rx_len - pos < len)
+	    break;
+	 handle_reply(inst, frame, len, new_minute);
+	 deadline = now_ms() + inst->timeout_ms;
+	 pos += len;
+	 waiting = 0;
+	 for(i=0; i<sent; i++)
+	    waiting += inst->requests[i].pending;
+      }
+      memmove(inst->rx, inst->rx + pos, inst->rx_len - pos);
+      inst->rx_len -= pos;
+   }
+   return (inst->num_requests - sent) + waiting;
+} /* poll_meter */
+
+/* frees what init_driver has allocated so far */
+static void *fail_init(struct instance *out)
+{
+   free(out->entry->ObisEntries);
+   out->entry->ObisEntries = NULL;
+   out->entry->numObisEntries = 0;
+   free(out->mappings);
+   free(out->filter_data);
+   free(out->requests);
+   free(out);
+   return NULL;
+} /* fail_init */
+
+void *init_driver(struct MeterTable_entry *entry,
+		  const char *parameters)
+{
+   char *pc;
+   const char *map, *map_end, *item;
+   int gap=0;
+   int port=502;
+   unsigned int i, rows;
+   struct instance *out = calloc(1, sizeof(struct instance));
+
+   if(!out)
+      return NULL;
+   out->entry=entry;
+   out->fd = -1;
+   entry->valid = 1;
+   pc = strstr(parameters, "ip=");
+   if(pc)
+   {
+      pc += 3;
+      strncpy(entry->MeterIP, pc, 254);
+      entry->MeterIP[254]=0;
+      pc=strchr(entry->MeterIP, ',');
+      if(pc)
+	 *pc=0;
+      entry->MeterIP_len = strlen(entry->MeterIP);
+   }
+   else
+   {
+      fprintf(stderr, "Missing parameter ip=\n");
+      free(out);
+      return NULL;
+   }
+   pc = strstr(parameters, "port=");
+   if(pc)
+      port = atoi(pc+5);
+   out->addr.sin_family = AF_INET;
+   out->addr.sin_port = htons(port);
+   if(!inet_aton(entry->MeterIP, &(out->addr.sin_addr)))
+   {
+      fprintf(stderr, "Bad ip address %s\n", entry->MeterIP);
+      free(out);
+      return NULL;
+   }
+   out->timeout_ms = 2000;
+   pc = strstr(parameters, "timeout=");
+   if(pc)
+      out->timeout_ms = atoi(pc+8);
+   out->window = 8;
+   pc = strstr(parameters, "pipeline=");
+   if(pc)
+      out->window = atoi(pc+9);
+   if(out->window < 1)
+      out->window = 1;
+   pc = strstr(parameters, "gap=");
+   if(pc)
+      gap = atoi(pc+4);
+   pc = strstr(parameters, "multiplier=");
+   if(pc)
+   {
+      pc += 11;
+      entry->MeterMultiplier=atol(pc);
+      if(entry->MeterMultiplier < 1)
+	 entry->MeterMultiplier = 1;
+   }
+   else
+   {
+      entry->MeterMultiplier=1000;
+   }
+   sprintf(entry->MeterType, "Modbus TCP");
+   entry->MeterType_len = strlen(entry->MeterType);
+   entry->MeterMAC[0]=0;
+   entry->MeterMAC_len=0;
+   entry->MeterRSSI=0; /* not used */
+
+   map = strstr(parameters, "map=");
+   if(!map)
+   {
+      fprintf(stderr, "Missing parameter map=\n");
+      free(out);
+      return NULL;
+   }
+   map += 4;
+   map_end = strchr(map, ',');
+   if(!map_end)
+      map_end = map + strlen(map);
+   for(rows=1, item=map; item<map_end; item++)
+      if(*item == ';')
+	 rows++;
+   out->mappings = calloc(rows, sizeof(struct mapping));
+   out->filter_data = calloc(rows, sizeof(struct filtered));
+   entry->ObisEntries = calloc(rows, sizeof(struct obis_data));
+   if((!out->mappings) || (!out->filter_data) || (!entry->ObisEntries))
+      return fail_init(out);
+   for(i=0, item=map; item<map_end; i++)
+   {
+      const char *end = memchr(item, ';', map_end - item);
+
+      if(!end)
+	 end = map_end;
+      if(parse_mapping(item, end, &(out->mappings[i]),
+		       &(entry->ObisEntries[i])))
+      {
+	 fprintf(stderr, "Bad map item %.*s\n", (int)(end-item), item);
+	 return fail_init(out);
+      }
+      out->mappings[i].row = i;
+      item = end + 1;
+   }
+   out->num_mappings = i;
+   entry->numObisEntries = i;
+   qsort(out->mappings, out->num_mappings, sizeof(struct mapping),
+	 compare_mapping);
+   /* the texts are kept in the mappings, which no longer move */
+   for(i=0; i<out->num_mappings; i++)
+   {
+      struct mapping *m = &(out->mappings[i]);
+      struct obis_data *o = &(entry->ObisEntries[m->row]);
+      const struct obis_catalogue_entry *c = obis_lookup(o->obis_oid);
+
+      if(m->unit_text[0])
+	 o->unit = m->unit_text;
+      snprintf(m->description, sizeof(m->description),
+	       "%s%sModbus unit %d %s register %d",
+	       c ? c->description : "", c ? ", " : "", m->unit,
+	       (m->fc == FC_INPUT) ? "input" : "holding", m->reg);
+      o->description = m->description;
+   }
+   if(build_requests(out, gap))
+      return fail_init(out);
+   out->minute = time(NULL)/60;
+   if(poll_meter(out))
+      fprintf(stderr, "Modbus meter %s did not answer all requests\n",
+	      entry->MeterIP);
+   return out;
+} /* init_driver */
+
+void update_driver_data(void *driver, struct MeterTable_entry *entry)
+{
+   struct instance *i = driver;
+
+   if(!i)
+      return;
+   poll_meter(i);
+} /* update_driver_data */
+
+void remove_driver(void *driver, struct MeterTable_entry *entry)
+{
+   struct instance *i = driver;
+
+   if(!i)
+      return;
+   if (!entry)
+      return;                 /* Nothing to remove */
+   entry->valid=0;
+   disconnect(i);
+   free(i->mappings);
+   free(i->requests);
+   free(i->filter_data);
+   free(entry->ObisEntries);
+   entry->ObisEntries = NULL;
+   entry->numObisEntries = 0;
+   free(i);
+} /* remove_driver */
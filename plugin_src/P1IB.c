@@ -29,9 +29,13 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  **************************************************************/
 #include <string.h>
 #include "driver.h"
+#include "obis_catalogue.h"
 #include <curl/curl.h>
-#include <json.h>
 #include <pthread.h>
+#include "capture.h"
+#include "quantile.h"
+#include "samples.h"
+#include "meterjson.h"
 
 struct filtered
 {
@@ -41,13 +45,80 @@ struct filtered
    double min[6];
 };
 
+/* the array of values of a row in the latest reply */
+struct row_reply
+{
+   int found;       /* the code was in the reply */
+   int num_values;
+   double value[10];
+};
+
 struct instance
 {
    struct MeterTable_entry *entry;
    CURL *curl;
+   struct capture *record; /* where to save what is received, if anywhere */
+   struct capture *replay; /* read from here instead of the meter if set */
    int64_t last_obis_filter_update;
    struct filtered *filter_data;
+   int percentiles; /* non zero to estimate 95 and 99 percentiles */
+   struct quantiles *quantile_data;
+   unsigned int num_samples; /* raw samples kept for each row */
+   struct sample_ring *rings;
+   int64_t last_sample_count; /* resetCnt of the previous reply */
+   uint64_t last_sample_time; /* when the previous reply came */
+   char reply[CURL_MAX_WRITE_SIZE+1]; /* the reply being received */
+   size_t reply_len;
+   struct meterjson json; /* index of the reply */
+   struct row_reply *replies; /* for each row */
+};
+
+/* Rows presented when there is no reply from the meter as the driver is
+   initialized, otherwise the rows are set up from the codes in the reply.
+   Descriptions and units come from the OBIS catalogue. */
+static const struct obis_data default_obis[] = {
+   {{1,0,1,7,0}, "1-0:1.7.0", NULL, 0, NULL, 0,
+    1, 0, 1, 0, 1, 0, 1, 0},
+   {{1,0,1,8,0}, "1-0:1.8.0", NULL, 0, NULL, 0,
+    1, 0, 0, 0, 0, 0, 0, 0},
+   {{1,0,2,7,0}, "1-0:2.7.0", NULL, 0, NULL, 0,
+    1, 0, 1, 0, 1, 0, 1, 0},
+   {{1,0,2,8,0}, "1-0:2.8.0", NULL, 0, NULL, 0,
+    1, 0, 0, 0, 0, 0, 0, 0},
+   {{1,0,3,7,0}, "1-0:3.7.0", NULL, 0, NULL, 0,
+    1, 0, 1, 0, 1, 0, 1, 0},
+   {{1,0,3,8,0}, "1-0:3.8.0", NULL, 0, NULL, 0,
+    1, 0, 0, 0, 0, 0, 0, 0},
+   {{1,0,4,7,0}, "1-0:4.7.0", NULL, 0, NULL, 0,
+    1, 0, 1, 0, 1, 0, 1, 0},
+   {{1,0,4,8,0}, "1-0:4.8.0", NULL, 0, NULL, 0,
+    1, 0, 0, 0, 0, 0, 0, 0},
+   {{1,0,21,7,0}, "1-0:21.7.0", NULL, 0, NULL, 0,
+    1, 0, 1, 0, 1, 0, 1, 0},
+   {{1,0,22,7,0}, "1-0:22.7.0", NULL, 0, NULL, 0,
+    1, 0, 1, 0, 1, 0, 1, 0},
+   {{1,0,31,7,0}, "1-0:31.7.0", NULL, 0, NULL, 0,
+    1, 0, 1, 0, 1, 0, 1, 0},
+   {{1,0,32,7,0}, "1-0:32.7.0", NULL, 0, NULL, 0,
+    1, 0, 1, 0, 1, 0, 1, 0},
+   {{1,0,41,7,0}, "1-0:41.7.0", NULL, 0, NULL, 0,
+    1, 0, 1, 0, 1, 0, 1, 0},
+   {{1,0,42,7,0}, "1-0:42.7.0", NULL, 0, NULL, 0,
+    1, 0, 1, 0, 1, 0, 1, 0},
+   {{1,0,51,7,0}, "1-0:51.7.0", NULL, 0, NULL, 0,
+    1, 0, 1, 0, 1, 0, 1, 0},
+   {{1,0,52,7,0}, "1-0:52.7.0", NULL, 0, NULL, 0,
+    1, 0, 1, 0, 1, 0, 1, 0},
+   {{1,0,61,7,0}, "1-0:61.7.0", NULL, 0, NULL, 0,
+    1, 0, 1, 0, 1, 0, 1, 0},
+   {{1,0,62,7,0}, "1-0:62.7.0", NULL, 0, NULL, 0,
+    1, 0, 1, 0, 1, 0, 1, 0},
+   {{1,0,71,7,0}, "1-0:71.7.0", NULL, 0, NULL, 0,
+    1, 0, 1, 0, 1, 0, 1, 0},
+   {{1,0,72,7,0}, "1-0:72.7.0", NULL, 0, NULL, 0,
+    1, 0, 1, 0, 1, 0, 1, 0},
 };
+#define NUM_DEFAULT_ROWS (sizeof(default_obis)/sizeof(struct obis_data))
 
 static double calc_mean(unsigned int num_vals, double *values)
 {
@@ -85,7 +156,7 @@ static double calc_min(unsigned int num_vals, double *values)
 #if 0
 /* might be useful to trace filtered data */
 static void present_arrays(const char *descr,
-			   struct json_object *array_json,
+			   const double values[10],
 			   double latest[6],
 			   double filtered[6])
 {
@@ -94,9 +165,7 @@ static void present_arrays(const char *descr,
    fprintf(stderr, "%s\n", descr);
    fprintf(stderr, "json: ");
    for(i=0; i<10; i++)
-      fprintf(
-	 stderr, "%7.3f ",
-	 json_object_get_double(json_object_array_get_idx(array_json, i)));
+      fprintf(stderr, "%7.3f ", values[i]);
    fprintf(stderr, "\n latest: ");
    for(i=0; i<6; i++)
       fprintf(stderr, "%7.3f ", latest[i]);
@@ -107,7 +176,7 @@ static void present_arrays(const char *descr,
 }
 #endif
 
-static void init_obis_filter(struct json_object *array_json,
+static void init_obis_filter(const double values[10],
 			     struct obis_data *ObisEntry,
 			     struct filtered *filter_data)
 {
@@ -116,45 +185,40 @@ static void init_obis_filter(struct json_object *array_json,
    if(ObisEntry->mean6m_is_valid)
    {
       for(i=0;i<6;i++)
-	 filter_data->mean[i] =
-	    json_object_get_double(json_object_array_get_idx(array_json, i));
+	 filter_data->mean[i] = values[i];
    }
    if(ObisEntry->max6m_is_valid)
    {
       for(i=0;i<6;i++)
-	 filter_data->max[i] =
-	    json_object_get_double(json_object_array_get_idx(array_json, i));
+	 filter_data->max[i] = values[i];
    }
    if(ObisEntry->min6m_is_valid)
    {
       for(i=0;i<6;i++)
-	 filter_data->min[i] =
-	    json_object_get_double(json_object_array_get_idx(array_json, i));
+	 filter_data->min[i] = values[i];
    }
 } /* init_obis_filter */
 
 static void fill_obis_entry(unsigned int filter_pos,
-			    struct json_object *array_json,
+			    const double values[10],
 			    long multiplier,
 			    struct obis_data *ObisEntry,
-			    struct filtered *filter_data)
+			    struct filtered *filter_data,
+			    struct quantiles *quantile_data)
 {
    double d[6];
    int i;
 
    if(ObisEntry->latest_is_valid)
    {
-      ObisEntry->latest_value =
-	 multiplier *
-	 json_object_get_double(json_object_array_get_idx(array_json, 9));
+      ObisEntry->latest_value = multiplier * values[9];
    }
-   if(filter_pos &&
-      (ObisEntry->mean6m_is_valid || ObisEntry->max6m_is_valid ||
-       ObisEntry->min6m_is_valid))
+   /* filter_pos is 0 when the minute is the oldest 6 of the 10 values */
+   if(ObisEntry->mean6m_is_valid || ObisEntry->max6m_is_valid ||
+      ObisEntry->min6m_is_valid)
    {
       for(i=0; i<6; i++)
-	 d[i] = json_object_get_double(json_object_array_get_idx(array_json,
-					  i+filter_pos));
+	 d[i] = values[i+filter_pos];
       if(ObisEntry->mean6m_is_valid)
       {
 	 memmove(&(filter_data->mean[0]), &(filter_data->mean[1]),
@@ -179,34 +243,221 @@ static void fill_obis_entry(unsigned int filter_pos,
 	 ObisEntry->min6m_value =
 	    multiplier * calc_min(6, filter_data->min);
       }
+      if(ObisEntry->p95_is_valid)
+      {
+	 /* the 6 samples are one minute, like the mean, max and min */
+	 for(i=0; i<6; i++)
+	    quantiles_add(quantile_data, d[i], !i);
+	 quantiles_fill(ObisEntry, quantile_data, multiplier);
+      }
    }
 } /* fill_obis_entry */
 
+static int compare_obis(const void *a, const void *b)
+{
+   return obis_compare(((const struct obis_data *)a)->obis_oid,
+		       ((const struct obis_data *)b)->obis_oid);
+} /* compare_obis */
+
+/* Sets up rows for the OBIS codes found in d_json, sorted by code.
+   Returns 0 at success. */
+static int discover_rows(struct instance *inst, long d_json)
+{
+   struct MeterTable_entry *entry = inst->entry;
+   unsigned int max_rows = 0;
+   unsigned int r=0;
+   size_t member = 0, key_len;
+   const char *key;
+   long val;
+
+   while(meterjson_next_member(&(inst->json), d_json, &member, &key,
+			       &key_len) >= 0)
+      max_rows++;
+
+   entry->ObisEntries = calloc(max_rows, sizeof(struct obis_data));
+   inst->filter_data = calloc(max_rows, sizeof(struct filtered));
+   if(inst->percentiles)
+      inst->quantile_data = calloc(max_rows, sizeof(struct quantiles));
+   if((!entry->ObisEntries) || (!inst->filter_data) ||
+      (inst->percentiles && !inst->quantile_data))
+   {
+      free(entry->ObisEntries);
+      free(inst->filter_data);
+      free(inst->quantile_data);
+      entry->ObisEntries = NULL;
+      inst->filter_data = NULL;
+      inst->quantile_data = NULL;
+      return -1;
+   }
+   member = 0;
+   while((val = meterjson_next_member(&(inst->json), d_json, &member, &key,
+				      &key_len)) >= 0)
+   {
+      struct obis_data *o = &(entry->ObisEntries[r]);
+
+      if((!meterjson_is_array(&(inst->json), val)) || (key_len > 49))
+	 continue;
+      memcpy(o->obis_string, key, key_len);
+      o->obis_string[key_len] = 0;
+      if(sscanf(o->obis_string, "%lu-%lu:%lu.%lu.%lu", &(o->obis_oid[0]),
+		&(o->obis_oid[1]), &(o->obis_oid[2]), &(o->obis_oid[3]),
+		&(o->obis_oid[4])) != 5)
+      {
+	 memset(o, 0, sizeof(struct obis_data));
+	 continue;
+      }
+      /* description and unit are set by the agent from the catalogue */
+      o->latest_is_valid = 1;
+      if(obis_is_gauge(o->obis_oid))
+      {
+	 o->mean6m_is_valid = 1;
+	 o->max6m_is_valid = 1;
+	 o->min6m_is_valid = 1;
+	 o->p95_is_valid = inst->percentiles;
+	 o->p99_is_valid = inst->percentiles;
+      }
+      r++;
+   }
+   qsort(entry->ObisEntries, r, sizeof(struct obis_data), compare_obis);
+   entry->numObisEntries = r;
+   return 0;
+} /* discover_rows */
+
+/* Presents the fixed default rows */
+static int default_rows(struct instance *inst)
+{
+   struct MeterTable_entry *entry = inst->entry;
+
+   unsigned int r;
+
+   entry->ObisEntries = malloc(NUM_DEFAULT_ROWS*sizeof(struct obis_data));
+   inst->filter_data = calloc(NUM_DEFAULT_ROWS, sizeof(struct filtered));
+   if(inst->percentiles)
+      inst->quantile_data = calloc(NUM_DEFAULT_ROWS, sizeof(struct quantiles));
+   if((!entry->ObisEntries) || (!inst->filter_data) ||
+      (inst->percentiles && !inst->quantile_data))
+   {
+      free(entry->ObisEntries);
+      free(inst->filter_data);
+      free(inst->quantile_data);
+      entry->ObisEntries = NULL;
+      inst->filter_data = NULL;
+      inst->quantile_data = NULL;
+      entry->numObisEntries = 0;
+      return -1;
+   }
+   memcpy(entry->ObisEntries, default_obis,
+	  NUM_DEFAULT_ROWS*sizeof(struct obis_data));
+   for(r=0; r<NUM_DEFAULT_ROWS; r++)
+      if(entry->ObisEntries[r].mean6m_is_valid)
+      {
+	 entry->ObisEntries[r].p95_is_valid = inst->percentiles;
+	 entry->ObisEntries[r].p99_is_valid = inst->percentiles;
+      }
+   entry->numObisEntries = NUM_DEFAULT_ROWS;
+   return 0;
+} /* default_rows */
+
+/* Gives each row a ring of its latest raw samples */
+static void alloc_rings(struct instance *inst)
+{
+   struct MeterTable_entry *entry = inst->entry;
+   unsigned int r;
+
+   inst->rings = calloc(entry->numObisEntries, sizeof(struct sample_ring));
+   if(!inst->rings)
+      return;
+   for(r=0; r<entry->numObisEntries; r++)
+      if(!samples_alloc(&(inst->rings[r]), inst->num_samples))
+	 entry->ObisEntries[r].samples = &(inst->rings[r]);
+} /* alloc_rings */
+
+/* Saves the samples in the arrays of the reply not seen in earlier
+   replies. The P1IB does not tell when each sample was taken, so the new
+   samples are spread evenly between the previous reply and this one. */
+static void keep_samples(struct instance *inst, int64_t obis_count)
+{
+   struct MeterTable_entry *entry = inst->entry;
+   uint64_t now = capture_now();
+   /* none if the clock has been set back */
+   uint64_t elapsed = (now > inst->last_sample_time) ?
+      now - inst->last_sample_time : 0;
+   int64_t new_samples = obis_count - inst->last_sample_count;
+   unsigned int r;
+   int j;
+
+   if((!inst->last_sample_time) || (new_samples < 0))
+      new_samples = 1; /* first reply or the P1IB has been restarted */
+   if(new_samples > 10)
+      new_samples = 10;
+   for(r=0; r<entry->numObisEntries; r++)
+   {
+      const struct row_reply *reply = &(inst->replies[r]);
+
+      if((!entry->ObisEntries[r].samples) || (reply->num_values < 10))
+	 continue;
+      for(j=0; j<new_samples; j++)
+	 samples_push(
+	    entry->ObisEntries[r].samples,
+	    (inst->last_sample_time + elapsed*(j+1)/new_samples) / 1000000,
+	    entry->MeterMultiplier * reply->value[10-new_samples+j]);
+   }
+   inst->last_sample_count = obis_count;
+   inst->last_sample_time = now;
+} /* keep_samples */
+
+/* Reads the array of every row from d_json, returns 0 at success */
+static int read_replies(struct instance *inst, long d_json)
+{
+   struct MeterTable_entry *entry = inst->entry;
+   unsigned int r;
+   long v;
+
+   if(!inst->replies)
+      inst->replies = calloc(entry->numObisEntries, sizeof(struct row_reply));
+   if(!inst->replies)
+      return -1;
+   for(r=0; r<entry->numObisEntries; r++)
+   {
+      v = meterjson_get(&(inst->json), d_json,
+			entry->ObisEntries[r].obis_string);
+      inst->replies[r].found = (v >= 0);
+      inst->replies[r].num_values =
+	 meterjson_doubles(&(inst->json), v, inst->replies[r].value, 10);
+   }
+   return 0;
+} /* read_replies */
+
 static void fill_obis_data(int64_t obis_count,
-			   struct instance *inst,
-			   struct json_object *meter_json)
+			   struct instance *inst)
 {
    int64_t filter_pos=0;
 
-   if(inst && meter_json)
+   if(inst)
    {
-      struct json_object *tmp_json;
       struct MeterTable_entry *entry = inst->entry;
       long multiplier = entry->MeterMultiplier;
-      struct json_object *d_json = json_object_object_get(meter_json, "d");
+      long d_json = meterjson_get(&(inst->json), 0, "d");
       int i;
 
-      if(!d_json)
+      if(!meterjson_is_object(&(inst->json), d_json))
 	 return;
+      if((!entry->ObisEntries) && discover_rows(inst, d_json))
+	 return;
+      if(read_replies(inst, d_json))
+	 return;
+      if(inst->num_samples)
+      {
+	 if(!inst->rings)
+	    alloc_rings(inst);
+	 keep_samples(inst, obis_count);
+      }
       if((!inst->last_obis_filter_update)&&(obis_count > 6))
       {
 	 for(i=0; i<entry->numObisEntries; i++)
 	 {
-	    tmp_json =
-	       json_object_object_get(d_json,
-				      entry->ObisEntries[i].obis_string);
-	    if(tmp_json)
-	       init_obis_filter(tmp_json,
+	    if(inst->replies[i].found)
+	       init_obis_filter(inst->replies[i].value,
 				&(entry->ObisEntries[i]),
 				&(inst->filter_data[i]));
 	 }
@@ -227,13 +478,12 @@ static void fill_obis_data(int64_t obis_count,
 	 filter_pos = 10 - (obis_count - inst->last_obis_filter_update);
 	 for(i=0; i<entry->numObisEntries; i++)
 	 {
-	    tmp_json =
-	       json_object_object_get(d_json,
-				      entry->ObisEntries[i].obis_string);
-	    if(tmp_json)
-	       fill_obis_entry(filter_pos, tmp_json, multiplier,
+	    if(inst->replies[i].found)
+	       fill_obis_entry(filter_pos, inst->replies[i].value, multiplier,
 			       &(entry->ObisEntries[i]),
-			       &(inst->filter_data[i]));
+			       &(inst->filter_data[i]),
+			       inst->quantile_data ?
+			       &(inst->quantile_data[i]) : NULL);
 	 }
 	 inst->last_obis_filter_update += 6;
       }
@@ -242,69 +492,63 @@ static void fill_obis_data(int64_t obis_count,
 
 static size_t my_curl_callback(void *buffer, size_t size, size_t nmemb, void *userp)
 {
-   static size_t pos = 0;
    size_t out = size*nmemb;
    struct instance *inst=userp;
    struct MeterTable_entry *entry;
-   char data[CURL_MAX_WRITE_SIZE+1];
+   char *data;
 
    if(!inst) /* sanity check */
       return 0;
    entry = inst->entry;
-   if((pos + out)<=CURL_MAX_WRITE_SIZE)
+   data = inst->reply;
+   if(inst->record)
+      capture_write(inst->record, buffer, out);
+   if((inst->reply_len + out)<=CURL_MAX_WRITE_SIZE)
    {      
-      memcpy(&data[pos], buffer, out);
-      pos += out;
-      data[pos]=0;
-      if((pos > 4) && (data[pos-1]== '}') && (data[pos-2]== '}'))
+      memcpy(&data[inst->reply_len], buffer, out);
+      inst->reply_len += out;
+      data[inst->reply_len]=0;
+      if((inst->reply_len > 4) && (data[inst->reply_len-1]== '}') &&
+	 (data[inst->reply_len-2]== '}'))
       {
-	 struct json_object *meter_json, *info_json, *tmp_json;
-	 pos = 0;
-	 meter_json = json_tokener_parse(data);
-	 if(meter_json)
+	 struct meterjson *json = &(inst->json);
+	 long info_json, tmp_json;
+
+	 /* the index refers to data, which is kept until the next reply */
+	 if(!meterjson_parse(json, data, inst->reply_len))
 	 {
-	    info_json = json_object_object_get(meter_json, "info");
-	    if(info_json)
+	    info_json = meterjson_get(json, 0, "info");
+	    if(meterjson_is_object(json, info_json))
 	    {
 	       if(!entry->MeterType_len)
 	       {
-		  tmp_json = json_object_object_get(info_json, "meter");
-		  if(tmp_json)
-		  {
-		     strncpy(entry->MeterType,
-			     json_object_get_string(tmp_json), 254);
-		     entry->MeterType[254]=0;
+		  tmp_json = meterjson_get(json, info_json, "meter");
+		  if(tmp_json >= 0)
 		     entry->MeterType_len =
-			strlen(entry->MeterType);
-		  }
+			meterjson_string(json, tmp_json, entry->MeterType,
+					 255);
 	       }
 	       if(!entry->MeterMAC_len)
 	       {
-		  tmp_json = json_object_object_get(info_json, "mac");
-		  if(tmp_json)
-		  {
-		     strncpy(entry->MeterMAC,
-			     json_object_get_string(tmp_json), 254);
-		     entry->MeterMAC[254]=0;
-		     entry->MeterMAC_len = strlen(entry->MeterMAC);
-		  }
-			
+		  tmp_json = meterjson_get(json, info_json, "mac");
+		  if(tmp_json >= 0)
+		     entry->MeterMAC_len =
+			meterjson_string(json, tmp_json, entry->MeterMAC,
+					 255);
 	       }
-	       tmp_json = json_object_object_get(info_json, "rssi");
-	       if(tmp_json)
+	       tmp_json = meterjson_get(json, info_json, "rssi");
+	       if(tmp_json >= 0)
 	       {
-		  entry->MeterRSSI = json_object_get_int(tmp_json);
+		  entry->MeterRSSI = meterjson_int64(json, tmp_json);
 	       }
-	       tmp_json = json_object_object_get(info_json, "resetCnt");
-	       if(tmp_json)
+	       tmp_json = meterjson_get(json, info_json, "resetCnt");
+	       if(tmp_json >= 0)
 	       {
-		  fill_obis_data(json_object_get_int64(tmp_json),
-				 inst,
-				 meter_json);
+		  fill_obis_data(meterjson_int64(json, tmp_json), inst);
 	       }
 	    }
-	    json_object_put(meter_json); /* free json stuff */
 	 }
+	 inst->reply_len = 0;
       }
       return out;
    }
@@ -313,72 +557,33 @@ static size_t my_curl_callback(void *buffer, size_t size, size_t nmemb, void *us
    
 } /* my_curl_callback */
 
+/* Gets new data from the meter, or from the capture being replayed */
+static void perform(struct instance *inst)
+{
+   char buf[CURL_MAX_WRITE_SIZE];
+   long len;
+
+   inst->reply_len = 0;
+   if(inst->replay)
+   {
+      if(capture_next_transfer(inst->replay))
+	 while((len = capture_read(inst->replay, buf,
+				   CURL_MAX_WRITE_SIZE)) > 0)
+	    my_curl_callback(buf, 1, len, inst);
+   }
+   else if(inst->curl)
+   {
+      curl_easy_perform(inst->curl);
+      if(inst->record)
+	 capture_end(inst->record);
+   }
+} /* perform */
+
 void *init_driver(struct MeterTable_entry *entry,
 		  const char *parameters)
 {
    char *pc;
-   const struct obis_data driver_obis[] = {
-      {{1,0,1,7,0}, "1-0:1.7.0",
-       "Instantaneous power (A+) consumed from grid", 0, "kW", 0,
-       1, 0, 1, 0, 1, 0, 1, 0},
-      {{1,0,1,8,0}, "1-0:1.8.0",
-       "Total active energy consumed from grid", 0, "kWh", 0,
-       1, 0, 0, 0, 0, 0, 0, 0},
-      {{1,0,2,7,0}, "1-0:2.7.0",
-       "Instantaneous power (A-) exported to grid", 0, "kW", 0,
-       1, 0, 1, 0, 1, 0, 1, 0},
-      {{1,0,2,8,0}, "1-0:2.8.0",
-       "Total active energy exported to grid", 0, "kWh", 0,
-       1, 0, 0, 0, 0, 0, 0, 0},
-      {{1,0,3,7,0}, "1-0:3.7.0",
-       "Positive reactive instantaneous power (Q+)", 0, "kvar", 0,
-       1, 0, 1, 0, 1, 0, 1, 0},
-      {{1,0,3,8,0}, "1-0:3.8.0",
-       "Positive reactive energy (Q+) total", 0, "kvarh", 0,
-       1, 0, 0, 0, 0, 0, 0, 0},
-      {{1,0,4,7,0}, "1-0:4.7.0",
-       "Negative reactive instantaneous power (Q-)", 0, "kvar", 0,
-       1, 0, 1, 0, 1, 0, 1, 0},
-      {{1,0,4,8,0}, "1-0:4.8.0",
-       "Negative reactive energy (Q-) total", 0, "kvarh", 0,
-       1, 0, 0, 0, 0, 0, 0, 0},
-      {{1,0,21,7,0}, "1-0:21.7.0",
-       "Instantaneous power (A+) consumed from phase L1", 0, "kW", 0,
-       1, 0, 1, 0, 1, 0, 1, 0},
-      {{1,0,22,7,0}, "1-0:22.7.0",
-       "Negative active instantaneous power (A-) phase L1", 0, "kW", 0,
-       1, 0, 1, 0, 1, 0, 1, 0},
-      {{1,0,31,7,0}, "1-0:31.7.0",
-       "Instantaneous current (I) in phase L1", 0, "A", 0,
-       1, 0, 1, 0, 1, 0, 1, 0},
-      {{1,0,32,7,0}, "1-0:32.7.0",
-       "Instantaneous voltage (U) in phase L1", 0, "V", 0,
-       1, 0, 1, 0, 1, 0, 1, 0},
-      {{1,0,41,7,0}, "1-0:41.7.0",
-       "Instantaneous power (A+) consumed from phase L2", 0, "kW", 0,
-       1, 0, 1, 0, 1, 0, 1, 0},
-      {{1,0,42,7,0}, "1-0:42.7.0",
-       "Negative active instantaneous power (A-) phase L2", 0, "kW", 0,
-       1, 0, 1, 0, 1, 0, 1, 0},
-      {{1,0,51,7,0}, "1-0:51.7.0",
-       "Instantaneous current (I) in phase L2", 0, "A", 0,
-       1, 0, 1, 0, 1, 0, 1, 0},
-      {{1,0,52,7,0}, "1-0:52.7.0",
-       "Instantaneous voltage (U) in phase L2", 0, "V", 0,
-       1, 0, 1, 0, 1, 0, 1, 0},
-      {{1,0,61,7,0}, "1-0:61.7.0",
-       "Instantaneous power (A+) consumed from phase L3", 0, "kW", 0,
-       1, 0, 1, 0, 1, 0, 1, 0},
-      {{1,0,62,7,0}, "1-0:62.7.0",
-       "Negative active instantaneous power (A-) phase L3", 0, "kW", 0,
-       1, 0, 1, 0, 1, 0, 1, 0},
-      {{1,0,71,7,0}, "1-0:71.7.0",
-       "Instantaneous current (I) in phase L3", 0, "A", 0,
-       1, 0, 1, 0, 1, 0, 1, 0},
-      {{1,0,72,7,0}, "1-0:72.7.0",
-       "Instantaneous voltage (U) in phase L3", 0, "V", 0,
-       1, 0, 1, 0, 1, 0, 1, 0},
-   };
+   char path[256];
    struct instance *out = malloc(sizeof(struct instance));
 
    if(!out)
@@ -421,17 +626,37 @@ void *init_driver(struct MeterTable_entry *entry,
    /* initialize other parts of entry */
    entry->MeterMAC[0]=0;
    entry->MeterMAC_len=0;
-   entry->numObisEntries = sizeof(driver_obis)/sizeof(struct obis_data);
-   entry->ObisEntries = malloc(sizeof(driver_obis));
-   if(!entry->ObisEntries)
-      entry->numObisEntries = 0;
-   else
-      memcpy(entry->ObisEntries, driver_obis, sizeof(driver_obis));
+   /* rows are set up from the first reply unless told otherwise */
+   entry->numObisEntries = 0;
+   entry->ObisEntries = NULL;
+   out->filter_data = NULL;
+   out->quantile_data = NULL;
+   out->rings = NULL;
+   out->replies = NULL;
+   memset(&(out->json), 0, sizeof(struct meterjson));
+   out->last_sample_count = 0;
+   out->last_sample_time = 0;
+   pc = strstr(parameters, "samples=");
+   out->num_samples = (pc && (atoi(pc+8) > 0)) ? atoi(pc+8) : 0;
+   pc = strstr(parameters, "percentiles=");
+   out->percentiles = pc && atoi(pc+12);
+   pc = strstr(parameters, "discover=");
+   if(pc && !atoi(pc+9))
+      default_rows(out);
    out->last_obis_filter_update=0;
-   out->filter_data = calloc(entry->numObisEntries, sizeof(struct filtered));
-   if(!out->filter_data)
-       entry->numObisEntries = 0;
-   if(entry->MeterIP_len)
+   out->curl = NULL;
+   out->record = NULL;
+   out->replay = NULL;
+   if(capture_parameter(parameters, "replay=", path, 256))
+   {
+      char speed[10]="";
+
+      capture_parameter(parameters, "replayspeed=", speed, 10);
+      out->replay = capture_open_replay(path, strcmp(speed, "max"));
+      if(!out->replay)
+	 fprintf(stderr, "Failed opening capture %s\n", path);
+   }
+   else if(entry->MeterIP_len)
    {
       char url[276];
       snprintf(url, 275, "http://%s/meterData", entry->MeterIP);
@@ -439,8 +664,24 @@ void *init_driver(struct MeterTable_entry *entry,
       curl_easy_setopt(out->curl, CURLOPT_URL, url);
       curl_easy_setopt(out->curl, CURLOPT_WRITEFUNCTION, my_curl_callback);
       curl_easy_setopt(out->curl, CURLOPT_WRITEDATA, (void *)out);
-      curl_easy_perform(out->curl);
+      /* updated by worker threads, no signals for timeouts */
+      curl_easy_setopt(out->curl, CURLOPT_NOSIGNAL, 1L);
+      /* an unreachable meter must not keep its worker thread for long */
+      curl_easy_setopt(out->curl, CURLOPT_CONNECTTIMEOUT, 3L);
+      curl_easy_setopt(out->curl, CURLOPT_TIMEOUT, 5L);
+      if(capture_parameter(parameters, "timeout=", path, 256) &&
+	 (atol(path) > 0))
+	 curl_easy_setopt(out->curl, CURLOPT_TIMEOUT, atol(path));
+      if(capture_parameter(parameters, "record=", path, 256))
+      {
+	 out->record = capture_open_record(path);
+	 if(!out->record)
+	    fprintf(stderr, "Failed opening capture %s\n", path);
+      }
    }
+   perform(out);
+   if(!entry->ObisEntries)
+      default_rows(out);
    return out;
 } /* init_driver */
 
@@ -451,7 +692,7 @@ void update_driver_data(void *driver, struct MeterTable_entry *entry)
    if(!i)
       return;
 
-   curl_easy_perform(i->curl);
+   perform(i);
 } /* update_driver_data */
 
 void remove_driver(void *driver, struct MeterTable_entry *entry)
@@ -466,12 +707,28 @@ void remove_driver(void *driver, struct MeterTable_entry *entry)
    if(i->curl)
       curl_easy_cleanup(i->curl);
    i->curl = NULL;
-   if(entry->numObisEntries)
+   capture_close(i->record);
+   i->record = NULL;
+   capture_close(i->replay);
+   i->replay = NULL;
+   free(i->filter_data);
+   i->filter_data = NULL;
+   free(i->quantile_data);
+   i->quantile_data = NULL;
+   free(i->replies);
+   i->replies = NULL;
+   meterjson_free(&(i->json));
+   if(i->rings)
    {
-      free(i->filter_data);
-      free(entry->ObisEntries);
-      entry->ObisEntries = NULL;
-      entry->numObisEntries = 0;
+      unsigned int r;
+
+      for(r=0; r<entry->numObisEntries; r++)
+	 samples_free(&(i->rings[r]));
+      free(i->rings);
+      i->rings = NULL;
    }
+   free(entry->ObisEntries);
+   entry->ObisEntries = NULL;
+   entry->numObisEntries = 0;
 } /* remove_driver */
 
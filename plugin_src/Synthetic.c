@@ -0,0 +1,283 @@
+/**************************************************************
+This is the dynamic driver plugin for synthetic meters. No hardware
+is read, instead each instance makes up a configurable number of
+OBIS values following realistic looking curves. Many instances can be
+configured to test how the agent behaves with a lot of meters.
+
+SPDX-License-Identifier: BSD-2-Clause
+
+Copyright (c) 2026, Henrik Carlqvist
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **************************************************************/
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+#include "driver.h"
+#include "filtered.h"
+
+/* The rows are made up in groups of three for each channel */
+#define ROW_POWER 0
+#define ROW_VOLTAGE 1
+#define ROW_ENERGY 2
+#define ROWS_PER_CHANNEL 3
+
+struct channel
+{
+   double base_power; /* kW */
+   double phase; /* radians */
+   double energy; /* kWh */
+};
+
+struct instance
+{
+   struct MeterTable_entry *entry;
+   unsigned int seed;
+   unsigned int period; /* seconds of one power cycle */
+   unsigned int cost_us; /* busy time spent by each update */
+   struct timespec previous;
+   time_t minute;
+   struct channel *channels;
+   struct filtered *filter_data;
+};
+
+static double noise(struct instance *inst, double amplitude)
+{
+   return amplitude * (2.0 * rand_r(&(inst->seed)) / RAND_MAX - 1.0);
+} /* noise */
+
+static double elapsed_us(const struct timespec *from,
+			 const struct timespec *to)
+{
+   return (to->tv_sec - from->tv_sec)*1e6 +
+      (to->tv_nsec - from->tv_nsec)/1e3;
+} /* elapsed_us */
+
+/* Spends cost_us of CPU time like a driver parsing a reply would */
+static void spend_cost(unsigned int cost_us)
+{
+   struct timespec start, now;
+
+   if(!cost_us)
+      return;
+   clock_gettime(CLOCK_MONOTONIC, &start);
+   do
+      clock_gettime(CLOCK_MONOTONIC, &now);
+   while(elapsed_us(&start, &now) < cost_us);
+} /* spend_cost */
+
+static void fill_obis_entry(double value,
+			    int new_minute,
+			    long multiplier,
+			    struct obis_data *ObisEntry,
+			    struct filtered *f)
+{
+   ObisEntry->latest_value = multiplier * value;
+   if(!ObisEntry->mean6m_is_valid)
+      return;
+   filtered_add(value, new_minute, f);
+   filtered_fill(ObisEntry, f, multiplier);
+} /* fill_obis_entry */
+
+static void fill_obis_data(struct instance *inst)
+{
+   struct MeterTable_entry *entry = inst->entry;
+   struct timespec now;
+   double t, dt, value=0.0;
+   int new_minute;
+   unsigned int r;
+
+   clock_gettime(CLOCK_REALTIME, &now);
+   t = now.tv_sec + now.tv_nsec/1e9;
+   dt = elapsed_us(&(inst->previous), &now)/1e6;
+   inst->previous = now;
+   new_minute = ((now.tv_sec/60) != inst->minute);
+   inst->minute = now.tv_sec/60;
+   for(r=0; r<entry->numObisEntries; r++)
+   {
+      struct channel *c = &(inst->channels[r/ROWS_PER_CHANNEL]);
+
+      switch(r % ROWS_PER_CHANNEL)
+      {
+	 case ROW_POWER:
+	    value = c->base_power *
+	       (1.0 + 0.5*sin(2*M_PI*t/inst->period + c->phase)) +
+	       noise(inst, 0.05*c->base_power);
+	    if(value < 0.0)
+	       value = 0.0;
+	    /* the energy counter of this channel follows its power */
+	    c->energy += value * dt / 3600;
+	    break;
+	 case ROW_VOLTAGE:
+	    value = 230.0 + 3.0*sin(2*M_PI*t/300 + c->phase) +
+	       noise(inst, 0.5);
+	    break;
+	 case ROW_ENERGY:
+	    value = c->energy;
+	    break;
+      }
+      fill_obis_entry(value, new_minute, entry->MeterMultiplier,
+		      &(entry->ObisEntries[r]), &(inst->filter_data[r]));
+   }
+} /* fill_obis_data */
+
+void *init_driver(struct MeterTable_entry *entry,
+		  const char *parameters)
+{
+   static unsigned int instances=0;
+   char *pc;
+   unsigned int num_rows=20;
+   unsigned int r;
+   struct instance *out = calloc(1, sizeof(struct instance));
+
+   if(!out)
+      return NULL;
+
+   out->entry=entry;
+   entry->valid = 1;
+   out->seed = ++instances;
+   pc = strstr(parameters, "seed=");
+   if(pc)
+      out->seed = atoi(pc+5);
+   pc = strstr(parameters, "rows=");
+   if(pc)
+      num_rows = atoi(pc+5);
+   out->period = 3600;
+   pc = strstr(parameters, "period=");
+   if(pc)
+      out->period = atoi(pc+7);
+   if(out->period < 1)
+      out->period = 1;
+   pc = strstr(parameters, "cost=");
+   if(pc)
+      out->cost_us = atoi(pc+5);
+   pc = strstr(parameters, "multiplier=");
+   if(pc)
+   {
+      pc += 11;
+      entry->MeterMultiplier=atol(pc);
+      if(entry->MeterMultiplier < 1)
+	 entry->MeterMultiplier = 1;
+   }
+   else
+   {
+      entry->MeterMultiplier=1000;
+   }
+   snprintf(entry->MeterType, 255, "Synthetic %u", out->seed);
+   entry->MeterType_len = strlen(entry->MeterType);
+   entry->MeterIP[0]=0;
+   entry->MeterIP_len=0;
+   entry->MeterMAC[0]=0;
+   entry->MeterMAC_len=0;
+   entry->MeterRSSI=0; /* not used */
+
+   entry->numObisEntries = num_rows;
+   entry->ObisEntries = calloc(num_rows, sizeof(struct obis_data));
+   out->filter_data = calloc(num_rows, sizeof(struct filtered));
+   out->channels = calloc(num_rows/ROWS_PER_CHANNEL + 1,
+			  sizeof(struct channel));
+   if((!entry->ObisEntries) || (!out->filter_data) || (!out->channels))
+   {
+      free(entry->ObisEntries);
+      free(out->filter_data);
+      free(out->channels);
+      entry->ObisEntries = NULL;
+      entry->numObisEntries = 0;
+      free(out);
+      return NULL;
+   }
+   for(r=0; r<=num_rows/ROWS_PER_CHANNEL; r++)
+   {
+      out->channels[r].base_power = 0.5 + 4.5*rand_r(&(out->seed))/RAND_MAX;
+      out->channels[r].phase = 2*M_PI*rand_r(&(out->seed))/RAND_MAX;
+      out->channels[r].energy = 1000.0*rand_r(&(out->seed))/RAND_MAX;
+   }
+   for(r=0; r<num_rows; r++)
+   {
+      struct obis_data *o = &(entry->ObisEntries[r]);
+      unsigned int channel = r/ROWS_PER_CHANNEL;
+
+      /* channel is given by OBIS B, and by E when there are more than 256,
+	 descriptions and units come from the catalogue */
+      o->obis_oid[0] = 1;
+      o->obis_oid[1] = channel % 256;
+      o->obis_oid[4] = channel / 256;
+      switch(r % ROWS_PER_CHANNEL)
+      {
+	 case ROW_POWER:
+	    o->obis_oid[2] = 1;
+	    o->obis_oid[3] = 7;
+	    o->mean6m_is_valid = 1;
+	    o->max6m_is_valid = 1;
+	    o->min6m_is_valid = 1;
+	    break;
+	 case ROW_VOLTAGE:
+	    o->obis_oid[2] = 32;
+	    o->obis_oid[3] = 7;
+	    o->mean6m_is_valid = 1;
+	    o->max6m_is_valid = 1;
+	    o->min6m_is_valid = 1;
+	    break;
+	 case ROW_ENERGY:
+	    o->obis_oid[2] = 1;
+	    o->obis_oid[3] = 8;
+	    break;
+      }
+      snprintf(o->obis_string, 50, "%lu-%lu:%lu.%lu.%lu",
+	       o->obis_oid[0], o->obis_oid[1], o->obis_oid[2],
+	       o->obis_oid[3], o->obis_oid[4]);
+      o->latest_is_valid = 1;
+   }
+   clock_gettime(CLOCK_REALTIME, &(out->previous));
+   out->minute = out->previous.tv_sec/60;
+   fill_obis_data(out);
+   return out;
+} /* init_driver */
+
+void update_driver_data(void *driver, struct MeterTable_entry *entry)
+{
+   struct instance *i = driver;
+
+   if(!i)
+      return;
+   spend_cost(i->cost_us);
+   fill_obis_data(i);
+} /* update_driver_data */
+
+void remove_driver(void *driver, struct MeterTable_entry *entry)
+{
+   struct instance *i = driver;
+
+   if(!i)
+      return;
+   if (!entry)
+      return;                 /* Nothing to remove */
+   entry->valid=0;
+   free(i->filter_data);
+   free(i->channels);
+   free(entry->ObisEntries);
+   entry->ObisEntries = NULL;
+   entry->numObisEntries = 0;
+   free(i);
+} /* remove_driver */
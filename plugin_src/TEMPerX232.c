@@ -39,26 +39,49 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <string.h>
 #include <stdlib.h>
 #include <pthread.h>
+#include <poll.h>
+#include <dirent.h>
 #include "driver.h"
+#include "capture.h"
 
-#define MAX_TEMPER_VALUES 10
+#define REPLY_SIZE 4096 /* room for a long chain of probes */
+#define MAX_TOKENS (REPLY_SIZE/5) /* shortest possible value is ",0[x]" */
+#define SERIAL_CHUNK 256 /* bytes asked for by each read */
+#define LINE_GAP_MS 20 /* about 20 characters at 9600 baud */
+#define BY_ID_DIR "/dev/serial/by-id"
 
-struct data
+/* One value found in a reply, the strings point into the reply buffer and
+   are not zero terminated */
+struct token
 {
-   char description[20];
-   float value;
-   char unit[5];
+   const char *name; /* probe name following "Temp-" */
+   int name_len;
+   int humidity; /* 0 for the temperature, 1 for the humidity of a probe */
+   unsigned long key; /* hash of name and humidity */
+   double value;
+   const char *unit;
+   int unit_len;
 };
 
 struct instance
 {
    struct MeterTable_entry *entry;
    int fdTtyUSB;
+   int timeout_ms;
    struct termios tattr;
    pthread_mutex_t mutex;
-   /* Add stuff for filtering averages here */
-   char description[MAX_TEMPER_VALUES][20];
-   float average[MAX_TEMPER_VALUES];
+   int failures;
+   struct capture *record; /* where to save what is received, if anywhere */
+   struct capture *replay; /* read from here instead of the device if set */
+   char reply[REPLY_SIZE];
+   struct token tokens[MAX_TOKENS];
+   /* set up by init_driver, the n:th token of a reply normally belongs to
+      ObisEntries[token_row[n]] whose key is row_key[token_row[n]] */
+   int num_token_rows;
+   int *token_row;
+   unsigned long *row_key;
+   double *average;
+   char (*units)[16];
 };
 
 static void reinit_serial(const char *port, struct instance *i)
@@ -74,7 +97,7 @@ static void reinit_serial(const char *port, struct instance *i)
 }
 
 /* returns file descriptor or < 0 at failure */
-static int init_serial(const char *port, unsigned int timeout_deciSec)
+static int init_serial(const char *port)
 {
    struct termios t;
    int fd = open(port, O_RDWR | O_NOCTTY);
@@ -99,186 +122,245 @@ static int init_serial(const char *port, unsigned int timeout_deciSec)
    t.c_cflag &= ~ECHO; 
    t.c_lflag &= ~ECHO;
    t.c_lflag &= ~ICANON;
-   t.c_cc[VTIME]=timeout_deciSec;
+   /* never block in read, waiting is done by poll in read_reply */
+   t.c_cc[VTIME]=0;
    t.c_cc[VMIN]=0;
    tcsetattr(fd, TCSANOW, &t);
 
    return fd; 
 }
 
-/* returns length of string or 0 at failure */
-static int get_version(int fd, char *buf, int maxlen)
+/* Sends command and collects the reply into buf with line terminators
+   stripped. The full timeout is only used while waiting for the first line,
+   once a line has been terminated the reply is complete as soon as no
+   more characters arrive within LINE_GAP_MS. Returns length of reply or 0
+   at failure */
+static int command_reply(struct instance *i, const char *command,
+			 char *buf, int maxlen)
 {
+   char chunk[SERIAL_CHUNK];
+   struct pollfd pfd;
    int out=0;
-   const char command[] = "Version\n";
-   (void)! write(fd, command, strlen(command));
-   while(maxlen > 0)
+   int have_line=0;
+   ssize_t n, k;
+
+   if(i->replay)
+   {
+      if(!capture_next_transfer(i->replay))
+	 return 0;
+   }
+   else
+   {
+      /* forget anything left from an earlier reply */
+      tcflush(i->fdTtyUSB, TCIFLUSH);
+      (void)! write(i->fdTtyUSB, command, strlen(command));
+   }
+   pfd.fd = i->fdTtyUSB;
+   pfd.events = POLLIN;
+   for(;;)
    {
-      if(read(fd, buf, 1))
+      if(i->replay)
+	 n = capture_read(i->replay, chunk, SERIAL_CHUNK);
+      else if(poll(&pfd, 1, have_line ? LINE_GAP_MS : i->timeout_ms) > 0)
+	 n = read(i->fdTtyUSB, chunk, SERIAL_CHUNK);
+      else
+	 n = 0;
+      if(n <= 0)
+	 break;
+      if(i->record)
+	 capture_write(i->record, chunk, n);
+      for(k=0; k<n; k++)
       {
-	 if(*buf++ > 0x0d) /* strip EOL */
+	 if(chunk[k] > 0x0d) /* strip EOL */
 	 {
-	    maxlen--;
-	    out++;
+	    /* anything not fitting is read but thrown away */
+	    if(out < (maxlen-1))
+	       buf[out++] = chunk[k];
 	 }
-	 else
-	    buf--;
-      }
-      else
-      {
-	 *buf = 0;
-	 return out;
+	 else if(out)
+	    have_line = 1;
       }
    }
-   /* Whoops, this should not happen, lets start by emptying from any remains
-      of the response */
-   while(read(fd, buf, 1));
-   /* We should also make sure that output is zero-terminated */
-   if(out)
-   {
-      buf--;
-      out--;
-      *buf=0;
-   }
+   if(i->record)
+      capture_end(i->record);
+   buf[out] = 0;
    return out;
 }
 
-static void sort_data(struct data *d, int numdata)
+/* returns length of string or 0 at failure */
+static int get_version(struct instance *i, char *buf, int maxlen)
 {
-   struct data t;
-   int i;
-   int cont=1;
-   while(cont)
-   {
-      cont=0;
-      /* kind of bubble sort */
-      for(i=0; i< numdata-1; i++)
-	 if(strcmp(d[i].description, d[i+1].description)>0)
-	 {
-	    t = d[i];
-	    d[i] = d[i+1];
-	    d[i+1] = t;
-	    cont = 1;
-	 }
-   }
-} /* sort_data */
+   return command_reply(i, "Version\n", buf, maxlen);
+}
 
-static int fill_data(const char *buf, struct data *d, int maxnum)
+enum tokenizer_state
 {
-   int numdata=0;
-   char *p;
+   SEEK_TEMP, /* looking for "Temp-" */
+   NAME, /* probe name until ':' */
+   UNIT_START, /* value has been read, looking for '[' */
+   UNIT, /* unit until ']' */
+   AFTER_UNIT /* a ',' here means that a humidity value follows */
+};
 
-   while((numdata<maxnum) && (p=strstr(buf, "Temp-")))
+/* Splits a zero terminated reply like
+   "Temp-Inner:23.62 [C],39.81 [%RH];Temp-Outer:5.25 [C]"
+   into tokens in one pass. Returns number of tokens found. */
+static int tokenize(const char *buf, struct token *t, int maxnum)
+{
+   static const char temp[] = "Temp-";
+   enum tokenizer_state state = SEEK_TEMP;
+   int numtokens = 0;
+   int matched = 0;
+   const char *name = NULL;
+   int name_len = 0;
+   unsigned long hash = 0;
+   const char *p;
+   char *end;
+
+   for(p=buf; *p && (numtokens < maxnum); p++)
    {
-      strncpy(d[numdata].description, p, 19);
-      d[numdata].description[19]=0;
-      buf=p;
-      if((p=strstr(d[numdata].description, ":")))
-	 *p=0;
-      if((p=strstr(buf, ":")))
+      switch(state)
       {
-	 p++;
-	 d[numdata].value=atof(p);
-	 buf=p;
-	 if((p=strstr(buf, "[")))
-	 {
-	    p++;
-	    strncpy(d[numdata].unit, p, 4);
-	    d[numdata].unit[4]=0;
-	    buf=p;
-	    if((p=strstr(d[numdata].unit, "]")))
-	       *p = 0;
-	    if((p=strstr(buf, "]")))
+	 case AFTER_UNIT:
+	    if(*p == ',')
 	    {
-	       p++;
-	       numdata++;
-	       if(*p ==',')
+	       t[numtokens].value = strtod(p+1, &end);
+	       if(end == (p+1))
 	       {
-		  p++;
-		  buf=p;
-		  snprintf(d[numdata].description, 20, "Humidity-%s",
-			   &(d[numdata-1].description[5]));
-		  d[numdata].value=atof(p);
-		  if((p=strstr(buf, "[")))
-		  {
-		     p++;
-		     strncpy(d[numdata].unit, p, 4);
-		     d[numdata].unit[4]=0;
-		     buf=p;
-		     if((p=strstr(d[numdata].unit, "]")))
-			*p = 0;
-		     if((p=strstr(buf, "]")))
-		     {
-			p++;
-			numdata++;
-		     }
-		  }
+		  state = SEEK_TEMP;
+		  break;
 	       }
+	       t[numtokens].humidity = 1;
+	       t[numtokens].key = (hash << 1) | 1;
+	       t[numtokens].name = name;
+	       t[numtokens].name_len = name_len;
+	       p = end - 1;
+	       state = UNIT_START;
+	       break;
 	    }
-	 }
+	    state = SEEK_TEMP;
+	    /* fall through, this might be the start of next probe */
+	 case SEEK_TEMP:
+	    if(*p == temp[matched])
+	       matched++;
+	    else
+	       matched = (*p == temp[0]);
+	    if(matched == (sizeof(temp)-1))
+	    {
+	       matched = 0;
+	       name = p+1;
+	       hash = 2166136261UL; /* FNV-1a */
+	       state = NAME;
+	    }
+	    break;
+	 case NAME:
+	    if(*p == ':')
+	    {
+	       name_len = p - name;
+	       t[numtokens].value = strtod(p+1, &end);
+	       if(end == (p+1))
+	       {
+		  state = SEEK_TEMP;
+		  break;
+	       }
+	       t[numtokens].humidity = 0;
+	       t[numtokens].key = hash << 1;
+	       t[numtokens].name = name;
+	       t[numtokens].name_len = name_len;
+	       p = end - 1;
+	       state = UNIT_START;
+	    }
+	    else
+	       hash = (hash ^ (unsigned char)*p) * 16777619UL;
+	    break;
+	 case UNIT_START:
+	    if(*p == '[')
+	    {
+	       t[numtokens].unit = p+1;
+	       state = UNIT;
+	    }
+	    else if(*p != ' ')
+	       state = SEEK_TEMP;
+	    break;
+	 case UNIT:
+	    if(*p == ']')
+	    {
+	       t[numtokens].unit_len = p - t[numtokens].unit;
+	       numtokens++;
+	       state = AFTER_UNIT;
+	    }
+	    break;
       }
    }
-   sort_data(d, numdata);
-   return numdata;
-}
-/* returns number of sorted data fields or 0 at failure */
-static int get_data(int fd, struct data *d, int maxnum)
+   return numtokens;
+} /* tokenize */
+
+/* returns number of tokens or 0 at failure */
+static int get_data(struct instance *i)
 {
-   int out=0;
-   const char command[] = "ReadTemp\n";
-   char b[500];
-   char *buf=b;
-   int maxlen = 500;
-   
-   (void)!write(fd, command, strlen(command));
-   while(maxlen > 0)
-   {
-      if(read(fd, buf, 1))
-      {
-	 if(*buf > 0x0d) /* strip EOL */
-	 {
-	    buf++;
-	    maxlen--;
-	    out++;
-	 }
-      }
-      else
-      {
-	 *buf = 0;
-	 return fill_data(b, d, maxnum);
-      }
-   }
-   /* Whoops, this should not happen, lets start by emptying from any remains
-      of the response */
-   while(read(fd, buf, 1));
-   /* We should also make sure that output is zero-terminated */
-   if(out)
-   {
-      buf--;
-      out--;
-      *buf=0;
-   }
-   return fill_data(b, d, maxnum);
+   if(!command_reply(i, "ReadTemp\n", i->reply, REPLY_SIZE))
+      return 0;
+   return tokenize(i->reply, i->tokens, MAX_TOKENS);
 }
 
+/* returns row index of key, or -1 if it is unknown */
+static int find_row(const struct instance *i, unsigned long key)
+{
+   int r;
+
+   for(r=0; r<i->entry->numObisEntries; r++)
+      if(i->row_key[r] == key)
+	 return r;
+   return -1;
+} /* find_row */
+
+/* the name of a row like "Temp-Outdoor" is kept in its obis_string */
+static int compare_name(const void *a, const void *b)
+{
+   return strcmp(((const struct obis_data *)a)->obis_string,
+		 ((const struct obis_data *)b)->obis_string);
+} /* compare_name */
+
+/* Writes the name of the row of t, cut like obis_string */
+static void row_name(const struct token *t, char *name)
+{
+   snprintf(name, sizeof(((struct obis_data *)0)->obis_string), "%s-%.*s",
+	    t->humidity ? "Humidity" : "Temp", t->name_len, t->name);
+} /* row_name */
+
+static void free_instance(struct instance *i)
+{
+   if(i->fdTtyUSB >= 0)
+      close(i->fdTtyUSB);
+   capture_close(i->record);
+   capture_close(i->replay);
+   free(i->token_row);
+   free(i->row_key);
+   free(i->average);
+   free(i->units);
+   free(i);
+} /* free_instance */
+
 #if 0
 int main(int argc, char **argv) /* remove this main function later, now only
 				   for testing purposes */
 {
    char version[50];
-   struct data d[MAX_TEMPER_VALUES];
+   static struct instance inst;
+   struct token *t = inst.tokens;
    int numdata;
    int i;
-   int fd;
    if(argc < 2)
       return  1;
-   if(!((fd = init_serial(argv[1], 5)) > 0))
+   if(!((inst.fdTtyUSB = init_serial(argv[1])) > 0))
       return 2;
-   get_version(fd, version, 50);
+   inst.timeout_ms = 500;
+   get_version(&inst, version, 50);
    printf("%s\n", version);
-   numdata=get_data(fd, d, MAX_TEMPER_VALUES);
+   numdata=get_data(&inst);
    for(i=0; i<numdata; i++)
-      printf("%20s : %5.2f %s\n", d[i].description, d[i].value, d[i].unit);
+      printf("%s-%.*s : %5.2f %.*s\n", t[i].humidity ? "Humidity" : "Temp",
+	     t[i].name_len, t[i].name, t[i].value, t[i].unit_len, t[i].unit);
 
    return 0;
 } /* main, to be removed!!! */
@@ -289,13 +371,15 @@ void *init_driver(struct MeterTable_entry *entry,
 		  const char *parameters)
 {
    char *pc;
-   struct obis_data driver_obis[MAX_TEMPER_VALUES];
-   struct data d[MAX_TEMPER_VALUES];
+   struct obis_data *driver_obis;
+   struct token *t;
    int numdata=0;
-   int i;
+   int i, r;
    unsigned int timeout_deciSec=5;
+   char path[256];
+   int realtime=0;
 
-   struct instance *out = malloc(sizeof(struct instance));
+   struct instance *out = calloc(1, sizeof(struct instance));
 
    if(!out)
       return NULL;
@@ -311,7 +395,7 @@ void *init_driver(struct MeterTable_entry *entry,
       pc += 7;
       strncpy(entry->MeterIP, pc, 255);
       entry->MeterIP[254]=0;
-      pc = strstr(entry->MeterIP, ",timeout=");
+      pc=strchr(entry->MeterIP, ',');
       if(pc)
 	 *pc=0;
       entry->MeterIP_len = strlen(entry->MeterIP);
@@ -327,41 +411,65 @@ void *init_driver(struct MeterTable_entry *entry,
       pc += 8;
       timeout_deciSec = atoi(pc);
    }
-   out->fdTtyUSB = init_serial(entry->MeterIP, timeout_deciSec);
-   if(out->fdTtyUSB < 0)
+   out->timeout_ms = 100*timeout_deciSec;
+   if(capture_parameter(parameters, "replay=", path, 256))
    {
-      free(out);      
-      return NULL;
+      char speed[10]="";
+
+      capture_parameter(parameters, "replayspeed=", speed, 10);
+      /* Version and ReadTemp are replayed back to back at start */
+      out->replay = capture_open_replay(path, 0);
+      realtime = strcmp(speed, "max");
+      if(!out->replay)
+      {
+	 fprintf(stderr, "Failed opening capture %s\n", path);
+	 free(out);
+	 return NULL;
+      }
+      out->fdTtyUSB = -1;
    }
-   if(tcgetattr(out->fdTtyUSB, &(out->tattr)))
+   else
    {
-      free(out);
-      return NULL;
+      out->fdTtyUSB = init_serial(entry->MeterIP);
+      if(out->fdTtyUSB < 0)
+      {
+	 free(out);      
+	 return NULL;
+      }
+      if(tcgetattr(out->fdTtyUSB, &(out->tattr)))
+      {
+	 close(out->fdTtyUSB);
+	 free(out);
+	 return NULL;
+      }
+      if(capture_parameter(parameters, "record=", path, 256))
+      {
+	 out->record = capture_open_record(path);
+	 if(!out->record)
+	    fprintf(stderr, "Failed opening capture %s\n", path);
+      }
    }
-   entry->MeterType_len =
-      get_version(out->fdTtyUSB, entry->MeterType, 254);
-   numdata=get_data(out->fdTtyUSB, d, MAX_TEMPER_VALUES);
-   if(!numdata)
+   entry->MeterType_len = get_version(out, entry->MeterType, 255);
+   t = out->tokens;
+   numdata=get_data(out);
+   if(out->replay)
    {
-      free(out);      
-      return NULL;
+      /* time the rest of the replay from here */
+      out->replay->realtime = realtime;
+      out->replay->start_us = 0;
    }
-   for(i=0; i<numdata; i++)
+   driver_obis = calloc(numdata, sizeof(struct obis_data));
+   out->token_row = calloc(numdata, sizeof(int));
+   out->row_key = calloc(numdata, sizeof(unsigned long));
+   out->average = calloc(numdata, sizeof(double));
+   out->units = calloc(numdata, sizeof(out->units[0]));
+   if((!numdata) || (!driver_obis) || (!out->token_row) || (!out->row_key) ||
+      (!out->average) || (!out->units))
    {
-      driver_obis[i].obis_oid[0] = 0;
-      driver_obis[i].obis_oid[1] = i;
-      driver_obis[i].obis_oid[2] = 10;
-      driver_obis[i].obis_oid[3] = 0;
-      driver_obis[i].obis_oid[4] = 0;
-      snprintf(driver_obis[i].obis_string, 50, "%s", d[i].description);
-      snprintf(driver_obis[i].description, 255, "%s", d[i].description);
-      snprintf(driver_obis[i].unit, 255, "%s", d[i].unit);
-      driver_obis[i].latest_is_valid = 1;
-      strcpy(out->description[i], d[i].description);
-      out->average[i] = d[i].value;
+      free(driver_obis);
+      free_instance(out);
+      return NULL;
    }
-   for(;i<MAX_TEMPER_VALUES;i++)
-      out->description[i][0]=0;
    pc = strstr(parameters, "multiplier=");
    if(pc)
    {
@@ -376,21 +484,15 @@ void *init_driver(struct MeterTable_entry *entry,
    }
    for(i=0; i<numdata; i++)
    {
-      driver_obis[i].obis_oid[0] = 0;
-      driver_obis[i].obis_oid[1] = i;
-      driver_obis[i].obis_oid[2] = 10;
-      driver_obis[i].obis_oid[3] = 0;
-      driver_obis[i].obis_oid[4] = 0;
-      snprintf(driver_obis[i].obis_string, 50, "%s", d[i].description);
-      snprintf(driver_obis[i].description, 255, "%s", d[i].description);
-      snprintf(driver_obis[i].unit, 255, "%s", d[i].unit);
+      row_name(&t[i], driver_obis[i].obis_string);
       driver_obis[i].latest_is_valid = 1;
-      driver_obis[i].latest_value = entry->MeterMultiplier * d[i].value;
       driver_obis[i].mean6m_is_valid = 1;
-      driver_obis[i].mean6m_value = entry->MeterMultiplier * out->average[i];
       driver_obis[i].max6m_is_valid = 0;
       driver_obis[i].min6m_is_valid = 0;
    }
+   /* The rows are sorted once by name to give them the same OBIS codes
+      whatever order the probes answer in */
+   qsort(driver_obis, numdata, sizeof(struct obis_data), compare_name);
 
    /* initialize other parts of entry */
    entry->MeterMAC[0]=0;
@@ -399,12 +501,46 @@ void *init_driver(struct MeterTable_entry *entry,
    entry->MeterRSSI=0; /* not used */
 			
    entry->numObisEntries = numdata;
-   entry->ObisEntries = malloc(numdata*sizeof(struct obis_data));
-   if(!entry->ObisEntries)
-      entry->numObisEntries = 0;
-   else
-      memcpy(entry->ObisEntries, driver_obis,
-	     numdata*sizeof(struct obis_data));
+   entry->ObisEntries = driver_obis;
+   for(r=0; r<numdata; r++)
+   {
+      driver_obis[r].obis_oid[0] = 0;
+      driver_obis[r].obis_oid[1] = r;
+      driver_obis[r].obis_oid[2] = 10;
+      driver_obis[r].obis_oid[3] = 0;
+      driver_obis[r].obis_oid[4] = 0;
+   }
+   for(i=0; i<numdata; i++)
+   {
+      char name[sizeof(driver_obis[0].obis_string)];
+
+      /* names are compared as cut in the rows, a row with a description
+	 has already been taken by a probe of the same name */
+      row_name(&t[i], name);
+      for(r=0; r<numdata; r++)
+	 if((!driver_obis[r].description) &&
+	    !strcmp(name, driver_obis[r].obis_string))
+	    break;
+      if(r == numdata)
+      {
+	 fprintf(stderr, "No row for %s\n", name);
+	 entry->ObisEntries = NULL;
+	 entry->numObisEntries = 0;
+	 free(driver_obis);
+	 free_instance(out);
+	 return NULL;
+      }
+      out->token_row[i] = r;
+      out->row_key[r] = t[i].key;
+      snprintf(out->units[r], sizeof(out->units[r]), "%.*s",
+	       t[i].unit_len, t[i].unit);
+      driver_obis[r].description = driver_obis[r].obis_string;
+      driver_obis[r].unit = out->units[r];
+      out->average[r] = t[i].value;
+      driver_obis[r].latest_value = entry->MeterMultiplier * t[i].value;
+      driver_obis[r].mean6m_value = entry->MeterMultiplier * t[i].value;
+   }
+   out->num_token_rows = numdata;
    if(pthread_mutex_init(&(out->mutex), NULL))
    {
       fprintf(stderr, "Failed initializing USB serial mutex\n");
@@ -412,53 +548,103 @@ void *init_driver(struct MeterTable_entry *entry,
    return out;
 } /* init_driver */
 
+/* Lists USB serial adapters, preferably by their stable names in
+   /dev/serial/by-id. Only adapters with the match= string in their name are
+   listed, the adapters are then probed by init_driver. */
+int discover_devices(const char *parameters, struct driver_device *devices,
+		     int max_devices)
+{
+   char match[256]="";
+   const char *dir = BY_ID_DIR;
+   int sysfs = 0;
+   char *pc;
+   DIR *d;
+   struct dirent *de;
+   int num=0;
+
+   pc = strstr(parameters, "match=");
+   if(pc)
+   {
+      pc += 6;
+      strncpy(match, pc, 255);
+      match[255]=0;
+      pc=strchr(match, ',');
+      if(pc)
+	 *pc=0;
+   }
+   d = opendir(dir);
+   if(!d)
+   {
+      /* no udev, look for the tty devices in sysfs instead */
+      dir = "/sys/class/tty";
+      sysfs = 1;
+      d = opendir(dir);
+      if(!d)
+	 return 0;
+   }
+   while((num < max_devices) && (de = readdir(d)))
+   {
+      if(de->d_name[0] == '.')
+	 continue;
+      if(sysfs && strncmp(de->d_name, "ttyUSB", 6) &&
+	 strncmp(de->d_name, "ttyACM", 6))
+	 continue;
+      if(!strstr(de->d_name, match))
+	 continue;
+      /* a cut name could not be opened */
+      if((snprintf(devices[num].key, sizeof(devices[num].key), "%s/%s",
+		   sysfs ? "/dev" : dir, de->d_name) >=
+	  sizeof(devices[num].key)) ||
+	 (snprintf(devices[num].parameters, sizeof(devices[num].parameters),
+		   "device=%s,%s", devices[num].key, parameters) >=
+	  sizeof(devices[num].parameters)))
+	 continue;
+      num++;
+   }
+   closedir(d);
+   return num;
+} /* discover_devices */
+
 void update_driver_data(void *driver, struct MeterTable_entry *entry)
 {
-   struct data d[MAX_TEMPER_VALUES];
    int numdata=0;
-   int m,n;
+   int n, r;
    struct instance *i = driver;
-   static int failures = 0;
+   struct token *t;
 
    if(!i)
       return;
+   t = i->tokens;
    pthread_mutex_lock(&(i->mutex));
-   numdata=get_data(i->fdTtyUSB, d, MAX_TEMPER_VALUES);
+   numdata=get_data(i);
    pthread_mutex_unlock(&(i->mutex));
-   /* Both arrays should be sorted and contain the same descriptions, but
-      if something would be missing somewhere we just skip that update */
    if(numdata)
    {
-      failures = 0;
+      i->failures = 0;
    }
    else
    {
-      failures++;
-      if(!(failures%3))
+      i->failures++;
+      if((!(i->failures%3)) && (!i->replay))
 	 reinit_serial(entry->MeterIP, i);
       /* For some reason TemperX232 sometimes stops giving data and need to get
 	 reopened to start working again */
    }
-   for(m=0, n=0; (m<numdata) && (n<i->entry->numObisEntries); m++, n++)
-      if(!strcmp(d[m].description, i->entry->ObisEntries[n].obis_string))
-      {
-	 i->entry->ObisEntries[n].latest_value =
-	    i->entry->MeterMultiplier * d[m].value;
-	 i->average[n] = 0.95*i->average[n] + 0.05*d[m].value;
-	 i->entry->ObisEntries[n].mean6m_value =
-	    i->entry->MeterMultiplier * i->average[n];
-      }
-      else if(0>strcmp(d[m].description, i->entry->ObisEntries[n].obis_string))
-	 n--;
-      else
-	 m--;
-   for(m=0, n=0; (m<numdata) && (n<i->entry->numObisEntries); m++, n++)
-      if(!strcmp(d[m].description, i->description[n]))
-	 i->average[n] = 0.9*i->average[n] + 0.1*d[m].value;
-      else if(0>strcmp(d[m].description, i->entry->ObisEntries[n].obis_string))
-	 n--;
-      else
-	 m--;
+   for(n=0; n<numdata; n++)
+   {
+      /* Probes answer in the same order every time, only if they do not
+	 the rows has to be searched for */
+      if((n < i->num_token_rows) && (i->row_key[i->token_row[n]] == t[n].key))
+	 r = i->token_row[n];
+      else if((r = find_row(i, t[n].key)) < 0)
+	 continue; /* probe added after start, skip it */
+      i->entry->ObisEntries[r].latest_value =
+	 i->entry->MeterMultiplier * t[n].value;
+      i->average[r] = 0.95*i->average[r] + 0.05*t[n].value;
+      i->entry->ObisEntries[r].mean6m_value =
+	 i->entry->MeterMultiplier * i->average[r];
+      i->average[r] = 0.9*i->average[r] + 0.1*t[n].value;
+   }
 } /* update_driver_data */
 
 void remove_driver(void *driver, struct MeterTable_entry *entry)
@@ -470,7 +656,6 @@ void remove_driver(void *driver, struct MeterTable_entry *entry)
    if (!entry)
       return;                 /* Nothing to remove */
    entry->valid=0;
-   close(i->fdTtyUSB);
    pthread_mutex_destroy(&(i->mutex));
    if(entry->numObisEntries)
    {
@@ -478,4 +663,5 @@ void remove_driver(void *driver, struct MeterTable_entry *entry)
       entry->ObisEntries = NULL;
       entry->numObisEntries = 0;
    }
+   free_instance(i);
 } /* remove_driver */
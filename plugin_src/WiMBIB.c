@@ -33,23 +33,29 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <string.h>
 #include "driver.h"
 #include <curl/curl.h>
-#include <json.h>
 #include <pthread.h>
+#include "capture.h"
+#include "meterjson.h"
 #include <time.h>
 
 struct instance
 {
    struct MeterTable_entry *entry;
    CURL *curl;
+   struct capture *record; /* where to save what is received, if anywhere */
+   struct capture *replay; /* read from here instead of the meter if set */
    int64_t last_obis_filter_update;
    long previous_volume;
    time_t previous_time;
    long average_flow;
    int showextra;
+   char reply[CURL_MAX_WRITE_SIZE+1]; /* the reply being received */
+   size_t reply_len;
+   struct meterjson json; /* index of the reply */
    /* Add stuff for filtering averages here */
 };
 
-static void fill_obis_entry(struct json_object *value_json,
+static void fill_obis_entry(double value,
 			    struct obis_data *ObisEntry
 			    /* add stuff here for filtered data */)
 {
@@ -60,34 +66,34 @@ static void fill_obis_entry(struct json_object *value_json,
    
    if(ObisEntry->latest_is_valid)
    {
-      ObisEntry->latest_value = multiplier*json_object_get_double(value_json);
+      ObisEntry->latest_value = multiplier*value;
    }
    if(ObisEntry->mean6m_is_valid)
    {
-      ObisEntry->mean6m_value = multiplier*json_object_get_double(value_json);
+      ObisEntry->mean6m_value = multiplier*value;
    }
    if(ObisEntry->max6m_is_valid)
    {
-      ObisEntry->max6m_value = multiplier*json_object_get_double(value_json);
+      ObisEntry->max6m_value = multiplier*value;
    }
    if(ObisEntry->min6m_is_valid)
    {
-      ObisEntry->min6m_value = multiplier*json_object_get_double(value_json);
+      ObisEntry->min6m_value = multiplier*value;
    }
 } /* fill_obis_entry */
 
 static void fill_obis_data(int64_t obis_count,
-			   struct instance *inst,
-			   struct json_object *meter_json)
+			   struct instance *inst)
 {
-   if(inst && meter_json)
+   if(inst)
    {
-      struct json_object *tmp_json;
+      struct meterjson *json = &(inst->json);
+      long tmp_json;
       struct MeterTable_entry *entry = inst->entry;
-      struct json_object *d_json = json_object_object_get(meter_json, "meter");
+      long d_json = meterjson_get(json, 0, "meter");
       int i;
 
-      if(!d_json)
+      if(!meterjson_is_object(json, d_json))
 	 return;
       if(obis_count < inst->last_obis_filter_update)
       {
@@ -110,46 +116,42 @@ static void fill_obis_data(int64_t obis_count,
 	    else if(!strcmp(entry->ObisEntries[i].obis_string,
 			    "leak-alarm burst-alarm"))
 	    {
-	       tmp_json =
-		  json_object_object_get(d_json, "leak-alarm");
-	       if(tmp_json)
+	       tmp_json = meterjson_get(json, d_json, "leak-alarm");
+	       if(tmp_json >= 0)
 	       {
 		  entry->ObisEntries[i].latest_value =
-		     json_object_get_boolean(tmp_json) ? 1 : 0;
-		  tmp_json =
-		     json_object_object_get(d_json, "burst-alarm");
-		  if(tmp_json)
+		     meterjson_boolean(json, tmp_json) ? 1 : 0;
+		  tmp_json = meterjson_get(json, d_json, "burst-alarm");
+		  if(tmp_json >= 0)
 		  {
 		     entry->ObisEntries[i].latest_value |=
-			json_object_get_boolean(tmp_json) ? 2 : 0;
+			meterjson_boolean(json, tmp_json) ? 2 : 0;
 		  }
 	       }
 	    }
 	    else if(!strcmp(entry->ObisEntries[i].obis_string,
 			    "dry-alarm reverse-alarm"))
 	    {
-	       tmp_json =
-		  json_object_object_get(d_json, "dry-alarm");
-	       if(tmp_json)
+	       tmp_json = meterjson_get(json, d_json, "dry-alarm");
+	       if(tmp_json >= 0)
 	       {
 		  entry->ObisEntries[i].latest_value =
-		     json_object_get_boolean(tmp_json) ? 1 : 0;
-		  tmp_json =
-		     json_object_object_get(d_json, "reverse-alarm");
-		  if(tmp_json)
+		     meterjson_boolean(json, tmp_json) ? 1 : 0;
+		  tmp_json = meterjson_get(json, d_json, "reverse-alarm");
+		  if(tmp_json >= 0)
 		  {
 		     entry->ObisEntries[i].latest_value |=
-			json_object_get_boolean(tmp_json) ? 2 : 0;
+			meterjson_boolean(json, tmp_json) ? 2 : 0;
 		  }
 	       }
 	    }
 	    else
 	    {
-	       tmp_json =
-		  json_object_object_get(d_json,
-					 entry->ObisEntries[i].obis_string);
-	       if(tmp_json)
-		  fill_obis_entry(tmp_json, &(entry->ObisEntries[i]));
+	       tmp_json = meterjson_get(json, d_json,
+				       entry->ObisEntries[i].obis_string);
+	       if(tmp_json >= 0)
+		  fill_obis_entry(meterjson_double(json, tmp_json),
+				  &(entry->ObisEntries[i]));
 	       if(!strcmp(entry->ObisEntries[i].obis_string,
 			  "total_volume"))
 	       {
@@ -182,85 +184,74 @@ static void fill_obis_data(int64_t obis_count,
 
 static size_t my_curl_callback(void *buffer, size_t size, size_t nmemb, void *userp)
 {
-   static size_t pos = 0;
    size_t out = size*nmemb;
    struct instance *inst=userp;
    struct MeterTable_entry *entry;
-   char data[CURL_MAX_WRITE_SIZE+1];
+   char *data;
 
    if(!inst) /* sanity check */
       return 0;
    entry = inst->entry;
-   if((pos + out)<=CURL_MAX_WRITE_SIZE)
+   data = inst->reply;
+   if(inst->record)
+      capture_write(inst->record, buffer, out);
+   if((inst->reply_len + out)<=CURL_MAX_WRITE_SIZE)
    {      
-      memcpy(&data[pos], buffer, out);
-      pos += out;
-      data[pos]=0;
-      if((pos > 4) && (data[pos-1]== '}') && (data[pos-2]== '}'))
+      memcpy(&data[inst->reply_len], buffer, out);
+      inst->reply_len += out;
+      data[inst->reply_len]=0;
+      if((inst->reply_len > 4) && (data[inst->reply_len-1]== '}') &&
+	 (data[inst->reply_len-2]== '}'))
       {
-	 struct json_object *meter_json, *info_json, *tmp_json;
-	 pos = 0;
-	 meter_json = json_tokener_parse(data);
-	 if(meter_json)
+	 struct meterjson *json = &(inst->json);
+	 long info_json, tmp_json;
+
+	 /* the index refers to data, which is kept until the next reply */
+	 if(!meterjson_parse(json, data, inst->reply_len))
 	 {
-	    info_json = json_object_object_get(meter_json, "info");
-	    if(info_json)
+	    info_json = meterjson_get(json, 0, "info");
+	    if(meterjson_is_object(json, info_json))
 	    {
 	       if(!entry->MeterType_len)
 	       {
 		  entry->MeterType[0]=0;
-		  tmp_json = json_object_object_get(info_json, "meter_model");
-		  if(tmp_json)
-		  {
-		     strncpy(entry->MeterType,
-			     json_object_get_string(tmp_json), 254);
-		     entry->MeterType[254]=0;
+		  tmp_json = meterjson_get(json, info_json, "meter_model");
+		  if(tmp_json >= 0)
 		     entry->MeterType_len =
-			strlen(entry->MeterType);
-		  }
-		  tmp_json = json_object_object_get(info_json, "meter_id");
-		  if(tmp_json)
+			meterjson_string(json, tmp_json, entry->MeterType,
+					 255);
+		  tmp_json = meterjson_get(json, info_json, "meter_id");
+		  if((tmp_json >= 0) && (entry->MeterType_len < 250))
 		  {
-		     if(strlen(entry->MeterType) < 250)
-		     {
-			strcpy(&(entry->MeterType[strlen(entry->MeterType)]),
-			       " ");
-			strncpy(&(entry->MeterType[strlen(entry->MeterType)]),
-				json_object_get_string(tmp_json),
-				254-strlen(entry->MeterType));
-			entry->MeterType[254]=0;
-			entry->MeterType_len =
-			   strlen(entry->MeterType);
-		     }
+		     entry->MeterType[entry->MeterType_len++] = ' ';
+		     entry->MeterType_len +=
+			meterjson_string(json, tmp_json,
+					 &(entry->MeterType[
+					      entry->MeterType_len]),
+					 255 - entry->MeterType_len);
 		  }
 	       }
 	       if(!entry->MeterMAC_len)
 	       {
-		  tmp_json = json_object_object_get(info_json, "mac");
-		  if(tmp_json)
-		  {
-		     strncpy(entry->MeterMAC,
-			     json_object_get_string(tmp_json), 254);
-		     entry->MeterMAC[254]=0;
-		     entry->MeterMAC_len = strlen(entry->MeterMAC);
-		  }
-			
+		  tmp_json = meterjson_get(json, info_json, "mac");
+		  if(tmp_json >= 0)
+		     entry->MeterMAC_len =
+			meterjson_string(json, tmp_json, entry->MeterMAC,
+					 255);
 	       }
-	       tmp_json = json_object_object_get(info_json, "rssi");
-	       if(tmp_json)
+	       tmp_json = meterjson_get(json, info_json, "rssi");
+	       if(tmp_json >= 0)
 	       {
-		  entry->MeterRSSI = json_object_get_int(tmp_json);
+		  entry->MeterRSSI = meterjson_int64(json, tmp_json);
 	       }
-	       tmp_json = json_object_object_get(info_json, "crc_ok_cnt");
-	       if(tmp_json)
+	       tmp_json = meterjson_get(json, info_json, "crc_ok_cnt");
+	       if(tmp_json >= 0)
 	       {
-		  fill_obis_data(json_object_get_int64(tmp_json),
-				 inst,
-				 meter_json);
+		  fill_obis_data(meterjson_int64(json, tmp_json), inst);
 	       }
 	    }
-	    json_object_put(meter_json); /* free json stuff */
 	 }
+	 inst->reply_len = 0;
       }
       return out;
    }
@@ -269,10 +260,33 @@ static size_t my_curl_callback(void *buffer, size_t size, size_t nmemb, void *us
    
 } /* my_curl_callback */
 
+/* Gets new data from the meter, or from the capture being replayed */
+static void perform(struct instance *inst)
+{
+   char buf[CURL_MAX_WRITE_SIZE];
+   long len;
+
+   inst->reply_len = 0;
+   if(inst->replay)
+   {
+      if(capture_next_transfer(inst->replay))
+	 while((len = capture_read(inst->replay, buf,
+				   CURL_MAX_WRITE_SIZE)) > 0)
+	    my_curl_callback(buf, 1, len, inst);
+   }
+   else if(inst->curl)
+   {
+      curl_easy_perform(inst->curl);
+      if(inst->record)
+	 capture_end(inst->record);
+   }
+} /* perform */
+
 void *init_driver(struct MeterTable_entry *entry,
 		  const char *parameters)
 {
    char *pc;
+   char path[256];
    const struct obis_data driver_obis[] = {
       /* Mandatory data from this driver */
       {{8,0,1,0,0}, "total_volume",
@@ -307,6 +321,7 @@ void *init_driver(struct MeterTable_entry *entry,
 	MeterTable_oid_len, OID_LENGTH(MeterTableEntry_oid)); */
    
    out->entry=entry;
+   memset(&(out->json), 0, sizeof(struct meterjson));
    
    entry->valid = 1;
    pc = strstr(parameters, "ip=");
@@ -355,7 +370,19 @@ void *init_driver(struct MeterTable_entry *entry,
    out->previous_volume=0;
    out->previous_time=0;
    out->average_flow=0;
-   if(entry->MeterIP_len)
+   out->curl = NULL;
+   out->record = NULL;
+   out->replay = NULL;
+   if(capture_parameter(parameters, "replay=", path, 256))
+   {
+      char speed[10]="";
+
+      capture_parameter(parameters, "replayspeed=", speed, 10);
+      out->replay = capture_open_replay(path, strcmp(speed, "max"));
+      if(!out->replay)
+	 fprintf(stderr, "Failed opening capture %s\n", path);
+   }
+   else if(entry->MeterIP_len)
    {
       char url[276];
       snprintf(url, 275, "http://%s/meterData", entry->MeterIP);
@@ -363,8 +390,22 @@ void *init_driver(struct MeterTable_entry *entry,
       curl_easy_setopt(out->curl, CURLOPT_URL, url);
       curl_easy_setopt(out->curl, CURLOPT_WRITEFUNCTION, my_curl_callback);
       curl_easy_setopt(out->curl, CURLOPT_WRITEDATA, (void *)out);
-      curl_easy_perform(out->curl);
+      /* updated by worker threads, no signals for timeouts */
+      curl_easy_setopt(out->curl, CURLOPT_NOSIGNAL, 1L);
+      /* an unreachable meter must not keep its worker thread for long */
+      curl_easy_setopt(out->curl, CURLOPT_CONNECTTIMEOUT, 3L);
+      curl_easy_setopt(out->curl, CURLOPT_TIMEOUT, 5L);
+      if(capture_parameter(parameters, "timeout=", path, 256) &&
+	 (atol(path) > 0))
+	 curl_easy_setopt(out->curl, CURLOPT_TIMEOUT, atol(path));
+      if(capture_parameter(parameters, "record=", path, 256))
+      {
+	 out->record = capture_open_record(path);
+	 if(!out->record)
+	    fprintf(stderr, "Failed opening capture %s\n", path);
+      }
    }
+   perform(out);
    return out;
 } /* init_driver */
 
@@ -375,7 +416,7 @@ void update_driver_data(void *driver, struct MeterTable_entry *entry)
    if(!i)
       return;
 
-   curl_easy_perform(i->curl);
+   perform(i);
 } /* update_driver_data */
 
 void remove_driver(void *driver, struct MeterTable_entry *entry)
@@ -390,6 +431,11 @@ void remove_driver(void *driver, struct MeterTable_entry *entry)
    if(i->curl)
       curl_easy_cleanup(i->curl);
    i->curl = NULL;
+   capture_close(i->record);
+   i->record = NULL;
+   capture_close(i->replay);
+   i->replay = NULL;
+   meterjson_free(&(i->json));
    if(entry->numObisEntries)
    {
       free(entry->ObisEntries);
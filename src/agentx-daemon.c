@@ -32,17 +32,32 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <net-snmp/agent/net-snmp-agent-includes.h>
 #include <json.h>
 #include <unistd.h>
-#include <signal.h>
 #include <dlfcn.h>
 #include <libgen.h>
 #include <time.h>
 #include <curl/curl.h>
+#include <pthread.h>
 
 #include "driver.h"
 #include "obis2snmp.h"
+#include "obis_catalogue.h"
+#include "derived.h"
+#include "aggregate.h"
+#include "samples.h"
+#include "tsdb.h"
+#include "archives.h"
+#include "snapshot.h"
+#include "shared.h"
+#include "export.h"
+#include "eventloop.h"
+#include "workers.h"
 #include <net-snmp/agent/util_funcs.h>
 
 #define VERSION_STRING "1.3beta"
+#define DISCOVERY_VERSION 1 /* format of the discovery document */
+#define DISCOVERY_SLOTS 16 /* default number of meters per discover entry */
+#define PROBE_BACKOFF_MIN 60 /* seconds before probing a rejected device */
+#define PROBE_BACKOFF_MAX 3600
 
 struct driver_data {
    void *dlhandle;
@@ -52,14 +67,53 @@ struct driver_data {
    void (*remove_driver)(void *, struct MeterTable_entry *);
 };
 
-static int keep_running;
+/* a newly discovered device being probed by init_driver */
+struct probe {
+   pthread_t thread;
+   int active;  /* the probe has not yet been finished by finish_probes */
+   int started; /* run by thread, else already done */
+   int done;    /* set by the thread when init_driver has returned */
+   int slot;
+   char parameters[sizeof(((struct driver_device *)0)->parameters)];
+};
 
-RETSIGTYPE
-stop_server(int a) {
-    keep_running = 0;
-}
+/* a device not accepted by init_driver, probed again at retry */
+struct rejected_device {
+   char *key;
+   time_t retry;
+   time_t backoff; /* doubled each time the device is rejected again */
+};
+
+/* A config entry letting its driver find devices, the devices are given
+   meter slots first_slot to first_slot+num_slots-1 */
+struct discovery {
+   struct driver_data driver;
+   int (*discover_devices)(const char *, struct driver_device *, int);
+   char *parameters;
+   int first_slot;
+   int num_slots;
+   char **keys; /* key of device in each slot, NULL if free */
+   struct probe *probes; /* probe of the device in each slot */
+   struct rejected_device *rejected;
+   int num_rejected;
+   char *derived; /* derived rows for the devices, NULL if none */
+};
 
 static struct MeterTable_entry *pMeterEntries=NULL;
+/* the entries updated by the drivers from worker threads, copied to
+   pMeterEntries when an update is done */
+static struct MeterTable_entry *work_entries=NULL;
+static unsigned long *updating=NULL; /* round of update being run or 0 */
+static unsigned long update_round=0;
+static unsigned int *done_meters=NULL; /* filled in by workers_done */
+static struct driver_data *drivers=NULL;
+static struct derived_rows *derived=NULL; /* derived rows of each meter */
+static struct sorted_rows *sorted=NULL; /* rows of each registered meter */
+static struct archives archives; /* no meters unless configured */
+static char *discovery_doc=NULL; /* JSON describing all meters and rows */
+static size_t discovery_len=0;
+static int discovery_changed=1; /* meters registered since last built */
+static unsigned long meters_generation=0; /* changed as meters get rows */
 static unsigned int MaxRegisteredEntry=0;
 
 #if 0
@@ -109,6 +163,100 @@ static int oid_part_match(oid o1[], oid o2[], size_t l)
    return 1;
 }
 
+/* A virtual meter in slot, aggregating rows of other meters */
+struct aggregate_meter {
+   int slot;
+   struct aggregate aggregate;
+};
+
+/* The rows of a meter sorted by OBIS code, so that the tables indexed by
+   meter and OBIS code can find the row following an index without looking
+   at every row of every meter */
+struct sorted_row {
+   oid obis_oid[5];
+   unsigned int row;
+};
+struct sorted_rows {
+   struct sorted_row *rows;
+   unsigned int num_rows;
+};
+
+/* Returns row o of meter i, derived rows follow the rows of the driver */
+static struct obis_data *meter_row(unsigned int i, unsigned int o)
+{
+   if(o < pMeterEntries[i].numObisEntries)
+      return &(pMeterEntries[i].ObisEntries[o]);
+   return &(derived[i].rows[o - pMeterEntries[i].numObisEntries]);
+} /* meter_row */
+
+static int compare_sorted_row(const void *a, const void *b)
+{
+   const struct sorted_row *ra = a, *rb = b;
+   int c = snmp_oid_compare(ra->obis_oid, 5, rb->obis_oid, 5);
+
+   if(c)
+      return c;
+   return (ra->row > rb->row) - (ra->row < rb->row);
+} /* compare_sorted_row */
+
+/* Sorts the rows of meter i by OBIS code */
+static void sort_rows(unsigned int i)
+{
+   unsigned int o, num = pMeterEntries[i].numObisEntries + derived[i].num_rows;
+   struct sorted_rows *s = &sorted[i];
+
+   free(s->rows);
+   s->num_rows = 0;
+   s->rows = malloc((num ? num : 1)*sizeof(struct sorted_row));
+   if(!s->rows)
+   {
+      snmp_log(LOG_CRIT,"Malloc failed!\n");
+      return;
+   }
+   for(o=0; o<num; o++)
+   {
+      memcpy(s->rows[o].obis_oid, meter_row(i, o)->obis_oid, 5*sizeof(oid));
+      s->rows[o].row = o;
+   }
+   qsort(s->rows, num, sizeof(struct sorted_row), compare_sorted_row);
+   s->num_rows = num;
+} /* sort_rows */
+
+/* Returns the first of the sorted rows of meter i whose {meter, A, B, C, D,
+   E} is not before index, num_rows if there is none */
+static unsigned int first_row_from(unsigned int i, const oid *index,
+				   size_t index_len)
+{
+   unsigned int low = 0, high = sorted[i].num_rows, mid;
+   oid key[6];
+
+   if((!index) || (!index_len))
+      return 0;
+   key[0] = i+1;
+   while(low < high)
+   {
+      mid = (low + high)/2;
+      memcpy(&key[1], sorted[i].rows[mid].obis_oid, 5*sizeof(oid));
+      if(snmp_oid_compare(key, 6, index, (index_len < 6) ? index_len : 6) < 0)
+	 low = mid + 1;
+      else
+	 high = mid;
+   }
+   return low;
+} /* first_row_from */
+
+/* The meter to start looking from for index, returns -1 if index comes
+   after all of num meters */
+static long first_meter_from(const oid *index, size_t index_len,
+			     unsigned int num)
+{
+   if((!index) || (!index_len) || (!index[0]))
+      return 0;
+   if(index[0] > num)
+      return -1;
+   return index[0] - 1;
+} /* first_meter_from */
+
 static u_char *
 agent_h_obis(struct variable *vp, oid *name, size_t *length, int exact,
     size_t *var_len, WriteMethod **write_method)
@@ -130,8 +278,9 @@ agent_h_obis(struct variable *vp, oid *name, size_t *length, int exact,
       index = name[*length -1];
       if(index < 1) return NULL;
       if(index > MaxRegisteredEntry) return NULL;
+      if(!pMeterEntries[index-1].valid) return NULL;
       obis_index = vp->magic;
-      obis = &(pMeterEntries[index-1].ObisEntries[obis_index]);
+      obis = meter_row(index-1, obis_index);
       if(!oid_part_match(&name[*length -6], obis->obis_oid, 5))
 	 if(header_simple_table(vp, name, length, exact, var_len,
 				write_method, -1))
@@ -201,6 +350,26 @@ agent_h_obis(struct variable *vp, oid *name, size_t *length, int exact,
 	       long_ret = obis->min6m_value;
 	       return (u_char *) &long_ret;
 	    }
+	 case COLUMN_METEROBIS6MINP95:
+	    if(!obis->p95_is_valid)
+	    {
+	       return NULL;
+	    }
+	    else
+	    {
+	       long_ret = obis->p95_value;
+	       return (u_char *) &long_ret;
+	    }
+	 case COLUMN_METEROBIS6MINP99:
+	    if(!obis->p99_is_valid)
+	    {
+	       return NULL;
+	    }
+	    else
+	    {
+	       long_ret = obis->p99_value;
+	       return (u_char *) &long_ret;
+	    }
 	 default:
 	    break;
       }
@@ -208,6 +377,241 @@ agent_h_obis(struct variable *vp, oid *name, size_t *length, int exact,
    return NULL;
 } /* agent_h_obis */
 
+/* Finds the sample of index {meter, A, B, C, D, E, number}, or for a
+   GETNEXT the first sample after index. index is NULL when the
+   requested name comes before all samples. */
+static const struct obis_sample *find_sample(const oid *index,
+					     size_t index_len, int exact,
+					     oid *found)
+{
+   oid key[METERSAMPLE_INDEX_LEN];
+   unsigned int o, p, n;
+   long i;
+
+   i = first_meter_from(index, index_len, MaxRegisteredEntry);
+   if((i < 0) ||
+      (exact && ((index_len != METERSAMPLE_INDEX_LEN) || (index[6] < 1))))
+      return NULL;
+   for(; i<MaxRegisteredEntry; i++)
+   {
+      if(!pMeterEntries[i].valid)
+	 continue;
+      /* the rows before index are never looked at */
+      for(p=first_row_from(i, index, index_len); p<sorted[i].num_rows; p++)
+      {
+	 struct obis_data *row;
+	 int c = 1;
+
+	 o = sorted[i].rows[p].row;
+	 row = meter_row(i, o);
+	 key[0] = i+1;
+	 memcpy(&key[1], row->obis_oid, 5*sizeof(oid));
+	 if(index)
+	    c = snmp_oid_compare(key, 6, index, (index_len < 6) ? index_len : 6);
+	 if(exact && c)
+	    return NULL;
+	 if((!row->samples) || (!row->samples->count))
+	    continue;
+	 if(exact)
+	 {
+	    memcpy(found, index, sizeof(key));
+	    return samples_get(row->samples, index[6]-1);
+	 }
+	 /* the first sample number of this row after index */
+	 n = 1;
+	 if(!c && (index_len > 6))
+	    n = index[6] + 1;
+	 if(n > row->samples->count)
+	    continue;
+	 key[6] = n;
+	 memcpy(found, key, sizeof(key));
+	 return samples_get(row->samples, n-1);
+      }
+      if(exact)
+	 return NULL;
+   }
+   return NULL;
+} /* find_sample */
+
+static u_char *
+agent_h_sample(struct variable *vp, oid *name, size_t *length, int exact,
+    size_t *var_len, WriteMethod **write_method)
+{
+   static long long_ret;
+   const struct obis_sample *sample;
+   oid found[METERSAMPLE_INDEX_LEN];
+   const oid *index = NULL;
+   size_t index_len = 0;
+   int c;
+
+   c = snmp_oid_compare(name, (*length < vp->namelen) ? *length : vp->namelen,
+			vp->name, vp->namelen);
+   if(c > 0)
+      return NULL;
+   if((!c) && (*length >= vp->namelen))
+   {
+      index = &name[vp->namelen];
+      index_len = *length - vp->namelen;
+   }
+   else if(exact)
+      return NULL;
+   sample = find_sample(index, index_len, exact, found);
+   if(!sample)
+      return NULL;
+   if(!exact)
+   {
+      memcpy(name, vp->name, vp->namelen*sizeof(oid));
+      memcpy(&name[vp->namelen], found, sizeof(found));
+      *length = vp->namelen + METERSAMPLE_INDEX_LEN;
+   }
+   *write_method = NULL;
+   *var_len = sizeof(long_ret);
+   if(vp->magic == COLUMN_METERSAMPLETIME)
+      long_ret = sample->time;
+   else
+      long_ret = sample->value;
+   return (u_char *) &long_ret;
+} /* agent_h_sample */
+
+/* Finds the archive slot of index {meter, A, B, C, D, E, step, number},
+   or for a GETNEXT the first slot after index. index is NULL when the
+   requested name comes before all slots. */
+static const struct archive_slot *find_history(const oid *index,
+					       size_t index_len, int exact,
+					       oid *found)
+{
+   oid key[METERHISTORY_INDEX_LEN];
+   unsigned int o, p, l, n, count;
+   long i;
+
+   i = first_meter_from(index, index_len, archives.num_meters);
+   if((i < 0) ||
+      (exact && ((index_len != METERHISTORY_INDEX_LEN) || (index[7] < 1))))
+      return NULL;
+   for(; i<archives.num_meters; i++)
+   {
+      if(!pMeterEntries[i].valid)
+	 continue;
+      /* the rows before index are never looked at, the levels of a row
+	 come in the order of their steps */
+      for(p=first_row_from(i, index, index_len); p<sorted[i].num_rows; p++)
+      {
+	 struct obis_data *row;
+
+	 o = sorted[i].rows[p].row;
+	 row = meter_row(i, o);
+	 key[0] = i+1;
+	 memcpy(&key[1], row->obis_oid, 5*sizeof(oid));
+	 if(exact && snmp_oid_compare(key, 6, index, 6))
+	    return NULL;
+	 for(l=0; l<ARCHIVE_LEVELS; l++)
+	 {
+	    int c = 1;
+
+	    key[6] = archive_step(l);
+	    if(index)
+	       c = snmp_oid_compare(key, 7, index,
+				    (index_len < 7) ? index_len : 7);
+	    if(c < 0)
+	       continue;
+	    if(exact && c)
+	       return NULL;
+	    count = archive_count(&archives, i, o, row, l);
+	    if(!count)
+	       continue;
+	    if(exact)
+	    {
+	       memcpy(found, index, sizeof(key));
+	       return archive_get(&archives, i, o, row, l, index[7]-1);
+	    }
+	    /* the first slot number of this archive after index */
+	    n = 1;
+	    if(!c && (index_len > 7))
+	       n = index[7] + 1;
+	    if(n > count)
+	       continue;
+	    key[7] = n;
+	    memcpy(found, key, sizeof(key));
+	    return archive_get(&archives, i, o, row, l, n-1);
+	 }
+      }
+      if(exact)
+	 return NULL;
+   }
+   return NULL;
+} /* find_history */
+
+static u_char *
+agent_h_history(struct variable *vp, oid *name, size_t *length, int exact,
+    size_t *var_len, WriteMethod **write_method)
+{
+   static long long_ret;
+   const struct archive_slot *slot;
+   oid found[METERHISTORY_INDEX_LEN];
+   const oid *index = NULL;
+   size_t index_len = 0;
+   int c;
+
+   c = snmp_oid_compare(name, (*length < vp->namelen) ? *length : vp->namelen,
+			vp->name, vp->namelen);
+   if(c > 0)
+      return NULL;
+   if((!c) && (*length >= vp->namelen))
+   {
+      index = &name[vp->namelen];
+      index_len = *length - vp->namelen;
+   }
+   else if(exact)
+      return NULL;
+   slot = find_history(index, index_len, exact, found);
+   if(!slot)
+      return NULL;
+   if(!exact)
+   {
+      memcpy(name, vp->name, vp->namelen*sizeof(oid));
+      memcpy(&name[vp->namelen], found, sizeof(found));
+      *length = vp->namelen + METERHISTORY_INDEX_LEN;
+   }
+   *write_method = NULL;
+   *var_len = sizeof(long_ret);
+   switch(vp->magic)
+   {
+      case COLUMN_METERHISTORYTIME:
+	 long_ret = slot->start;
+	 break;
+      case COLUMN_METERHISTORYMEAN:
+	 long_ret = slot->mean;
+	 break;
+      case COLUMN_METERHISTORYMAX:
+	 long_ret = slot->max;
+	 break;
+      default:
+	 long_ret = slot->min;
+	 break;
+   }
+   return (u_char *) &long_ret;
+} /* agent_h_history */
+
+static u_char *
+agent_h_discovery(struct variable *vp, oid *name, size_t *length, int exact,
+    size_t *var_len, WriteMethod **write_method)
+{
+   unsigned int chunk;
+   unsigned int num_chunks =
+      (discovery_len + METERDISCOVERY_CHUNK - 1) / METERDISCOVERY_CHUNK;
+
+   if (header_simple_table(vp, name, length, exact, var_len, write_method,
+			   num_chunks))
+      return NULL;
+   chunk = name[*length -1];
+   if((chunk < 1) || (chunk > num_chunks))
+      return NULL;
+   *var_len = discovery_len - (chunk-1)*METERDISCOVERY_CHUNK;
+   if(*var_len > METERDISCOVERY_CHUNK)
+      *var_len = METERDISCOVERY_CHUNK;
+   return (u_char *) &discovery_doc[(chunk-1)*METERDISCOVERY_CHUNK];
+} /* agent_h_discovery */
+
 static u_char *
 agent_h_meter(struct variable *vp, oid *name, size_t *length, int exact,
     size_t *var_len, WriteMethod **write_method)
@@ -220,8 +624,9 @@ agent_h_meter(struct variable *vp, oid *name, size_t *length, int exact,
       return NULL;
    index = name[*length -1];
    /* fprintf(stderr, "index: %d\n", index); */
-   if(index > MaxRegisteredEntry) return NULL;
+   if((index < 1) || (index > MaxRegisteredEntry)) return NULL;
    entry = &(pMeterEntries[index-1]);
+   if(!entry->valid) return NULL;
    /* fprintf(stderr, "low enough\n", index); */
    
    /* fprintf(stderr, "vp: %p\n", vp);
@@ -271,30 +676,972 @@ agent_h_meter(struct variable *vp, oid *name, size_t *length, int exact,
    return NULL;
 } /* agent_h_meter */
 
+/* Loads the driver plugin named driver, returns 0 at success */
+static int load_driver(struct driver_data *d, const char *driver)
+{
+   char driver_path[256];
+
+   /* printf("Driver: '%s'\n", driver); */
+   snprintf(driver_path, 256, "%s.so", driver);
+   /* printf("Trying to open: %s\n", driver_path); */
+   d->dlhandle = dlopen(driver_path,  RTLD_NOW);
+   if(!d->dlhandle)
+   {
+      snmp_log(LOG_CRIT,"driver %s load failure, %s\n",
+	       driver_path, dlerror());
+      fprintf(stderr, "driver %s load failure, %s\n",
+	      driver_path, dlerror());
+      return -1;
+   }
+   d->init_driver = dlsym(d->dlhandle, "init_driver");
+   if(!d->init_driver)
+   {
+      snmp_log(LOG_CRIT,
+	       "driver %s is missing init_driver function!\n",
+	       driver);
+      d->remove_driver = NULL;
+      return -1;
+   }
+   d->update_driver_data = dlsym(d->dlhandle, "update_driver_data");
+   d->remove_driver = dlsym(d->dlhandle, "remove_driver");
+   return 0;
+} /* load_driver */
+
+/* Gives a row the description and unit of its OBIS code when the driver
+   has left them out */
+static void fill_from_catalogue(struct obis_data *o)
+{
+   const struct obis_catalogue_entry *e = NULL;
+
+   if((!o->description) || (!o->unit))
+      e = obis_lookup(o->obis_oid);
+   if(!o->description)
+   {
+      if(e)
+	 o->description = e->description;
+      else if(o->obis_string[0])
+	 o->description = o->obis_string;
+      else
+	 o->description = "Unknown OBIS code";
+   }
+   if(!o->unit)
+      o->unit = e ? e->unit : "";
+} /* fill_from_catalogue */
+
+/* Registers the MIB rows of meter i which has been successfully
+   initialized by its driver */
+static void register_meter(unsigned int i)
+{
+   struct variable8 agent_meter_vars[6]= {
+      { COLUMN_METERINDEX, ASN_INTEGER, RONLY, agent_h_meter,
+	1, { COLUMN_METERINDEX } },
+      { COLUMN_METERTYPE, ASN_OCTET_STR, RONLY, agent_h_meter,
+	1, { COLUMN_METERTYPE } },
+      { COLUMN_METERIP, ASN_OCTET_STR, RONLY, agent_h_meter,
+	1, { COLUMN_METERIP } },
+      { COLUMN_METERMAC, ASN_OCTET_STR, RONLY, agent_h_meter,
+	1, { COLUMN_METERMAC } },
+      { COLUMN_METERRSSI, ASN_INTEGER, RONLY, agent_h_meter,
+	1, { COLUMN_METERRSSI } },
+      { COLUMN_METERMULTIPLIER, ASN_INTEGER, RONLY, agent_h_meter,
+	1, { COLUMN_METERMULTIPLIER } },
+   };
+   size_t num_vars = 1; /* We allways have an index */
+   oid       MeterTableEntry_oid[MeterTable_oid_len+1];
+   char descr[20];
+   int o;
+
+   memcpy(MeterTableEntry_oid, MeterTable_oid,
+	  MeterTable_oid_len*sizeof(oid));
+   MeterTableEntry_oid[MeterTable_oid_len] = 1;
+
+   if(pMeterEntries[i].MeterType_len)
+      num_vars++;
+   else
+      memmove(&agent_meter_vars[num_vars],
+	      &agent_meter_vars[num_vars+1],
+	      (5-num_vars)*sizeof(struct variable8));
+   if(pMeterEntries[i].MeterIP_len)
+      num_vars++;
+   else
+      memmove(&agent_meter_vars[num_vars],
+	      &agent_meter_vars[num_vars+1],
+	      (5-num_vars)*sizeof(struct variable8));
+   if(pMeterEntries[i].MeterMAC_len)
+      num_vars++;
+   else
+      memmove(&agent_meter_vars[num_vars],
+	      &agent_meter_vars[num_vars+1],
+	      (5-num_vars)*sizeof(struct variable8));
+   if(pMeterEntries[i].MeterRSSI)
+      num_vars++;
+   else
+      memmove(&agent_meter_vars[num_vars],
+	      &agent_meter_vars[num_vars+1],
+	      (5-num_vars)*sizeof(struct variable8));
+   num_vars++; /* Multiplier should allways be valid */
+   snprintf(descr, 19, "Meter%d", i);
+   if (register_mib_range(descr,
+			  (struct variable *) agent_meter_vars,
+			  sizeof(struct variable8),
+			  num_vars,
+			  MeterTableEntry_oid,
+			  sizeof(MeterTableEntry_oid)/sizeof(oid),
+			  DEFAULT_MIB_PRIORITY,
+			  i+1,
+			  i+2,
+			  NULL) !=
+       MIB_REGISTERED_OK)
+   {
+      DEBUGMSGTL(("register_mib", "%s registration failed\n",
+		  descr));
+   }
+   for(o=0; o < pMeterEntries[i].numObisEntries + derived[i].num_rows; o++)
+   {
+      struct obis_data *row = meter_row(i, o);
+      oid oid_name[8][MAX_OID_LEN];
+      int j,r;
+      fill_from_catalogue(row);
+      row->description_len = strlen(row->description);
+      row->unit_len = strlen(row->unit);
+      for(r=0;r<8;r++)
+      {
+	 oid_name[r][0] = r+COLUMN_METEROBISDESCRIPTION;
+	 for(j=0;j<5;j++)
+	 {
+	    oid_name[r][j+1] = row->obis_oid[j];
+	 }
+      }
+      {
+	 struct variable8 agent_obis_vars[8]= {
+	    { o, ASN_OCTET_STR, RONLY, agent_h_obis, 6,
+	      {oid_name[0][0],oid_name[0][1],oid_name[0][2],
+	       oid_name[0][3],oid_name[0][4],oid_name[0][5]} },
+	    { o, ASN_OCTET_STR, RONLY, agent_h_obis, 6,
+	      {oid_name[1][0],oid_name[1][1],oid_name[1][2],
+	       oid_name[1][3],oid_name[1][4],oid_name[1][5]} },
+	    { o, ASN_INTEGER,   RONLY, agent_h_obis, 6,
+	      {oid_name[2][0],oid_name[2][1],oid_name[2][2],
+	       oid_name[2][3],oid_name[2][4],oid_name[2][5]} },
+	    { o, ASN_INTEGER,   RONLY, agent_h_obis, 6,
+	      {oid_name[3][0],oid_name[3][1],oid_name[3][2],
+	       oid_name[3][3],oid_name[3][4],oid_name[3][5]} },
+	    { o, ASN_INTEGER,   RONLY, agent_h_obis, 6,
+	      {oid_name[4][0],oid_name[4][1],oid_name[4][2],
+	       oid_name[4][3],oid_name[4][4],oid_name[4][5]} },
+	    { o, ASN_INTEGER,   RONLY, agent_h_obis, 6,
+	      {oid_name[5][0],oid_name[5][1],oid_name[5][2],
+	       oid_name[5][3],oid_name[5][4],oid_name[5][5]} },
+	    { o, ASN_INTEGER,   RONLY, agent_h_obis, 6,
+	      {oid_name[6][0],oid_name[6][1],oid_name[6][2],
+	       oid_name[6][3],oid_name[6][4],oid_name[6][5]} },
+	    { o, ASN_INTEGER,   RONLY, agent_h_obis, 6,
+	      {oid_name[7][0],oid_name[7][1],oid_name[7][2],
+	       oid_name[7][3],oid_name[7][4],oid_name[7][5]} },
+	 };
+	 num_vars = 2; /* We allways have description and unit */
+	 if(row->latest_is_valid)
+	    num_vars++;
+	 else
+	    memmove(&agent_obis_vars[num_vars],
+		    &agent_obis_vars[num_vars+1],
+		    (7-num_vars)*sizeof(struct variable8));
+	 if(row->mean6m_is_valid)
+	    num_vars++;
+	 else
+	    memmove(&agent_obis_vars[num_vars],
+		    &agent_obis_vars[num_vars+1],
+		    (7-num_vars)*sizeof(struct variable8));
+	 if(row->max6m_is_valid)
+	    num_vars++;
+	 else
+	    memmove(&agent_obis_vars[num_vars],
+		    &agent_obis_vars[num_vars+1],
+		    (7-num_vars)*sizeof(struct variable8));
+	 if(row->min6m_is_valid)
+	    num_vars++;
+	 else
+	    memmove(&agent_obis_vars[num_vars],
+		    &agent_obis_vars[num_vars+1],
+		    (7-num_vars)*sizeof(struct variable8));
+	 if(row->p95_is_valid)
+	    num_vars++;
+	 else
+	    memmove(&agent_obis_vars[num_vars],
+		    &agent_obis_vars[num_vars+1],
+		    (7-num_vars)*sizeof(struct variable8));
+	 if(row->p99_is_valid)
+	    num_vars++;
+	 else
+	    memmove(&agent_obis_vars[num_vars],
+		    &agent_obis_vars[num_vars+1],
+		    (7-num_vars)*sizeof(struct variable8));
+#if 1
+	 if (register_mib_range(descr,
+				(struct variable *)agent_obis_vars,
+				sizeof(struct variable8),
+				num_vars,
+				MeterTableEntry_oid,
+				sizeof(MeterTableEntry_oid) /
+				  sizeof(oid),
+				DEFAULT_MIB_PRIORITY,
+				i+1,
+				i+2,
+				NULL) !=
+#endif
+#if 0
+	 if (register_mib(descr,
+			  (struct variable *)agent_obis_vars,
+			  sizeof(struct variable8),
+			  num_vars,
+			  MeterTableEntry_oid,
+			  sizeof(MeterTableEntry_oid) /
+			  sizeof(oid)) !=
+#endif
+	     MIB_REGISTERED_OK)
+	 {
+	    DEBUGMSGTL(("register_mib", "%s registration failed\n",
+			descr));
+	 }
+      }
+   }
+   sort_rows(i);
+   discovery_changed = 1;
+} /* register_meter */
+
+/* Registers the table of raw samples kept by drivers */
+static void register_samples(void)
+{
+   struct variable2 agent_sample_vars[2]= {
+      { COLUMN_METERSAMPLETIME, ASN_UNSIGNED, RONLY, agent_h_sample,
+	1, { COLUMN_METERSAMPLETIME } },
+      { COLUMN_METERSAMPLEVALUE, ASN_INTEGER, RONLY, agent_h_sample,
+	1, { COLUMN_METERSAMPLEVALUE } },
+   };
+
+   if(register_mib("MeterSamples",
+		   (struct variable *) agent_sample_vars,
+		   sizeof(struct variable2),
+		   2,
+		   MeterSampleEntry_oid,
+		   MeterSampleEntry_oid_len) !=
+      MIB_REGISTERED_OK)
+   {
+      DEBUGMSGTL(("register_mib", "MeterSamples registration failed\n"));
+   }
+} /* register_samples */
+
+/* Registers the table of values consolidated by the agent */
+static void register_history(void)
+{
+   struct variable2 agent_history_vars[4]= {
+      { COLUMN_METERHISTORYTIME, ASN_UNSIGNED, RONLY, agent_h_history,
+	1, { COLUMN_METERHISTORYTIME } },
+      { COLUMN_METERHISTORYMEAN, ASN_INTEGER, RONLY, agent_h_history,
+	1, { COLUMN_METERHISTORYMEAN } },
+      { COLUMN_METERHISTORYMAX, ASN_INTEGER, RONLY, agent_h_history,
+	1, { COLUMN_METERHISTORYMAX } },
+      { COLUMN_METERHISTORYMIN, ASN_INTEGER, RONLY, agent_h_history,
+	1, { COLUMN_METERHISTORYMIN } },
+   };
+
+   if(register_mib("MeterHistory",
+		   (struct variable *) agent_history_vars,
+		   sizeof(struct variable2),
+		   4,
+		   MeterHistoryEntry_oid,
+		   MeterHistoryEntry_oid_len) !=
+      MIB_REGISTERED_OK)
+   {
+      DEBUGMSGTL(("register_mib", "MeterHistory registration failed\n"));
+   }
+} /* register_history */
+
+/* Registers the table presenting the discovery document in chunks */
+static void register_discovery(void)
+{
+   struct variable2 agent_discovery_vars[1]= {
+      { COLUMN_METERDISCOVERYCHUNK, ASN_OCTET_STR, RONLY, agent_h_discovery,
+	1, { COLUMN_METERDISCOVERYCHUNK } },
+   };
+
+   if(register_mib("MeterDiscovery",
+		   (struct variable *) agent_discovery_vars,
+		   sizeof(struct variable2),
+		   1,
+		   MeterDiscoveryEntry_oid,
+		   MeterDiscoveryEntry_oid_len) !=
+      MIB_REGISTERED_OK)
+   {
+      DEBUGMSGTL(("register_mib", "MeterDiscovery registration failed\n"));
+   }
+} /* register_discovery */
+
+/* Returns a JSON array of the columns of MeterTable presented for row */
+static struct json_object *row_columns(const struct obis_data *row)
+{
+   struct json_object *columns = json_object_new_array();
+
+   json_object_array_add(columns,
+			 json_object_new_int(COLUMN_METEROBISDESCRIPTION));
+   json_object_array_add(columns, json_object_new_int(COLUMN_METEROBISUNIT));
+   if(row->latest_is_valid)
+      json_object_array_add(columns,
+			    json_object_new_int(COLUMN_METEROBISLATEST));
+   if(row->mean6m_is_valid)
+      json_object_array_add(columns,
+			    json_object_new_int(COLUMN_METEROBIS6MINMEAN));
+   if(row->max6m_is_valid)
+      json_object_array_add(columns,
+			    json_object_new_int(COLUMN_METEROBIS6MINMAX));
+   if(row->min6m_is_valid)
+      json_object_array_add(columns,
+			    json_object_new_int(COLUMN_METEROBIS6MINMIN));
+   if(row->p95_is_valid)
+      json_object_array_add(columns,
+			    json_object_new_int(COLUMN_METEROBIS6MINP95));
+   if(row->p99_is_valid)
+      json_object_array_add(columns,
+			    json_object_new_int(COLUMN_METEROBIS6MINP99));
+   return columns;
+} /* row_columns */
+
+/* Writes the discovery document to file, replacing it at once */
+static void write_discovery(const char *file)
+{
+   char tmp_path[PATH_MAX];
+   FILE *f;
+   int ok;
+
+   snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", file);
+   f = fopen(tmp_path, "w");
+   if(!f)
+   {
+      snmp_log(LOG_ERR, "Failed writing %s\n", tmp_path);
+      return;
+   }
+   ok = (fwrite(discovery_doc, discovery_len, 1, f) == 1);
+   if(fclose(f))
+      ok = 0;
+   if((!ok) || rename(tmp_path, file))
+   {
+      snmp_log(LOG_ERR, "Failed writing %s\n", file);
+      unlink(tmp_path);
+   }
+} /* write_discovery */
+
+/* Builds the discovery document describing all meters and their rows if
+   meters have been registered since it was last built, and writes it to
+   file unless file is NULL */
+static void update_discovery(const char *file)
+{
+   static unsigned int generation = 0;
+   struct json_object *doc, *meters, *meter, *rows, *row, *code;
+   const char *text;
+   unsigned int i, o, j;
+
+   if(!discovery_changed)
+      return;
+   doc = json_object_new_object();
+   json_object_object_add(doc, "version",
+			  json_object_new_int(DISCOVERY_VERSION));
+   json_object_object_add(doc, "generation",
+			  json_object_new_int(++generation));
+   json_object_object_add(doc, "agent", json_object_new_string(VERSION_STRING));
+   meters = json_object_new_array();
+   for(i=0; i<MaxRegisteredEntry; i++)
+   {
+      struct MeterTable_entry *entry = &pMeterEntries[i];
+
+      if(!entry->valid)
+	 continue;
+      meter = json_object_new_object();
+      json_object_object_add(meter, "index", json_object_new_int(i+1));
+      json_object_object_add(meter, "type",
+			     json_object_new_string_len(entry->MeterType,
+							entry->MeterType_len));
+      json_object_object_add(meter, "ip",
+			     json_object_new_string_len(entry->MeterIP,
+							entry->MeterIP_len));
+      json_object_object_add(meter, "mac",
+			     json_object_new_string_len(entry->MeterMAC,
+							entry->MeterMAC_len));
+      json_object_object_add(meter, "rssi",
+			     json_object_new_boolean(entry->MeterRSSI != 0));
+      json_object_object_add(meter, "multiplier",
+			     json_object_new_int64(entry->MeterMultiplier));
+      rows = json_object_new_array();
+      for(o=0; o < entry->numObisEntries + derived[i].num_rows; o++)
+      {
+	 struct obis_data *r = meter_row(i, o);
+
+	 row = json_object_new_object();
+	 code = json_object_new_array();
+	 for(j=0; j<5; j++)
+	    json_object_array_add(code, json_object_new_int(r->obis_oid[j]));
+	 json_object_object_add(row, "code", code);
+	 json_object_object_add(row, "description",
+				json_object_new_string_len(r->description,
+							   r->description_len));
+	 json_object_object_add(row, "unit",
+				json_object_new_string_len(r->unit,
+							   r->unit_len));
+	 json_object_object_add(row, "columns", row_columns(r));
+	 if(r->samples)
+	    json_object_object_add(row, "samples",
+				   json_object_new_int(r->samples->size));
+	 json_object_array_add(rows, row);
+      }
+      json_object_object_add(meter, "rows", rows);
+      json_object_array_add(meters, meter);
+   }
+   json_object_object_add(doc, "meters", meters);
+   json_object_object_add(doc, "history",
+			  json_object_new_boolean(archives.num_meters != 0));
+   text = json_object_to_json_string_ext(doc, JSON_C_TO_STRING_PLAIN);
+   free(discovery_doc);
+   discovery_doc = strdup(text);
+   discovery_len = discovery_doc ? strlen(discovery_doc) : 0;
+   json_object_put(doc);
+   discovery_changed = 0;
+   if(file && discovery_doc)
+      write_discovery(file);
+} /* update_discovery */
+
+static unsigned long hash_string(const char *s)
+{
+   unsigned long hash = 2166136261UL; /* FNV-1a */
+
+   while(*s)
+      hash = (hash ^ (unsigned char)*s++) * 16777619UL;
+   return hash;
+} /* hash_string */
+
+static int compare_device(const void *a, const void *b)
+{
+   return strcmp(((const struct driver_device *)a)->key,
+		 ((const struct driver_device *)b)->key);
+} /* compare_device */
+
+/* Copies row w updated by a driver to row e, keeping the description and
+   unit filled in by the agent and the samples of e, which are copied */
+static void publish_row(struct obis_data *e, const struct obis_data *w)
+{
+   struct obis_data row = *w;
+
+   row.description = e->description;
+   row.description_len = e->description_len;
+   row.unit = e->unit;
+   row.unit_len = e->unit_len;
+   row.samples = e->samples;
+   *e = row;
+   if((!w->samples) || (!w->samples->size))
+      return;
+   if(e->samples && (e->samples->size != w->samples->size))
+   {
+      samples_free(e->samples);
+      free(e->samples);
+      e->samples = NULL;
+   }
+   if(!e->samples)
+   {
+      e->samples = calloc(1, sizeof(struct sample_ring));
+      if((!e->samples) || samples_alloc(e->samples, w->samples->size))
+      {
+	 free(e->samples);
+	 e->samples = NULL;
+	 return;
+      }
+   }
+   e->samples->count = w->samples->count;
+   e->samples->next = w->samples->next;
+   memcpy(e->samples->samples, w->samples->samples,
+	  w->samples->size * sizeof(struct obis_sample));
+} /* publish_row */
+
+/* Copies what the driver of meter i has updated in its work entry to the
+   entry served, called only while no worker thread updates the meter */
+static void publish_meter(unsigned int i)
+{
+   struct MeterTable_entry *e = &pMeterEntries[i];
+   struct MeterTable_entry meter = work_entries[i];
+   unsigned int o;
+
+   meter.numObisEntries = e->numObisEntries;
+   meter.ObisEntries = e->ObisEntries;
+   meter.valid = e->valid;
+   *e = meter;
+   for(o=0; (o < e->numObisEntries) && (o < work_entries[i].numObisEntries);
+       o++)
+      publish_row(&e->ObisEntries[o], &work_entries[i].ObisEntries[o]);
+} /* publish_meter */
+
+/* Gives meter i the rows set up by its init_driver, in an array of its
+   own. Returns 0 on success. */
+static int copy_meter(unsigned int i)
+{
+   struct MeterTable_entry *e = &pMeterEntries[i];
+   const struct MeterTable_entry *w = &work_entries[i];
+   unsigned int o;
+
+   *e = *w;
+   e->ObisEntries = calloc(w->numObisEntries ? w->numObisEntries : 1,
+			   sizeof(struct obis_data));
+   if(!e->ObisEntries)
+   {
+      snmp_log(LOG_CRIT,"Calloc failed!\n");
+      memset(e, 0, sizeof(struct MeterTable_entry));
+      return -1;
+   }
+   for(o=0; o<w->numObisEntries; o++)
+   {
+      e->ObisEntries[o] = w->ObisEntries[o];
+      e->ObisEntries[o].samples = NULL;
+   }
+   publish_meter(i);
+   meters_generation++;
+   return 0;
+} /* copy_meter */
+
+/* Frees the rows given to meter i by copy_meter */
+static void free_meter(unsigned int i)
+{
+   struct MeterTable_entry *e = &pMeterEntries[i];
+   unsigned int o;
+
+   for(o=0; e->ObisEntries && (o<e->numObisEntries); o++)
+      if(e->ObisEntries[o].samples)
+      {
+	 samples_free(e->ObisEntries[o].samples);
+	 free(e->ObisEntries[o].samples);
+      }
+   free(e->ObisEntries);
+   memset(e, 0, sizeof(struct MeterTable_entry));
+   meters_generation++;
+} /* free_meter */
+
+static void *probe_device(void *arg)
+{
+   struct probe *p = arg;
+   struct driver_data *d = &drivers[p->slot];
+
+   d->instance = d->init_driver(&work_entries[p->slot], p->parameters);
+   __atomic_store_n(&p->done, 1, __ATOMIC_RELEASE);
+   return NULL;
+} /* probe_device */
+
+/* Removes every registration of the rows of meter i */
+static void unregister_meter(unsigned int i)
+{
+   oid MeterTableEntry_oid[MeterTable_oid_len+1];
+   unsigned int n;
+
+   memcpy(MeterTableEntry_oid, MeterTable_oid,
+	  MeterTable_oid_len*sizeof(oid));
+   MeterTableEntry_oid[MeterTable_oid_len] = 1;
+   /* the meter columns and each row were registered the same way */
+   for(n=0; n <= pMeterEntries[i].numObisEntries + derived[i].num_rows; n++)
+      if(unregister_mib_range(MeterTableEntry_oid,
+			      sizeof(MeterTableEntry_oid)/sizeof(oid),
+			      DEFAULT_MIB_PRIORITY, i+1, i+2) !=
+	 MIB_UNREGISTERED_OK)
+	 break;
+   free(sorted[i].rows);
+   memset(&sorted[i], 0, sizeof(struct sorted_rows));
+   discovery_changed = 1;
+} /* unregister_meter */
+
+static int find_rejected(const struct discovery *b, const char *key)
+{
+   int k;
+
+   for(k=0; k<b->num_rejected; k++)
+      if(!strcmp(b->rejected[k].key, key))
+	 return k;
+   return -1;
+} /* find_rejected */
+
+/* Remembers that the device with key was not accepted, to probe it again
+   after a delay doubled every time it is rejected. Takes over key. */
+static void reject_device(struct discovery *b, char *key, time_t now)
+{
+   struct rejected_device *r;
+   int k = find_rejected(b, key);
+
+   if(k >= 0)
+   {
+      free(key);
+      r = &b->rejected[k];
+      r->backoff = (r->backoff*2 < PROBE_BACKOFF_MAX) ?
+	 r->backoff*2 : PROBE_BACKOFF_MAX;
+   }
+   else
+   {
+      r = realloc(b->rejected,
+		  (b->num_rejected+1)*sizeof(struct rejected_device));
+      if(!r)
+      {
+	 free(key);
+	 return;
+      }
+      b->rejected = r;
+      r = &b->rejected[b->num_rejected++];
+      r->key = key;
+      r->backoff = PROBE_BACKOFF_MIN;
+   }
+   r->retry = now + r->backoff;
+} /* reject_device */
+
+static void forget_rejected(struct discovery *b, int k)
+{
+   free(b->rejected[k].key);
+   b->rejected[k] = b->rejected[--b->num_rejected];
+} /* forget_rejected */
+
+/* Registers the devices of discovery block b accepted by their driver and
+   frees the slots of those rejected. With wait set all probes are waited
+   for, else only those already done are finished. */
+static void finish_probes(struct discovery *b, time_t now, int wait)
+{
+   struct probe *p;
+   int s, k, slot;
+
+   for(s=0; s<b->num_slots; s++)
+   {
+      p = &b->probes[s];
+      if((!p->active) ||
+	 ((!wait) && !__atomic_load_n(&p->done, __ATOMIC_ACQUIRE)))
+	 continue;
+      if(p->started)
+	 pthread_join(p->thread, NULL);
+      p->active = 0;
+      slot = p->slot;
+      if(drivers[slot].instance && work_entries[slot].valid &&
+	 !copy_meter(slot))
+      {
+	 snmp_log(LOG_INFO, "Found %s as meter %d\n", b->keys[s], slot+1);
+	 k = find_rejected(b, b->keys[s]);
+	 if(k >= 0)
+	    forget_rejected(b, k);
+	 derived_init(&derived[slot], &pMeterEntries[slot], b->derived);
+	 register_meter(slot);
+      }
+      else
+      {
+	 if(drivers[slot].instance && drivers[slot].remove_driver)
+	    drivers[slot].remove_driver(drivers[slot].instance,
+					&work_entries[slot]);
+	 memset(&drivers[slot], 0, sizeof(struct driver_data));
+	 memset(&work_entries[slot], 0, sizeof(struct MeterTable_entry));
+	 reject_device(b, b->keys[s], now);
+	 b->keys[s] = NULL;
+      }
+   }
+} /* finish_probes */
+
+/* Removes the meter of a device no longer found */
+static void remove_device(struct discovery *b, int s)
+{
+   int slot = b->first_slot + s;
+
+   snmp_log(LOG_INFO, "%s is gone, removing meter %d\n", b->keys[s],
+	    slot+1);
+   unregister_meter(slot);
+   if(drivers[slot].remove_driver)
+      drivers[slot].remove_driver(drivers[slot].instance,
+				  &work_entries[slot]);
+   free_meter(slot);
+   derived_free(&derived[slot]);
+   memset(&derived[slot], 0, sizeof(struct derived_rows));
+   memset(&drivers[slot], 0, sizeof(struct driver_data));
+   memset(&work_entries[slot], 0, sizeof(struct MeterTable_entry));
+   free(b->keys[s]);
+   b->keys[s] = NULL;
+} /* remove_device */
+
+/* Looks for new and removed devices of discovery block b. Each new device
+   is given the free slot closest after the hash of its key, so that a
+   device keeps its meter index whatever order devices are found in. New
+   devices are probed by threads of their own and registered by a later
+   call when accepted by their driver, or by this call with wait set. The
+   meter of a device gone is removed once no worker updates it. */
+static void discover_meters(struct discovery *b, time_t now, int wait)
+{
+   struct driver_device *found;
+   struct probe *p;
+   int num_found;
+   int f, k, s, slot;
+
+   finish_probes(b, now, 0);
+   found = calloc(b->num_slots, sizeof(struct driver_device));
+   if(!found)
+      return;
+   num_found = b->discover_devices(b->parameters, found, b->num_slots);
+   /* sorted to resolve hash collisions the same way every time */
+   qsort(found, num_found, sizeof(struct driver_device), compare_device);
+   /* forget rejected devices which have gone away, they are probed again
+      if they come back */
+   for(k=0; k<b->num_rejected; k++)
+   {
+      for(f=0; f<num_found; f++)
+	 if(!strcmp(b->rejected[k].key, found[f].key))
+	    break;
+      if(f == num_found)
+	 forget_rejected(b, k--);
+   }
+   for(s=0; s<b->num_slots; s++)
+   {
+      if((!b->keys[s]) || b->probes[s].active ||
+	 updating[b->first_slot + s])
+	 continue;
+      for(f=0; f<num_found; f++)
+	 if(!strcmp(b->keys[s], found[f].key))
+	    break;
+      if(f == num_found)
+	 remove_device(b, s);
+   }
+   for(f=0; f<num_found; f++)
+   {
+      for(s=0; s<b->num_slots; s++)
+	 if(b->keys[s] && !strcmp(b->keys[s], found[f].key))
+	    break;
+      if(s < b->num_slots)
+	 continue; /* already known */
+      k = find_rejected(b, found[f].key);
+      if((k >= 0) && (now < b->rejected[k].retry))
+	 continue; /* did not answer as expected when last probed */
+      s = hash_string(found[f].key) % b->num_slots;
+      for(k=0; (k<b->num_slots) && b->keys[(s+k) % b->num_slots]; k++);
+      if(k == b->num_slots)
+      {
+	 snmp_log(LOG_WARNING, "No free meter slot for %s\n", found[f].key);
+	 continue;
+      }
+      s = (s+k) % b->num_slots;
+      b->keys[s] = strdup(found[f].key);
+      if(!b->keys[s])
+	 continue;
+      slot = b->first_slot + s;
+      drivers[slot] = b->driver;
+      p = &b->probes[s];
+      p->slot = slot;
+      p->done = 0;
+      p->active = 1;
+      memcpy(p->parameters, found[f].parameters, sizeof(p->parameters));
+      p->started = !pthread_create(&p->thread, NULL, probe_device, p);
+      if(!p->started)
+	 probe_device(p);
+   }
+   free(found);
+   if(wait)
+      finish_probes(b, now, 1);
+} /* discover_meters */
+
+/* Updates aggregate a from its members, first finding the rows of the
+   members again if any meter has got or lost its rows since last time.
+   Only counting the valid members would miss one device replacing
+   another, leaving sources pointing at freed rows. */
+static void update_aggregate(struct aggregate *a)
+{
+   unsigned int m, o;
+
+   if(a->generation != meters_generation)
+   {
+      aggregate_clear_sources(a);
+      for(m=0; m<a->num_members; m++)
+      {
+	 unsigned int i = a->members[m];
+
+	 if((i >= MaxRegisteredEntry) || (&pMeterEntries[i] == a->entry) ||
+	    (!pMeterEntries[i].valid))
+	    continue;
+	 for(o=0; o < pMeterEntries[i].numObisEntries + derived[i].num_rows;
+	     o++)
+	    aggregate_add_source(a, meter_row(i, o),
+				 pMeterEntries[i].MeterMultiplier);
+      }
+      aggregate_sources_done(a);
+      a->generation = meters_generation;
+   }
+   aggregate_update(a);
+} /* update_aggregate */
+
+/* Appends the values of all meters to the history on disk */
+static void save_history(struct tsdb *history, time_t now)
+{
+   unsigned int i, o;
+
+   for(i=0; i<MaxRegisteredEntry; i++)
+      if(pMeterEntries[i].valid)
+	 for(o=0; o < pMeterEntries[i].numObisEntries + derived[i].num_rows;
+	     o++)
+	    tsdb_append(history, i, o, meter_row(i, o), now);
+   tsdb_sync(history, now);
+} /* save_history */
+
+/* Adds the values of all meters to the archives */
+static void update_archives(time_t now)
+{
+   unsigned int i, o;
+
+   for(i=0; i<archives.num_meters; i++)
+      if(pMeterEntries[i].valid)
+	 for(o=0; o < pMeterEntries[i].numObisEntries + derived[i].num_rows;
+	     o++)
+	    archive_add(&archives, i, o, meter_row(i, o), now);
+} /* update_archives */
+
+/* Publishes a snapshot of all meters to readers of the socket */
+static void publish_snapshot(struct snapshot *snapshot, time_t now)
+{
+   unsigned int i, o;
+
+   snapshot_begin(snapshot);
+   for(i=0; i<MaxRegisteredEntry; i++)
+   {
+      if(!pMeterEntries[i].valid)
+	 continue;
+      snapshot_add_meter(snapshot, i+1, &pMeterEntries[i]);
+      for(o=0; o < pMeterEntries[i].numObisEntries + derived[i].num_rows;
+	  o++)
+	 snapshot_add_row(snapshot, meter_row(i, o));
+   }
+   for(i=0; i<MaxRegisteredEntry; i++)
+   {
+      if(!pMeterEntries[i].valid)
+	 continue;
+      for(o=0; o < pMeterEntries[i].numObisEntries; o++)
+	 snapshot_add_samples(snapshot, i+1, o,
+			      pMeterEntries[i].ObisEntries[o].samples);
+   }
+   snapshot_publish(snapshot, now);
+} /* publish_snapshot */
+
+/* Mirrors the values of all meters in shared memory */
+static void share_values(struct shared *shared, time_t now)
+{
+   unsigned int i, o, num_rows;
+
+   for(i=0; i<MaxRegisteredEntry; i++)
+   {
+      if(!pMeterEntries[i].valid)
+	 continue;
+      num_rows = pMeterEntries[i].numObisEntries + derived[i].num_rows;
+      shared_begin_meter(shared, i, &pMeterEntries[i]);
+      for(o=0; o<num_rows; o++)
+	 shared_set_row(shared, i, o, meter_row(i, o));
+      shared_end_meter(shared, i, num_rows, now);
+   }
+} /* share_values */
+
+/* Gets new values of meter i into its work entry, run by a worker thread */
+static void update_meter(unsigned int i, void *arg)
+{
+   drivers[i].update_driver_data(drivers[i].instance, &work_entries[i]);
+} /* update_meter */
+
+/* Starts a new round, queuing the update of every meter not still being
+   updated since an earlier round. Returns the number of meters queued. */
+static unsigned int update_meters(struct workers *w)
+{
+   unsigned int i, queued=0;
+
+   update_round++;
+   for(i=0; i<MaxRegisteredEntry; i++)
+   {
+      if((!drivers[i].update_driver_data) || (!pMeterEntries[i].valid))
+	 continue;
+      if(updating[i])
+      {
+	 snmp_log(LOG_DEBUG, "Meter %u is still being updated\n", i+1);
+	 continue;
+      }
+      updating[i] = update_round;
+      workers_queue(w, i);
+      queued++;
+   }
+   return queued;
+} /* update_meters */
+
+/* Publishes the meters worker threads are done updating. Returns how many
+   of them were queued in the current round. */
+static unsigned int collect_meters(struct workers *w)
+{
+   unsigned int i, k, num_done, current=0;
+
+   num_done = workers_done(w, done_meters);
+   for(k=0; k<num_done; k++)
+   {
+      i = done_meters[k];
+      publish_meter(i);
+      derived_update(&derived[i], &pMeterEntries[i]);
+      if(updating[i] == update_round)
+	 current++;
+      updating[i] = 0;
+   }
+   return current;
+} /* collect_meters */
+
+/* Pushes the changed values of all meters to a time series database */
+static void export_values(struct exporter *exporter, time_t now)
+{
+   unsigned int i, o;
+
+   export_begin(exporter, now);
+   for(i=0; i<MaxRegisteredEntry; i++)
+   {
+      if(!pMeterEntries[i].valid)
+	 continue;
+      for(o=0; o < pMeterEntries[i].numObisEntries + derived[i].num_rows;
+	  o++)
+	 export_row(exporter, i, o, &pMeterEntries[i], meter_row(i, o));
+   }
+   export_end(exporter);
+} /* export_values */
+
 int
 main (int argc, char **argv) {
   int background = 1; /* change if you not want to run in the background */
   int syslog = 1; /* change this if you not want to use syslog */
   char *conffile = ETC_DIR "/obis2snmp_config.json";
   int opt;
-  struct json_object *conf_obj, *meter_array, *meter_obj;
+  struct json_object *conf_obj, *meter_array, *meter_obj, *tmp_obj;
   const char *driver;
   const char *parameters;
   int num_meters;
-  int i, o;
-  struct driver_data *drivers=NULL;
-  char driver_path[256];
-  time_t last_time_updated=0;
+  int num_slots;
+  int num_discoveries=0;
+  struct discovery *discoveries=NULL;
+  int num_aggregates=0;
+  struct aggregate_meter *aggregates=NULL;
+  int i, slot;
   time_t current_time;
-  char descr[20];
+  time_t interval=10;
+  struct eventloop loop;
+  struct workers workers;
+  unsigned int num_threads=0;
+  unsigned int pending=0; /* meters of the round not yet done */
+  int events, due=0, collecting=0;
+  struct tsdb history;
+  int keep_history=0;
+  char *discovery_file=NULL;
+  struct snapshot snapshot;
+  char *snapshot_path=NULL;
+  int serve_snapshot=0;
+  struct shared shared;
+  int share=0;
+  struct exporter exporter;
+  int push=0;
 
   curl_global_init(CURL_GLOBAL_NOTHING);
   
-  while ((opt = getopt(argc, argv, "vhc:")) != -1) {
+  while ((opt = getopt(argc, argv, "vhc:d:")) != -1) {
      switch(opt) {
 	case 'c':
 	   conffile=optarg;
 	   break;
+	case 'd':
+	   exit(tsdb_dump(optarg, stdout) ? EXIT_FAILURE : EXIT_SUCCESS);
 	case 'h':
 	case 'v':
 	default:
@@ -306,11 +1653,15 @@ main (int argc, char **argv) {
 	      "Copyright (c) Henrik Carlqvist, BSD-2-Clause license\n");
 	   fprintf(stderr,
 		   "Usage: %s [-c /path/to/config.json]\n"
-		   "(-c defaults to %s)\n",
-		   argv[0], conffile);
+		   "(-c defaults to %s)\n"
+		   "   or: %s -d /path/to/history/file.tsd\n"
+		   "(-d prints the samples of a history file)\n",
+		   argv[0], conffile, argv[0]);
 	   exit(EXIT_FAILURE);
      }
   }
+  /* before any thread is started, signals are read by the event loop */
+  eventloop_block_signals();
   /* print log errors to syslog or stderr */
   netsnmp_enable_subagent();
   if (syslog)
@@ -332,7 +1683,6 @@ main (int argc, char **argv) {
      exit(EXIT_FAILURE);
   }
   num_meters = json_object_array_length(meter_array);
-  MaxRegisteredEntry = num_meters;
   if(num_meters < 1) {
      snmp_log(LOG_CRIT,"File %s does not have any meters in array!\n",
 	      conffile);
@@ -340,210 +1690,155 @@ main (int argc, char **argv) {
 	      conffile);
      exit(EXIT_FAILURE);
   }
-  pMeterEntries = calloc(num_meters, sizeof(struct MeterTable_entry));
-  drivers = calloc(num_meters, sizeof(struct driver_data));
-  if((!drivers)||(!pMeterEntries)) {
+  /* A discovering entry reserves a range of slots for its devices, all
+     other entries have one slot each */
+  for(i=0, num_slots=0; i<num_meters; i++){
+     meter_obj = json_object_array_get_idx(meter_array, i);
+     if(json_object_object_get_ex(meter_obj, "discover", NULL))
+     {
+	num_discoveries++;
+	if(json_object_object_get_ex(meter_obj, "slots", &tmp_obj) &&
+	   (json_object_get_int(tmp_obj) > 0))
+	   num_slots += json_object_get_int(tmp_obj);
+	else
+	   num_slots += DISCOVERY_SLOTS;
+     }
+     else
+     {
+	if(json_object_object_get_ex(meter_obj, "aggregate", NULL))
+	   num_aggregates++;
+	num_slots++;
+     }
+  }
+  MaxRegisteredEntry = num_slots;
+  if(json_object_object_get_ex(conf_obj, "interval", &tmp_obj) &&
+     (json_object_get_int(tmp_obj) > 0))
+     interval = json_object_get_int(tmp_obj);
+  if(json_object_object_get_ex(conf_obj, "threads", &tmp_obj) &&
+     (json_object_get_int(tmp_obj) > 0))
+     num_threads = json_object_get_int(tmp_obj);
+  if(json_object_object_get_ex(conf_obj, "history", &tmp_obj))
+     keep_history = !tsdb_init(&history, tmp_obj, num_slots);
+  if(json_object_object_get_ex(conf_obj, "discovery", &tmp_obj))
+     discovery_file = strdup(json_object_get_string(tmp_obj));
+  /* "shm" is either an object with settings or true for the defaults */
+  if(json_object_object_get_ex(conf_obj, "shm", &tmp_obj) &&
+     (json_object_is_type(tmp_obj, json_type_object) ||
+      (json_object_is_type(tmp_obj, json_type_boolean) &&
+       json_object_get_boolean(tmp_obj))))
+     share = !shared_init(&shared, tmp_obj, num_slots);
+  if(json_object_object_get_ex(conf_obj, "export", &tmp_obj))
+     push = !export_init(&exporter, tmp_obj, num_slots);
+  if(json_object_object_get_ex(conf_obj, "socket", &tmp_obj))
+     snapshot_path = strdup(json_object_get_string(tmp_obj));
+  if(json_object_object_get_ex(conf_obj, "archive", &tmp_obj) &&
+     json_object_get_boolean(tmp_obj) && archive_init(&archives, num_slots))
+  {
+     snmp_log(LOG_CRIT,"Calloc failed!\n");
+     exit(EXIT_FAILURE);
+  }
+  pMeterEntries = calloc(num_slots, sizeof(struct MeterTable_entry));
+  work_entries = calloc(num_slots, sizeof(struct MeterTable_entry));
+  updating = calloc(num_slots, sizeof(unsigned long));
+  done_meters = calloc(num_slots, sizeof(unsigned int));
+  drivers = calloc(num_slots, sizeof(struct driver_data));
+  derived = calloc(num_slots, sizeof(struct derived_rows));
+  sorted = calloc(num_slots, sizeof(struct sorted_rows));
+  if(num_discoveries)
+     discoveries = calloc(num_discoveries, sizeof(struct discovery));
+  if(num_aggregates)
+     aggregates = calloc(num_aggregates, sizeof(struct aggregate_meter));
+  if((!drivers)||(!pMeterEntries)||(!work_entries)||(!updating)||
+     (!done_meters)||(!derived)||(!sorted)||
+     (num_discoveries && !discoveries)||(num_aggregates && !aggregates)) {
      snmp_log(LOG_CRIT,"Calloc failed!\n");
      exit(EXIT_FAILURE);
   }
   /* initialize the agent library */
   init_agent("MeterTable");
+  register_samples();
+  register_history();
+  register_discovery();
 
-  for(i=0; i<num_meters; i++){
+  num_discoveries = 0;
+  num_aggregates = 0;
+  for(i=0, slot=0; i<num_meters; i++){
      meter_obj = json_object_array_get_idx(meter_array, i);
-     driver = json_object_get_string(
-	json_object_object_get(meter_obj, "driver"));
-     parameters = json_object_get_string(
-	json_object_object_get(meter_obj, "parameters"));
-
-     /* printf("Driver: '%s' , parameters: '%s'\n", driver, parameters); */
-     snprintf(driver_path, 256, "%s.so", driver);
-     /* printf("Trying to open: %s\n", driver_path); */
-     drivers[i].dlhandle = dlopen(driver_path,  RTLD_NOW);
-     if(!drivers[i].dlhandle)
+     if(json_object_object_get_ex(meter_obj, "aggregate", NULL))
      {
-	snmp_log(LOG_CRIT,"driver %s load failure, %s\n",
-		 driver_path, dlerror());
-	fprintf(stderr, "driver %s load failure, %s\n",
-		driver_path, dlerror());
+	struct aggregate_meter *a = &aggregates[num_aggregates];
+
+	a->slot = slot;
+	if(!aggregate_init(&a->aggregate, &pMeterEntries[slot], meter_obj))
+	{
+	   num_aggregates++;
+	   if(json_object_object_get_ex(meter_obj, "derived", &tmp_obj))
+	      derived_init(&derived[slot], &pMeterEntries[slot],
+			   json_object_get_string(tmp_obj));
+	   register_meter(slot);
+	}
+	slot++;
+	continue;
      }
-     else
+     driver = json_object_get_string(
+	json_object_object_get(meter_obj, "driver"));
+     if(json_object_object_get_ex(meter_obj, "discover", &tmp_obj))
      {
-	drivers[i].init_driver = dlsym(drivers[i].dlhandle, "init_driver");
-	if(drivers[i].init_driver)
+	struct discovery *b = &discoveries[num_discoveries];
+
+	b->first_slot = slot;
+	b->num_slots = DISCOVERY_SLOTS;
+	if(json_object_object_get_ex(meter_obj, "slots", &tmp_obj) &&
+	   (json_object_get_int(tmp_obj) > 0))
+	   b->num_slots = json_object_get_int(tmp_obj);
+	slot += b->num_slots;
+	json_object_object_get_ex(meter_obj, "discover", &tmp_obj);
+	b->parameters = strdup(json_object_get_string(tmp_obj));
+	b->keys = calloc(b->num_slots, sizeof(char *));
+	b->probes = calloc(b->num_slots, sizeof(struct probe));
+	b->derived = NULL;
+	if(json_object_object_get_ex(meter_obj, "derived", &tmp_obj))
+	   b->derived = strdup(json_object_get_string(tmp_obj));
+	if(load_driver(&b->driver, driver) || (!b->parameters) ||
+	   (!b->keys) || (!b->probes))
 	{
-	   drivers[i].update_driver_data = dlsym(drivers[i].dlhandle,
-						 "update_driver_data");
-	   drivers[i].remove_driver = dlsym(drivers[i].dlhandle,
-					    "remove_driver");
-	   drivers[i].instance = drivers[i].init_driver(&pMeterEntries[i],
-							parameters);
-	   if(pMeterEntries[i].valid)
-	   {
-	      struct variable8 agent_meter_vars[6]= {
-		 { COLUMN_METERINDEX, ASN_INTEGER, RONLY, agent_h_meter,
-		   1, { COLUMN_METERINDEX } },
-		 { COLUMN_METERTYPE, ASN_OCTET_STR, RONLY, agent_h_meter,
-		   1, { COLUMN_METERTYPE } },
-		 { COLUMN_METERIP, ASN_OCTET_STR, RONLY, agent_h_meter,
-		   1, { COLUMN_METERIP } },
-		 { COLUMN_METERMAC, ASN_OCTET_STR, RONLY, agent_h_meter,
-		   1, { COLUMN_METERMAC } },
-		 { COLUMN_METERRSSI, ASN_INTEGER, RONLY, agent_h_meter,
-		   1, { COLUMN_METERRSSI } },
-		 { COLUMN_METERMULTIPLIER, ASN_INTEGER, RONLY, agent_h_meter,
-		   1, { COLUMN_METERMULTIPLIER } },
-	      };
-	      size_t num_vars = 1; /* We allways have an index */
-	      oid       MeterTableEntry_oid[MeterTable_oid_len+1];
-
-	      memcpy(MeterTableEntry_oid, MeterTable_oid,
-		     MeterTable_oid_len*sizeof(oid));
-	      MeterTableEntry_oid[MeterTable_oid_len] = 1;
-
-	      if(pMeterEntries[i].MeterType_len)
-		 num_vars++;
-	      else
-		 memmove(&agent_meter_vars[num_vars],
-			 &agent_meter_vars[num_vars+1],
-			 (5-num_vars)*sizeof(struct variable8));
-	      if(pMeterEntries[i].MeterIP_len)
-		 num_vars++;
-	      else
-		 memmove(&agent_meter_vars[num_vars],
-			 &agent_meter_vars[num_vars+1],
-			 (5-num_vars)*sizeof(struct variable8));
-	      if(pMeterEntries[i].MeterMAC_len)
-		 num_vars++;
-	      else
-		 memmove(&agent_meter_vars[num_vars],
-			 &agent_meter_vars[num_vars+1],
-			 (5-num_vars)*sizeof(struct variable8));
-	      if(pMeterEntries[i].MeterRSSI)
-		 num_vars++;
-	      else
-		 memmove(&agent_meter_vars[num_vars],
-			 &agent_meter_vars[num_vars+1],
-			 (5-num_vars)*sizeof(struct variable8));
-	      num_vars++; /* Multiplier should allways be valid */
-	      snprintf(descr, 19, "Meter%d", i);
-	      if (register_mib_range(descr,
-				     (struct variable *) agent_meter_vars,
-				     sizeof(struct variable8),
-				     num_vars,
-				     MeterTableEntry_oid,
-				     sizeof(MeterTableEntry_oid)/sizeof(oid),
-				     DEFAULT_MIB_PRIORITY,
-				     i+1,
-				     i+2,
-				     NULL) !=
-		  MIB_REGISTERED_OK)
-	      {
-		 DEBUGMSGTL(("register_mib", "%s registration failed\n",
-			     descr));
-	      }
-	      for(o=0; o < pMeterEntries[i].numObisEntries; o++)
-	      {
-		 oid oid_name[6][MAX_OID_LEN];
-		 int j,r;
-		 pMeterEntries[i].ObisEntries[o].description_len =
-		    strlen(pMeterEntries[i].ObisEntries[o].description);
-		 pMeterEntries[i].ObisEntries[o].unit_len =
-		    strlen(pMeterEntries[i].ObisEntries[o].unit);
-		 for(r=0;r<6;r++)
-		 {
-		    oid_name[r][0] = r+COLUMN_METEROBISDESCRIPTION;
-		    for(j=0;j<5;j++)
-		    {
-		       oid_name[r][j+1] =
-			  pMeterEntries[i].ObisEntries[o].obis_oid[j];
-		    }
-		 }
-		 {
-		    struct variable8 agent_obis_vars[6]= {
-		       { o, ASN_OCTET_STR, RONLY, agent_h_obis, 6,
-			 {oid_name[0][0],oid_name[0][1],oid_name[0][2],
-			  oid_name[0][3],oid_name[0][4],oid_name[0][5]} },
-		       { o, ASN_OCTET_STR, RONLY, agent_h_obis, 6,
-			 {oid_name[1][0],oid_name[1][1],oid_name[1][2],
-			  oid_name[1][3],oid_name[1][4],oid_name[1][5]} },
-		       { o, ASN_INTEGER,   RONLY, agent_h_obis, 6,
-			 {oid_name[2][0],oid_name[2][1],oid_name[2][2],
-			  oid_name[2][3],oid_name[2][4],oid_name[2][5]} },
-		       { o, ASN_INTEGER,   RONLY, agent_h_obis, 6,
-			 {oid_name[3][0],oid_name[3][1],oid_name[3][2],
-			  oid_name[3][3],oid_name[3][4],oid_name[3][5]} },
-		       { o, ASN_INTEGER,   RONLY, agent_h_obis, 6,
-			 {oid_name[4][0],oid_name[4][1],oid_name[4][2],
-			  oid_name[4][3],oid_name[4][4],oid_name[4][5]} },
-		       { o, ASN_INTEGER,   RONLY, agent_h_obis, 6,
-			 {oid_name[5][0],oid_name[5][1],oid_name[5][2],
-			  oid_name[5][3],oid_name[5][4],oid_name[5][5]} },
-		    };
-		    num_vars = 2; /* We allways have description and unit */
-		    if(pMeterEntries[i].ObisEntries[o].latest_is_valid)
-		       num_vars++;
-		    else
-		       memmove(&agent_obis_vars[num_vars],
-			       &agent_obis_vars[num_vars+1],
-			       (5-num_vars)*sizeof(struct variable8));
-		    if(pMeterEntries[i].ObisEntries[o].mean6m_is_valid)
-		       num_vars++;
-		    else
-		       memmove(&agent_obis_vars[num_vars],
-			       &agent_obis_vars[num_vars+1],
-			       (5-num_vars)*sizeof(struct variable8));
-		    if(pMeterEntries[i].ObisEntries[o].max6m_is_valid)
-		       num_vars++;
-		    else
-		       memmove(&agent_obis_vars[num_vars],
-			       &agent_obis_vars[num_vars+1],
-			       (5-num_vars)*sizeof(struct variable8));
-		    if(pMeterEntries[i].ObisEntries[o].min6m_is_valid)
-		       num_vars++;
-		    else
-		       memmove(&agent_obis_vars[num_vars],
-			       &agent_obis_vars[num_vars+1],
-			       (5-num_vars)*sizeof(struct variable8));
-#if 1
-		    if (register_mib_range(descr,
-					   (struct variable *)agent_obis_vars,
-					   sizeof(struct variable8),
-					   num_vars,
-					   MeterTableEntry_oid,
-					   sizeof(MeterTableEntry_oid) /
-					     sizeof(oid),
-					   DEFAULT_MIB_PRIORITY,
-					   i+1,
-					   i+2,
-					   NULL) !=
-#endif
-#if 0
-		    if (register_mib(descr,
-				     (struct variable *)agent_obis_vars,
-				     sizeof(struct variable8),
-				     num_vars,
-				     MeterTableEntry_oid,
-				     sizeof(MeterTableEntry_oid) /
-				     sizeof(oid)) !=
-#endif
-			MIB_REGISTERED_OK)
-		    {
-		       DEBUGMSGTL(("register_mib", "%s registration failed\n",
-				   descr));
-		    }
-		 }
-	      }
-	   }
+	   free(b->parameters);
+	   free(b->keys);
+	   free(b->probes);
+	   free(b->derived);
+	   continue;
 	}
-	else
+	b->discover_devices = dlsym(b->driver.dlhandle, "discover_devices");
+	if(!b->discover_devices)
 	{
 	   snmp_log(LOG_CRIT,
-		    "driver %s is missing init_driver function!\n",
+		    "driver %s is missing discover_devices function!\n",
 		    driver);
-	   drivers[i].remove_driver = NULL;
+	   free(b->parameters);
+	   free(b->keys);
+	   free(b->probes);
+	   free(b->derived);
+	   continue;
 	}
+	num_discoveries++;
+	discover_meters(b, time(NULL), 1);
+	continue;
      }
+     parameters = json_object_get_string(
+	json_object_object_get(meter_obj, "parameters"));
+     if(!load_driver(&drivers[slot], driver))
+     {
+	drivers[slot].instance = drivers[slot].init_driver(&work_entries[slot],
+							   parameters);
+	if(work_entries[slot].valid && !copy_meter(slot))
+	{
+	   if(json_object_object_get_ex(meter_obj, "derived", &tmp_obj))
+	      derived_init(&derived[slot], &pMeterEntries[slot],
+			   json_object_get_string(tmp_obj));
+	   register_meter(slot);
+	}
+     }
+     slot++;
   }
 
   json_object_put(conf_obj); /* free json stuff */
@@ -564,40 +1859,108 @@ main (int argc, char **argv) {
   /* example-demon will be used to read example-demon.conf files. */
   init_snmp("MeterTable");
 
-  /* In case we recevie a request to stop (kill -TERM or kill -INT) */
-  keep_running = 1;
-  signal(SIGTERM, stop_server);
-  signal(SIGINT, stop_server);
+  /* kill -TERM or kill -INT stops the loop, kill -HUP updates at once */
+  if(eventloop_init(&loop, interval))
+     exit(EXIT_FAILURE);
+  if((workers_init(&workers, num_threads, num_slots, update_meter, NULL) < 0)
+     || eventloop_watch_workers(&loop, workers.fd))
+     exit(EXIT_FAILURE);
 
+  update_discovery(discovery_file);
+  if(snapshot_path)
+  {
+     serve_snapshot = !snapshot_init(&snapshot, snapshot_path);
+     free(snapshot_path);
+     if(serve_snapshot)
+	publish_snapshot(&snapshot, time(NULL));
+  }
   snmp_log(LOG_INFO,"MeterTable-daemon is up and running.\n");
 
-  /* your main loop here... */
-  while(keep_running) {
-    /* if you use select(), see snmp_select_info() in snmp_api(3) */
-    /*     --- OR ---  */
-     i=agent_check_and_process(1); /* 0 == don't block */
-     time(&current_time);
-     if((!i) || ((current_time - last_time_updated) > 10))
+  /* serve requests and update all meters every interval. Worker threads
+     update the meters while requests are served and each meter is
+     published as soon as it is done. */
+  while(!((events = eventloop_wait(&loop)) & EVENTLOOP_STOP)) {
+     if(events & EVENTLOOP_DONE)
+	pending -= collect_meters(&workers);
+     if(events & EVENTLOOP_UPDATE)
+	due = 1;
+     for(;;)
      {
-	last_time_updated = current_time;
-	for(i=0; i<num_meters;i++)
-	   if(drivers[i].update_driver_data)
-	      drivers[i].update_driver_data(drivers[i].instance,
-					    &pMeterEntries[i]);
+	/* the values of a round are used when all its meters are done, or
+	   when the next round is due and a slow meter is still updating,
+	   that meter then keeps its last values */
+	if(collecting && (due || !pending))
+	{
+	   collecting = 0;
+	   /* pick up devices plugged in since last time */
+	   for(i=0; i<num_discoveries; i++)
+	      discover_meters(&discoveries[i], current_time, 0);
+	   update_discovery(discovery_file);
+	   for(i=0; i<num_aggregates; i++)
+	   {
+	      update_aggregate(&aggregates[i].aggregate);
+	      derived_update(&derived[aggregates[i].slot],
+			     &pMeterEntries[aggregates[i].slot]);
+	   }
+	   update_archives(current_time);
+	   if(keep_history)
+	      save_history(&history, current_time);
+	   if(serve_snapshot)
+	      publish_snapshot(&snapshot, current_time);
+	   if(share)
+	      share_values(&shared, current_time);
+	   if(push)
+	      export_values(&exporter, current_time);
+	}
+	else if(due && !collecting)
+	{
+	   due = 0;
+	   time(&current_time);
+	   pending = update_meters(&workers);
+	   collecting = 1;
+	}
+	else
+	   break;
      }
   }
-  for(i=0; i<num_meters; i++){
-     if(drivers[i].remove_driver)
-	drivers[i].remove_driver(drivers[i].instance, &pMeterEntries[i]);
+  eventloop_close(&loop);
+  workers_close(&workers);
+  for(i=0; i<num_discoveries; i++)
+     finish_probes(&discoveries[i], time(NULL), 1);
+  if(keep_history)
+     tsdb_close(&history);
+  if(serve_snapshot)
+     snapshot_close(&snapshot);
+  if(share)
+     shared_close(&shared);
+  if(push)
+     export_close(&exporter);
+  for(i=0; i<num_slots; i++){
+     if(drivers[i].remove_driver && work_entries[i].valid)
+	drivers[i].remove_driver(drivers[i].instance, &work_entries[i]);
+     if(drivers[i].init_driver)
+	free_meter(i);
+     derived_free(&derived[i]);
+     free(sorted[i].rows);
   }
+  for(i=0; i<num_aggregates; i++)
+     aggregate_free(&aggregates[i].aggregate);
+  archive_free(&archives);
   /* at shutdown time */
   snmp_shutdown("MeterTable");
   /* shutdown_MeterTable(); */
   SOCK_CLEANUP;
   curl_global_cleanup();
 
+  free(discovery_file);
+  free(discovery_doc);
   free(drivers);
+  free(derived);
+  free(sorted);
+  free(aggregates);
   free(pMeterEntries);
+  free(work_entries);
+  free(updating);
+  free(done_meters);
   return 0;
 }
-
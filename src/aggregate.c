@@ -0,0 +1,282 @@
+/**************************************************************
+This file keeps the rows of virtual meters aggregating rows of other
+meters. Only member rows whose value has changed since the last update
+are looked at, each changing the aggregated value by its difference.
+
+SPDX-License-Identifier: BSD-2-Clause
+
+Copyright (c) 2026, Henrik Carlqvist
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "aggregate.h"
+#include "obis_catalogue.h"
+
+static const char *op_names[] = {"sum", "mean", "max"};
+
+/* Parses "A-B:C.D.E" into code, returns 0 on success */
+static int parse_obis(const char *s, oid *code)
+{
+   unsigned long v[5];
+   int n=0, i;
+
+   if((sscanf(s, "%lu-%lu:%lu.%lu.%lu%n", &v[0], &v[1], &v[2], &v[3], &v[4],
+	      &n) != 5) || s[n])
+      return -1;
+   for(i=0; i<5; i++)
+      code[i] = v[i];
+   return 0;
+} /* parse_obis */
+
+/* Logs message and releases what has been allocated, returns -1 */
+static int fail_init(struct aggregate *a, const char *message)
+{
+   snmp_log(LOG_ERR, "Aggregate meter: %s\n", message);
+   aggregate_free(a);
+   return -1;
+} /* fail_init */
+
+int aggregate_init(struct aggregate *a, struct MeterTable_entry *entry,
+		   struct json_object *conf)
+{
+   struct json_object *tmp_obj, *members, *codes;
+   const char *op;
+   unsigned int i, r, n;
+
+   memset(a, 0, sizeof(struct aggregate));
+   a->entry = entry;
+   op = json_object_get_string(json_object_object_get(conf, "aggregate"));
+   for(i=0; i<sizeof(op_names)/sizeof(op_names[0]); i++)
+      if(op && !strcmp(op, op_names[i]))
+	 break;
+   if(i == sizeof(op_names)/sizeof(op_names[0]))
+      return fail_init(a, "aggregate must be sum, mean or max");
+   a->op = i;
+   if((!json_object_object_get_ex(conf, "members", &members)) ||
+      (!json_object_object_get_ex(conf, "codes", &codes)) ||
+      (!json_object_array_length(members)) ||
+      (!json_object_array_length(codes)))
+      return fail_init(a, "members and codes must be given");
+   n = json_object_array_length(members);
+   a->members = calloc(n, sizeof(unsigned int));
+   n = json_object_array_length(codes);
+   a->rows = calloc(n, sizeof(struct aggregate_row));
+   entry->ObisEntries = calloc(n, sizeof(struct obis_data));
+   if((!a->members) || (!a->rows) || (!entry->ObisEntries))
+      return fail_init(a, "calloc failed");
+   /* members are given as meter indexes, counting from 1 */
+   for(i=0; i<json_object_array_length(members); i++)
+   {
+      int m = json_object_get_int(json_object_array_get_idx(members, i));
+
+      if(m < 1)
+	 return fail_init(a, "members must be meter indexes");
+      a->members[a->num_members++] = m-1;
+   }
+   for(r=0; r<n; r++)
+   {
+      struct obis_data *o = &(entry->ObisEntries[r]);
+      const char *s =
+	 json_object_get_string(json_object_array_get_idx(codes, r));
+
+      if((!s) || parse_obis(s, o->obis_oid))
+	 return fail_init(a, "codes must be like 1-0:1.7.0");
+      snprintf(o->obis_string, sizeof(o->obis_string), "%s", s);
+      o->latest_is_valid = 1;
+      if(obis_is_gauge(o->obis_oid))
+      {
+	 o->mean6m_is_valid = 1;
+	 o->max6m_is_valid = 1;
+	 o->min6m_is_valid = 1;
+      }
+   }
+   entry->numObisEntries = n;
+   entry->MeterMultiplier = 1000;
+   if(json_object_object_get_ex(conf, "multiplier", &tmp_obj) &&
+      (json_object_get_int(tmp_obj) > 0))
+      entry->MeterMultiplier = json_object_get_int(tmp_obj);
+   if(json_object_object_get_ex(conf, "type", &tmp_obj))
+      snprintf(entry->MeterType, sizeof(entry->MeterType), "%s",
+	       json_object_get_string(tmp_obj));
+   else
+      snprintf(entry->MeterType, sizeof(entry->MeterType), "Aggregate %s",
+	       op_names[a->op]);
+   entry->MeterType_len = strlen(entry->MeterType);
+   entry->valid = 1;
+   return 0;
+} /* aggregate_init */
+
+void aggregate_clear_sources(struct aggregate *a)
+{
+   unsigned int r;
+
+   a->num_sources = 0;
+   for(r=0; r<a->entry->numObisEntries; r++)
+   {
+      a->rows[r].sum = 0.0;
+      a->rows[r].max = 0.0;
+      a->rows[r].count = 0;
+      a->rows[r].num_sources = 0;
+      a->rows[r].rescan = 0;
+   }
+} /* aggregate_clear_sources */
+
+void aggregate_add_source(struct aggregate *a, const struct obis_data *data,
+			  long multiplier)
+{
+   struct aggregate_source *s;
+   unsigned int r;
+
+   for(r=0; r<a->entry->numObisEntries; r++)
+      if(!obis_compare(a->entry->ObisEntries[r].obis_oid, data->obis_oid))
+	 break;
+   if((r == a->entry->numObisEntries) || (!data->latest_is_valid) ||
+      (multiplier <= 0))
+      return;
+   if(a->num_sources == a->max_sources)
+   {
+      unsigned int max = a->max_sources ? 2*a->max_sources : 16;
+
+      s = realloc(a->sources, max*sizeof(struct aggregate_source));
+      if(!s)
+	 return;
+      a->sources = s;
+      a->max_sources = max;
+   }
+   s = &(a->sources[a->num_sources++]);
+   s->row = r;
+   s->data = data;
+   s->scale = (double)a->entry->MeterMultiplier / multiplier;
+   s->last = 0.0;
+   s->seen = 0;
+} /* aggregate_add_source */
+
+static int compare_source(const void *a, const void *b)
+{
+   const struct aggregate_source *sa = a;
+   const struct aggregate_source *sb = b;
+
+   return (sa->row > sb->row) - (sa->row < sb->row);
+} /* compare_source */
+
+void aggregate_sources_done(struct aggregate *a)
+{
+   unsigned int s;
+
+   qsort(a->sources, a->num_sources, sizeof(struct aggregate_source),
+	 compare_source);
+   for(s=0; s<a->num_sources; s++)
+   {
+      struct aggregate_row *row = &(a->rows[a->sources[s].row]);
+
+      if(!row->num_sources)
+	 row->first_source = s;
+      row->num_sources++;
+   }
+} /* aggregate_sources_done */
+
+void aggregate_update(struct aggregate *a)
+{
+   time_t minute = time(NULL) / 60;
+   int new_minute = (minute != a->minute);
+   double multiplier = a->entry->MeterMultiplier;
+   unsigned int r, s;
+
+   a->minute = minute;
+   for(s=0; s<a->num_sources; s++)
+   {
+      struct aggregate_source *src = &(a->sources[s]);
+      struct aggregate_row *row = &(a->rows[src->row]);
+      double value = src->data->latest_value * src->scale;
+
+      if(src->seen && (value == src->last))
+	 continue;
+      if(src->seen)
+	 row->sum += value - src->last;
+      else
+      {
+	 row->sum += value;
+	 row->count++;
+      }
+      /* a lowered max can only be found among all sources of the row */
+      if((row->count == 1) || (value >= row->max))
+	 row->max = value;
+      else if(src->seen && (src->last == row->max))
+	 row->rescan = 1;
+      src->last = value;
+      src->seen = 1;
+   }
+   for(r=0; r<a->entry->numObisEntries; r++)
+   {
+      struct aggregate_row *row = &(a->rows[r]);
+      struct obis_data *o = &(a->entry->ObisEntries[r]);
+      double value;
+
+      if(!row->count)
+	 continue;
+      if(row->rescan)
+      {
+	 row->max = a->sources[row->first_source].last;
+	 for(s=row->first_source; s<row->first_source+row->num_sources; s++)
+	    if(a->sources[s].last > row->max)
+	       row->max = a->sources[s].last;
+	 row->rescan = 0;
+      }
+      switch(a->op)
+      {
+	 case AGGREGATE_MEAN:
+	    value = row->sum / row->count;
+	    break;
+	 case AGGREGATE_MAX:
+	    value = row->max;
+	    break;
+	 default:
+	    value = row->sum;
+	    break;
+      }
+      o->latest_value = value;
+      if(!o->mean6m_is_valid)
+	 continue;
+      filtered_add(value / multiplier, new_minute, &(row->filter));
+      filtered_fill(o, &(row->filter), multiplier);
+   }
+} /* aggregate_update */
+
+void aggregate_free(struct aggregate *a)
+{
+   if(a->entry)
+   {
+      free(a->entry->ObisEntries);
+      a->entry->ObisEntries = NULL;
+      a->entry->numObisEntries = 0;
+      a->entry->valid = 0;
+   }
+   free(a->rows);
+   free(a->sources);
+   free(a->members);
+   memset(a, 0, sizeof(struct aggregate));
+} /* aggregate_free */
@@ -0,0 +1,247 @@
+/**************************************************************
+This file consolidates the values of all rows into round robin archives.
+
+Every sample is added to the slot being consolidated of the first
+level. When a sample belongs to a later slot the pending slot is written
+to the ring of its level and added to the pending slot of the next level,
+which in turn is finished when a slot of a later time arrives. Mean
+values are weighted by the number of samples behind them. Slots start at
+multiples of their length since 1970-01-01 UTC, so the daily slots are
+UTC days. Times without samples give no slots.
+
+SPDX-License-Identifier: BSD-2-Clause
+
+Copyright (c) 2026, Henrik Carlqvist
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "archives.h"
+#include "samples.h"
+
+/* the same resolutions and lengths as the archives of mrtg */
+static const struct
+{
+   int step; /* seconds per slot */
+   unsigned int size; /* number of slots */
+} levels[ARCHIVE_LEVELS] = {
+   {300, 600},
+   {1800, 600},
+   {7200, 600},
+   {86400, 732},
+};
+
+int archive_step(unsigned int level)
+{
+   return (level < ARCHIVE_LEVELS) ? levels[level].step : 0;
+} /* archive_step */
+
+/* Returns the index of the first slot of level in the slots of a row */
+static unsigned int level_offset(unsigned int level)
+{
+   unsigned int l, offset=0;
+
+   for(l=0; l<level; l++)
+      offset += levels[l].size;
+   return offset;
+} /* level_offset */
+
+int archive_init(struct archives *a, unsigned int num_meters)
+{
+   memset(a, 0, sizeof(struct archives));
+   a->meters = calloc(num_meters, sizeof(struct archive_meter));
+   if(!a->meters)
+      return -1;
+   a->num_meters = num_meters;
+   return 0;
+} /* archive_init */
+
+static void add_to_level(struct archive_row *r, unsigned int level,
+			 time_t time, double sum, unsigned long count,
+			 long max, long min);
+
+/* Writes the pending slot of level to its ring and passes it on */
+static void finish_slot(struct archive_row *r, unsigned int level)
+{
+   struct archive_pending p = r->pending[level];
+   struct archive_slot *s =
+      &(r->slots[level_offset(level) + r->next[level]]);
+
+   s->start = p.start;
+   s->mean = lround(p.sum / p.count);
+   s->max = p.max;
+   s->min = p.min;
+   r->next[level] = (r->next[level] + 1) % levels[level].size;
+   if(r->count[level] < levels[level].size)
+      r->count[level]++;
+   r->pending[level].count = 0;
+   if(level+1 < ARCHIVE_LEVELS)
+      add_to_level(r, level+1, p.start, p.sum, p.count, p.max, p.min);
+} /* finish_slot */
+
+static void add_to_level(struct archive_row *r, unsigned int level,
+			 time_t time, double sum, unsigned long count,
+			 long max, long min)
+{
+   struct archive_pending *p = &(r->pending[level]);
+   time_t start = time - time % levels[level].step;
+
+   if(p->count && (p->start != start))
+      finish_slot(r, level);
+   if(!p->count)
+   {
+      p->start = start;
+      p->sum = 0.0;
+      p->max = max;
+      p->min = min;
+   }
+   p->sum += sum;
+   p->count += count;
+   if(max > p->max)
+      p->max = max;
+   if(min < p->min)
+      p->min = min;
+} /* add_to_level */
+
+static void add_sample(struct archive_row *r, time_t time, long value)
+{
+   if(time <= r->last_time)
+      return; /* already added */
+   r->last_time = time;
+   add_to_level(r, 0, time, value, 1, value, value);
+} /* add_sample */
+
+void archive_add(struct archives *a, unsigned int meter, unsigned int row,
+		 const struct obis_data *o, time_t now)
+{
+   struct archive_meter *m;
+   struct archive_row *r;
+   int i;
+
+   if((meter >= a->num_meters) || (!o->latest_is_valid))
+      return;
+   m = &(a->meters[meter]);
+   if(row >= m->num_rows)
+   {
+      r = realloc(m->rows, (row+1)*sizeof(struct archive_row));
+      if(!r)
+	 return;
+      memset(&r[m->num_rows], 0,
+	     (row+1-m->num_rows)*sizeof(struct archive_row));
+      m->rows = r;
+      m->num_rows = row+1;
+   }
+   r = &(m->rows[row]);
+   if(!r->slots)
+   {
+      r->slots = malloc(level_offset(ARCHIVE_LEVELS) *
+			sizeof(struct archive_slot));
+      if(!r->slots)
+	 return;
+   }
+   for(i=0; i<5; i++)
+      if(r->code[i] != o->obis_oid[i])
+	 break;
+   if(i < 5)
+   {
+      /* the row has got another code, start all over */
+      struct archive_slot *slots = r->slots;
+
+      memset(r, 0, sizeof(struct archive_row));
+      r->slots = slots;
+      for(i=0; i<5; i++)
+	 r->code[i] = o->obis_oid[i];
+   }
+   if(o->samples)
+   {
+      unsigned int n;
+
+      for(n=o->samples->count; n>0; n--)
+      {
+	 const struct obis_sample *sample = samples_get(o->samples, n-1);
+
+	 add_sample(r, sample->time, sample->value);
+      }
+   }
+   else
+      add_sample(r, now, o->latest_value);
+} /* archive_add */
+
+/* Returns the archives of row o of meter, or NULL if there are none */
+static const struct archive_row *find_row(const struct archives *a,
+					  unsigned int meter,
+					  unsigned int row,
+					  const struct obis_data *o)
+{
+   const struct archive_row *r;
+
+   if((meter >= a->num_meters) || (row >= a->meters[meter].num_rows))
+      return NULL;
+   r = &(a->meters[meter].rows[row]);
+   if((!r->slots) || memcmp(r->code, o->obis_oid, sizeof(r->code)))
+      return NULL;
+   return r;
+} /* find_row */
+
+unsigned int archive_count(const struct archives *a, unsigned int meter,
+			   unsigned int row, const struct obis_data *o,
+			   unsigned int level)
+{
+   const struct archive_row *r = find_row(a, meter, row, o);
+
+   if((!r) || (level >= ARCHIVE_LEVELS))
+      return 0;
+   return r->count[level];
+} /* archive_count */
+
+const struct archive_slot *archive_get(const struct archives *a,
+				       unsigned int meter, unsigned int row,
+				       const struct obis_data *o,
+				       unsigned int level, unsigned int n)
+{
+   const struct archive_row *r = find_row(a, meter, row, o);
+   unsigned int size;
+
+   if((!r) || (level >= ARCHIVE_LEVELS) || (n >= r->count[level]))
+      return NULL;
+   size = levels[level].size;
+   return &(r->slots[level_offset(level) +
+		     (r->next[level] + size - 1 - n) % size]);
+} /* archive_get */
+
+void archive_free(struct archives *a)
+{
+   unsigned int m, r;
+
+   for(m=0; m<a->num_meters; m++)
+   {
+      for(r=0; r<a->meters[m].num_rows; r++)
+	 free(a->meters[m].rows[r].slots);
+      free(a->meters[m].rows);
+   }
+   free(a->meters);
+   memset(a, 0, sizeof(struct archives));
+} /* archive_free */
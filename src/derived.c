@@ -0,0 +1,315 @@
+/**************************************************************
+This file computes derived rows like apparent power, power factor,
+neutral current, phase imbalance and net power from the rows of a meter.
+
+SPDX-License-Identifier: BSD-2-Clause
+
+Copyright (c) 2026, Henrik Carlqvist
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include "derived.h"
+#include "obis_catalogue.h"
+
+enum derived_op
+{
+   OP_APPARENT,  /* sum of U*I/1000 of each (U,I) pair */
+   OP_PF,        /* |import-export| / apparent power of the (U,I) pairs */
+   OP_NEUTRAL,   /* neutral current from three phase currents */
+   OP_IMBALANCE, /* largest deviation from mean in percent of mean */
+   OP_DIFF       /* first input minus second input */
+};
+
+/* A formula giving row 1-0:C.D.0 from inputs 1-0:C.D.0 */
+struct formula
+{
+   const char *group;
+   unsigned char code[2];
+   enum derived_op op;
+   int num_inputs;
+   unsigned char inputs[DERIVED_MAX_INPUTS][2];
+};
+
+#define NUM_FORMULAS (sizeof(formulas)/sizeof(struct formula))
+
+static const struct formula formulas[] = {
+   {"apparent", {29,7}, OP_APPARENT, 2, {{32,7},{31,7}}},
+   {"apparent", {49,7}, OP_APPARENT, 2, {{52,7},{51,7}}},
+   {"apparent", {69,7}, OP_APPARENT, 2, {{72,7},{71,7}}},
+   {"apparent", {9,7}, OP_APPARENT, 6,
+    {{32,7},{31,7},{52,7},{51,7},{72,7},{71,7}}},
+   {"pf", {33,7}, OP_PF, 4, {{21,7},{22,7},{32,7},{31,7}}},
+   {"pf", {53,7}, OP_PF, 4, {{41,7},{42,7},{52,7},{51,7}}},
+   {"pf", {73,7}, OP_PF, 4, {{61,7},{62,7},{72,7},{71,7}}},
+   {"pf", {13,7}, OP_PF, 8,
+    {{1,7},{2,7},{32,7},{31,7},{52,7},{51,7},{72,7},{71,7}}},
+   {"neutral", {91,7}, OP_NEUTRAL, 3, {{31,7},{51,7},{71,7}}},
+   {"imbalance", {128,7}, OP_IMBALANCE, 3, {{31,7},{51,7},{71,7}}},
+   {"imbalance", {129,7}, OP_IMBALANCE, 3, {{32,7},{52,7},{72,7}}},
+   {"net", {16,7}, OP_DIFF, 2, {{1,7},{2,7}}},
+   {"net", {16,8}, OP_DIFF, 2, {{1,8},{2,8}}},
+};
+
+static void make_code(oid *code, const unsigned char *cd)
+{
+   code[0] = 1;
+   code[1] = 0;
+   code[2] = cd[0];
+   code[3] = cd[1];
+   code[4] = 0;
+} /* make_code */
+
+static int find_row(const struct MeterTable_entry *entry,
+		    const unsigned char *cd)
+{
+   oid code[5];
+   unsigned int r;
+
+   make_code(code, cd);
+   for(r=0; r<entry->numObisEntries; r++)
+      if(!obis_compare(entry->ObisEntries[r].obis_oid, code))
+	 return r;
+   return -1;
+} /* find_row */
+
+/* Returns non zero if group is in the comma separated list spec */
+static int wanted(const char *spec, const char *group)
+{
+   size_t len = strlen(group);
+   const char *p = spec;
+
+   if(!strcmp(spec, "all"))
+      return 1;
+   while((p = strstr(p, group)))
+   {
+      if(((p == spec) || (p[-1] == ',')) && ((!p[len]) || (p[len] == ',')))
+	 return 1;
+      p += len;
+   }
+   return 0;
+} /* wanted */
+
+/* Returns non zero if the meter has all inputs needed by formula f. Phases
+   are optional for the totals, but at least one complete (U,I) pair is
+   needed. Export is optional for power factor. */
+static int usable(const struct formula *f, const int *rows)
+{
+   int i, pairs=0, first=0;
+
+   switch(f->op)
+   {
+      case OP_PF:
+	 if(rows[0] < 0)
+	    return 0;
+	 first = 2;
+	 /* fall through */
+      case OP_APPARENT:
+	 for(i=first; i+1<f->num_inputs; i+=2)
+	    if((rows[i] >= 0) && (rows[i+1] >= 0))
+	       pairs++;
+	 return pairs > 0;
+      default:
+	 for(i=0; i<f->num_inputs; i++)
+	    if(rows[i] < 0)
+	       return 0;
+	 return 1;
+   }
+} /* usable */
+
+/* Returns the index in d->sources of driver row r, adding it if needed */
+static int source_index(struct derived_rows *d, unsigned int r)
+{
+   unsigned int s;
+
+   for(s=0; s<d->num_sources; s++)
+      if(d->sources[s] == r)
+	 return s;
+   d->sources[d->num_sources] = r;
+   return d->num_sources++;
+} /* source_index */
+
+unsigned int derived_init(struct derived_rows *d,
+			  const struct MeterTable_entry *entry,
+			  const char *spec)
+{
+   int rows[NUM_FORMULAS][DERIVED_MAX_INPUTS];
+   int use[NUM_FORMULAS];
+   unsigned int f, n=0, max_sources=0;
+   int i;
+
+   memset(d, 0, sizeof(struct derived_rows));
+   if(!spec)
+      return 0;
+   for(f=0; f<NUM_FORMULAS; f++)
+   {
+      use[f] = 0;
+      if(!wanted(spec, formulas[f].group))
+	 continue;
+      /* the meter knows better if it has the value itself */
+      if(find_row(entry, formulas[f].code) >= 0)
+	 continue;
+      for(i=0; i<formulas[f].num_inputs; i++)
+	 rows[f][i] = find_row(entry, formulas[f].inputs[i]);
+      if(!usable(&formulas[f], rows[f]))
+	 continue;
+      use[f] = 1;
+      n++;
+      max_sources += formulas[f].num_inputs;
+   }
+   if(!n)
+      return 0;
+   d->rows = calloc(n, sizeof(struct obis_data));
+   d->steps = calloc(n, sizeof(struct derived_step));
+   d->filters = calloc(n, sizeof(struct filtered));
+   d->sources = calloc(max_sources, sizeof(unsigned int));
+   d->gathered = calloc(max_sources, sizeof(double));
+   if((!d->rows) || (!d->steps) || (!d->filters) || (!d->sources) ||
+      (!d->gathered))
+   {
+      snmp_log(LOG_ERR, "Failed allocating derived rows\n");
+      derived_free(d);
+      return 0;
+   }
+   for(f=0; f<NUM_FORMULAS; f++)
+   {
+      struct obis_data *o = &(d->rows[d->num_rows]);
+      struct derived_step *s = &(d->steps[d->num_rows]);
+
+      if(!use[f])
+	 continue;
+      make_code(o->obis_oid, formulas[f].code);
+      snprintf(o->obis_string, sizeof(o->obis_string), "1-0:%d.%d.0",
+	       formulas[f].code[0], formulas[f].code[1]);
+      o->latest_is_valid = 1;
+      if(obis_is_gauge(o->obis_oid))
+      {
+	 o->mean6m_is_valid = 1;
+	 o->max6m_is_valid = 1;
+	 o->min6m_is_valid = 1;
+      }
+      s->op = formulas[f].op;
+      s->num_inputs = formulas[f].num_inputs;
+      for(i=0; i<s->num_inputs; i++)
+	 s->inputs[i] = (rows[f][i] < 0) ? -1 : source_index(d, rows[f][i]);
+      d->num_rows++;
+   }
+   return d->num_rows;
+} /* derived_init */
+
+/* Sum of U*I/1000 for the complete (U,I) pairs from input first */
+static double apparent(const struct derived_step *s, const double *in,
+		       int first)
+{
+   double sum = 0.0;
+   int i;
+
+   for(i=first; i+1<s->num_inputs; i+=2)
+      if((s->inputs[i] >= 0) && (s->inputs[i+1] >= 0))
+	 sum += in[s->inputs[i]] * in[s->inputs[i+1]] / 1000.0;
+   return sum;
+} /* apparent */
+
+static double evaluate(const struct derived_step *s, const double *in)
+{
+   double a, b, c, mean, dev, value;
+   int i;
+
+   switch(s->op)
+   {
+      case OP_APPARENT:
+	 return apparent(s, in, 0);
+      case OP_PF:
+	 a = apparent(s, in, 2);
+	 if(a <= 0.0)
+	    return 0.0;
+	 value = in[s->inputs[0]];
+	 if(s->inputs[1] >= 0)
+	    value -= in[s->inputs[1]];
+	 value = fabs(value) / a;
+	 /* power and current are not sampled at exactly the same time */
+	 return (value > 1.0) ? 1.0 : value;
+      case OP_NEUTRAL:
+	 a = in[s->inputs[0]];
+	 b = in[s->inputs[1]];
+	 c = in[s->inputs[2]];
+	 /* assuming 120 degrees between phases and equal power factors */
+	 value = a*a + b*b + c*c - a*b - b*c - c*a;
+	 return (value > 0.0) ? sqrt(value) : 0.0;
+      case OP_IMBALANCE:
+	 for(i=0, mean=0.0; i<s->num_inputs; i++)
+	    mean += in[s->inputs[i]];
+	 mean /= s->num_inputs;
+	 if(mean <= 0.0)
+	    return 0.0;
+	 for(i=0, dev=0.0; i<s->num_inputs; i++)
+	    if(fabs(in[s->inputs[i]] - mean) > dev)
+	       dev = fabs(in[s->inputs[i]] - mean);
+	 return 100.0 * dev / mean;
+      case OP_DIFF:
+	 return in[s->inputs[0]] - in[s->inputs[1]];
+   }
+   return 0.0;
+} /* evaluate */
+
+void derived_update(struct derived_rows *d,
+		    const struct MeterTable_entry *entry)
+{
+   double multiplier = entry->MeterMultiplier;
+   time_t minute = time(NULL) / 60;
+   int new_minute = (minute != d->minute);
+   unsigned int r, s;
+
+   if(!d->num_rows)
+      return;
+   d->minute = minute;
+   /* read each input row once, all steps then work on this array */
+   for(s=0; s<d->num_sources; s++)
+      d->gathered[s] =
+	 entry->ObisEntries[d->sources[s]].latest_value / multiplier;
+   for(r=0; r<d->num_rows; r++)
+   {
+      struct obis_data *o = &(d->rows[r]);
+      double value = evaluate(&(d->steps[r]), d->gathered);
+
+      o->latest_value = multiplier * value;
+      if(!o->mean6m_is_valid)
+	 continue;
+      filtered_add(value, new_minute, &(d->filters[r]));
+      filtered_fill(o, &(d->filters[r]), multiplier);
+   }
+} /* derived_update */
+
+void derived_free(struct derived_rows *d)
+{
+   free(d->rows);
+   free(d->steps);
+   free(d->filters);
+   free(d->sources);
+   free(d->gathered);
+   memset(d, 0, sizeof(struct derived_rows));
+} /* derived_free */
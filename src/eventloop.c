@@ -0,0 +1,279 @@
+/**************************************************************
+This file is the main loop of the agent, replacing
+agent_check_and_process. Each time around the loop the file descriptors
+net-snmp wants to read, including those of sessions and those registered
+with register_readfd, are synchronized with an epoll set also holding a
+timerfd and a signalfd.
+
+The timer is periodic on CLOCK_MONOTONIC, so updates follow each other
+at exactly the configured interval no matter how long they take or how
+the wall clock is changed. Updates missed while the agent was busy are
+not made up for, the next one is made at once.
+
+SPDX-License-Identifier: BSD-2-Clause
+
+Copyright (c) 2026, Henrik Carlqvist
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <sys/time.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <sys/signalfd.h>
+#include <net-snmp/net-snmp-config.h>
+#include <net-snmp/net-snmp-includes.h>
+#include <net-snmp/agent/net-snmp-agent-includes.h>
+#include <net-snmp/library/fd_event_manager.h>
+
+#include "eventloop.h"
+
+#define EVENTLOOP_MAX_EVENTS 32
+
+static void signal_set(sigset_t *set)
+{
+   sigemptyset(set);
+   sigaddset(set, SIGTERM);
+   sigaddset(set, SIGINT);
+   sigaddset(set, SIGHUP);
+} /* signal_set */
+
+void eventloop_block_signals(void)
+{
+   sigset_t set;
+
+   signal_set(&set);
+   pthread_sigmask(SIG_BLOCK, &set, NULL);
+} /* eventloop_block_signals */
+
+static int add_fd(struct eventloop *l, int fd)
+{
+   struct epoll_event ev;
+
+   memset(&ev, 0, sizeof(ev));
+   ev.events = EPOLLIN;
+   ev.data.fd = fd;
+   return epoll_ctl(l->epfd, EPOLL_CTL_ADD, fd, &ev);
+} /* add_fd */
+
+/* Starts the timer with the first expiry after delay nanoseconds */
+static int arm_timer(struct eventloop *l, long delay)
+{
+   struct itimerspec spec;
+
+   memset(&spec, 0, sizeof(spec));
+   spec.it_value.tv_nsec = delay;
+   spec.it_interval.tv_sec = l->interval;
+   return timerfd_settime(l->timerfd, 0, &spec, NULL);
+} /* arm_timer */
+
+int eventloop_init(struct eventloop *l, time_t interval)
+{
+   sigset_t set;
+
+   memset(l, 0, sizeof(struct eventloop));
+   l->workfd = -1;
+   l->interval = interval > 0 ? interval : 1;
+   signal_set(&set);
+   l->epfd = epoll_create1(EPOLL_CLOEXEC);
+   l->timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+   l->sigfd = signalfd(-1, &set, SFD_NONBLOCK | SFD_CLOEXEC);
+   if((l->epfd < 0) || (l->timerfd < 0) || (l->sigfd < 0) ||
+      add_fd(l, l->timerfd) || add_fd(l, l->sigfd) || arm_timer(l, 1))
+   {
+      snmp_log(LOG_ERR, "Failed setting up event loop: %s\n",
+	       strerror(errno));
+      eventloop_close(l);
+      return -1;
+   }
+   return 0;
+} /* eventloop_init */
+
+int eventloop_watch_workers(struct eventloop *l, int fd)
+{
+   if(add_fd(l, fd))
+   {
+      snmp_log(LOG_ERR, "Failed watching worker threads: %s\n",
+	       strerror(errno));
+      return -1;
+   }
+   l->workfd = fd;
+   return 0;
+} /* eventloop_watch_workers */
+
+/* Makes the epoll set follow the fd sets of net-snmp. Sessions may close
+   and reopen a fd with the same number, e.g. when reconnecting to snmpd,
+   and epoll forgets closed fds, so every fd is modified or added again. */
+static void watch_fds(struct eventloop *l, int numfds, fd_set *readfds,
+		      fd_set *writefds, fd_set *exceptfds)
+{
+   struct epoll_event ev;
+   int fd;
+
+   if(numfds > l->num_fds)
+      l->num_fds = numfds;
+   for(fd=0; fd<l->num_fds; fd++)
+   {
+      unsigned int events = 0;
+
+      if(fd < numfds)
+      {
+	 if(FD_ISSET(fd, readfds))
+	    events |= EPOLLIN;
+	 if(FD_ISSET(fd, writefds))
+	    events |= EPOLLOUT;
+	 if(FD_ISSET(fd, exceptfds))
+	    events |= EPOLLPRI;
+      }
+      if((!events) && (!l->events[fd]))
+	 continue;
+      memset(&ev, 0, sizeof(ev));
+      ev.events = events;
+      ev.data.fd = fd;
+      if(!events)
+	 epoll_ctl(l->epfd, EPOLL_CTL_DEL, fd, &ev);
+      else if(epoll_ctl(l->epfd, EPOLL_CTL_MOD, fd, &ev) &&
+	      epoll_ctl(l->epfd, EPOLL_CTL_ADD, fd, &ev))
+	 snmp_log(LOG_WARNING, "Failed watching fd %d: %s\n", fd,
+		  strerror(errno));
+      l->events[fd] = events;
+   }
+} /* watch_fds */
+
+/* Returns EVENTLOOP_ bits of signals received */
+static int read_signals(struct eventloop *l)
+{
+   struct signalfd_siginfo info;
+   int ret = 0;
+
+   while(read(l->sigfd, &info, sizeof(info)) == sizeof(info))
+   {
+      if(info.ssi_signo == SIGHUP)
+      {
+	 snmp_log(LOG_INFO, "SIGHUP received, updating meters\n");
+	 arm_timer(l, 1); /* next update now, then every interval */
+      }
+      else
+	 ret |= EVENTLOOP_STOP;
+   }
+   return ret;
+} /* read_signals */
+
+int eventloop_wait(struct eventloop *l)
+{
+   struct epoll_event events[EVENTLOOP_MAX_EVENTS];
+   fd_set readfds, writefds, exceptfds;
+   struct timeval timeout;
+   int numfds, block, count, n, e, ret = 0;
+   long ms;
+   uint64_t expirations;
+
+   while(!ret)
+   {
+      numfds = 0;
+      block = 1;
+      FD_ZERO(&readfds);
+      FD_ZERO(&writefds);
+      FD_ZERO(&exceptfds);
+      timerclear(&timeout);
+      snmp_select_info(&numfds, &readfds, &timeout, &block);
+      netsnmp_external_event_info(&numfds, &readfds, &writefds, &exceptfds);
+      watch_fds(l, numfds, &readfds, &writefds, &exceptfds);
+      ms = block ? -1 : timeout.tv_sec*1000 + (timeout.tv_usec+999)/1000;
+      n = epoll_wait(l->epfd, events, EVENTLOOP_MAX_EVENTS, (int)ms);
+      if(n < 0)
+      {
+	 if(errno != EINTR)
+	 {
+	    snmp_log(LOG_ERR, "epoll_wait: %s\n", strerror(errno));
+	    return EVENTLOOP_STOP;
+	 }
+	 continue;
+      }
+      FD_ZERO(&readfds);
+      FD_ZERO(&writefds);
+      FD_ZERO(&exceptfds);
+      count = 0;
+      for(e=0; e<n; e++)
+      {
+	 int fd = events[e].data.fd;
+	 unsigned int got = events[e].events;
+
+	 if(fd == l->timerfd)
+	 {
+	    if(read(fd, &expirations, sizeof(expirations)) > 0)
+	       ret |= EVENTLOOP_UPDATE;
+	    continue;
+	 }
+	 if(fd == l->sigfd)
+	 {
+	    ret |= read_signals(l);
+	    continue;
+	 }
+	 if(fd == l->workfd)
+	 {
+	    ret |= EVENTLOOP_DONE; /* read by workers_done */
+	    continue;
+	 }
+	 /* errors and hangups are found by reading */
+	 if(got & (EPOLLERR | EPOLLHUP))
+	    got |= l->events[fd] & (EPOLLIN | EPOLLOUT);
+	 if(got & EPOLLIN)
+	    FD_SET(fd, &readfds);
+	 if(got & EPOLLOUT)
+	    FD_SET(fd, &writefds);
+	 if(got & EPOLLPRI)
+	    FD_SET(fd, &exceptfds);
+	 count++;
+      }
+      if(count)
+      {
+	 netsnmp_dispatch_external_events(&count, &readfds, &writefds,
+					  &exceptfds);
+	 if(count)
+	    snmp_read(&readfds);
+      }
+      else if(!n)
+	 snmp_timeout();
+      run_alarms();
+      netsnmp_check_outstanding_agent_requests();
+   }
+   return ret;
+} /* eventloop_wait */
+
+void eventloop_close(struct eventloop *l)
+{
+   if(l->epfd >= 0)
+      close(l->epfd);
+   if(l->timerfd >= 0)
+      close(l->timerfd);
+   if(l->sigfd >= 0)
+      close(l->sigfd);
+   l->epfd = l->timerfd = l->sigfd = -1;
+} /* eventloop_close */
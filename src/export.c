@@ -0,0 +1,826 @@
+/**************************************************************
+This file pushes the values of all meters to a time series database.
+
+Each update gives one batch with a line for each row whose values have
+changed since they were last sent, or which have not been sent for
+"resend" seconds. A line for InfluxDB looks like
+
+obis,meter=1,type=P1IB,code=1-0:1.7.0 latest=1.234,mean=1.2 1700000000000000000
+
+and the same values for Graphite
+
+obis2snmp.meter1.1-0_1_7_0.latest 1.234 1700000000
+
+Batches are written to a TCP, UDP or UNIX stream socket. When the
+receiver is unavailable batches are appended to a spool file, up to a
+maximum size, and sent before the next batch once the receiver is back.
+Every line has its time, so a batch sent twice does no harm.
+
+SPDX-License-Identifier: BSD-2-Clause
+
+Copyright (c) 2026, Henrik Carlqvist
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdint.h>
+#include <sys/eventfd.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <net-snmp/net-snmp-config.h>
+#include <net-snmp/net-snmp-includes.h>
+
+#include "export.h"
+#include "samples.h"
+
+#define EXPORT_RETRY 30 /* seconds between attempts to connect */
+#define EXPORT_DATAGRAM 1400 /* max bytes of each UDP datagram */
+#define EXPORT_CHUNK 65536 /* bytes of the spool file moved to out at once */
+
+#define SENT_LATEST 1
+#define SENT_MEAN   2
+#define SENT_MAX    4
+#define SENT_MIN    8
+
+static int config_string(struct json_object *conf, const char *name,
+			 char *value, size_t size)
+{
+   struct json_object *tmp_obj;
+
+   if(!json_object_object_get_ex(conf, name, &tmp_obj))
+      return 0;
+   if(strlen(json_object_get_string(tmp_obj)) >= size)
+   {
+      snmp_log(LOG_ERR, "Too long export %s\n", name);
+      return -1;
+   }
+   strcpy(value, json_object_get_string(tmp_obj));
+   return 0;
+} /* config_string */
+
+/* Parses url like tcp://host:port, udp://[::1]:port or unix:///path */
+static int parse_url(struct exporter *e, const char *url)
+{
+   const char *p, *colon;
+   size_t len;
+
+   if(!strncmp(url, "unix://", 7))
+   {
+      if(strlen(url+7) >= sizeof(((struct sockaddr_un *)0)->sun_path))
+	 return -1;
+      e->type = SOCK_STREAM;
+      strcpy(e->host, url+7);
+      return 0;
+   }
+   if(!strncmp(url, "tcp://", 6))
+      e->type = SOCK_STREAM;
+   else if(!strncmp(url, "udp://", 6))
+      e->type = SOCK_DGRAM;
+   else
+      return -1;
+   p = url + 6;
+   if(*p == '[')
+   {
+      colon = strstr(p, "]:");
+      p++;
+      len = colon ? (size_t)(colon - p) : 0;
+      colon = colon ? colon+1 : NULL;
+   }
+   else
+   {
+      colon = strrchr(p, ':');
+      len = colon ? (size_t)(colon - p) : 0;
+   }
+   if((!colon) || (!len) || (len >= sizeof(e->host)) ||
+      (strlen(colon+1) >= sizeof(e->port)) || !colon[1])
+      return -1;
+   memcpy(e->host, p, len);
+   e->host[len] = 0;
+   strcpy(e->port, colon+1);
+   return 0;
+} /* parse_url */
+
+static void flush(struct exporter *e);
+
+/* Returns how many bytes of len the receiver took, 0 if it would block, or
+   -1 if it failed. A datagram only holds whole lines. */
+static ssize_t send_some(struct exporter *e, const char *data, size_t len)
+{
+   ssize_t n;
+
+   if((e->type == SOCK_DGRAM) && (len > EXPORT_DATAGRAM))
+   {
+      for(n=EXPORT_DATAGRAM; (n > 0) && (data[n-1] != '\n'); n--);
+      len = n ? (size_t)n : EXPORT_DATAGRAM;
+   }
+   do
+      n = send(e->fd, data, len, MSG_NOSIGNAL);
+   while((n < 0) && (errno == EINTR));
+   if((n < 0) && ((errno == EAGAIN) || (errno == EWOULDBLOCK)))
+      return 0;
+   return n;
+} /* send_some */
+
+/* Appends len bytes to out, returns 0 on success */
+static int append_out(struct exporter *e, const char *data, size_t len)
+{
+   if(e->out_sent == e->out_len)
+      e->out_sent = e->out_len = 0;
+   if(e->out_len + len > e->out_size)
+   {
+      size_t size = e->out_size ? e->out_size : EXPORT_CHUNK;
+      char *p;
+
+      if(e->out_sent)
+      {
+	 /* make room by forgetting what has been sent */
+	 memmove(e->out, e->out + e->out_sent, e->out_len - e->out_sent);
+	 e->out_len -= e->out_sent;
+	 e->out_sent = 0;
+      }
+      while(e->out_len + len > size)
+	 size *= 2;
+      if(size > e->out_size)
+      {
+	 p = realloc(e->out, size);
+	 if(!p)
+	    return -1;
+	 e->out = p;
+	 e->out_size = size;
+      }
+   }
+   memcpy(e->out + e->out_len, data, len);
+   e->out_len += len;
+   return 0;
+} /* append_out */
+
+/* Moves the next whole lines of the spool file to out, returns 0 if there
+   were none. The spool file is removed once all of it has been moved. */
+static int read_spool(struct exporter *e)
+{
+   char chunk[EXPORT_CHUNK];
+   FILE *f;
+   size_t len;
+
+   if(e->spool_read >= e->spool_len)
+   {
+      if(e->spool_len)
+      {
+	 unlink(e->spool);
+	 e->spool_len = 0;
+	 e->spool_read = 0;
+	 e->spool_full = 0;
+      }
+      return 0;
+   }
+   f = fopen(e->spool, "rb");
+   if((!f) || fseek(f, e->spool_read, SEEK_SET))
+      len = 0;
+   else
+      len = fread(chunk, 1, sizeof(chunk), f);
+   if(f)
+      fclose(f);
+   if(!len)
+   {
+      snmp_log(LOG_ERR, "Failed reading %s, dropping it\n", e->spool);
+      e->spool_read = e->spool_len;
+      return read_spool(e);
+   }
+   /* a partial last line is moved with the next chunk */
+   if(e->spool_read + (long)len < e->spool_len)
+   {
+      size_t lines = len;
+
+      while((lines > 0) && (chunk[lines-1] != '\n'))
+	 lines--;
+      if(lines)
+	 len = lines;
+   }
+   if(append_out(e, chunk, len))
+      return 0;
+   e->spool_read += len;
+   return 1;
+} /* read_spool */
+
+/* Rewrites the spool file with what was not sent, the unsent part of out
+   first. Called when the connection is lost, so that nothing already sent
+   is sent again and nothing unsent is lost at a restart. */
+static void keep_unsent(struct exporter *e)
+{
+   char chunk[EXPORT_CHUNK];
+   char path[sizeof(e->spool) + 4];
+   FILE *in = NULL, *out;
+   size_t len;
+   int failed;
+
+   if((e->type == SOCK_STREAM) && (e->out_sent > 0) &&
+      (e->out[e->out_sent-1] != '\n'))
+   {
+      /* the rest of a partly sent line is of no use to a new connection */
+      while((e->out_sent < e->out_len) && (e->out[e->out_sent] != '\n'))
+	 e->out_sent++;
+      if(e->out_sent < e->out_len)
+	 e->out_sent++;
+   }
+   if((!e->spool[0]) ||
+      ((e->out_sent == e->out_len) && (!e->spool_read)))
+      return;
+   if((e->out_sent == e->out_len) && (e->spool_read >= e->spool_len))
+   {
+      /* all of it has been sent */
+      unlink(e->spool);
+      e->spool_len = 0;
+      e->spool_read = 0;
+      return;
+   }
+   snprintf(path, sizeof(path), "%s.new", e->spool);
+   out = fopen(path, "wb");
+   failed = !out;
+   if(out && (e->out_len > e->out_sent))
+      failed = (fwrite(e->out + e->out_sent, e->out_len - e->out_sent, 1,
+		       out) != 1);
+   if(out && (e->spool_read < e->spool_len))
+   {
+      in = fopen(e->spool, "rb");
+      failed |= (!in) || fseek(in, e->spool_read, SEEK_SET);
+      while((!failed) && ((len = fread(chunk, 1, sizeof(chunk), in)) > 0))
+	 failed = (fwrite(chunk, len, 1, out) != 1);
+      if(in)
+	 fclose(in);
+   }
+   if(out)
+      failed |= fclose(out);
+   if(failed || rename(path, e->spool))
+   {
+      snmp_log(LOG_ERR, "Failed writing %s\n", path);
+      unlink(path);
+      return;
+   }
+   e->spool_len += (long)(e->out_len - e->out_sent) - e->spool_read;
+   e->spool_read = 0;
+   e->out_sent = e->out_len = 0;
+} /* keep_unsent */
+
+static void disconnect_receiver(struct exporter *e)
+{
+   if(e->fd >= 0)
+   {
+      if(e->connecting || e->writing)
+	 unregister_writefd(e->fd);
+      close(e->fd);
+   }
+   e->fd = -1;
+   e->connecting = 0;
+   e->writing = 0;
+   e->down = 1;
+   e->last_attempt = e->now;
+   keep_unsent(e);
+} /* disconnect_receiver */
+
+static void write_ready(int fd, void *data)
+{
+   flush(data);
+} /* write_ready */
+
+/* Sends out and then the spool file until the receiver would block */
+static void flush(struct exporter *e)
+{
+   ssize_t n;
+
+   while(e->fd >= 0)
+   {
+      if((e->out_sent == e->out_len) && !read_spool(e))
+	 break;
+      n = send_some(e, e->out + e->out_sent, e->out_len - e->out_sent);
+      if(n < 0)
+      {
+	 snmp_log(LOG_WARNING, "Failed sending to %s%s%s, spooling\n",
+		  e->host, e->port[0] ? ":" : "", e->port);
+	 disconnect_receiver(e);
+	 return;
+      }
+      if(!n)
+      {
+	 /* continued by write_ready when the receiver takes more */
+	 if((!e->writing) && !register_writefd(e->fd, write_ready, e))
+	    e->writing = 1;
+	 return;
+      }
+      e->out_sent += n;
+   }
+   if(e->writing)
+      unregister_writefd(e->fd);
+   e->writing = 0;
+} /* flush */
+
+static void connected(struct exporter *e)
+{
+   if(e->addrs)
+      freeaddrinfo(e->addrs);
+   e->addrs = NULL;
+   e->next_addr = NULL;
+   if(e->down)
+      snmp_log(LOG_INFO, "Connected to %s%s%s again\n",
+	       e->host, e->port[0] ? ":" : "", e->port);
+   e->down = 0;
+   flush(e);
+} /* connected */
+
+static void connect_failed(struct exporter *e)
+{
+   if(e->addrs)
+      freeaddrinfo(e->addrs);
+   e->addrs = NULL;
+   e->next_addr = NULL;
+   if(!e->down)
+      snmp_log(LOG_WARNING, "Failed connecting to %s%s%s, spooling\n",
+	       e->host, e->port[0] ? ":" : "", e->port);
+   e->down = 1;
+   keep_unsent(e);
+} /* connect_failed */
+
+static void connect_next(struct exporter *e);
+
+static void connect_done(int fd, void *data)
+{
+   struct exporter *e = data;
+   int error = 0;
+   socklen_t error_len = sizeof(error);
+
+   unregister_writefd(fd);
+   e->connecting = 0;
+   if(getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &error_len) || error)
+   {
+      close(fd);
+      e->fd = -1;
+      connect_next(e);
+      return;
+   }
+   connected(e);
+} /* connect_done */
+
+/* Starts connecting to the next address of the receiver, finished by
+   connect_done */
+static void connect_next(struct exporter *e)
+{
+   while(e->next_addr)
+   {
+      struct addrinfo *ai = e->next_addr;
+
+      e->next_addr = ai->ai_next;
+      e->fd = socket(ai->ai_family,
+		     ai->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC,
+		     ai->ai_protocol);
+      if(e->fd < 0)
+	 continue;
+      if(!connect(e->fd, ai->ai_addr, ai->ai_addrlen))
+      {
+	 connected(e);
+	 return;
+      }
+      if((errno == EINPROGRESS) &&
+	 !register_writefd(e->fd, connect_done, e))
+      {
+	 e->connecting = 1;
+	 return;
+      }
+      close(e->fd);
+      e->fd = -1;
+   }
+   connect_failed(e);
+} /* connect_next */
+
+/* Looks up the receiver in a thread of its own, getaddrinfo may wait for
+   DNS servers for long */
+static void *resolve(void *arg)
+{
+   struct exporter *e = arg;
+   struct addrinfo hints;
+   uint64_t one = 1;
+
+   memset(&hints, 0, sizeof(hints));
+   hints.ai_family = AF_UNSPEC;
+   hints.ai_socktype = e->type;
+   if(getaddrinfo(e->host, e->port, &hints, &(e->addrs)))
+      e->addrs = NULL;
+   if(write(e->wake, &one, sizeof(one)) != sizeof(one))
+      snmp_log(LOG_ERR, "Failed waking the agent\n");
+   return NULL;
+} /* resolve */
+
+static void resolved(int fd, void *data)
+{
+   struct exporter *e = data;
+   uint64_t count;
+
+   if(read(fd, &count, sizeof(count)) != sizeof(count))
+      return;
+   if(!e->resolving)
+      return;
+   pthread_join(e->resolver, NULL);
+   e->resolving = 0;
+   e->next_addr = e->addrs;
+   connect_next(e);
+} /* resolved */
+
+/* Starts connecting unless connected or connecting, attempts are made at
+   most every EXPORT_RETRY seconds */
+static void connect_receiver(struct exporter *e)
+{
+   struct sockaddr_un addr;
+
+   if(e->connecting && (e->now - e->last_attempt >= EXPORT_RETRY))
+   {
+      /* give up on this address */
+      unregister_writefd(e->fd);
+      close(e->fd);
+      e->fd = -1;
+      e->connecting = 0;
+      connect_next(e);
+   }
+   if((e->fd >= 0) || e->resolving ||
+      (e->last_attempt && (e->now - e->last_attempt < EXPORT_RETRY)))
+      return;
+   e->last_attempt = e->now;
+   if(e->port[0])
+   {
+      e->resolving = !pthread_create(&(e->resolver), NULL, resolve, e);
+      if(!e->resolving)
+	 connect_failed(e);
+      return;
+   }
+   memset(&addr, 0, sizeof(addr));
+   addr.sun_family = AF_UNIX;
+   strcpy(addr.sun_path, e->host);
+   e->fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+   if((e->fd >= 0) && !connect(e->fd, (struct sockaddr *)&addr, sizeof(addr)))
+   {
+      connected(e);
+      return;
+   }
+   if(e->fd >= 0)
+      close(e->fd);
+   e->fd = -1;
+   connect_failed(e);
+} /* connect_receiver */
+
+/* Appends the batch to the spool file if there is room */
+static void spool_batch(struct exporter *e)
+{
+   FILE *f;
+
+   if(e->spool_len - e->spool_read + (long)e->used > e->spool_size)
+   {
+      if(!e->spool_full)
+	 snmp_log(LOG_WARNING, "Spool %s is full, dropping values\n",
+		  e->spool);
+      e->spool_full = 1;
+      return;
+   }
+   f = fopen(e->spool, "ab");
+   if((!f) || (fwrite(e->buffer, e->used, 1, f) != 1))
+      snmp_log(LOG_ERR, "Failed writing %s\n", e->spool);
+   else
+      e->spool_len += e->used;
+   if(f)
+      fclose(f);
+} /* spool_batch */
+
+int export_init(struct exporter *e, struct json_object *conf,
+		unsigned int num_meters)
+{
+   struct json_object *tmp_obj;
+   char format[16] = "influx";
+   struct stat st;
+
+   memset(e, 0, sizeof(struct exporter));
+   e->fd = -1;
+   e->wake = -1;
+   if((!json_object_object_get_ex(conf, "url", &tmp_obj)) ||
+      parse_url(e, json_object_get_string(tmp_obj)))
+   {
+      snmp_log(LOG_ERR, "export needs an url like tcp://host:port, "
+	       "udp://host:port or unix:///path\n");
+      return -1;
+   }
+   if(config_string(conf, "format", format, sizeof(format)))
+      return -1;
+   if(!strcmp(format, "influx"))
+   {
+      e->format = EXPORT_INFLUX;
+      strcpy(e->name, "obis");
+   }
+   else if(!strcmp(format, "graphite"))
+   {
+      e->format = EXPORT_GRAPHITE;
+      strcpy(e->name, "obis2snmp");
+   }
+   else
+   {
+      snmp_log(LOG_ERR, "Unknown export format %s\n", format);
+      return -1;
+   }
+   if(config_string(conf, "name", e->name, sizeof(e->name)) ||
+      config_string(conf, "spool", e->spool, sizeof(e->spool)))
+      return -1;
+   e->spool_size = 16*1024*1024;
+   if(json_object_object_get_ex(conf, "spool_size", &tmp_obj) &&
+      (json_object_get_int64(tmp_obj) > 0))
+      e->spool_size = json_object_get_int64(tmp_obj);
+   e->resend = 300;
+   if(json_object_object_get_ex(conf, "resend", &tmp_obj) &&
+      (json_object_get_int(tmp_obj) > 0))
+      e->resend = json_object_get_int(tmp_obj);
+   e->meters = calloc(num_meters, sizeof(struct export_meter));
+   if(!e->meters)
+      return -1;
+   e->num_meters = num_meters;
+   if(e->spool[0] && !stat(e->spool, &st))
+      e->spool_len = st.st_size; /* left from before, sent first */
+   e->wake = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+   if((e->wake < 0) || register_readfd(e->wake, resolved, e))
+   {
+      snmp_log(LOG_ERR, "Failed setting up export\n");
+      if(e->wake >= 0)
+	 close(e->wake);
+      e->wake = -1;
+      return -1;
+   }
+   return 0;
+} /* export_init */
+
+/* Appends printf formatted text to the batch */
+static void append(struct exporter *e, const char *format, ...)
+{
+   va_list ap;
+   int n;
+
+   for(;;)
+   {
+      if(e->size - e->used > 1)
+      {
+	 va_start(ap, format);
+	 n = vsnprintf(e->buffer + e->used, e->size - e->used, format, ap);
+	 va_end(ap);
+	 if((n >= 0) && ((size_t)n < e->size - e->used))
+	 {
+	    e->used += n;
+	    return;
+	 }
+      }
+      {
+	 size_t size = e->size ? 2*e->size : 65536;
+	 char *p = realloc(e->buffer, size);
+
+	 if(!p)
+	    return;
+	 e->buffer = p;
+	 e->size = size;
+      }
+   }
+} /* append */
+
+/* Appends s with characters special in InfluxDB tags escaped */
+static void append_tag(struct exporter *e, const char *s, size_t len)
+{
+   size_t i;
+
+   for(i=0; i<len; i++)
+   {
+      if((s[i] == ' ') || (s[i] == ',') || (s[i] == '='))
+	 append(e, "\\%c", s[i]);
+      else
+	 append(e, "%c", s[i]);
+   }
+} /* append_tag */
+
+static const char *names[4] = {"latest", "mean", "max", "min"};
+
+/* Appends the InfluxDB measurement and tags of a row */
+static void append_series(struct exporter *e, unsigned int meter,
+			  const struct MeterTable_entry *entry,
+			  const oid code[5])
+{
+   append(e, "%s,meter=%u", e->name, meter+1);
+   if(entry->MeterType_len)
+   {
+      append(e, ",type=");
+      append_tag(e, entry->MeterType, entry->MeterType_len);
+   }
+   append(e, ",code=%lu-%lu:%lu.%lu.%lu ", code[0], code[1], code[2],
+	  code[3], code[4]);
+} /* append_series */
+
+static void append_line(struct exporter *e, unsigned int meter,
+			const struct MeterTable_entry *entry,
+			const struct export_sent *s)
+{
+   long values[4] = {s->latest, s->mean, s->max, s->min};
+   double multiplier = entry->MeterMultiplier ? entry->MeterMultiplier : 1;
+   int v, first = 1;
+
+   if(e->format == EXPORT_GRAPHITE)
+   {
+      for(v=0; v<4; v++)
+	 if(s->valid & (1 << v))
+	    append(e, "%s.meter%u.%lu-%lu_%lu_%lu_%lu.%s %.10g %lld\n",
+		   e->name, meter+1, s->code[0], s->code[1], s->code[2],
+		   s->code[3], s->code[4], names[v],
+		   values[v] / multiplier, (long long)e->now);
+      return;
+   }
+   append_series(e, meter, entry, s->code);
+   for(v=0; v<4; v++)
+      if(s->valid & (1 << v))
+      {
+	 append(e, "%s%s=%.10g", first ? "" : ",", names[v],
+		values[v] / multiplier);
+	 first = 0;
+      }
+   append(e, " %lld000000000\n", (long long)e->now);
+} /* append_line */
+
+/* Appends the raw samples of row o taken after s->sample_time, each with
+   the time it was taken */
+static void append_samples(struct exporter *e, unsigned int meter,
+			   const struct MeterTable_entry *entry,
+			   const struct obis_data *o, struct export_sent *s)
+{
+   double multiplier = entry->MeterMultiplier ? entry->MeterMultiplier : 1;
+   const struct obis_sample *sample;
+   unsigned int n;
+
+   if(!o->samples)
+      return;
+   /* find the oldest sample not sent */
+   for(n=0; (sample = samples_get(o->samples, n)) &&
+	  (sample->time > s->sample_time); n++);
+   while(n--)
+   {
+      sample = samples_get(o->samples, n);
+      if(e->format == EXPORT_GRAPHITE)
+	 append(e, "%s.meter%u.%lu-%lu_%lu_%lu_%lu.sample %.10g %lld\n",
+		e->name, meter+1, o->obis_oid[0], o->obis_oid[1],
+		o->obis_oid[2], o->obis_oid[3], o->obis_oid[4],
+		sample->value / multiplier, (long long)sample->time);
+      else
+      {
+	 append_series(e, meter, entry, o->obis_oid);
+	 append(e, "sample=%.10g %lld000000000\n",
+		sample->value / multiplier, (long long)sample->time);
+      }
+      s->sample_time = sample->time;
+   }
+} /* append_samples */
+
+void export_begin(struct exporter *e, time_t now)
+{
+   e->now = now;
+   e->used = 0;
+} /* export_begin */
+
+void export_row(struct exporter *e, unsigned int meter, unsigned int row,
+		const struct MeterTable_entry *entry,
+		const struct obis_data *o)
+{
+   struct export_meter *m;
+   struct export_sent now, *s;
+
+   if(meter >= e->num_meters)
+      return;
+   m = &(e->meters[meter]);
+   if(row >= m->num_rows)
+   {
+      s = realloc(m->rows, (row+1)*sizeof(struct export_sent));
+      if(!s)
+	 return;
+      memset(&s[m->num_rows], 0,
+	     (row+1-m->num_rows)*sizeof(struct export_sent));
+      m->rows = s;
+      m->num_rows = row+1;
+   }
+   s = &(m->rows[row]);
+   if(memcmp(o->obis_oid, s->code, sizeof(s->code)))
+   {
+      /* another row than before */
+      memset(s, 0, sizeof(struct export_sent));
+      memcpy(s->code, o->obis_oid, sizeof(s->code));
+   }
+   append_samples(e, meter, entry, o, s);
+   memset(&now, 0, sizeof(now));
+   memcpy(now.code, o->obis_oid, sizeof(now.code));
+   if(o->latest_is_valid)
+   {
+      now.valid |= SENT_LATEST;
+      now.latest = o->latest_value;
+   }
+   if(o->mean6m_is_valid)
+   {
+      now.valid |= SENT_MEAN;
+      now.mean = o->mean6m_value;
+   }
+   if(o->max6m_is_valid)
+   {
+      now.valid |= SENT_MAX;
+      now.max = o->max6m_value;
+   }
+   if(o->min6m_is_valid)
+   {
+      now.valid |= SENT_MIN;
+      now.min = o->min6m_value;
+   }
+   if(!now.valid)
+      return;
+   if(s->time && (e->now - s->time < e->resend) &&
+      !memcmp(now.code, s->code, sizeof(now.code)) &&
+      (now.valid == s->valid) && (now.latest == s->latest) &&
+      (now.mean == s->mean) && (now.max == s->max) && (now.min == s->min))
+      return; /* unchanged */
+   now.time = e->now;
+   now.sample_time = s->sample_time;
+   *s = now;
+   append_line(e, meter, entry, s);
+} /* export_row */
+
+void export_end(struct exporter *e)
+{
+   connect_receiver(e);
+   if(!e->used)
+      return;
+   /* lines already waiting are sent first */
+   if(e->spool[0] &&
+      (e->down || e->resolving || e->connecting ||
+       (e->spool_len > e->spool_read) || (e->out_len > e->out_sent)))
+   {
+      spool_batch(e);
+      return;
+   }
+   if(e->down)
+      return; /* nowhere to keep it */
+   if((long)(e->out_len - e->out_sent + e->used) > e->spool_size)
+   {
+      if(!e->spool_full)
+	 snmp_log(LOG_WARNING, "%s%s%s is not keeping up, dropping values\n",
+		  e->host, e->port[0] ? ":" : "", e->port);
+      e->spool_full = 1;
+      return;
+   }
+   e->spool_full = 0;
+   if(!append_out(e, e->buffer, e->used))
+      flush(e);
+} /* export_end */
+
+void export_close(struct exporter *e)
+{
+   unsigned int m;
+
+   if(e->resolving)
+      pthread_join(e->resolver, NULL);
+   if(e->addrs)
+      freeaddrinfo(e->addrs);
+   if(e->fd >= 0)
+   {
+      if(e->connecting || e->writing)
+	 unregister_writefd(e->fd);
+      close(e->fd);
+   }
+   keep_unsent(e);
+   if(e->wake >= 0)
+   {
+      unregister_readfd(e->wake);
+      close(e->wake);
+   }
+   for(m=0; m<e->num_meters; m++)
+      free(e->meters[m].rows);
+   free(e->meters);
+   free(e->buffer);
+   free(e->out);
+   memset(e, 0, sizeof(struct exporter));
+   e->fd = -1;
+   e->wake = -1;
+} /* export_close */
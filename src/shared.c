@@ -0,0 +1,201 @@
+/**************************************************************
+This file mirrors the latest values of all meters in a POSIX shared
+memory segment.
+
+Each meter is written between two increments of its sequence number, so
+that readers see an odd number while it is being written and a changed
+number if it was written while they copied it. The agent is the only
+writer and never waits for readers.
+
+SPDX-License-Identifier: BSD-2-Clause
+
+Copyright (c) 2026, Henrik Carlqvist
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <net-snmp/net-snmp-config.h>
+#include <net-snmp/net-snmp-includes.h>
+
+#include "shared.h"
+
+int shared_init(struct shared *s, struct json_object *conf,
+		unsigned int num_meters)
+{
+   struct json_object *tmp_obj;
+   const char *name = O2S_SHM_NAME;
+   unsigned int rows = SHARED_ROWS;
+   struct o2s_shm_meter *meters;
+   struct stat st;
+   unsigned int i;
+   int fd;
+
+   memset(s, 0, sizeof(struct shared));
+   if(json_object_object_get_ex(conf, "name", &tmp_obj))
+      name = json_object_get_string(tmp_obj);
+   if(json_object_object_get_ex(conf, "rows", &tmp_obj) &&
+      (json_object_get_int(tmp_obj) > 0))
+      rows = json_object_get_int(tmp_obj);
+   if((name[0] != '/') || (strlen(name) >= sizeof(s->name)))
+   {
+      snmp_log(LOG_ERR, "shm name must start with / : %s\n", name);
+      return -1;
+   }
+   strcpy(s->name, name);
+   s->size = sizeof(struct o2s_shm_header) +
+      num_meters * (sizeof(struct o2s_shm_meter) +
+		    rows * sizeof(struct o2s_shm_row));
+   /* a segment left by an earlier run may still be mapped by readers, so
+      it is reused instead of truncated */
+   fd = shm_open(s->name, O_CREAT | O_RDWR, 0644);
+   if((fd >= 0) && fstat(fd, &st))
+      st.st_size = 0;
+   if((fd >= 0) && ((size_t)st.st_size > s->size))
+   {
+      /* readers touching the end of a shrunk segment would get SIGBUS,
+	 they keep the old one until they open the name again */
+      close(fd);
+      shm_unlink(s->name);
+      fd = shm_open(s->name, O_CREAT | O_EXCL | O_RDWR, 0644);
+      st.st_size = 0;
+   }
+   if(fd < 0)
+   {
+      snmp_log(LOG_ERR, "Failed creating shared memory %s\n", s->name);
+      return -1;
+   }
+   if(((size_t)st.st_size != s->size) && ftruncate(fd, s->size))
+   {
+      snmp_log(LOG_ERR, "Failed sizing shared memory %s\n", s->name);
+      close(fd);
+      shm_unlink(s->name);
+      return -1;
+   }
+   s->header = mmap(NULL, s->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+   close(fd);
+   if(s->header == MAP_FAILED)
+   {
+      snmp_log(LOG_ERR, "Failed mapping shared memory %s\n", s->name);
+      s->header = NULL;
+      shm_unlink(s->name);
+      return -1;
+   }
+   /* every meter is marked as being written while the layout changes and
+      cleared, so readers of an old segment retry instead of mixing up
+      old and new data */
+   meters = o2s_shm_meters(s->header);
+   for(i=0; i<num_meters; i++)
+      __atomic_store_n(&meters[i].sequence, meters[i].sequence | 1,
+		       __ATOMIC_RELAXED);
+   __atomic_thread_fence(__ATOMIC_RELEASE);
+   s->header->version = O2S_SHM_VERSION;
+   s->header->num_meters = num_meters;
+   s->header->rows_per_meter = rows;
+   for(i=0; i<num_meters; i++)
+   {
+      meters[i].num_rows = 0;
+      meters[i].multiplier = 0;
+      meters[i].updated = 0;
+      memset(meters[i].type, 0, sizeof(meters[i].type));
+      memset(o2s_shm_rows(s->header, i), 0, rows*sizeof(struct o2s_shm_row));
+      __atomic_store_n(&meters[i].sequence, meters[i].sequence + 1,
+		       __ATOMIC_RELEASE);
+   }
+   __atomic_thread_fence(__ATOMIC_RELEASE);
+   memcpy(s->header->magic, O2S_SHM_MAGIC, sizeof(s->header->magic));
+   return 0;
+} /* shared_init */
+
+void shared_begin_meter(struct shared *s, unsigned int i,
+			const struct MeterTable_entry *entry)
+{
+   struct o2s_shm_meter *m = &(o2s_shm_meters(s->header)[i]);
+   size_t len = entry->MeterType_len;
+
+   __atomic_store_n(&m->sequence, m->sequence + 1, __ATOMIC_RELAXED);
+   __atomic_thread_fence(__ATOMIC_RELEASE);
+   m->multiplier = entry->MeterMultiplier;
+   if(len >= sizeof(m->type))
+      len = sizeof(m->type) - 1;
+   memcpy(m->type, entry->MeterType, len);
+   m->type[len] = 0;
+} /* shared_begin_meter */
+
+void shared_set_row(struct shared *s, unsigned int i, unsigned int row,
+		    const struct obis_data *o)
+{
+   struct o2s_shm_row *r;
+   int k;
+
+   if(row >= s->header->rows_per_meter)
+      return;
+   r = &(o2s_shm_rows(s->header, i)[row]);
+   for(k=0; k<5; k++)
+      r->code[k] = o->obis_oid[k];
+   r->valid = 0;
+   if(o->latest_is_valid)
+      r->valid |= O2S_SHM_LATEST;
+   if(o->mean6m_is_valid)
+      r->valid |= O2S_SHM_MEAN;
+   if(o->max6m_is_valid)
+      r->valid |= O2S_SHM_MAX;
+   if(o->min6m_is_valid)
+      r->valid |= O2S_SHM_MIN;
+   r->latest = o->latest_value;
+   r->mean = o->mean6m_value;
+   r->max = o->max6m_value;
+   r->min = o->min6m_value;
+} /* shared_set_row */
+
+void shared_end_meter(struct shared *s, unsigned int i,
+		      unsigned int num_rows, time_t now)
+{
+   struct o2s_shm_meter *m = &(o2s_shm_meters(s->header)[i]);
+
+   if(num_rows > s->header->rows_per_meter)
+   {
+      if(!s->warned)
+	 snmp_log(LOG_WARNING, "Meter %u has %u rows, only %u fit in %s\n",
+		  i+1, num_rows, s->header->rows_per_meter, s->name);
+      s->warned = 1;
+      num_rows = s->header->rows_per_meter;
+   }
+   m->num_rows = num_rows;
+   m->updated = now;
+   __atomic_store_n(&m->sequence, m->sequence + 1, __ATOMIC_RELEASE);
+} /* shared_end_meter */
+
+void shared_close(struct shared *s)
+{
+   if(s->header)
+   {
+      munmap(s->header, s->size);
+      shm_unlink(s->name);
+   }
+   memset(s, 0, sizeof(struct shared));
+} /* shared_close */
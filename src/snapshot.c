@@ -0,0 +1,421 @@
+/**************************************************************
+This file serves snapshots of all meters on a UNIX domain socket.
+
+The listening socket and each client are registered with net-snmp, so
+they are served by the event loop like SNMP requests. A client
+asking for a snapshot newer than the latest one is kept waiting until
+the next snapshot is published. Snapshots are sent with a blocking write
+with a timeout, a client not reading them is disconnected.
+
+SPDX-License-Identifier: BSD-2-Clause
+
+Copyright (c) 2026, Henrik Carlqvist
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <net-snmp/net-snmp-config.h>
+#include <net-snmp/net-snmp-includes.h>
+#include <net-snmp/library/fd_event_manager.h>
+
+#include "snapshot.h"
+#include "samples.h"
+
+static void drop_client(struct snapshot *s, unsigned int c)
+{
+   if(s->clients[c].backlog_len)
+      unregister_writefd(s->clients[c].fd);
+   unregister_readfd(s->clients[c].fd);
+   close(s->clients[c].fd);
+   free(s->clients[c].backlog);
+   s->clients[c] = s->clients[--s->num_clients];
+} /* drop_client */
+
+static int find_client(struct snapshot *s, int fd)
+{
+   unsigned int c;
+
+   for(c=0; (c < s->num_clients) && (s->clients[c].fd != fd); c++);
+   return (c < s->num_clients) ? (int)c : -1;
+} /* find_client */
+
+/* Returns how many bytes the socket took without blocking, or -1 if the
+   client is gone */
+static ssize_t send_some(int fd, const uint8_t *data, size_t len)
+{
+   ssize_t n;
+
+   do
+      n = send(fd, data, len, MSG_NOSIGNAL);
+   while((n < 0) && (errno == EINTR));
+   if((n < 0) && ((errno == EAGAIN) || (errno == EWOULDBLOCK)))
+      return 0;
+   return n;
+} /* send_some */
+
+static void write_client(int fd, void *data)
+{
+   struct snapshot *s = data;
+   struct snapshot_client *client;
+   int c = find_client(s, fd);
+   ssize_t n;
+
+   if(c < 0)
+      return;
+   client = &(s->clients[c]);
+   n = send_some(fd, client->backlog + client->backlog_sent,
+		 client->backlog_len - client->backlog_sent);
+   if(n < 0)
+   {
+      drop_client(s, c);
+      return;
+   }
+   client->backlog_sent += n;
+   if(client->backlog_sent == client->backlog_len)
+   {
+      client->backlog_len = 0;
+      unregister_writefd(fd);
+   }
+} /* write_client */
+
+/* Sends the snapshot to client c, what the socket does not take at once is
+   kept as its backlog and sent by write_client. Returns 0 unless the
+   client has to be dropped. */
+static int send_snapshot(struct snapshot *s, unsigned int c)
+{
+   struct snapshot_client *client = &(s->clients[c]);
+   ssize_t n;
+   size_t left;
+
+   if(client->backlog_len)
+      return -1; /* has not even taken the previous snapshot */
+   n = send_some(client->fd, s->data, s->used);
+   if(n < 0)
+      return -1;
+   client->waiting = 0;
+   left = s->used - n;
+   if(!left)
+      return 0;
+   if(left > client->backlog_size)
+   {
+      uint8_t *backlog = realloc(client->backlog, left);
+
+      if(!backlog)
+	 return -1;
+      client->backlog = backlog;
+      client->backlog_size = left;
+   }
+   memcpy(client->backlog, s->data + n, left);
+   client->backlog_len = left;
+   client->backlog_sent = 0;
+   if(register_writefd(client->fd, write_client, s))
+   {
+      client->backlog_len = 0;
+      return -1;
+   }
+   return 0;
+} /* send_snapshot */
+
+static void read_client(int fd, void *data)
+{
+   struct snapshot *s = data;
+   struct snapshot_client *client;
+   int c = find_client(s, fd);
+   ssize_t n;
+
+   if(c < 0)
+      return;
+   client = &(s->clients[c]);
+   n = recv(fd, client->request + client->request_len,
+	    sizeof(client->request) - client->request_len, 0);
+   if((n < 0) &&
+      ((errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINTR)))
+      return;
+   if(n <= 0)
+   {
+      /* closed by the client */
+      drop_client(s, c);
+      return;
+   }
+   /* the sequence number may come in more than one piece */
+   client->request_len += n;
+   if(client->request_len < sizeof(client->request))
+      return;
+   client->request_len = 0;
+   memcpy(&(client->have), client->request, sizeof(client->have));
+   client->waiting = 1;
+   if((s->sequence > client->have) && !s->failed && !client->backlog_len)
+   {
+      if(send_snapshot(s, c))
+	 drop_client(s, c);
+   }
+} /* read_client */
+
+static void accept_client(int fd, void *data)
+{
+   struct snapshot *s = data;
+   struct snapshot_client *client;
+   int new_client = accept(fd, NULL, NULL);
+
+   if(new_client < 0)
+      return;
+   if(s->num_clients == SNAPSHOT_MAX_CLIENTS)
+   {
+      snmp_log(LOG_WARNING, "Too many clients on %s\n", s->path);
+      close(new_client);
+      return;
+   }
+   fcntl(new_client, F_SETFD, FD_CLOEXEC);
+   fcntl(new_client, F_SETFL, fcntl(new_client, F_GETFL) | O_NONBLOCK);
+   if(register_readfd(new_client, read_client, s))
+   {
+      close(new_client);
+      return;
+   }
+   client = &(s->clients[s->num_clients++]);
+   memset(client, 0, sizeof(struct snapshot_client));
+   client->fd = new_client;
+} /* accept_client */
+
+int snapshot_init(struct snapshot *s, const char *path)
+{
+   struct sockaddr_un addr;
+
+   memset(s, 0, sizeof(struct snapshot));
+   s->fd = -1;
+   if(strlen(path) >= sizeof(addr.sun_path))
+   {
+      snmp_log(LOG_ERR, "Too long socket path %s\n", path);
+      return -1;
+   }
+   strcpy(s->path, path);
+   memset(&addr, 0, sizeof(addr));
+   addr.sun_family = AF_UNIX;
+   strcpy(addr.sun_path, path);
+   s->fd = socket(AF_UNIX, SOCK_STREAM, 0);
+   if(s->fd < 0)
+   {
+      snmp_log(LOG_ERR, "Failed creating socket %s\n", path);
+      return -1;
+   }
+   fcntl(s->fd, F_SETFD, FD_CLOEXEC);
+   unlink(path); /* left by an agent which did not stop cleanly */
+   if(bind(s->fd, (struct sockaddr *)&addr, sizeof(addr)) ||
+      listen(s->fd, SNAPSHOT_MAX_CLIENTS) ||
+      register_readfd(s->fd, accept_client, s))
+   {
+      snmp_log(LOG_ERR, "Failed listening on %s\n", path);
+      close(s->fd);
+      s->fd = -1;
+      return -1;
+   }
+   return 0;
+} /* snapshot_init */
+
+/* Returns n more bytes at the end of the snapshot, or NULL if out of
+   memory */
+static void *reserve(struct snapshot *s, size_t n)
+{
+   void *p;
+
+   if(s->failed)
+      return NULL;
+   if(s->used + n > s->size)
+   {
+      size_t size = s->size ? s->size : 4096;
+      uint8_t *data;
+
+      while(s->used + n > size)
+	 size *= 2;
+      data = realloc(s->data, size);
+      if(!data)
+      {
+	 s->failed = 1;
+	 return NULL;
+      }
+      s->data = data;
+      s->size = size;
+   }
+   p = s->data + s->used;
+   memset(p, 0, n);
+   s->used += n;
+   return p;
+} /* reserve */
+
+/* Copies string src of length len to dst of size bytes, truncating it */
+static void copy_string(char *dst, size_t size, const char *src, size_t len)
+{
+   if(!src)
+      len = 0;
+   if(len >= size)
+      len = size - 1;
+   if(len)
+      memcpy(dst, src, len);
+   dst[len] = 0;
+} /* copy_string */
+
+void snapshot_begin(struct snapshot *s)
+{
+   s->used = 0;
+   s->failed = 0;
+   s->num_meters = 0;
+   reserve(s, sizeof(struct o2s_snapshot_header));
+} /* snapshot_begin */
+
+void snapshot_add_meter(struct snapshot *s, unsigned int index,
+			const struct MeterTable_entry *entry)
+{
+   struct o2s_snapshot_meter *m;
+
+   s->meter = s->used;
+   m = reserve(s, sizeof(struct o2s_snapshot_meter));
+   if(!m)
+      return;
+   m->index = index;
+   m->multiplier = entry->MeterMultiplier;
+   m->rssi = entry->MeterRSSI;
+   copy_string(m->type, sizeof(m->type), entry->MeterType,
+	       entry->MeterType_len);
+   copy_string(m->ip, sizeof(m->ip), entry->MeterIP, entry->MeterIP_len);
+   copy_string(m->mac, sizeof(m->mac), entry->MeterMAC, entry->MeterMAC_len);
+   s->num_meters++;
+} /* snapshot_add_meter */
+
+void snapshot_add_row(struct snapshot *s, const struct obis_data *o)
+{
+   struct o2s_snapshot_row *r = reserve(s, sizeof(struct o2s_snapshot_row));
+   int i;
+
+   if(!r)
+      return;
+   ((struct o2s_snapshot_meter *)(s->data + s->meter))->num_rows++;
+   for(i=0; i<5; i++)
+      r->code[i] = o->obis_oid[i];
+   if(o->latest_is_valid)
+   {
+      r->valid |= O2S_LATEST;
+      r->latest = o->latest_value;
+   }
+   if(o->mean6m_is_valid)
+   {
+      r->valid |= O2S_MEAN;
+      r->mean = o->mean6m_value;
+   }
+   if(o->max6m_is_valid)
+   {
+      r->valid |= O2S_MAX;
+      r->max = o->max6m_value;
+   }
+   if(o->min6m_is_valid)
+   {
+      r->valid |= O2S_MIN;
+      r->min = o->min6m_value;
+   }
+   if(o->p95_is_valid)
+   {
+      r->valid |= O2S_P95;
+      r->p95 = o->p95_value;
+   }
+   if(o->p99_is_valid)
+   {
+      r->valid |= O2S_P99;
+      r->p99 = o->p99_value;
+   }
+   copy_string(r->unit, sizeof(r->unit), o->unit, o->unit_len);
+   copy_string(r->description, sizeof(r->description), o->description,
+	       o->description_len);
+} /* snapshot_add_row */
+
+void snapshot_add_samples(struct snapshot *s, unsigned int index,
+			  unsigned int row, const struct sample_ring *r)
+{
+   struct o2s_snapshot_samples *h;
+   struct o2s_snapshot_sample *sample;
+   unsigned int n;
+
+   if((!r) || (!r->count))
+      return;
+   h = reserve(s, sizeof(struct o2s_snapshot_samples));
+   if(!h)
+      return;
+   h->index = index;
+   h->row = row;
+   h->num_samples = r->count;
+   for(n=r->count; n--; )
+   {
+      sample = reserve(s, sizeof(struct o2s_snapshot_sample));
+      if(!sample)
+	 return;
+      sample->time = samples_get(r, n)->time;
+      sample->value = samples_get(r, n)->value;
+   }
+} /* snapshot_add_samples */
+
+void snapshot_publish(struct snapshot *s, time_t now)
+{
+   struct o2s_snapshot_header *h = (struct o2s_snapshot_header *)s->data;
+   unsigned int c;
+
+   if(s->failed || !h)
+   {
+      snmp_log(LOG_ERR, "Failed allocating snapshot\n");
+      return;
+   }
+   memcpy(h->magic, O2S_SNAPSHOT_MAGIC, sizeof(h->magic));
+   h->version = O2S_SNAPSHOT_VERSION;
+   h->sequence = ++s->sequence;
+   h->time = now;
+   h->size = s->used;
+   h->num_meters = s->num_meters;
+   for(c=0; c<s->num_clients; c++)
+   {
+      if((!s->clients[c].waiting) || (s->clients[c].have >= s->sequence))
+	 continue;
+      if(s->clients[c].backlog_len)
+	 snmp_log(LOG_WARNING, "Dropped client on %s not keeping up\n",
+		  s->path);
+      if(send_snapshot(s, c))
+	 drop_client(s, c--);
+   }
+} /* snapshot_publish */
+
+void snapshot_close(struct snapshot *s)
+{
+   while(s->num_clients)
+      drop_client(s, 0);
+   if(s->fd >= 0)
+   {
+      unregister_readfd(s->fd);
+      close(s->fd);
+      unlink(s->path);
+   }
+   free(s->data);
+   memset(s, 0, sizeof(struct snapshot));
+   s->fd = -1;
+} /* snapshot_close */
@@ -0,0 +1,785 @@
+/**************************************************************
+This file keeps the history of all meters on disk.
+
+Samples of each row are collected in memory into a block and the
+block is appended to the segment file of its meter and day when it has
+been open for "flush" seconds. Times are encoded as the difference
+from the previous difference between times (delta-of-delta), which for
+samples at a steady rate is a single 0 bit. Values are integers
+already multiplied by the meter multiplier and are encoded the same
+way, which is a single bit for counters increasing at a steady rate
+and a few bits for gauges changing slowly.
+
+Once an hour the files of finished days are rewritten into one block
+per row, days older than "downsample" days are rewritten with one
+sample every "resolution" seconds and days older than "retention" days
+are removed. A file of a day being appended to is named YYYYMMDD.tsd,
+a rewritten file YYYYMMDD-R.tsd where R is its resolution.
+
+SPDX-License-Identifier: BSD-2-Clause
+
+Copyright (c) 2026, Henrik Carlqvist
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <math.h>
+
+#include <net-snmp/net-snmp-config.h>
+#include <net-snmp/net-snmp-includes.h>
+
+#include "tsdb.h"
+#include "obis_catalogue.h"
+#include "samples.h"
+
+#define TSDB_MAX_BLOCK_SAMPLES 100000
+#define TSDB_MAINTENANCE_INTERVAL 3600
+
+/* bits of the zigzag encoded delta-of-delta for each of the 4 prefixes */
+static const int time_widths[4] = {7, 9, 12, 32};
+static const int value_widths[4] = {6, 13, 20, 64};
+
+struct reader
+{
+   const uint8_t *data;
+   uint32_t nbits;
+   uint32_t pos;
+   int error;
+};
+
+struct sample
+{
+   int64_t time;
+   int64_t value;
+};
+
+/* all samples of one OBIS code in the files of a day being rewritten */
+struct sample_set
+{
+   uint32_t code[5];
+   struct sample *samples;
+   size_t count;
+   size_t size;
+};
+
+struct day_samples
+{
+   struct sample_set *sets;
+   unsigned int num_sets;
+};
+
+static uint64_t zigzag(int64_t v)
+{
+   return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);
+} /* zigzag */
+
+static int64_t unzigzag(uint64_t v)
+{
+   return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+} /* unzigzag */
+
+static int put_bits(struct tsdb_series *s, uint64_t value, int n)
+{
+   size_t need = (s->block.nbits + n + 7) / 8;
+   int i;
+
+   if(need > s->size)
+   {
+      size_t size = s->size ? 2*s->size : 256;
+      uint8_t *data;
+
+      while(size < need)
+	 size *= 2;
+      data = realloc(s->data, size);
+      if(!data)
+	 return -1;
+      memset(data + s->size, 0, size - s->size);
+      s->data = data;
+      s->size = size;
+   }
+   for(i=n-1; i>=0; i--)
+   {
+      if((value >> i) & 1)
+	 s->data[s->block.nbits / 8] |= 0x80 >> (s->block.nbits % 8);
+      s->block.nbits++;
+   }
+   return 0;
+} /* put_bits */
+
+/* 0 is a single 0 bit, other values are 10, 110, 1110 or 1111 followed by
+   the zigzag encoded value in the number of bits given by widths */
+static int encode(struct tsdb_series *s, int64_t v, const int *widths)
+{
+   uint64_t z = zigzag(v);
+   int k;
+
+   if(!v)
+      return put_bits(s, 0, 1);
+   for(k=0; (k < 3) && (z >> widths[k]); k++);
+   if(k < 3)
+      return put_bits(s, ((1U << (k+2)) - 2), k+2) ||
+	 put_bits(s, z, widths[k]);
+   return put_bits(s, 0xf, 4) || put_bits(s, z, widths[3]);
+} /* encode */
+
+static uint64_t get_bits(struct reader *r, int n)
+{
+   uint64_t v = 0;
+   int i;
+
+   if(r->pos + n > r->nbits)
+   {
+      r->error = 1;
+      return 0;
+   }
+   for(i=0; i<n; i++, r->pos++)
+      v = (v << 1) | ((r->data[r->pos / 8] >> (7 - r->pos % 8)) & 1);
+   return v;
+} /* get_bits */
+
+static int64_t decode(struct reader *r, const int *widths)
+{
+   int k;
+
+   if(!get_bits(r, 1))
+      return 0;
+   for(k=0; (k < 3) && get_bits(r, 1); k++);
+   return unzigzag(get_bits(r, widths[k]));
+} /* decode */
+
+static void series_reset(struct tsdb_series *s)
+{
+   if(s->data)
+      memset(s->data, 0, s->size);
+   s->block.count = 0;
+   s->block.nbits = 0;
+} /* series_reset */
+
+static int series_append(struct tsdb_series *s, int64_t time, int64_t value)
+{
+   int64_t delta;
+
+   if(!s->block.count)
+   {
+      s->block.first_time = time;
+      s->block.first_value = value;
+      s->prev_time_delta = 0;
+      s->prev_value_delta = 0;
+      s->opened = time;
+   }
+   else
+   {
+      delta = time - s->prev_time;
+      if(encode(s, delta - s->prev_time_delta, time_widths))
+	 return -1;
+      s->prev_time_delta = delta;
+      delta = value - s->prev_value;
+      if(encode(s, delta - s->prev_value_delta, value_widths))
+	 return -1;
+      s->prev_value_delta = delta;
+   }
+   s->prev_time = time;
+   s->prev_value = value;
+   s->last_time = time;
+   s->block.count++;
+   return 0;
+} /* series_append */
+
+static int write_block(FILE *f, const struct tsdb_series *s)
+{
+   if(!ftell(f) && (fwrite(TSDB_MAGIC, 8, 1, f) != 1))
+      return -1;
+   if(fwrite(&(s->block), sizeof(struct tsdb_block), 1, f) != 1)
+      return -1;
+   if(s->block.nbits &&
+      (fwrite(s->data, (s->block.nbits + 7) / 8, 1, f) != 1))
+      return -1;
+   return 0;
+} /* write_block */
+
+static int64_t day_of(int64_t time)
+{
+   return (time >= 0) ? time / 86400 : (time - 86399) / 86400;
+} /* day_of */
+
+/* Gets the name of the file of meter for day, counting from 1970 */
+static void segment_path(const struct tsdb *t, unsigned int meter,
+			 int64_t day, int resolution, char *path, size_t len)
+{
+   time_t time = day * 86400;
+   struct tm tm;
+
+   gmtime_r(&time, &tm);
+   if(resolution < 0)
+      snprintf(path, len, "%s/meter%u/%04d%02d%02d.tsd", t->dir, meter+1,
+	       tm.tm_year+1900, tm.tm_mon+1, tm.tm_mday);
+   else
+      snprintf(path, len, "%s/meter%u/%04d%02d%02d-%d.tsd", t->dir, meter+1,
+	       tm.tm_year+1900, tm.tm_mon+1, tm.tm_mday, resolution);
+} /* segment_path */
+
+static void flush_series(struct tsdb *t, unsigned int meter,
+			 struct tsdb_series *s)
+{
+   char path[512];
+   FILE *f;
+
+   if(!s->block.count)
+      return;
+   snprintf(path, sizeof(path), "%s/meter%u", t->dir, meter+1);
+   if(mkdir(path, 0755) && (errno != EEXIST))
+      snmp_log(LOG_ERR, "Failed creating %s\n", path);
+   segment_path(t, meter, day_of(s->block.first_time), -1, path,
+		sizeof(path));
+   f = fopen(path, "ab");
+   if((!f) || write_block(f, s))
+      snmp_log(LOG_ERR, "Failed writing history to %s\n", path);
+   if(f)
+      fclose(f);
+   series_reset(s);
+} /* flush_series */
+
+static int config_int(struct json_object *conf, const char *name, int value)
+{
+   struct json_object *tmp_obj;
+
+   if(json_object_object_get_ex(conf, name, &tmp_obj) &&
+      (json_object_get_int(tmp_obj) > 0))
+      return json_object_get_int(tmp_obj);
+   return value;
+} /* config_int */
+
+int tsdb_init(struct tsdb *t, struct json_object *conf,
+	      unsigned int num_meters)
+{
+   struct json_object *tmp_obj;
+
+   memset(t, 0, sizeof(struct tsdb));
+   if((!json_object_object_get_ex(conf, "dir", &tmp_obj)) ||
+      (strlen(json_object_get_string(tmp_obj)) >= sizeof(t->dir)))
+   {
+      snmp_log(LOG_ERR, "history needs a dir\n");
+      return -1;
+   }
+   strcpy(t->dir, json_object_get_string(tmp_obj));
+   if(mkdir(t->dir, 0755) && (errno != EEXIST))
+   {
+      snmp_log(LOG_ERR, "Failed creating %s\n", t->dir);
+      return -1;
+   }
+   t->flush = config_int(conf, "flush", 300);
+   t->retention = config_int(conf, "retention", 365);
+   t->downsample = config_int(conf, "downsample", 30);
+   t->resolution = config_int(conf, "resolution", 300);
+   t->meters = calloc(num_meters, sizeof(struct tsdb_meter));
+   if(!t->meters)
+      return -1;
+   t->num_meters = num_meters;
+   return 0;
+} /* tsdb_init */
+
+static void append_sample(struct tsdb *t, unsigned int meter,
+			  struct tsdb_series *s, int64_t time, int64_t value)
+{
+   if(time <= s->last_time)
+      return; /* already stored */
+   if(s->block.count &&
+      ((day_of(time) != day_of(s->block.first_time)) ||
+       (s->block.count >= TSDB_MAX_BLOCK_SAMPLES)))
+      flush_series(t, meter, s);
+   if(series_append(s, time, value))
+   {
+      /* out of memory, save what we have and start again */
+      flush_series(t, meter, s);
+      series_append(s, time, value);
+   }
+} /* append_sample */
+
+void tsdb_append(struct tsdb *t, unsigned int meter, unsigned int row,
+		 const struct obis_data *o, time_t now)
+{
+   struct tsdb_meter *m;
+   struct tsdb_series *s;
+   int i;
+
+   if((meter >= t->num_meters) || (!o->latest_is_valid))
+      return;
+   m = &(t->meters[meter]);
+   if(row >= m->num_series)
+   {
+      s = realloc(m->series, (row+1)*sizeof(struct tsdb_series));
+      if(!s)
+	 return;
+      memset(&s[m->num_series], 0,
+	     (row+1-m->num_series)*sizeof(struct tsdb_series));
+      m->series = s;
+      m->num_series = row+1;
+   }
+   s = &(m->series[row]);
+   for(i=0; i<5; i++)
+      if(s->block.code[i] != o->obis_oid[i])
+	 break;
+   if(i < 5)
+   {
+      /* the row has got another code */
+      flush_series(t, meter, s);
+      for(i=0; i<5; i++)
+	 s->block.code[i] = o->obis_oid[i];
+      s->last_time = 0;
+   }
+   if(o->samples)
+   {
+      unsigned int n;
+
+      for(n=o->samples->count; n>0; n--)
+      {
+	 const struct obis_sample *sample = samples_get(o->samples, n-1);
+
+	 append_sample(t, meter, s, sample->time, sample->value);
+      }
+   }
+   else
+      append_sample(t, meter, s, now, o->latest_value);
+} /* tsdb_append */
+
+typedef void (*sample_callback)(void *arg, const struct tsdb_block *block,
+				int64_t time, int64_t value);
+
+/* Calls callback for each sample in the segment file path */
+static int read_segment(const char *path, sample_callback callback,
+			void *arg)
+{
+   struct tsdb_block block;
+   char magic[8];
+   uint8_t *data = NULL;
+   size_t size = 0;
+   FILE *f = fopen(path, "rb");
+   struct stat st;
+   int ret = 0;
+
+   if(!f)
+      return -1;
+   if(fstat(fileno(f), &st) || (fread(magic, 8, 1, f) != 1) ||
+      memcmp(magic, TSDB_MAGIC, 8))
+   {
+      fclose(f);
+      return -1;
+   }
+   while(fread(&block, sizeof(block), 1, f) == 1)
+   {
+      struct reader r;
+      size_t len = (block.nbits + 7) / 8;
+      int64_t time = block.first_time;
+      int64_t value = block.first_value;
+      int64_t time_delta = 0, value_delta = 0;
+      uint32_t n;
+
+      /* a damaged header must not make us allocate more than the file */
+      if(len > (size_t)(st.st_size - ftell(f)))
+      {
+	 ret = -1;
+	 break;
+      }
+      if(len > size)
+      {
+	 uint8_t *p = realloc(data, len);
+
+	 if(!p)
+	 {
+	    ret = -1;
+	    break;
+	 }
+	 data = p;
+	 size = len;
+      }
+      if(len && (fread(data, len, 1, f) != 1))
+      {
+	 ret = -1;
+	 break;
+      }
+      r.data = data;
+      r.nbits = block.nbits;
+      r.pos = 0;
+      r.error = 0;
+      for(n=0; (n < block.count) && !r.error; n++)
+      {
+	 if(n)
+	 {
+	    time_delta += decode(&r, time_widths);
+	    time += time_delta;
+	    value_delta += decode(&r, value_widths);
+	    value += value_delta;
+	 }
+	 if(!r.error)
+	    callback(arg, &block, time, value);
+      }
+      if(r.error)
+	 ret = -1;
+   }
+   free(data);
+   fclose(f);
+   return ret;
+} /* read_segment */
+
+static void collect_sample(void *arg, const struct tsdb_block *block,
+			   int64_t time, int64_t value)
+{
+   struct day_samples *d = arg;
+   struct sample_set *set;
+   unsigned int i;
+
+   for(i=0; i<d->num_sets; i++)
+      if(!memcmp(d->sets[i].code, block->code, sizeof(block->code)))
+	 break;
+   if(i == d->num_sets)
+   {
+      set = realloc(d->sets, (i+1)*sizeof(struct sample_set));
+      if(!set)
+	 return;
+      d->sets = set;
+      memset(&(d->sets[i]), 0, sizeof(struct sample_set));
+      memcpy(d->sets[i].code, block->code, sizeof(block->code));
+      d->num_sets++;
+   }
+   set = &(d->sets[i]);
+   if(set->count == set->size)
+   {
+      size_t size = set->size ? 2*set->size : 1024;
+      struct sample *p = realloc(set->samples, size*sizeof(struct sample));
+
+      if(!p)
+	 return;
+      set->samples = p;
+      set->size = size;
+   }
+   set->samples[set->count].time = time;
+   set->samples[set->count].value = value;
+   set->count++;
+} /* collect_sample */
+
+/* Orders samples by time, samples from different files of a day may
+   overlap. Of samples with the same time the highest value comes last, the
+   newest of a counter. */
+static int compare_sample(const void *a, const void *b)
+{
+   const struct sample *sa = a;
+   const struct sample *sb = b;
+
+   if(sa->time != sb->time)
+      return (sa->time > sb->time) - (sa->time < sb->time);
+   return (sa->value > sb->value) - (sa->value < sb->value);
+} /* compare_sample */
+
+static int64_t bucket_of(int64_t time, int resolution)
+{
+   int64_t r;
+
+   if(!resolution)
+      return time;
+   r = time % resolution;
+   return time - ((r < 0) ? r + resolution : r);
+} /* bucket_of */
+
+/* Writes the samples of set as one block, with gauges averaged and the
+   last value of counters kept for each resolution seconds */
+static int write_set(FILE *f, struct sample_set *set, int resolution)
+{
+   struct tsdb_series s;
+   oid code[5];
+   int gauge, i, ret=0;
+   size_t n, next;
+
+   memset(&s, 0, sizeof(s));
+   memcpy(s.block.code, set->code, sizeof(set->code));
+   s.block.resolution = resolution;
+   for(i=0; i<5; i++)
+      code[i] = set->code[i];
+   gauge = obis_is_gauge(code);
+   qsort(set->samples, set->count, sizeof(struct sample), compare_sample);
+   for(n=0; (n < set->count) && !ret; n=next)
+   {
+      int64_t bucket = bucket_of(set->samples[n].time, resolution);
+      double sum = 0.0;
+
+      /* samples with the same time are also stored once */
+      for(next=n; (next < set->count) &&
+	     (bucket_of(set->samples[next].time, resolution) == bucket);
+	  next++)
+	 sum += set->samples[next].value;
+      ret = series_append(&s, bucket,
+			  gauge ? llround(sum / (next - n))
+			  : set->samples[next-1].value);
+   }
+   if(!ret && s.block.count)
+      ret = write_block(f, &s);
+   free(s.data);
+   return ret;
+} /* write_set */
+
+static void free_day(struct day_samples *d)
+{
+   unsigned int i;
+
+   for(i=0; i<d->num_sets; i++)
+      free(d->sets[i].samples);
+   free(d->sets);
+   d->sets = NULL;
+   d->num_sets = 0;
+} /* free_day */
+
+/* a segment file found in the directory of a meter */
+struct segment
+{
+   char name[32];
+   int64_t day;
+   int resolution; /* -1 for a file being appended to */
+};
+
+static int compare_segment(const void *a, const void *b)
+{
+   const struct segment *sa = a;
+   const struct segment *sb = b;
+
+   return (sa->day > sb->day) - (sa->day < sb->day);
+} /* compare_segment */
+
+/* Rewrites the num files of a day into one file with the given resolution */
+static void rewrite_day(struct tsdb *t, unsigned int meter,
+			const struct segment *files, int num, int resolution)
+{
+   struct day_samples d = {NULL, 0};
+   char path[512], tmp[520];
+   unsigned int i;
+   FILE *f;
+   int k, ret = 0;
+
+   for(k=0; k<num; k++)
+   {
+      snprintf(path, sizeof(path), "%s/meter%u/%s", t->dir, meter+1,
+	       files[k].name);
+      if(read_segment(path, collect_sample, &d))
+	 snmp_log(LOG_WARNING, "History file %s is damaged\n", path);
+   }
+   segment_path(t, meter, files[0].day, resolution, path, sizeof(path));
+   snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+   f = fopen(tmp, "wb");
+   if(!f)
+   {
+      snmp_log(LOG_ERR, "Failed creating %s\n", tmp);
+      free_day(&d);
+      return;
+   }
+   for(i=0; (i < d.num_sets) && !ret; i++)
+      ret = write_set(f, &(d.sets[i]), resolution);
+   if(!d.num_sets)
+      ret = (fwrite(TSDB_MAGIC, 8, 1, f) != 1);
+   if(fclose(f) || ret || rename(tmp, path))
+   {
+      snmp_log(LOG_ERR, "Failed rewriting history to %s\n", path);
+      unlink(tmp);
+   }
+   else
+   {
+      /* the new file replaces the old ones */
+      for(k=0; k<num; k++)
+      {
+	 char old[512];
+
+	 snprintf(old, sizeof(old), "%s/meter%u/%s", t->dir, meter+1,
+		  files[k].name);
+	 if(strcmp(old, path))
+	    unlink(old);
+      }
+   }
+   free_day(&d);
+} /* rewrite_day */
+
+/* Rewrites and removes old days of meter */
+static void maintain_meter(struct tsdb *t, unsigned int meter, time_t now)
+{
+   struct segment *files = NULL;
+   struct dirent *de;
+   char path[512];
+   int num=0, size=0, first, k;
+   int64_t today = day_of(now);
+   DIR *dir;
+
+   snprintf(path, sizeof(path), "%s/meter%u", t->dir, meter+1);
+   dir = opendir(path);
+   if(!dir)
+      return;
+   while((de = readdir(dir)))
+   {
+      struct tm tm;
+      int y, m, d, n=0, resolution=-1;
+
+      if(strlen(de->d_name) >= sizeof(files[0].name))
+	 continue;
+      if((sscanf(de->d_name, "%4d%2d%2d.tsd%n", &y, &m, &d, &n) != 3) ||
+	 de->d_name[n])
+      {
+	 n = 0;
+	 if((sscanf(de->d_name, "%4d%2d%2d-%d.tsd%n", &y, &m, &d,
+		    &resolution, &n) != 4) || de->d_name[n] || (resolution < 0))
+	    continue;
+      }
+      if(num == size)
+      {
+	 struct segment *p;
+
+	 size = size ? 2*size : 64;
+	 p = realloc(files, size*sizeof(struct segment));
+	 if(!p)
+	    break;
+	 files = p;
+      }
+      memset(&tm, 0, sizeof(tm));
+      tm.tm_year = y - 1900;
+      tm.tm_mon = m - 1;
+      tm.tm_mday = d;
+      strcpy(files[num].name, de->d_name);
+      files[num].day = day_of(timegm(&tm));
+      files[num].resolution = resolution;
+      num++;
+   }
+   closedir(dir);
+   qsort(files, num, sizeof(struct segment), compare_segment);
+   for(first=0; first<num; first=k)
+   {
+      int64_t age = today - files[first].day;
+      int resolution = (age >= t->downsample) ? t->resolution : 0;
+
+      for(k=first; (k < num) && (files[k].day == files[first].day); k++);
+      if(age >= t->retention)
+      {
+	 for(; first<k; first++)
+	 {
+	    snprintf(path, sizeof(path), "%s/meter%u/%s", t->dir, meter+1,
+		     files[first].name);
+	    unlink(path);
+	 }
+      }
+      else if((age >= 1) && ((k - first > 1) ||
+			     (files[first].resolution != resolution)))
+	 rewrite_day(t, meter, &files[first], k - first, resolution);
+   }
+   free(files);
+} /* maintain_meter */
+
+/* The maintainer thread, only touching files of days before today */
+static void *maintain(void *arg)
+{
+   struct tsdb *t = arg;
+   unsigned int m;
+
+   for(m=0; m<t->num_meters; m++)
+      maintain_meter(t, m, t->maintenance_time);
+   __atomic_store_n(&t->maintained, 1, __ATOMIC_RELEASE);
+   return NULL;
+} /* maintain */
+
+void tsdb_sync(struct tsdb *t, time_t now)
+{
+   unsigned int m, r;
+
+   if(t->maintaining && __atomic_load_n(&t->maintained, __ATOMIC_ACQUIRE))
+   {
+      pthread_join(t->maintainer, NULL);
+      t->maintaining = 0;
+   }
+   for(m=0; m<t->num_meters; m++)
+      for(r=0; r<t->meters[m].num_series; r++)
+      {
+	 struct tsdb_series *s = &(t->meters[m].series[r]);
+
+	 if(s->block.count && ((now - s->opened) >= t->flush))
+	    flush_series(t, m, s);
+      }
+   if(t->maintaining ||
+      ((now - t->last_maintenance) < TSDB_MAINTENANCE_INTERVAL))
+      return;
+   t->last_maintenance = now;
+   /* the days to rewrite must be complete on disk */
+   for(m=0; m<t->num_meters; m++)
+      for(r=0; r<t->meters[m].num_series; r++)
+      {
+	 struct tsdb_series *s = &(t->meters[m].series[r]);
+
+	 if(s->block.count && (day_of(s->block.first_time) < day_of(now)))
+	    flush_series(t, m, s);
+      }
+   t->maintenance_time = now;
+   t->maintained = 0;
+   t->maintaining = !pthread_create(&(t->maintainer), NULL, maintain, t);
+   if(!t->maintaining)
+      snmp_log(LOG_ERR, "Failed starting maintenance of history\n");
+} /* tsdb_sync */
+
+void tsdb_close(struct tsdb *t)
+{
+   unsigned int m, r;
+
+   if(t->maintaining)
+      pthread_join(t->maintainer, NULL);
+   for(m=0; m<t->num_meters; m++)
+   {
+      for(r=0; r<t->meters[m].num_series; r++)
+      {
+	 flush_series(t, m, &(t->meters[m].series[r]));
+	 free(t->meters[m].series[r].data);
+      }
+      free(t->meters[m].series);
+   }
+   free(t->meters);
+   memset(t, 0, sizeof(struct tsdb));
+} /* tsdb_close */
+
+static void print_sample(void *arg, const struct tsdb_block *block,
+			 int64_t time, int64_t value)
+{
+   time_t t = time;
+   struct tm tm;
+   char when[32];
+
+   gmtime_r(&t, &tm);
+   strftime(when, sizeof(when), "%Y-%m-%dT%H:%M:%SZ", &tm);
+   fprintf((FILE *)arg, "%u-%u:%u.%u.%u %s %lld %u\n",
+	   block->code[0], block->code[1], block->code[2], block->code[3],
+	   block->code[4], when, (long long)value, block->resolution);
+} /* print_sample */
+
+int tsdb_dump(const char *path, FILE *out)
+{
+   if(read_segment(path, print_sample, out))
+   {
+      fprintf(stderr, "Failed reading %s as history\n", path);
+      return -1;
+   }
+   return 0;
+} /* tsdb_dump */
@@ -0,0 +1,174 @@
+/**************************************************************
+This file is a pool of worker threads running numbered jobs.
+
+Jobs are not handed out in advance. Every thread takes the next queued
+job as soon as it is idle, so a thread stuck on a slow meter does not
+hold back the jobs it would otherwise have been given, which is what
+stealing work between the queues of each thread would give for jobs
+independent of each other. Nobody waits for a job to be done, the job is
+put on a list of done jobs and the eventfd is written to tell the thread
+collecting them.
+
+SPDX-License-Identifier: BSD-2-Clause
+
+Copyright (c) 2026, Henrik Carlqvist
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <net-snmp/net-snmp-config.h>
+#include <net-snmp/net-snmp-includes.h>
+
+#include "workers.h"
+
+/* Adds job to the done jobs, called with lock held */
+static void job_done(struct workers *w, unsigned int job)
+{
+   uint64_t one = 1;
+
+   w->done[w->num_done++] = job;
+   if(write(w->fd, &one, sizeof(one)) != sizeof(one))
+      ; /* the counter is already signalled */
+} /* job_done */
+
+static void *worker(void *arg)
+{
+   struct workers *w = arg;
+   unsigned int j;
+
+   pthread_mutex_lock(&w->lock);
+   for(;;)
+   {
+      while((!w->stop) && (!w->num_queued))
+	 pthread_cond_wait(&w->start, &w->lock);
+      if(w->stop)
+	 break;
+      j = w->queue[w->first];
+      w->first = (w->first + 1) % w->max_jobs;
+      w->num_queued--;
+      pthread_mutex_unlock(&w->lock);
+      w->job(j, w->arg);
+      pthread_mutex_lock(&w->lock);
+      job_done(w, j);
+   }
+   pthread_mutex_unlock(&w->lock);
+   return NULL;
+} /* worker */
+
+int workers_init(struct workers *w, unsigned int num_threads,
+		 unsigned int max_jobs, worker_job job, void *arg)
+{
+   long cores;
+
+   memset(w, 0, sizeof(struct workers));
+   w->job = job;
+   w->arg = arg;
+   w->max_jobs = max_jobs;
+   w->fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+   w->queue = calloc(max_jobs ? max_jobs : 1, sizeof(unsigned int));
+   w->done = calloc(max_jobs ? max_jobs : 1, sizeof(unsigned int));
+   if((w->fd < 0) || (!w->queue) || (!w->done))
+   {
+      snmp_log(LOG_ERR, "Could not set up worker threads\n");
+      if(w->fd >= 0)
+	 close(w->fd);
+      free(w->queue);
+      free(w->done);
+      return -1;
+   }
+   pthread_mutex_init(&w->lock, NULL);
+   pthread_cond_init(&w->start, NULL);
+   if(!num_threads)
+   {
+      cores = sysconf(_SC_NPROCESSORS_ONLN);
+      num_threads = cores > 0 ? cores : 1;
+   }
+   if(num_threads > max_jobs)
+      num_threads = max_jobs;
+   w->threads = calloc(num_threads ? num_threads : 1, sizeof(pthread_t));
+   if(!w->threads)
+      return 0;
+   for(; w->num_threads < num_threads; w->num_threads++)
+      if(pthread_create(&w->threads[w->num_threads], NULL, worker, w))
+      {
+	 snmp_log(LOG_WARNING, "Started only %u worker threads\n",
+		  w->num_threads);
+	 break;
+      }
+   return w->num_threads;
+} /* workers_init */
+
+void workers_queue(struct workers *w, unsigned int job)
+{
+   if(!w->num_threads)
+   {
+      w->job(job, w->arg);
+      pthread_mutex_lock(&w->lock);
+      job_done(w, job);
+      pthread_mutex_unlock(&w->lock);
+      return;
+   }
+   pthread_mutex_lock(&w->lock);
+   w->queue[(w->first + w->num_queued++) % w->max_jobs] = job;
+   pthread_cond_signal(&w->start);
+   pthread_mutex_unlock(&w->lock);
+} /* workers_queue */
+
+unsigned int workers_done(struct workers *w, unsigned int *jobs)
+{
+   uint64_t count;
+   unsigned int num_done;
+
+   /* read before taking the list, a job done after this signals again */
+   if(read(w->fd, &count, sizeof(count)) != sizeof(count))
+      ; /* nothing signalled, the list may still hold jobs */
+   pthread_mutex_lock(&w->lock);
+   num_done = w->num_done;
+   memcpy(jobs, w->done, num_done * sizeof(unsigned int));
+   w->num_done = 0;
+   pthread_mutex_unlock(&w->lock);
+   return num_done;
+} /* workers_done */
+
+void workers_close(struct workers *w)
+{
+   unsigned int t;
+
+   pthread_mutex_lock(&w->lock);
+   w->stop = 1;
+   pthread_cond_broadcast(&w->start);
+   pthread_mutex_unlock(&w->lock);
+   for(t=0; t<w->num_threads; t++)
+      pthread_join(w->threads[t], NULL);
+   free(w->threads);
+   free(w->queue);
+   free(w->done);
+   close(w->fd);
+   pthread_mutex_destroy(&w->lock);
+   pthread_cond_destroy(&w->start);
+   memset(w, 0, sizeof(struct workers));
+} /* workers_close */